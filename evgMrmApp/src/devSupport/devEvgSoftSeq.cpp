@@ -12,6 +12,7 @@
 #include <boRecord.h>
 #include <biRecord.h>
 #include <longinRecord.h>
+#include <longoutRecord.h>
 
 #include <devSup.h>
 #include <dbAccess.h>
@@ -19,6 +20,7 @@
 #include <epicsExport.h>
 #include "evgMrm.h"
 #include "evgRegMap.h"
+#include "evgSeqLib.h"
 
 #include "devObj.h"
 
@@ -154,6 +156,11 @@ init_li(longinRecord* pli) {
     return init_record((dbCommon*)pli, &pli->inp);
 }
 
+static long
+init_lo(longoutRecord* plo) {
+    return init_record((dbCommon*)plo, &plo->out);
+}
+
 /**        Read/Write Function        **/
 static long
 get_ioint_info_pvt(int cmd, dbCommon *pwf, IOSCANPVT *ppvt) {
@@ -1001,6 +1008,33 @@ init_wf_loadedSeq(waveformRecord* pwf) {
     return ret;
 }
 
+/*returns: (-1,0)=>(failure,success)*/
+static long
+write_lo_libSelect(longoutRecord* plo) {
+    long ret = 0;
+    evgSoftSeq* seq = 0;
+
+    try {
+        seq = (evgSoftSeq*)plo->dpvt;
+        if(!seq)
+            return S_dev_noDevice;
+
+        SCOPED_LOCK2(seq->m_lock, guard);
+        evgSeqLib::select(seq, (epicsUInt32)plo->val);
+        seq->setErr("");
+    } catch(std::runtime_error& e) {
+        (void)recGblSetSevr(plo, WRITE_ALARM, MAJOR_ALARM);
+        seq->setErr(e.what());
+        errlogPrintf("ERROR: %s : %s\n", e.what(), plo->name);
+        ret = S_dev_noDevice;
+    } catch(std::exception& e) {
+        errlogPrintf("ERROR: %s : %s\n", e.what(), plo->name);
+        ret = S_db_noMemory;
+    }
+
+    return ret;
+}
+
 /*returns: (-1,0)=>(failure,success)*/
 static long
 read_wf_loadedSeq(waveformRecord* pwf) {
@@ -1256,6 +1290,16 @@ common_dset devBoEvgCommitSeq = {
 };
 epicsExportAddress(dset, devBoEvgCommitSeq);
 
+common_dset devLoEvgSeqLibSelect = {
+    5,
+    NULL,
+    NULL,
+    (DEVSUPFUN)init_lo,
+    NULL,
+    (DEVSUPFUN)write_lo_libSelect,
+};
+epicsExportAddress(dset, devLoEvgSeqLibSelect);
+
 common_dset devBoEvgEnableSeq = {
     5,
     NULL,
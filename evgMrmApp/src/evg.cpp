@@ -2,6 +2,7 @@
 
 #include "evgOutput.h"
 #include "evgAcTrig.h"
+#include "evgTimingCfg.h"
 #include "evgDbus.h"
 #include "evgInput.h"
 #include "evgTrigEvt.h"
@@ -9,6 +10,7 @@
 #include "evgEvtClk.h"
 #include "evgMrm.h"
 #include "evgFct.h"
+#include "evgHealth.h"
 #include "evgPhaseMonSel.h"
 
 OBJECT_BEGIN(evgAcTrig) {
@@ -18,6 +20,19 @@ OBJECT_BEGIN(evgAcTrig) {
     OBJECT_PROP2("SyncSrc", &evgAcTrig::getSyncSrcEpics, &evgAcTrig::setSyncSrcEpics);
 } OBJECT_END(evgAcTrig)
 
+OBJECT_BEGIN(evgTimingCfg) {
+    OBJECT_PROP2("Stage",      &evgTimingCfg::staging,    &evgTimingCfg::setStaging);
+    OBJECT_PROP2("Align",      &evgTimingCfg::getAlign,   &evgTimingCfg::setAlign);
+    OBJECT_PROP2("Apply",      &evgTimingCfg::pending,    &evgTimingCfg::apply);
+    OBJECT_PROP1("Pending",    &evgTimingCfg::pending);
+    OBJECT_PROP1("Pending",    &evgTimingCfg::applyChanged);
+    OBJECT_PROP1("Dirty",      &evgTimingCfg::dirty);
+    OBJECT_PROP1("Dirty",      &evgTimingCfg::dirtyChanged);
+    OBJECT_PROP1("Apply Time", &evgTimingCfg::applyTime);
+    OBJECT_PROP1("Apply Time", &evgTimingCfg::applyChanged);
+    OBJECT_PROP1("Apply Count",&evgTimingCfg::applyCount);
+} OBJECT_END(evgTimingCfg)
+
 OBJECT_BEGIN(evgDbus) {
     OBJECT_PROP2("Source", &evgDbus::getSource, &evgDbus::setSource);
 } OBJECT_END(evgDbus)
@@ -73,21 +88,60 @@ OBJECT_BEGIN(evgMrm) {
     OBJECT_PROP2("DlyCompens master", &evgMrm::dlyCompMasterEnabled,   &evgMrm::dlyCompMasterEnable);
     OBJECT_PROP1("Version",    &evgMrm::getFwVersion);
     OBJECT_PROP1("Sw Version", &evgMrm::getSwVersion);
+    OBJECT_PROP2("TS Send Mode", &evgMrm::getTsSendMode, &evgMrm::setTsSendMode);
+    OBJECT_PROP1("TS Send Time", &evgMrm::getTsSendTime);
+    OBJECT_PROP1("TS Send Time", &evgMrm::tsSendChanged);
+    OBJECT_PROP1("TS Send Late", &evgMrm::getTsSendLate);
+    OBJECT_PROP1("TS Send Late", &evgMrm::tsSendChanged);
 } OBJECT_END(evgMrm)
 
 OBJECT_BEGIN(evgFct) {
     OBJECT_PROP1("DlyCompens upstream", &evgFct::getUpstreamDC);
+    OBJECT_PROP1("DlyCompens upstream", &evgFct::sampled);
     OBJECT_PROP1("DlyCompens fifo", &evgFct::getFIFODC);
+    OBJECT_PROP1("DlyCompens fifo", &evgFct::sampled);
     OBJECT_PROP1("DlyCompens internal", &evgFct::getInternalDC);
+    OBJECT_PROP1("DlyCompens internal", &evgFct::sampled);
     OBJECT_PROP1("Status", &evgFct::getPortStatus);
+    OBJECT_PROP1("Status", &evgFct::sampled);
     OBJECT_PROP2("Violation", &evgFct::getPortViolation, &evgFct::clearPortViolation);
     OBJECT_PROP1("LoopDelay port1", &evgFct::getPort1DelayValue);
+    OBJECT_PROP1("LoopDelay port1", &evgFct::sampled);
     OBJECT_PROP1("LoopDelay port2", &evgFct::getPort2DelayValue);
+    OBJECT_PROP1("LoopDelay port2", &evgFct::sampled);
     OBJECT_PROP1("LoopDelay port3", &evgFct::getPort3DelayValue);
+    OBJECT_PROP1("LoopDelay port3", &evgFct::sampled);
     OBJECT_PROP1("LoopDelay port4", &evgFct::getPort4DelayValue);
+    OBJECT_PROP1("LoopDelay port4", &evgFct::sampled);
     OBJECT_PROP1("LoopDelay port5", &evgFct::getPort5DelayValue);
+    OBJECT_PROP1("LoopDelay port5", &evgFct::sampled);
     OBJECT_PROP1("LoopDelay port6", &evgFct::getPort6DelayValue);
+    OBJECT_PROP1("LoopDelay port6", &evgFct::sampled);
     OBJECT_PROP1("LoopDelay port7", &evgFct::getPort7DelayValue);
+    OBJECT_PROP1("LoopDelay port7", &evgFct::sampled);
     OBJECT_PROP1("LoopDelay port8", &evgFct::getPort8DelayValue);
+    OBJECT_PROP1("LoopDelay port8", &evgFct::sampled);
     OBJECT_PROP1("Topology ID", &evgFct::getTopologyId);
+    OBJECT_PROP1("Topology ID", &evgFct::sampled);
+    OBJECT_PROP2("Sample Period", &evgFct::getSamplePeriod, &evgFct::setSamplePeriod);
+    OBJECT_PROP1("Sample Version", &evgFct::getSampleVersion);
+    OBJECT_PROP1("Sample Version", &evgFct::sampled);
+    OBJECT_PROP2("History Reset", &evgFct::dummyReturn, &evgFct::resetHistory);
+    OBJECT_PROP2("History Port", &evgFct::getHistoryPort, &evgFct::setHistoryPort);
+    OBJECT_PROP1("LoopDelay History", &evgFct::getPortDelayHistory);
+    OBJECT_PROP1("LoopDelay History", &evgFct::sampled);
+    OBJECT_PROP1("LoopDelay Min", &evgFct::getPortDelayMin);
+    OBJECT_PROP1("LoopDelay Min", &evgFct::sampled);
+    OBJECT_PROP1("LoopDelay Max", &evgFct::getPortDelayMax);
+    OBJECT_PROP1("LoopDelay Max", &evgFct::sampled);
+    OBJECT_PROP1("LoopDelay Mean", &evgFct::getPortDelayMean);
+    OBJECT_PROP1("LoopDelay Mean", &evgFct::sampled);
+    OBJECT_PROP1("LoopDelay Jitter", &evgFct::getPortDelayJitter);
+    OBJECT_PROP1("LoopDelay Jitter", &evgFct::sampled);
 } OBJECT_END(evgFct)
+
+OBJECT_BEGIN(evgHealth) {
+    OBJECT_PROP2("Monitor Ports", &evgHealth::getMonitorPorts, &evgHealth::setMonitorPorts);
+    OBJECT_PROP1("Reason", &evgHealth::getReason);
+    OBJECT_PROP1("Reason", &evgHealth::reasonChanged);
+} OBJECT_END(evgHealth)
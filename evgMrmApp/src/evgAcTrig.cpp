@@ -7,10 +7,13 @@
 #include <mrfCommon.h>
 
 #include "evgRegMap.h"
+#include "evgTimingCfg.h"
 
-evgAcTrig::evgAcTrig(const std::string& name, volatile epicsUInt8* const pReg):
+evgAcTrig::evgAcTrig(const std::string& name, volatile epicsUInt8* const pReg,
+                     evgTimingCfg* const cfg):
 mrf::ObjectInst<evgAcTrig>(name),
-m_pReg(pReg) {
+m_pReg(pReg),
+m_cfg(cfg) {
 }
 
 evgAcTrig::~evgAcTrig() {
@@ -21,6 +24,9 @@ evgAcTrig::setDivider(epicsUInt32 divider) {
     if(divider > 255)
         throw std::runtime_error("EVG AC Trigger divider out of range. Range: 0 - 255"); // 0: divide by 1, 1: divide by 2, ... 255: divide by 256
 
+    if(m_cfg->stageAcDivider(divider))
+        return;
+
     WRITE8(m_pReg, AcTrigDivider, divider);
 }
 
@@ -34,6 +40,9 @@ evgAcTrig::setPhase(epicsFloat64 phase) {
     if(phase < 0 || phase > 25.5)
         throw std::runtime_error("EVG AC Trigger phase out of range. Delay range 0 ms - 25.5 ms in 0.1 ms steps");
 
+    if(m_cfg->stageAcPhase((epicsUInt8)phase))
+        return;
+
     WRITE8(m_pReg, AcTrigPhase, (epicsUInt8)phase);
 }
 
@@ -44,6 +53,9 @@ evgAcTrig::getPhase() const {
 
 void
 evgAcTrig::setBypass(bool byp) {
+    if(m_cfg->stageAcControl(EVG_AC_TRIG_BYP, byp ? EVG_AC_TRIG_BYP : 0))
+        return;
+
     if(byp)
         BITSET8(m_pReg, AcTrigControl, EVG_AC_TRIG_BYP);
     else
@@ -58,9 +70,7 @@ evgAcTrig::getBypass() const {
 
 void
 evgAcTrig::setSyncSrc(triggerSourceT syncSrc) {
-    epicsUInt8 reg = READ8(m_pReg, AcTrigControl);
-
-    reg &= ~EVG_AC_TRIG_SYNC_MASK;
+    epicsUInt8 reg = 0;
 
     switch(syncSrc) {
     case trigSrc_eventClock:
@@ -83,7 +93,13 @@ evgAcTrig::setSyncSrc(triggerSourceT syncSrc) {
         throw std::runtime_error("EVG: Trying to set invalid AC trigger source. Ignoring.");
     }
 
-    WRITE8(m_pReg, AcTrigControl, reg);
+    if(m_cfg->stageAcControl(EVG_AC_TRIG_SYNC_MASK, reg))
+        return;
+
+    //Read-Modify-Write
+    epicsUInt8 ctrl = READ8(m_pReg, AcTrigControl);
+    ctrl = (ctrl & ~EVG_AC_TRIG_SYNC_MASK) | reg;
+    WRITE8(m_pReg, AcTrigControl, ctrl);
 }
 
 evgAcTrig::triggerSourceT evgAcTrig::getSyncSrc() const {
@@ -120,6 +136,9 @@ evgAcTrig::setTrigEvtMap(epicsUInt16 trigEvt, bool ena) {
     if(trigEvt > 7)
         throw std::runtime_error("EVG Trig Event ID too large. Max : 7");
 
+    if(m_cfg->stageAcTrigMap(trigEvt, ena))
+        return;
+
     epicsUInt8    mask = 1 << trigEvt;
     //Read-Modify-Write
     epicsUInt8 map = READ8(m_pReg, AcTrigEvtMap);
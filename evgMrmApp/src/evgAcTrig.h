@@ -4,9 +4,11 @@
 #include <epicsTypes.h>
 #include "mrf/object.h"
 
+class evgTimingCfg;
+
 class evgAcTrig : public mrf::ObjectInst<evgAcTrig> {
 public:
-    evgAcTrig(const std::string&, volatile epicsUInt8* const);
+    evgAcTrig(const std::string&, volatile epicsUInt8* const, evgTimingCfg* const);
     ~evgAcTrig();
 
     typedef enum trigSrc {
@@ -41,6 +43,7 @@ public:
 
 private:
     volatile epicsUInt8* const m_pReg;
+    evgTimingCfg* const        m_cfg;
 };
 
 #endif //EVG_AC_TRIG_H
@@ -85,7 +85,7 @@ evgEvtClk::setFracSynFreq(epicsFloat64 freq) {
     epicsUInt32 controlWord, oldControlWord;
     epicsFloat64 error;
 
-    controlWord = FracSynthControlWord (freq, MRF_FRAC_SYNTH_REF, 0, &error);
+    controlWord = FracSynthSolve (freq, MRF_FRAC_SYNTH_REF, 0, &error);
     if ((!controlWord) || (error > 100.0)) {
         char err[80];
         sprintf(err, "Cannot set event clock speed to %f MHz.\n", freq);
@@ -1,6 +1,11 @@
 #define epicsExportSharedSymbols
 #include "evgFct.h"
 
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+#include <math.h>
+
 #include <mrfCommonIO.h>
 #include <mrfCommon.h>
 
@@ -10,16 +15,38 @@
 evgFct::evgFct(const std::string& evgName, volatile epicsUInt8* const fctReg, std::vector<SFP *> *sfp):
 mrf::ObjectInst<evgFct>(evgName+":FCT"),
 m_fctReg(fctReg),
-m_sfp(sfp)
+m_sfp(sfp),
+m_period(1.0),
+m_stop(false),
+m_histPort(1),
+m_histPos(0),
+m_histCount(0),
+m_thread(*this, (evgName+":FCT").c_str(),
+         epicsThreadGetStackSize(epicsThreadStackSmall),
+         epicsThreadPriorityLow)
 {
     for(int i = 1; i <= evgNumSFPModules; i++) {
         std::ostringstream name;
         name<<evgName<<":SFP"<<i;
         m_sfp->push_back(new SFP(name.str(), fctReg + U32_SFP(i-1)));
     }
+
+    memset(&m_snap, 0, sizeof(m_snap));
+    memset(m_hist, 0, sizeof(m_hist));
+    scanIoInit(&m_sampleScan);
+
+    sample();
+    m_thread.start();
 }
 
 evgFct::~evgFct() {
+    {
+        SCOPED_LOCK(m_lock);
+        m_stop = true;
+    }
+    m_wake.signal();
+    m_thread.exitWait();
+
     size_t i;
 
     for(i=0; i<m_sfp->size(); i++){
@@ -30,29 +57,36 @@ evgFct::~evgFct() {
 
 epicsUInt32
 evgFct::getTopologyId() const{
-    return READ32(m_fctReg, fct_topologyID);
+    SCOPED_LOCK(m_lock);
+    return m_snap.topologyId;
 }
 
 epicsUInt32
 evgFct::getUpstreamDC() const{
-    return READ32(m_fctReg, fct_upstreamDC);
+    SCOPED_LOCK(m_lock);
+    return m_snap.upstreamDC;
 }
 
 epicsUInt32
 evgFct::getFIFODC() const{
-    return READ32(m_fctReg, fct_fifoDC);
+    SCOPED_LOCK(m_lock);
+    return m_snap.fifoDC;
 }
 
 epicsUInt32
 evgFct::getInternalDC() const{
-    return READ32(m_fctReg, fct_internalDC);
+    SCOPED_LOCK(m_lock);
+    return m_snap.internalDC;
 }
 
 epicsUInt16
 evgFct::getPortStatus() const{
     epicsUInt32 status;
+    {
+        SCOPED_LOCK(m_lock);
+        status = m_snap.status;
+    }
 
-    status = READ32(m_fctReg, fct_status_base);
     status &= EVG_FCT_STATUS_STATUS_mask;
     status = status >> EVG_FCT_STATUS_STATUS_shift;
 
@@ -70,6 +104,18 @@ evgFct::getPortViolation() const{
     return  (epicsUInt16)violation;
 }
 
+void
+evgFct::getPortState(epicsUInt16& status, epicsUInt16& violation) const{
+    epicsUInt32 reg;
+    {
+        SCOPED_LOCK(m_lock);
+        reg = m_snap.status;
+    }
+
+    status = (epicsUInt16)((reg & EVG_FCT_STATUS_STATUS_mask) >> EVG_FCT_STATUS_STATUS_shift);
+    violation = (epicsUInt16)((reg & EVG_FCT_STATUS_VIOLATION_mask) >> EVG_FCT_STATUS_VIOLATION_shift);
+}
+
 void
 evgFct::clearPortViolation(epicsUInt16 port){
     epicsUInt32 ctrlReg;
@@ -89,5 +135,179 @@ evgFct::getPortDelayValue(epicsUInt16 port)  const{
         throw std::out_of_range("Selected fanout port does not exist.");
     }
 
-    return READ32(m_fctReg, fct_portDC(port-1));
+    SCOPED_LOCK(m_lock);
+    return m_snap.portDC[port-1];
+}
+
+void
+evgFct::sample() {
+    Snapshot snap;
+
+    // Read the whole block before taking the lock
+    snap.status     = READ32(m_fctReg, fct_status_base);
+    snap.upstreamDC = READ32(m_fctReg, fct_upstreamDC);
+    snap.fifoDC     = READ32(m_fctReg, fct_fifoDC);
+    snap.internalDC = READ32(m_fctReg, fct_internalDC);
+    snap.topologyId = READ32(m_fctReg, fct_topologyID);
+    for(epicsUInt32 i = 0; i < EVG_FCT_maxPorts; i++)
+        snap.portDC[i] = READ32(m_fctReg, fct_portDC(i));
+
+    {
+        SCOPED_LOCK(m_lock);
+        snap.version = m_snap.version + 1;
+        m_snap = snap;
+
+        for(epicsUInt32 i = 0; i < EVG_FCT_maxPorts; i++)
+            m_hist[i][m_histPos] = snap.portDC[i];
+        m_histPos = (m_histPos + 1) % evgFctHistory;
+        if(m_histCount < evgFctHistory)
+            m_histCount++;
+    }
+
+    scanIoRequest(m_sampleScan);
+}
+
+void
+evgFct::run() {
+    while(1) {
+        double period;
+        {
+            SCOPED_LOCK(m_lock);
+            if(m_stop)
+                break;
+            period = m_period;
+        }
+
+        m_wake.wait(period);
+
+        {
+            SCOPED_LOCK(m_lock);
+            if(m_stop)
+                break;
+        }
+
+        sample();
+    }
+}
+
+void
+evgFct::setSamplePeriod(double period) {
+    if(period < 0.01)
+        throw std::out_of_range("FCT sample period too short. Min: 0.01 s");
+    {
+        SCOPED_LOCK(m_lock);
+        m_period = period;
+    }
+    m_wake.signal();
+}
+
+double
+evgFct::getSamplePeriod() const {
+    SCOPED_LOCK(m_lock);
+    return m_period;
+}
+
+epicsUInt32
+evgFct::getSampleVersion() const {
+    SCOPED_LOCK(m_lock);
+    return m_snap.version;
+}
+
+void
+evgFct::resetHistory(bool) {
+    SCOPED_LOCK(m_lock);
+    m_histPos = 0;
+    m_histCount = 0;
+}
+
+epicsUInt32
+evgFct::getPortDelayMin(double* arr, epicsUInt32 count) const {
+    SCOPED_LOCK(m_lock);
+    if(m_histCount == 0)
+        return 0;
+    epicsUInt32 n = 0;
+    for(; n < count && n < EVG_FCT_maxPorts; n++) {
+        epicsUInt32 v = m_hist[n][0];
+        for(epicsUInt32 j = 1; j < m_histCount; j++)
+            v = std::min(v, m_hist[n][j]);
+        arr[n] = v;
+    }
+    return n;
+}
+
+epicsUInt32
+evgFct::getPortDelayMax(double* arr, epicsUInt32 count) const {
+    SCOPED_LOCK(m_lock);
+    if(m_histCount == 0)
+        return 0;
+    epicsUInt32 n = 0;
+    for(; n < count && n < EVG_FCT_maxPorts; n++) {
+        epicsUInt32 v = m_hist[n][0];
+        for(epicsUInt32 j = 1; j < m_histCount; j++)
+            v = std::max(v, m_hist[n][j]);
+        arr[n] = v;
+    }
+    return n;
+}
+
+epicsUInt32
+evgFct::getPortDelayMean(double* arr, epicsUInt32 count) const {
+    SCOPED_LOCK(m_lock);
+    if(m_histCount == 0)
+        return 0;
+    epicsUInt32 n = 0;
+    for(; n < count && n < EVG_FCT_maxPorts; n++) {
+        double sum = 0.0;
+        for(epicsUInt32 j = 0; j < m_histCount; j++)
+            sum += m_hist[n][j];
+        arr[n] = sum / m_histCount;
+    }
+    return n;
+}
+
+epicsUInt32
+evgFct::getPortDelayJitter(double* arr, epicsUInt32 count) const {
+    SCOPED_LOCK(m_lock);
+    if(m_histCount == 0)
+        return 0;
+    epicsUInt32 n = 0;
+    for(; n < count && n < EVG_FCT_maxPorts; n++) {
+        double sum = 0.0, sum2 = 0.0;
+        for(epicsUInt32 j = 0; j < m_histCount; j++) {
+            // offset by the first sample to keep the sums small
+            double d = (double)m_hist[n][j] - (double)m_hist[n][0];
+            sum += d;
+            sum2 += d*d;
+        }
+        double mean = sum / m_histCount;
+        double var = sum2 / m_histCount - mean*mean;
+        arr[n] = var > 0.0 ? sqrt(var) : 0.0;
+    }
+    return n;
+}
+
+void
+evgFct::setHistoryPort(epicsUInt16 port) {
+    if(port > EVG_FCT_maxPorts || port < 1)
+        throw std::out_of_range("Selected fanout port does not exist.");
+    SCOPED_LOCK(m_lock);
+    m_histPort = port;
+}
+
+epicsUInt16
+evgFct::getHistoryPort() const {
+    SCOPED_LOCK(m_lock);
+    return m_histPort;
+}
+
+epicsUInt32
+evgFct::getPortDelayHistory(double* arr, epicsUInt32 count) const {
+    SCOPED_LOCK(m_lock);
+    const epicsUInt32 *hist = m_hist[m_histPort-1];
+    // oldest entry is at m_histPos once the ring has wrapped
+    epicsUInt32 first = m_histCount < evgFctHistory ? 0 : m_histPos;
+    epicsUInt32 n = 0;
+    for(; n < count && n < m_histCount; n++)
+        arr[n] = hist[(first + n) % evgFctHistory];
+    return n;
 }
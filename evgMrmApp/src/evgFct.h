@@ -2,10 +2,25 @@
 #define evgFct_H
 
 #include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <dbScan.h>
+
 #include "mrf/object.h"
 #include "sfp.h"
+#include "evgRegMap.h"
+
+// Number of samples kept for each port
+#define evgFctHistory 64
 
-class evgFct : public mrf::ObjectInst<evgFct> {
+/* The FCT register block is read by a sampler thread in one pass.
+ * Getters return the latest snapshot, and records are scanned with
+ * I/O Intr after each pass.  Loop delays of the ports are also kept
+ * in a ring to give min/max/mean/jitter.
+ */
+class evgFct : public mrf::ObjectInst<evgFct>,
+               public epicsThreadRunable {
 public:
     evgFct(const std::string&, volatile epicsUInt8* const, std::vector<SFP *> *);
     ~evgFct();
@@ -22,10 +37,39 @@ public:
 
     epicsUInt16 getPortStatus() const;
     epicsUInt16 getPortViolation() const;
+    //! Status and violation bits of the fanout ports from the same sample
+    void getPortState(epicsUInt16& status, epicsUInt16& violation) const;
     void clearPortViolation(epicsUInt16 port);
 
     epicsUInt32 getPortDelayValue(epicsUInt16 port) const;
 
+    //! Seconds between samples
+    void setSamplePeriod(double);
+    double getSamplePeriod() const;
+    //! Incremented by each sample
+    epicsUInt32 getSampleVersion() const;
+    IOSCANPVT sampled() const{return m_sampleScan;}
+
+    //! Clear the port history
+    void resetHistory(bool);
+    bool dummyReturn() const{return false;}
+
+    /* Statistics of the loop delay history, one element per port.
+     * Raw units.  Jitter is the standard deviation.
+     */
+    epicsUInt32 getPortDelayMin(double*, epicsUInt32) const;
+    epicsUInt32 getPortDelayMax(double*, epicsUInt32) const;
+    epicsUInt32 getPortDelayMean(double*, epicsUInt32) const;
+    epicsUInt32 getPortDelayJitter(double*, epicsUInt32) const;
+
+    //! Port (1-8) shown by getPortDelayHistory()
+    void setHistoryPort(epicsUInt16);
+    epicsUInt16 getHistoryPort() const;
+    //! Loop delays of the history port, oldest first
+    epicsUInt32 getPortDelayHistory(double*, epicsUInt32) const;
+
+    virtual void run();
+
     // helpers for creating objects (in evg.cpp) //
     inline epicsUInt32 getPort1DelayValue() const{return getPortDelayValue(1);}
     inline epicsUInt32 getPort2DelayValue() const{return getPortDelayValue(2);}
@@ -37,8 +81,35 @@ public:
     inline epicsUInt32 getPort8DelayValue() const{return getPortDelayValue(8);}
 
 private:
+    struct Snapshot {
+        epicsUInt32 version;
+        epicsUInt32 status;
+        epicsUInt32 upstreamDC;
+        epicsUInt32 fifoDC;
+        epicsUInt32 internalDC;
+        epicsUInt32 topologyId;
+        epicsUInt32 portDC[EVG_FCT_maxPorts];
+    };
+
+    void sample();
+
     volatile epicsUInt8* const m_fctReg;
     std::vector<SFP*> *m_sfp;
+
+    mutable epicsMutex m_lock;
+
+    // Guarded by m_lock
+    Snapshot    m_snap;
+    double      m_period;
+    bool        m_stop;
+    epicsUInt16 m_histPort;
+    epicsUInt32 m_hist[EVG_FCT_maxPorts][evgFctHistory];
+    epicsUInt32 m_histPos;   // next entry to write
+    epicsUInt32 m_histCount; // valid entries
+
+    IOSCANPVT   m_sampleScan;
+    epicsEvent  m_wake;
+    epicsThread m_thread;
 };
 
 
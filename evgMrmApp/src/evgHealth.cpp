@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <errlog.h>
+#include <alarm.h>
+#include <epicsExport.h>
+
+#define epicsExportSharedSymbols
+#include <mrfCommon.h>
+
+#include "evgHealth.h"
+#include "evgEvtClk.h"
+#include "evgFct.h"
+#include "evgRegMap.h"
+
+extern "C" {
+/* Interval between evaluations of the health of each EVG.
+ *
+ * Set to 0.0 to disable
+ */
+double mrmEvgHealthPeriod = 1.0; /* sec */
+
+epicsExportAddress(double,mrmEvgHealthPeriod);
+}
+
+evgHealth::evgHealth(const std::string& name, evgEvtClk& evtClk, evgFct* fct, std::vector<SFP*>& sfp):
+mrf::ObjectInst<evgHealth>(name),
+m_evtClk(evtClk),
+m_fct(fct),
+m_sfp(sfp),
+m_monitor(0),
+m_stop(false),
+m_thread(*this, name.c_str(),
+         epicsThreadGetStackSize(epicsThreadStackSmall),
+         epicsThreadPriorityLow)
+{
+    m_thread.start();
+}
+
+evgHealth::~evgHealth() {
+    {
+        SCOPED_LOCK(m_lock);
+        m_stop = true;
+    }
+    m_wake.signal();
+    m_thread.exitWait();
+}
+
+void
+evgHealth::setMonitorPorts(epicsUInt32 mask) {
+    {
+        SCOPED_LOCK(m_lock);
+        m_monitor = mask & ((1u << (EVG_FCT_maxPorts+1)) - 1);
+    }
+    m_wake.signal();
+}
+
+epicsUInt32
+evgHealth::getMonitorPorts() const {
+    SCOPED_LOCK(m_lock);
+    return m_monitor;
+}
+
+epicsUInt32
+evgHealth::getReason() const {
+    SCOPED_LOCK(m_lock);
+    return m_reason.value();
+}
+
+/* Same precedence as the calc chain this replaces:
+ * uplink, PLL, link, SFP error, SFP RX error, SFP warning, SFP RX warning.
+ * Temperature and TX power are checked for all fanout SFPs, RX power and
+ * the link only for monitored ports.  An SFP which can not be read is an
+ * error on a monitored port, and ignored otherwise.
+ */
+epicsUInt32
+evgHealth::evaluate() const {
+    epicsUInt32 monitor;
+    {
+        SCOPED_LOCK(m_lock);
+        monitor = m_monitor;
+    }
+
+    if((monitor & 1) && !m_sfp.empty()) {
+        epicsUInt16 sev = std::max(m_sfp[0]->severity(), m_sfp[0]->severityRX());
+        if(sev >= MAJOR_ALARM)
+            return uplinkError;
+        else if(sev == MINOR_ALARM)
+            return uplinkWarning;
+    }
+
+    if(!m_evtClk.getPllLocked())
+        return pllUnlocked;
+
+    if(m_fct) {
+        epicsUInt16 status, violation;
+        m_fct->getPortState(status, violation);
+
+        epicsUInt16 bad = (~status | violation) & (monitor >> 1);
+        if(bad)
+            return linkError;
+    }
+
+    epicsUInt16 sev = NO_ALARM, sevRX = NO_ALARM;
+    for(size_t i = 1; i < m_sfp.size(); i++) {
+        epicsUInt16 s = m_sfp[i]->severity();
+        if(monitor & (1u << i)) {
+            sevRX = std::max(sevRX, m_sfp[i]->severityRX());
+        } else if(s == INVALID_ALARM) {
+            continue; // empty cage
+        }
+        sev = std::max(sev, s);
+    }
+
+    if(sev >= MAJOR_ALARM)
+        return sfpError;
+    else if(sevRX >= MAJOR_ALARM)
+        return sfpRxError;
+    else if(sev == MINOR_ALARM)
+        return sfpWarning;
+    else if(sevRX == MINOR_ALARM)
+        return sfpRxWarning;
+
+    return ok;
+}
+
+void
+evgHealth::run() {
+    while(1) {
+        double period = mrmEvgHealthPeriod;
+
+        m_wake.wait(period > 0.0 ? period : 1.0);
+
+        {
+            SCOPED_LOCK(m_lock);
+            if(m_stop)
+                break;
+        }
+
+        if(period <= 0.0)
+            continue;
+
+        try {
+            epicsUInt32 reason = evaluate();
+
+            SCOPED_LOCK(m_lock);
+            m_reason.update(reason);
+        } catch(std::exception& e) {
+            errlogPrintf("%s: health evaluation error: %s\n", name().c_str(), e.what());
+        }
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef evgHealth_H
+#define evgHealth_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <dbScan.h>
+
+#include "mrf/object.h"
+#include "mrf/changeScan.h"
+#include "sfp.h"
+
+class evgEvtClk;
+class evgFct;
+
+/* Health of an EVG, evaluated in one pass by a low priority thread
+ * (see mrmEvgHealthPeriod) from the PLL lock, the fanout port status of
+ * the FCT and the severities of the SFP modules.  The reason is published
+ * only when it changes.
+ *
+ * Ports are selected with a bit mask.  Bit 0 is the uplink (SFP0),
+ * bits 1-8 the fanout ports 1-8.
+ */
+class evgHealth : public mrf::ObjectInst<evgHealth>,
+                  public epicsThreadRunable {
+public:
+    enum reason_t {
+        notConnected = 0,
+        ok,
+        sfpRxWarning,
+        sfpRxError,
+        linkError,
+        sfpWarning,
+        sfpError,
+        pllUnlocked,
+        uplinkWarning,
+        uplinkError
+    };
+
+    evgHealth(const std::string&, evgEvtClk&, evgFct*, std::vector<SFP*>&);
+    ~evgHealth();
+
+    /* locking done internally */
+    virtual void lock() const{};
+    virtual void unlock() const{};
+
+    void setMonitorPorts(epicsUInt32);
+    epicsUInt32 getMonitorPorts() const;
+
+    epicsUInt32 getReason() const;
+    IOSCANPVT reasonChanged() const{return m_reason.scan();}
+
+    virtual void run();
+
+private:
+    epicsUInt32 evaluate() const;
+
+    evgEvtClk& m_evtClk;
+    evgFct* const m_fct;
+    std::vector<SFP*>& m_sfp;
+
+    mutable epicsMutex m_lock;
+
+    // Guarded by m_lock
+    epicsUInt32 m_monitor;
+    bool        m_stop;
+    mrf::changeScan<epicsUInt32> m_reason;
+
+    epicsEvent  m_wake;
+    epicsThread m_thread;
+};
+
+#endif // evgHealth_H
@@ -22,6 +22,7 @@
 
 #define epicsExportSharedSymbols
 #include "mrf/object.h"
+#include <mrfCommon.h>
 
 #include <mrfcsr.h>
 #include <mrfpci.h>
@@ -30,6 +31,7 @@
 #include "plx9030.h"
 
 #include "mrmDeviceInfo.h"
+#include "mrmDeferredSetup.h"
 #include "evgRegMap.h"
 #include "mrmShared.h"
 
@@ -443,6 +445,10 @@ mrmEvgSetupPCI (
     bus.function = f;
 
     try {
+        // Cards may be set up concurrently, see mrmSetupDeferred.
+        // The ID check and the registration of the object are atomic.
+        SCOPED_LOCK2(mrmDeferredSetup::busLock(), busGuard);
+
         if (mrf::Object::getObject(id)) {
             errlogPrintf("ID %s already in use\n", id);
             return -1;
@@ -586,16 +592,8 @@ void mrmEvgSoftTime(void* pvt) {
             continue;
         }
 
-        //Send out event reset
-        evg->getSoftEvt()->setEvtCode(MRF_EVENT_TS_COUNTER_RST);
-
-        //Clock out data...
-        for (int i = 0; i < 32; data <<= 1, i++) {
-            if (data & 0x80000000)
-                evg->getSoftEvt()->setEvtCode(MRF_EVENT_TS_SHIFT_1);
-            else
-                evg->getSoftEvt()->setEvtCode(MRF_EVENT_TS_SHIFT_0);
-        }
+        //Send out event reset, then clock out data...
+        evg->sendTsBurst(data, mrfMonotonicSeconds(), true);
 
         struct timespec sleep_until_t;
 
@@ -686,15 +684,31 @@ static const iocshArg * const mrmEvgSetupPCIArgs[5] = { &mrmEvgSetupPCIArg0,
 static const iocshFuncDef mrmEvgSetupPCIFuncDef = { "mrmEvgSetupPCI", 5,
         mrmEvgSetupPCIArgs };
 
-static void mrmEvgSetupPCICallFunc(const iocshArgBuf *args) {
-    // check the 'ignore' parameter
-    if(args[4].aval.ac > 1 && (strcmp("true", args[4].aval.av[1]) == 0 ||
-                               strtol(args[4].aval.av[1], NULL, 10) != 0)){
-        mrmEvgSetupPCI(args[0].sval, args[1].ival, args[2].ival, args[3].ival, true);
+namespace {
+struct evgSetupPCIJob : public mrmDeferredSetup::Job {
+    int b, d, f;
+    bool ignoreVersion;
+    evgSetupPCIJob(const char *id, int b, int d, int f, bool ignoreVersion)
+        :mrmDeferredSetup::Job(id), b(b), d(d), f(f), ignoreVersion(ignoreVersion)
+    {}
+    virtual int setup() {
+        return mrmEvgSetupPCI(card.c_str(), b, d, f, ignoreVersion);
     }
-    else{
-        mrmEvgSetupPCI(args[0].sval, args[1].ival, args[2].ival, args[3].ival, false);
+};
+}
+
+static void mrmEvgSetupPCICallFunc(const iocshArgBuf *args) {
+    if(!args[0].sval) {
+        errlogPrintf("mrmEvgSetupPCI: missing device name\n");
+        return;
     }
+
+    // check the 'ignore' parameter
+    bool ignoreVersion = args[4].aval.ac > 1 && (strcmp("true", args[4].aval.av[1]) == 0 ||
+                                                 strtol(args[4].aval.av[1], NULL, 10) != 0);
+
+    mrmDeferredSetup::submit(new evgSetupPCIJob(args[0].sval, args[1].ival, args[2].ival, args[3].ival,
+                                                ignoreVersion));
 }
 
 
@@ -30,31 +30,34 @@
 
 
 #define evgAllowedTsJitter 0.5f
+/* Shift events must be sent well before the next PPS */
+#define evgTsSendDeadline 0.5
 
 
 evgMrm::evgMrm(const std::string& id, mrmDeviceInfo &devInfo, volatile epicsUInt8* const pReg, volatile epicsUInt8* const fctReg, const epicsPCIDevice *pciDevice):
     mrf::ObjectInst<evgMrm>(id),
-    irqStop0_queued(0),
-    irqStop1_queued(0),
-    irqStart0_queued(0),
-    irqStart1_queued(0),
-    irqExtInp_queued(0),
     m_syncTimestamp(false),
     m_pciDevice(pciDevice),
     m_id(id),
     m_pReg(pReg),
     m_fctReg(fctReg),
     m_deviceInfo(devInfo),
-    m_acTrig(id+":AcTrig", pReg),
+    m_timingCfg(id+":TimingCfg", pReg),
+    m_acTrig(id+":AcTrig", pReg, &m_timingCfg),
     m_evtClk(id+":EvtClk", pReg, this),
     m_softEvt(id+":SoftEvt", pReg),
     m_flash(pReg),
     m_seqRamMgr(this),
     m_softSeqMgr(this),
+    m_tsSender(NULL),
+    m_tsSendMode(tsSendThread),
+    m_tsSendTime(0.0),
+    m_tsSendLate(0),
     m_dataBuffer_230(NULL),
     m_dataBuffer_300(NULL),
     m_dataBufferObj_230(NULL),
-    m_dataBufferObj_300(NULL)
+    m_dataBufferObj_300(NULL),
+    m_irqQueue(NULL)
 {
     try{
 
@@ -183,6 +186,8 @@ evgMrm::evgMrm(const std::string& id, mrmDeviceInfo &devInfo, volatile epicsUInt
             m_fct = 0;
         }
 
+        m_health = new evgHealth(id+":Health", m_evtClk, m_fct, m_sfp);
+
 
         m_dataBuffer_230 = new mrmDataBuffer_230(id.c_str(), pReg, U32_DataTxCtrlEvg, 0, U8_DataTxBaseEvg, 0);
         m_dataBufferObj_230 = new mrmDataBufferObj(id.c_str(), *m_dataBuffer_230);
@@ -209,6 +214,9 @@ evgMrm::evgMrm(const std::string& id, mrmDeviceInfo &devInfo, volatile epicsUInt
         m_timerEvent = new epicsEvent();
         m_wdTimer = new wdTimer("Watch Dog Timer", this);
 
+        scanIoInit(&m_tsSendScan);
+        m_tsSender = new tsSender("EVG TS Send", this);
+
         init_cb(&irqStart0_cb, priorityHigh, &evgMrm::process_sos0_cb,
                                             m_seqRamMgr.getSeqRam(0));
         init_cb(&irqStart1_cb, priorityHigh, &evgMrm::process_sos1_cb,
@@ -217,7 +225,15 @@ evgMrm::evgMrm(const std::string& id, mrmDeviceInfo &devInfo, volatile epicsUInt
                                             m_seqRamMgr.getSeqRam(0));
         init_cb(&irqStop1_cb, priorityHigh, &evgMrm::process_eos1_cb,
                                             m_seqRamMgr.getSeqRam(1));
-        init_cb(&irqExtInp_cb, priorityHigh, &evgMrm::process_inp_cb, this);
+
+        m_irqQueue = new mrmIrqQueue(id+":IrqQueue", id, &evgMrm::process_irq, this,
+                                     64, epicsThreadPriorityHigh);
+        m_irqQueue->addSource("Stop0", EVG_IRQ_STOP_RAM(0));
+        m_irqQueue->addSource("Stop1", EVG_IRQ_STOP_RAM(1));
+        m_irqQueue->addSource("Start0", EVG_IRQ_START_RAM(0));
+        m_irqQueue->addSource("Start1", EVG_IRQ_START_RAM(1));
+        m_irqQueue->addSource("ExtInp", EVG_IRQ_EXT_INP);
+        m_irqQueue->start();
 
         scanIoInit(&ioScanTimestamp);
     } catch(std::exception& e) {
@@ -226,6 +242,10 @@ evgMrm::evgMrm(const std::string& id, mrmDeviceInfo &devInfo, volatile epicsUInt
 }
 
 evgMrm::~evgMrm() {
+    // stop the threads using the registers first
+    delete m_tsSender;
+    delete m_irqQueue;
+
     for(size_t i = 0; i < m_trigEvt.size(); i++)
         delete m_trigEvt[i];
 
@@ -243,6 +263,8 @@ evgMrm::~evgMrm() {
         delete it->second;
     }
 
+    delete m_health;
+
     for(size_t i = 0; i < m_sfp.size(); i++)
         delete m_sfp[i];
 
@@ -431,115 +453,42 @@ evgMrm::isr(void* arg) {
     epicsUInt32 enable = READ32(evg->m_pReg, IrqEnable);
     epicsUInt32 active = flags & enable;
 
-    #ifdef vxWorks
-    /* actually: if isr runs in kernel mode */
-
-        /*
-         * For IFC1210 board this is useless
-         * and for SwissFEL_TIM it is dangerous, since
-         * in the unlikely event of queuing more than 2 IRQs the system
-         * will stop dropping them. For SwissFEL timing system this is
-         * unacceptable.
-         * Furthermore it is not thread safe!!!
-         * A race condition has been observed where
-         * x_queued is changed back to 0 without re-enabling interrupts.         *
-         * For PSI, this is now handled in the IRQ thread, avg ISR time is
-         * around ~10us
-         */
-
-     if(active & EVG_IRQ_STOP_RAM(0)) {
-         if(evg->irqStop0_queued==0) {
-             callbackRequest(&evg->irqStop0_cb);
-             evg->irqStop0_queued=1;
-         } else if(evg->irqStop0_queued==1) {
-             WRITE32(evg->getRegAddr(), IrqEnable, enable & ~EVG_IRQ_STOP_RAM(0));
-             evg->irqStop0_queued=2;
-         }
-     }
-
-     if(active & EVG_IRQ_STOP_RAM(1)) {
-         if(evg->irqStop1_queued==0) {
-             callbackRequest(&evg->irqStop1_cb);
-             evg->irqStop1_queued=1;
-         } else if(evg->irqStop1_queued==1) {
-             WRITE32(evg->getRegAddr(), IrqEnable, enable & ~EVG_IRQ_STOP_RAM(1));
-             evg->irqStop1_queued=2;
-         }
-     }
+    // staged timing configuration aligned to start of sequence (VME and PCI)
+    evg->m_timingCfg.isr(active);
 
-    if(active & EVG_IRQ_START_RAM(0)) {
-        if(evg->irqStart0_queued==0) {
-            callbackRequest(&evg->irqStart0_cb);
-            evg->irqStart0_queued=1;
-        } else if(evg->irqStart0_queued==1) {
-            WRITE32(evg->getRegAddr(), IrqEnable, enable & ~EVG_IRQ_START_RAM(0));
-            evg->irqStart0_queued=2;
-        }
-    }
+    /*
+     * The sequence RAM and external input work is done by the
+     * IRQ queue worker, in order.  When the worker falls behind the
+     * interrupt is dropped and counted as overrun of its sources
+     * (see <EVG>:IrqQueue:*), instead of disabling the interrupt.
+     */
+    if(active && evg->m_irqQueue)
+        evg->m_irqQueue->push(active);
 
-    if(active & EVG_IRQ_START_RAM(1)) {
-        if(evg->irqStart1_queued==0) {
-            callbackRequest(&evg->irqStart1_cb);
-            evg->irqStart1_queued=1;
-        } else if(evg->irqStart1_queued==1) {
-            WRITE32(evg->getRegAddr(), IrqEnable, enable & ~EVG_IRQ_START_RAM(1));
-            evg->irqStart1_queued=2;
-        }
-    }
+    WRITE32(evg->m_pReg, IrqFlag, flags);  // Clear the interrupt causes
+    READ32(evg->m_pReg, IrqFlag);          // Make sure the clear completes before returning
 
-     if(active & EVG_IRQ_EXT_INP) {
-         if(evg->irqExtInp_queued==0) {
-             callbackRequest(&evg->irqExtInp_cb);
-             evg->irqExtInp_queued=1;
-         } else if(evg->irqExtInp_queued==1) {
-             WRITE32(evg->getRegAddr(), IrqEnable, enable & ~EVG_IRQ_EXT_INP);
-             evg->irqExtInp_queued=2;
-         }
-     }
+    return;
+}
 
-    #else
+void
+evgMrm::process_irq(void *pvt, epicsUInt32 active) {
+    evgMrm *evg = (evgMrm*)pvt;
 
-    /*
-     * This is far far far far from proper solution
-     * since it blocks IRQ thread. Luckily the whole ISR
-     * Executes in ~10us so it's not a big problem.
-     * A better solution would be to use epics callback like
-     * original driver, but care must be taken in order to
-     * avoid race conditions.
-     */
-    if(active & EVG_IRQ_STOP_RAM(0)) {
+    if(active & EVG_IRQ_STOP_RAM(0))
         evg->getSeqRamMgr()->getSeqRam(0)->process_eos();
-    }
 
-    if(active & EVG_IRQ_STOP_RAM(1)) {
+    if(active & EVG_IRQ_STOP_RAM(1))
         evg->getSeqRamMgr()->getSeqRam(1)->process_eos();
-    }
 
-    if(active & EVG_IRQ_START_RAM(0)) {
+    if(active & EVG_IRQ_START_RAM(0))
         evg->getSeqRamMgr()->getSeqRam(0)->process_sos();
-    }
 
-    if(active & EVG_IRQ_START_RAM(1)) {
+    if(active & EVG_IRQ_START_RAM(1))
         evg->getSeqRamMgr()->getSeqRam(1)->process_sos();
-    }
-
-    if(active & EVG_IRQ_EXT_INP) {
-        if(evg->irqExtInp_queued==0) {
-            callbackRequest(&evg->irqExtInp_cb);
-            evg->irqExtInp_queued=1;
-        } else if(evg->irqExtInp_queued==1) {
-            WRITE32(evg->getRegAddr(), IrqEnable, enable & ~EVG_IRQ_EXT_INP);
-            evg->irqExtInp_queued=2;
-        }
-    }
-#endif
-
-
-
-    WRITE32(evg->m_pReg, IrqFlag, flags);  // Clear the interrupt causes
-    READ32(evg->m_pReg, IrqFlag);          // Make sure the clear completes before returning
 
-    return;
+    if(active & EVG_IRQ_EXT_INP)
+        evg->process_inp();
 }
 
 void
@@ -552,13 +501,6 @@ evgMrm::process_eos0_cb(CALLBACK *pCallback) {
     if(!seqRam)
         return;
 
-    {
-        interruptLock ig;
-        if(seqRam->m_owner->irqStop0_queued==2)
-            BITSET32(seqRam->m_owner->getRegAddr(), IrqEnable, EVG_IRQ_STOP_RAM(0));
-        seqRam->m_owner->irqStop0_queued=0;
-    }
-
     seqRam->process_eos();
 }
 
@@ -572,13 +514,6 @@ evgMrm::process_eos1_cb(CALLBACK *pCallback) {
     if(!seqRam)
         return;
 
-    {
-        interruptLock ig;
-        if(seqRam->m_owner->irqStop1_queued==2)
-            BITSET32(seqRam->m_owner->getRegAddr(), IrqEnable, EVG_IRQ_STOP_RAM(1));
-        seqRam->m_owner->irqStop1_queued=0;
-    }
-
     seqRam->process_eos();
 }
 
@@ -592,13 +527,6 @@ evgMrm::process_sos0_cb(CALLBACK *pCallback) {
     if(!seqRam)
         return;
 
-    {
-        interruptLock ig;
-        if(seqRam->m_owner->irqStart0_queued==2)
-            BITSET32(seqRam->m_owner->getRegAddr(), IrqEnable, EVG_IRQ_START_RAM(0));
-        seqRam->m_owner->irqStart0_queued=0;
-    }
-
     seqRam->process_sos();
 }
 
@@ -612,39 +540,81 @@ evgMrm::process_sos1_cb(CALLBACK *pCallback) {
     if(!seqRam)
         return;
 
-    {
-        interruptLock ig;
-        if(seqRam->m_owner->irqStart1_queued==2)
-            BITSET32(seqRam->m_owner->getRegAddr(), IrqEnable, EVG_IRQ_START_RAM(1));
-        seqRam->m_owner->irqStart1_queued=0;
-    }
-
     seqRam->process_sos();
 }
 
 void
-evgMrm::process_inp_cb(CALLBACK *pCallback) {
-    void* pVoid;
-    callbackGetUser(pVoid, pCallback);
-    evgMrm* evg = (evgMrm*)pVoid;
+evgMrm::process_inp() {
+    double start = mrfMonotonicSeconds();
 
-    {
-        interruptLock ig;
-        if(evg->irqExtInp_queued==2)
-            BITSET32(evg->getRegAddr(), IrqEnable, EVG_IRQ_EXT_INP);
-        evg->irqExtInp_queued=0;
-    }
-
-    epicsUInt32 data = evg->sendTimestamp();
+    epicsUInt32 data = sendTimestamp();
     if(!data)
         return;
 
-    for(int i = 0; i < 32; data <<= 1, i++) {
-        if( data & 0x80000000 )
-            evg->getSoftEvt()->setEvtCode(MRF_EVENT_TS_SHIFT_1);
-        else
-            evg->getSoftEvt()->setEvtCode(MRF_EVENT_TS_SHIFT_0);
+    if(getTsSendMode()==tsSendThread)
+        m_tsSender->queue(data, start);
+    else
+        sendTsBurst(data, start, false);
+}
+
+size_t
+evgMrm::tsBurst(epicsUInt32 sec, epicsUInt8 *codes, bool reset) {
+    size_t n = 0;
+
+    if(reset)
+        codes[n++] = MRF_EVENT_TS_COUNTER_RST;
+
+    for(int i = 0; i < 32; sec <<= 1, i++)
+        codes[n++] = (sec & 0x80000000) ? MRF_EVENT_TS_SHIFT_1 : MRF_EVENT_TS_SHIFT_0;
+
+    return n;
+}
+
+void
+evgMrm::sendTsBurst(epicsUInt32 sec, double start, bool reset) {
+    epicsUInt8 codes[33];
+    size_t n = tsBurst(sec, codes, reset);
+
+    try {
+        m_softEvt.setEvtCodes(codes, n);
+    } catch(std::exception& e) {
+        errlogPrintf("%s: Error sending timestamp: %s\n", m_id.c_str(), e.what());
     }
+
+    double elapsed = mrfMonotonicSeconds() - start;
+    {
+        SCOPED_LOCK(m_tsLock);
+        m_tsSendTime = elapsed;
+        if(elapsed > evgTsSendDeadline)
+            m_tsSendLate++;
+    }
+    scanIoRequest(m_tsSendScan);
+}
+
+void
+evgMrm::setTsSendMode(epicsUInt16 mode) {
+    if(mode > tsSendThread)
+        throw std::out_of_range("Invalid timestamp send mode");
+    SCOPED_LOCK(m_tsLock);
+    m_tsSendMode = mode;
+}
+
+epicsUInt16
+evgMrm::getTsSendMode() const {
+    SCOPED_LOCK(m_tsLock);
+    return m_tsSendMode;
+}
+
+double
+evgMrm::getTsSendTime() const {
+    SCOPED_LOCK(m_tsLock);
+    return m_tsSendTime;
+}
+
+epicsUInt32
+evgMrm::getTsSendLate() const {
+    SCOPED_LOCK(m_tsLock);
+    return m_tsSendLate;
 }
 
 epicsUInt32
@@ -741,6 +711,11 @@ evgMrm::getAcTrig() {
     return &m_acTrig;
 }
 
+evgTimingCfg*
+evgMrm::getTimingCfg() {
+    return &m_timingCfg;
+}
+
 mrmSoftEvent *evgMrm::getSoftEvt() {
     return &m_softEvt;
 }
@@ -809,6 +784,10 @@ std::vector<SFP *>* evgMrm::getSFP(){
     return &m_sfp;
 }
 
+evgHealth* evgMrm::getHealth(){
+    return m_health;
+}
+
 mrmRemoteFlash *evgMrm::getRemoteFlash()
 {
     return m_remoteFlash;
@@ -874,3 +853,62 @@ bool wdTimer::getPilotCount() {
     SCOPED_LOCK(m_lock);
     return m_pilotCount != 0;
 }
+
+/*********************************/
+/** Start of the TS Sender class **/
+/*********************************/
+
+tsSender::tsSender(const char *name, evgMrm *evg):
+    m_lock(),
+    m_wake(),
+    m_thread(*this,name,epicsThreadGetStackSize(epicsThreadStackSmall),
+             epicsThreadPriorityScanHigh),
+    m_evg(evg),
+    m_pending(false),
+    m_stop(false),
+    m_sec(0),
+    m_start(0.0) {
+    m_thread.start();
+}
+
+tsSender::~tsSender() {
+    {
+        SCOPED_LOCK(m_lock);
+        m_stop = true;
+    }
+    m_wake.signal();
+    m_thread.exitWait();
+}
+
+void tsSender::queue(epicsUInt32 sec, double start) {
+    {
+        SCOPED_LOCK(m_lock);
+        if(m_pending)
+            errlogPrintf("%s: Timestamp send overrun\n", m_evg->getId().c_str());
+        m_pending = true;
+        m_sec = sec;
+        m_start = start;
+    }
+    m_wake.signal();
+}
+
+void tsSender::run() {
+    while(1) {
+        m_wake.wait();
+
+        epicsUInt32 sec;
+        double start;
+        {
+            SCOPED_LOCK(m_lock);
+            if(m_stop)
+                break;
+            if(!m_pending)
+                continue;
+            m_pending = false;
+            sec = m_sec;
+            start = m_start;
+        }
+
+        m_evg->sendTsBurst(sec, start, false);
+    }
+}
@@ -20,6 +20,7 @@
 #include <devLibPCI.h>
 
 #include "evgAcTrig.h"
+#include "evgTimingCfg.h"
 #include "evgEvtClk.h"
 #include "evgTrigEvt.h"
 #include "evgMxc.h"
@@ -33,10 +34,12 @@
 #include "mrmShared.h"
 #include "sfp.h"
 #include "evgFct.h"
+#include "evgHealth.h"
 #include "mrmSoftEvent.h"
 #include "mrmDeviceInfo.h"
 #include "mrmFlash.h"
 #include "mrmRemoteFlash.h"
+#include "mrmIrqQueue.h"
 #include "dataBuffer/mrmDataBufferObj.h"
 #include "dataBuffer/mrmDataBuffer_300.h"
 #include "dataBuffer/mrmDataBuffer_230.h"
@@ -48,6 +51,7 @@
  * Input, Output etc.
  */
 class wdTimer;
+class tsSender;
 
 enum ALARM_TS {TS_ALARM_NONE, TS_ALARM_MINOR, TS_ALARM_MAJOR};
 
@@ -98,7 +102,9 @@ public:
     static void process_eos1_cb(CALLBACK*);
     static void process_sos0_cb(CALLBACK*);
     static void process_sos1_cb(CALLBACK*);
-    static void process_inp_cb(CALLBACK*);
+    //! Worker of m_irqQueue, with the IrqFlag bits of one interrupt
+    static void process_irq(void*, epicsUInt32);
+    void process_inp();
 
     /** TimeStamp    **/
     epicsUInt32 sendTimestamp();
@@ -107,8 +113,29 @@ public:
     void syncTsRequest();
     void incrTimestamp();
 
+    /* How the seconds are shifted out after each PPS.
+     * tsSendCallback - From the PPS callback (callback queue is busy meanwhile)
+     * tsSendThread   - From a dedicated thread
+     */
+    enum tsSendMode_t {tsSendCallback=0, tsSendThread=1};
+    void setTsSendMode(epicsUInt16);
+    epicsUInt16 getTsSendMode() const;
+    //! Time from PPS to last shift event sent.  Units of sec.
+    double getTsSendTime() const;
+    //! Number of times the shift events were not sent before the deadline
+    epicsUInt32 getTsSendLate() const;
+    IOSCANPVT tsSendChanged() const{return m_tsSendScan;}
+
+    /* Fill 'codes' with the shift events for 'sec' (MSB first),
+     * optionally preceded by a counter reset.  @returns number of codes.
+     */
+    static size_t tsBurst(epicsUInt32 sec, epicsUInt8 *codes, bool reset);
+    //! Send shift events for 'sec'.  'start' is the time of the PPS.
+    void sendTsBurst(epicsUInt32 sec, double start, bool reset);
+
     /**    Access    functions     **/
     evgAcTrig* getAcTrig();
+    evgTimingCfg* getTimingCfg();
     evgEvtClk* getEvtClk();
     mrmSoftEvent* getSoftEvt();
     evgTrigEvt* getTrigEvt(epicsUInt32);
@@ -121,6 +148,7 @@ public:
     evgSoftSeqMgr* getSoftSeqMgr();
     epicsEvent* getTimerEvent();
     std::vector<SFP *> *getSFP();
+    evgHealth* getHealth();
 
     mrmRemoteFlash* getRemoteFlash();
 
@@ -131,17 +159,9 @@ public:
     CALLBACK                      irqStop1_cb;
     CALLBACK                      irqStart0_cb;
     CALLBACK                      irqStart1_cb;
-    CALLBACK                      irqExtInp_cb;
 
     const epicsPCIDevice *pciDevice;
 
-    // flags for CB rate limiting
-    unsigned char irqStop0_queued;
-    unsigned char irqStop1_queued;
-    unsigned char irqStart0_queued;
-    unsigned char irqStart1_queued;
-    unsigned char irqExtInp_queued;
-
     IOSCANPVT                     ioScanTimestamp;
     bool                          m_syncTimestamp;
     ALARM_TS                      m_alarmTimestamp;
@@ -156,6 +176,7 @@ private:
     volatile epicsUInt8* const    m_fctReg; // FCT function register map
     mrmDeviceInfo                 m_deviceInfo;
 
+    evgTimingCfg                  m_timingCfg;
     evgAcTrig                     m_acTrig;
     evgEvtClk                     m_evtClk;
     mrmSoftEvent                  m_softEvt;
@@ -179,6 +200,7 @@ private:
     Output_t                      m_output;
 
     evgFct*                       m_fct;
+    evgHealth*                    m_health;
 
     evgSeqRamMgr                  m_seqRamMgr;
     evgSoftSeqMgr                 m_softSeqMgr;
@@ -188,6 +210,13 @@ private:
     wdTimer*                      m_wdTimer;
     epicsEvent*                   m_timerEvent;
 
+    tsSender*                     m_tsSender;
+    mutable epicsMutex            m_tsLock;
+    epicsUInt16                   m_tsSendMode;
+    double                        m_tsSendTime;
+    epicsUInt32                   m_tsSendLate;
+    IOSCANPVT                     m_tsSendScan;
+
     std::vector<SFP*>             m_sfp;    // upstream + fanout transceivers. Transceiver indexed 0 is upstream transceiver.
 
     mrmDataBuffer*                m_dataBuffer_230;
@@ -195,6 +224,8 @@ private:
     mrmDataBufferObj*             m_dataBufferObj_230;
     mrmDataBufferObj*             m_dataBufferObj_300;
 
+    mrmIrqQueue*                  m_irqQueue;
+
     /**
      * @brief setFormFactor sets the internal m_deviceInfo.formFactor based on the content of the device registers
      */
@@ -222,4 +253,31 @@ private:
     epicsInt32  m_pilotCount;
 };
 
+/* Sends the seconds shift events of each PPS from a dedicated thread
+ * so that the callback queue is not held up.
+ */
+class tsSender : public epicsThreadRunable {
+public:
+    tsSender(const char *name, evgMrm* evg);
+    //! Stops and joins the thread
+    virtual ~tsSender();
+
+    virtual void run();
+
+    //! Queue sending of 'sec'.  Replaces any send not yet started.
+    void queue(epicsUInt32 sec, double start);
+
+private:
+    epicsMutex  m_lock;
+    epicsEvent  m_wake;
+    epicsThread m_thread;
+    evgMrm*     m_evg;
+
+    // Guarded by m_lock
+    bool        m_pending;
+    bool        m_stop;
+    epicsUInt32 m_sec;
+    double      m_start;
+};
+
 #endif //EVG_MRM_H
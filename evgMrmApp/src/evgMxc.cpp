@@ -29,6 +29,9 @@ evgMxc::getStatus() const {
 
 void
 evgMxc::setPolarity(bool polarity) {
+    if(m_owner->getTimingCfg()->stageMxcPolarity(m_id, polarity))
+        return;
+
     if(polarity)
         BITSET32(m_pReg, MuxControl(m_id), EVG_MUX_POLARITY);
     else
@@ -45,6 +48,9 @@ evgMxc::setPrescaler(epicsUInt32 preScaler) {
     if(preScaler == 0 || preScaler == 1)
         throw std::runtime_error("Invalid preScaler value in Multiplexed Counter. Value should not be 0 or 1.");
 
+    if(m_owner->getTimingCfg()->stageMxcPrescaler(m_id, preScaler))
+        return;
+
     WRITE32(m_pReg, MuxPrescaler(m_id), preScaler);
 }
 
@@ -56,8 +62,7 @@ evgMxc::getPrescaler() const {
 
 void
 evgMxc::setFrequency(epicsFloat64 freq) {
-    epicsUInt32 clkSpeed = (epicsUInt32)(m_owner->getEvtClk()->getFrequency() *
-                            pow(10.0, 6));
+    epicsUInt32 clkSpeed = (epicsUInt32)(m_owner->getEvtClk()->getFrequency() * 1e6);
     epicsUInt32 preScaler = (epicsUInt32)((epicsFloat64)clkSpeed / freq);
     
     setPrescaler(preScaler);
@@ -65,8 +70,7 @@ evgMxc::setFrequency(epicsFloat64 freq) {
 
 epicsFloat64 
 evgMxc::getFrequency() const {
-    epicsFloat64 clkSpeed = (epicsFloat64)m_owner->getEvtClk()->getFrequency()
-                             * pow(10.0, 6);
+    epicsFloat64 clkSpeed = m_owner->getEvtClk()->getFrequency() * 1e6;
     epicsFloat64 preScaler = (epicsFloat64)getPrescaler();
     return clkSpeed/preScaler;    
 }
@@ -76,6 +80,9 @@ evgMxc::setTrigEvtMap(epicsUInt16 trigEvt, bool ena) {
     if(trigEvt > 7)
         throw std::runtime_error("EVG Mxc Trig Event ID too large. Max: 7");
 
+    if(m_owner->getTimingCfg()->stageMxcTrigMap(m_id, trigEvt, ena))
+        return;
+
     epicsUInt8    mask = 1 << trigEvt;
     //Read-Modify-Write
     epicsUInt8 map = READ8(m_pReg, MuxTrigMap(m_id));
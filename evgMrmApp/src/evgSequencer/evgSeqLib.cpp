@@ -0,0 +1,458 @@
+#include "evgSeqLib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdexcept>
+#include <sstream>
+#include <memory>
+#include <algorithm>
+
+#ifdef __linux__
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include <errlog.h>
+#include <epicsMutex.h>
+#include <iocsh.h>
+
+#include <mrfCommon.h>
+
+#include "evgMrm.h"
+
+static const char seqLibMagic[4] = {'E','S','Q','L'};
+static const epicsUInt32 seqLibBOM = 0x01020304;
+static const epicsUInt32 seqLibVersion = 1;
+
+// size of the data block of one entry, padded to 8 bytes
+static size_t entryBytes(epicsUInt32 length)
+{
+    return (length*(sizeof(epicsUInt64)+2) + 7u) & ~(size_t)7u;
+}
+
+static void throwErrno(const std::string& msg, const std::string& fname)
+{
+    std::ostringstream strm;
+    strm<<msg<<" '"<<fname<<"' : "<<strerror(errno);
+    throw std::runtime_error(strm.str());
+}
+
+evgSeqLib::evgSeqLib(const std::string& fname)
+    :m_fname(fname)
+    ,m_base(0)
+    ,m_len(0)
+    ,m_mapped(false)
+{
+#ifdef __linux__
+    int fd = open(fname.c_str(), O_RDONLY);
+    if(fd<0)
+        throwErrno("Can't open", fname);
+
+    struct stat st;
+    if(fstat(fd, &st)) {
+        close(fd);
+        throwErrno("Can't stat", fname);
+    }
+    m_len = st.st_size;
+
+    if(m_len) {
+        void *mem = mmap(0, m_len, PROT_READ, MAP_SHARED, fd, 0);
+        if(mem==MAP_FAILED) {
+            close(fd);
+            throwErrno("Can't map", fname);
+        }
+        m_base = (const char*)mem;
+        m_mapped = true;
+    }
+    close(fd); // mapping remains valid
+#else
+    FILE *fp = fopen(fname.c_str(), "rb");
+    if(!fp)
+        throwErrno("Can't open", fname);
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if(len>0) {
+        char *mem = (char*)malloc(len);
+        if(!mem) {
+            fclose(fp);
+            throw std::bad_alloc();
+        }
+        if(fread(mem, 1, len, fp)!=(size_t)len) {
+            free(mem);
+            fclose(fp);
+            throwErrno("Can't read", fname);
+        }
+        m_base = mem;
+        m_len = len;
+    }
+    fclose(fp);
+#endif
+
+    try {
+        // validate
+        const evgSeqLibHeader *head = (const evgSeqLibHeader*)m_base;
+
+        if(m_len < sizeof(*head) || memcmp(head->magic, seqLibMagic, sizeof(seqLibMagic))!=0)
+            throw std::runtime_error("Not a sequence library");
+        else if(head->bom!=seqLibBOM)
+            throw std::runtime_error("Sequence library has wrong byte order");
+        else if(head->version!=seqLibVersion)
+            throw std::runtime_error("Unsupported sequence library version");
+        else if(head->count > (m_len-sizeof(*head))/sizeof(evgSeqLibEntry))
+            throw std::runtime_error("Sequence library truncated");
+
+        const evgSeqLibEntry *ents = (const evgSeqLibEntry*)(head+1);
+
+        m_seqs.resize(head->count);
+
+        for(epicsUInt32 i=0; i<head->count; i++) {
+            const evgSeqLibEntry& ent = ents[i];
+            Sequence& seq = m_seqs[i];
+
+            if(ent.length > 2047 || ent.offset%8 || ent.offset > m_len
+                    || ent.length*(sizeof(epicsUInt64)+2) > m_len-ent.offset
+                    || !memchr(ent.name, '\0', sizeof(ent.name)))
+            {
+                std::ostringstream strm;
+                strm<<"Sequence library entry "<<i<<" corrupt";
+                throw std::runtime_error(strm.str());
+            }
+
+            const char *data = m_base + ent.offset;
+
+            if(mrfCrc32(0, data, ent.length*(sizeof(epicsUInt64)+2))!=ent.crc) {
+                std::ostringstream strm;
+                strm<<"Sequence library entry "<<i<<" '"<<ent.name<<"' checksum mismatch";
+                throw std::runtime_error(strm.str());
+            }
+
+            seq.name = ent.name;
+            seq.size = ent.length;
+            seq.timestamp = (const epicsUInt64*)data;
+            seq.eventCode = (const epicsUInt8*)(seq.timestamp + ent.length);
+            seq.eventMask = seq.eventCode + ent.length;
+        }
+    } catch(...) {
+        release();
+        throw;
+    }
+}
+
+evgSeqLib::~evgSeqLib()
+{
+    release();
+}
+
+void
+evgSeqLib::release()
+{
+    if(!m_base)
+        return;
+#ifdef __linux__
+    munmap((void*)m_base, m_len);
+#else
+    free((void*)m_base);
+#endif
+    m_base = 0;
+}
+
+const evgSeqLib::Sequence&
+evgSeqLib::get(size_t i) const
+{
+    if(i>=m_seqs.size())
+        throw std::out_of_range("No such sequence library entry");
+    return m_seqs[i];
+}
+
+const evgSeqLib::Sequence*
+evgSeqLib::find(const std::string& name) const
+{
+    for(size_t i=0; i<m_seqs.size(); i++) {
+        if(m_seqs[i].name==name)
+            return &m_seqs[i];
+    }
+    return 0;
+}
+
+void
+evgSeqLib::show(int lvl) const
+{
+    printf("Sequence library '%s' (%s) %u entries\n", m_fname.c_str(),
+           m_mapped ? "mapped" : "in memory", (unsigned)m_seqs.size());
+    if(lvl<1)
+        return;
+    for(size_t i=0; i<m_seqs.size(); i++)
+        printf(" %3u %-20s %4u events\n", (unsigned)i,
+               m_seqs[i].name.c_str(), (unsigned)m_seqs[i].size);
+}
+
+void
+evgSeqLib::write(const std::string& fname, const std::vector<Sequence>& seqs)
+{
+    evgSeqLibHeader head;
+    memcpy(head.magic, seqLibMagic, sizeof(head.magic));
+    head.bom = seqLibBOM;
+    head.version = seqLibVersion;
+    head.count = (epicsUInt32)seqs.size();
+
+    std::vector<evgSeqLibEntry> ents(seqs.size());
+    size_t offset = (sizeof(head) + ents.size()*sizeof(evgSeqLibEntry) + 7u) & ~(size_t)7u;
+
+    for(size_t i=0; i<seqs.size(); i++) {
+        const Sequence& seq = seqs[i];
+        evgSeqLibEntry& ent = ents[i];
+
+        if(seq.name.size() >= sizeof(ent.name))
+            throw std::runtime_error("Sequence name too long");
+        else if(seq.size > 2047)
+            throw std::runtime_error("Sequence too long. Max: 2047");
+
+        memset(&ent, 0, sizeof(ent));
+        strcpy(ent.name, seq.name.c_str());
+        ent.offset = (epicsUInt32)offset;
+        ent.length = seq.size;
+
+        epicsUInt32 crc = mrfCrc32(0, seq.timestamp, seq.size*sizeof(epicsUInt64));
+        crc = mrfCrc32(crc, seq.eventCode, seq.size);
+        ent.crc = mrfCrc32(crc, seq.eventMask, seq.size);
+
+        offset += entryBytes(seq.size);
+    }
+
+    // write to a temporary and rename so that a mapped library is not disturbed
+    std::string tmpname(fname + ".tmp");
+
+    FILE *fp = fopen(tmpname.c_str(), "wb");
+    if(!fp)
+        throwErrno("Can't create", tmpname);
+
+    static const char zeros[8] = {0,0,0,0,0,0,0,0};
+    bool ok = fwrite(&head, sizeof(head), 1, fp)==1;
+    if(ok && !ents.empty())
+        ok = fwrite(&ents[0], sizeof(evgSeqLibEntry), ents.size(), fp)==ents.size();
+
+    for(size_t i=0; ok && i<seqs.size(); i++) {
+        const Sequence& seq = seqs[i];
+        long pad = (long)ents[i].offset - ftell(fp);
+        ok = pad>=0 && pad<8 && fwrite(zeros, 1, pad, fp)==(size_t)pad
+          && fwrite(seq.timestamp, sizeof(epicsUInt64), seq.size, fp)==seq.size
+          && fwrite(seq.eventCode, 1, seq.size, fp)==seq.size
+          && fwrite(seq.eventMask, 1, seq.size, fp)==seq.size;
+    }
+
+    if(fclose(fp) || !ok) {
+        remove(tmpname.c_str());
+        throwErrno("Can't write", tmpname);
+    }
+
+#ifdef _WIN32
+    remove(fname.c_str()); // rename() won't replace
+#endif
+    if(rename(tmpname.c_str(), fname.c_str())) {
+        remove(tmpname.c_str());
+        throwErrno("Can't replace", fname);
+    }
+}
+
+/* The library loaded by mrmEvgSeqLibLoad().
+ * Lock order: evgSoftSeq::m_lock, then seqLibLock.
+ */
+static evgSeqLib *seqLib;
+static epicsMutex *seqLibLock;
+
+void
+evgSeqLib::select(evgSoftSeq* seq, epicsUInt32 idx)
+{
+    SCOPED_LOCK2(*seqLibLock, guard);
+    if(!seqLib)
+        throw std::runtime_error("No sequence library loaded");
+
+    const Sequence& ent = seqLib->get(idx);
+
+    seq->setSequence(ent.timestamp, ent.eventCode, ent.eventMask, ent.size);
+    seq->commit();
+    if(mrmEVGSeqDebug)
+        fprintf(stderr, "SS%u: Selected library entry %u '%s'\n",
+                seq->getId(), (unsigned)idx, ent.name.c_str());
+}
+
+void
+evgSeqLib::select(evgSoftSeq* seq, const std::string& key)
+{
+    SCOPED_LOCK2(*seqLibLock, guard);
+    if(!seqLib)
+        throw std::runtime_error("No sequence library loaded");
+
+    for(size_t i=0; i<seqLib->size(); i++) {
+        if(seqLib->get(i).name==key) {
+            select(seq, (epicsUInt32)i);
+            return;
+        }
+    }
+
+    char *end;
+    epicsUInt32 idx = strtoul(key.c_str(), &end, 0);
+    if(key.empty() || *end)
+        throw std::runtime_error("No such sequence library entry");
+    select(seq, idx);
+}
+
+static
+evgSoftSeq* findSoftSeq(const char* evgName, int seqNum)
+{
+    evgMrm* evg = dynamic_cast<evgMrm*>(mrf::Object::getObject(evgName ? evgName : ""));
+    if(!evg)
+        throw std::runtime_error("EVG not found");
+    evgSoftSeq* seq = evg->getSoftSeqMgr()->getSoftSeq(seqNum);
+    if(!seq)
+        throw std::runtime_error("Failed to lookup EVG Sequence");
+    return seq;
+}
+
+static
+void mrmEvgSeqLibLoad(const char* fname)
+{
+    try {
+        if(!fname)
+            throw std::runtime_error("Missing file name");
+
+        std::auto_ptr<evgSeqLib> lib(new evgSeqLib(fname));
+        lib->show(0);
+
+        SCOPED_LOCK2(*seqLibLock, guard);
+        delete seqLib;
+        seqLib = lib.release();
+    } catch(std::exception& e) {
+        errlogPrintf("Error: %s\n", e.what());
+    }
+}
+
+static
+void mrmEvgSeqLibShow(int lvl)
+{
+    SCOPED_LOCK2(*seqLibLock, guard);
+    if(seqLib)
+        seqLib->show(lvl);
+    else
+        printf("No sequence library loaded\n");
+}
+
+static
+void mrmEvgSeqLibSelect(const char* evgName, int seqNum, const char* key)
+{
+    try {
+        evgSoftSeq* seq = findSoftSeq(evgName, seqNum);
+        SCOPED_LOCK2(seq->m_lock, guard);
+        evgSeqLib::select(seq, key ? key : "");
+    } catch(std::exception& e) {
+        errlogPrintf("Error: %s\n", e.what());
+    }
+}
+
+/* Add the (uncommited) sequence of a soft sequence to a library file.
+ * Existing entries are kept, an entry of the same name replaced.
+ * The loaded library is not changed.
+ */
+static
+void mrmEvgSeqLibSave(const char* fname, const char* name, const char* evgName, int seqNum)
+{
+    try {
+        if(!fname || !name)
+            throw std::runtime_error("Missing file or entry name");
+
+        evgSoftSeq* soft = findSoftSeq(evgName, seqNum);
+
+        std::auto_ptr<evgSeqLib> old;
+        FILE *fp = fopen(fname, "rb");
+        if(fp) {
+            fclose(fp);
+            old.reset(new evgSeqLib(fname));
+        }
+
+        SCOPED_LOCK2(soft->m_lock, guard);
+
+        evgSeqLib::Sequence seq;
+        seq.name = name;
+        seq.size = (epicsUInt32)std::min(soft->getTimestamp().size(),
+                                         std::min(soft->getEventCode().size(),
+                                                  soft->getEventMask().size()));
+        if(!seq.size)
+            throw std::runtime_error("Sequence is empty");
+        seq.timestamp = &soft->getTimestamp()[0];
+        seq.eventCode = &soft->getEventCode()[0];
+        seq.eventMask = &soft->getEventMask()[0];
+
+        std::vector<evgSeqLib::Sequence> seqs;
+        bool replaced = false;
+        for(size_t i=0; old.get() && i<old->size(); i++) {
+            if(old->get(i).name==seq.name) {
+                seqs.push_back(seq);
+                replaced = true;
+            } else {
+                seqs.push_back(old->get(i));
+            }
+        }
+        if(!replaced)
+            seqs.push_back(seq);
+
+        evgSeqLib::write(fname, seqs);
+        printf("%s '%s' in %s\n", replaced ? "Replaced" : "Added", name, fname);
+    } catch(std::exception& e) {
+        errlogPrintf("Error: %s\n", e.what());
+    }
+}
+
+static const iocshArg mrmEvgSeqLibLoadArg0 = { "File", iocshArgString };
+static const iocshArg * const mrmEvgSeqLibLoadArgs[1] = { &mrmEvgSeqLibLoadArg0 };
+static const iocshFuncDef mrmEvgSeqLibLoadFuncDef = { "mrmEvgSeqLibLoad", 1, mrmEvgSeqLibLoadArgs };
+static void mrmEvgSeqLibLoadCallFunc(const iocshArgBuf *args) {
+    mrmEvgSeqLibLoad(args[0].sval);
+}
+
+static const iocshArg mrmEvgSeqLibShowArg0 = { "Level", iocshArgInt };
+static const iocshArg * const mrmEvgSeqLibShowArgs[1] = { &mrmEvgSeqLibShowArg0 };
+static const iocshFuncDef mrmEvgSeqLibShowFuncDef = { "mrmEvgSeqLibShow", 1, mrmEvgSeqLibShowArgs };
+static void mrmEvgSeqLibShowCallFunc(const iocshArgBuf *args) {
+    mrmEvgSeqLibShow(args[0].ival);
+}
+
+static const iocshArg mrmEvgSeqLibSelectArg0 = { "Device", iocshArgString };
+static const iocshArg mrmEvgSeqLibSelectArg1 = { "Soft sequence number", iocshArgInt };
+static const iocshArg mrmEvgSeqLibSelectArg2 = { "Entry name or index", iocshArgString };
+static const iocshArg * const mrmEvgSeqLibSelectArgs[3] = { &mrmEvgSeqLibSelectArg0,
+        &mrmEvgSeqLibSelectArg1, &mrmEvgSeqLibSelectArg2 };
+static const iocshFuncDef mrmEvgSeqLibSelectFuncDef = { "mrmEvgSeqLibSelect", 3, mrmEvgSeqLibSelectArgs };
+static void mrmEvgSeqLibSelectCallFunc(const iocshArgBuf *args) {
+    mrmEvgSeqLibSelect(args[0].sval, args[1].ival, args[2].sval);
+}
+
+static const iocshArg mrmEvgSeqLibSaveArg0 = { "File", iocshArgString };
+static const iocshArg mrmEvgSeqLibSaveArg1 = { "Entry name", iocshArgString };
+static const iocshArg mrmEvgSeqLibSaveArg2 = { "Device", iocshArgString };
+static const iocshArg mrmEvgSeqLibSaveArg3 = { "Soft sequence number", iocshArgInt };
+static const iocshArg * const mrmEvgSeqLibSaveArgs[4] = { &mrmEvgSeqLibSaveArg0,
+        &mrmEvgSeqLibSaveArg1, &mrmEvgSeqLibSaveArg2, &mrmEvgSeqLibSaveArg3 };
+static const iocshFuncDef mrmEvgSeqLibSaveFuncDef = { "mrmEvgSeqLibSave", 4, mrmEvgSeqLibSaveArgs };
+static void mrmEvgSeqLibSaveCallFunc(const iocshArgBuf *args) {
+    mrmEvgSeqLibSave(args[0].sval, args[1].sval, args[2].sval, args[3].ival);
+}
+
+#include <epicsExport.h>
+extern "C"{
+static void evgSeqLibRegistrar() {
+    seqLibLock = new epicsMutex;
+    iocshRegister(&mrmEvgSeqLibLoadFuncDef, mrmEvgSeqLibLoadCallFunc);
+    iocshRegister(&mrmEvgSeqLibShowFuncDef, mrmEvgSeqLibShowCallFunc);
+    iocshRegister(&mrmEvgSeqLibSelectFuncDef, mrmEvgSeqLibSelectCallFunc);
+    iocshRegister(&mrmEvgSeqLibSaveFuncDef, mrmEvgSeqLibSaveCallFunc);
+}
+
+epicsExportRegistrar(evgSeqLibRegistrar);
+}
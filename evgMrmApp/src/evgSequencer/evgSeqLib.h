@@ -0,0 +1,94 @@
+#ifndef EVG_SEQLIB_H
+#define EVG_SEQLIB_H
+
+#include <vector>
+#include <string>
+
+#include <epicsTypes.h>
+
+#include "evgSoftSeq.h"
+
+/**
+ * Binary sequence library file.
+ *
+ * Layout, in host byte order (checked with evgSeqLibHeader::bom)
+ *
+ *   evgSeqLibHeader
+ *   evgSeqLibEntry[count]
+ *   for each entry, at the 8 byte aligned 'offset'
+ *     epicsUInt64 timestamp[length]   (event clock ticks)
+ *     epicsUInt8  eventCode[length]
+ *     epicsUInt8  eventMask[length]
+ *
+ * 'crc' is the CRC32 of the data block of the entry.
+ */
+struct evgSeqLibHeader {
+    char        magic[4];   // "ESQL"
+    epicsUInt32 bom;        // 0x01020304
+    epicsUInt32 version;    // 1
+    epicsUInt32 count;
+};
+
+struct evgSeqLibEntry {
+    char        name[48];   // nil terminated
+    epicsUInt32 offset;     // from start of file
+    epicsUInt32 length;     // number of events
+    epicsUInt32 crc;
+    epicsUInt32 reserved;
+};
+
+/**
+ * A library of pre-converted sequences.
+ *
+ * The file is memory mapped where possible (read into memory otherwise)
+ * and checked when opened.  Sequences are then handed to an evgSoftSeq
+ * without conversion.
+ */
+class evgSeqLib {
+public:
+    struct Sequence {
+        std::string        name;
+        const epicsUInt64* timestamp;
+        const epicsUInt8*  eventCode;
+        const epicsUInt8*  eventMask;
+        epicsUInt32        size;
+    };
+
+    explicit evgSeqLib(const std::string& fname);
+    ~evgSeqLib();
+
+    const std::string& fileName() const{return m_fname;}
+
+    size_t size() const{return m_seqs.size();}
+    const Sequence& get(size_t i) const;
+    //! @returns NULL if no sequence of this name
+    const Sequence* find(const std::string& name) const;
+
+    void show(int lvl) const;
+
+    //! Write a new library file
+    static void write(const std::string& fname, const std::vector<Sequence>& seqs);
+
+    /** @brief Copy a sequence of the current library into a soft sequence and commit
+     *
+     * Caller must hold seq->m_lock.
+     @param key Library entry name or index
+     */
+    static void select(evgSoftSeq* seq, const std::string& key);
+    static void select(evgSoftSeq* seq, epicsUInt32 idx);
+
+private:
+    std::string m_fname;
+    const char* m_base;
+    size_t      m_len;
+    bool        m_mapped;
+
+    std::vector<Sequence> m_seqs;
+
+    void release();
+
+    evgSeqLib(const evgSeqLib&);
+    evgSeqLib& operator=(const evgSeqLib&);
+};
+
+#endif // EVG_SEQLIB_H
@@ -1,6 +1,7 @@
 #include "evgSeqRam.h"
 
 #include <iostream>
+#include <algorithm>
 #include <stdexcept>
 #include <stdlib.h>
 
@@ -22,9 +23,13 @@ m_pReg(owner->getRegAddr()),
 m_softSeq(0) {
 }
 
+/* The setters write entries [first, last) of the given table.
+ * By default the whole table.
+ */
 void
-evgSeqRam::setEventCode(const std::vector<epicsUInt8>& eventCode) {
-    for(unsigned int i = 0; i < eventCode.size(); i++)
+evgSeqRam::setEventCode(const std::vector<epicsUInt8>& eventCode, size_t first, size_t last) {
+    last = std::min(last, eventCode.size());
+    for(size_t i = first; i < last; i++)
         WRITE8(m_pReg, SeqRamEvent(m_id,i), eventCode[i]);
 }
 
@@ -38,9 +43,10 @@ evgSeqRam::getEventCode() {
     return eventCode;
 }
 
-void evgSeqRam::setEventMask(const std::vector<epicsUInt8> & eventMask)
+void evgSeqRam::setEventMask(const std::vector<epicsUInt8> & eventMask, size_t first, size_t last)
 {
-    for(unsigned int i = 0; i < eventMask.size(); i++)
+    last = std::min(last, eventMask.size());
+    for(size_t i = first; i < last; i++)
         WRITE8(m_pReg, SeqRamMask(m_id,i), eventMask[i]);
 
 }
@@ -60,8 +66,9 @@ std::vector<epicsUInt8> evgSeqRam::getEventMask()
 }
 
 void
-evgSeqRam::setTimestamp(const std::vector<epicsUInt64>& timestamp){
-    for(unsigned int i = 0; i < timestamp.size(); i++)
+evgSeqRam::setTimestamp(const std::vector<epicsUInt64>& timestamp, size_t first, size_t last){
+    last = std::min(last, timestamp.size());
+    for(size_t i = first; i < last; i++)
         WRITE32(m_pReg, SeqRamTS(m_id,i), (epicsUInt32)timestamp[i]);
 }
 
@@ -25,13 +25,13 @@ public:
      */
     epicsUInt32 getId() const{return m_id;}
 
-    void setEventCode(const std::vector<epicsUInt8>&);
+    void setEventCode(const std::vector<epicsUInt8>&, size_t first=0, size_t last=(size_t)-1);
     std::vector<epicsUInt8> getEventCode();
 
-    void setEventMask(const std::vector<epicsUInt8>&);
+    void setEventMask(const std::vector<epicsUInt8>&, size_t first=0, size_t last=(size_t)-1);
     std::vector<epicsUInt8> getEventMask();
 
-    void setTimestamp(const std::vector<epicsUInt64>&);
+    void setTimestamp(const std::vector<epicsUInt64>&, size_t first=0, size_t last=(size_t)-1);
     std::vector<epicsUInt64> getTimestamp();
 
     void setTrigSrc(SeqTrigSrc);
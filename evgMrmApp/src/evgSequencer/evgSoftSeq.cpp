@@ -2,6 +2,7 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <algorithm>
 #include <stdexcept>
 #include <string>
 #include <iostream>
@@ -11,12 +12,37 @@
 
 #include <mrfCommonIO.h>
 #include <mrfCommon.h>
+#include <mrf/seqCompile.h>
 #include "evgRegMap.h"
 
 #include "evgMrm.h"
 
 int mrmEVGSeqDebug = 0;
 
+/* Working copy holds at most 2047 entries, plus up to two
+ * entries for the appended 'End of Sequence'.
+ */
+static const size_t wkCapacity = 2047+2;
+
+namespace {
+// Entry of the working copy equal to the one of the commited copy
+struct sameEntry {
+    const std::vector<epicsUInt64> &tsWk, &tsCt;
+    const std::vector<epicsUInt8> &ecWk, &ecCt, &mskWk, &mskCt;
+
+    sameEntry(const std::vector<epicsUInt64>& tw, const std::vector<epicsUInt64>& tc,
+              const std::vector<epicsUInt8>& ew, const std::vector<epicsUInt8>& ec,
+              const std::vector<epicsUInt8>& mw, const std::vector<epicsUInt8>& mc)
+        :tsWk(tw), tsCt(tc), ecWk(ew), ecCt(ec), mskWk(mw), mskCt(mc)
+    {}
+
+    bool operator()(size_t i) const
+    {
+        return tsWk[i]==tsCt[i] && ecWk[i]==ecCt[i] && mskWk[i]==mskCt[i];
+    }
+};
+}
+
 evgSoftSeq::evgSoftSeq(const epicsUInt32 id, evgMrm* const owner):
 m_lock(),
 m_id(id),
@@ -25,9 +51,19 @@ m_pReg(owner->getRegAddr()),
 m_timestampInpMode(EGU),
 m_trigSrc(None),
 m_runMode(Single),
-m_timestampWk(2048),
-m_eventCodeWk(2048),
-m_eventMaskWk(2048),
+m_dirtyLo(0),
+m_dirtyHi(0),
+m_timestampWk(wkCapacity),
+m_eventCodeWk(wkCapacity),
+m_eventMaskWk(wkCapacity),
+m_startWk(2048),
+m_lenWk(0),
+m_bodyLenWk(0),
+m_consumedWk(0),
+m_userEosWk(false),
+m_validWk(false),
+m_ramLo(0),
+m_ramHi((size_t)-1),
 m_timestampCt(2048),
 m_eventCodeCt(2048),
 m_eventMaskCt(2048),
@@ -42,6 +78,9 @@ m_numOfRuns(0)
  {
     m_eventCodeCt.push_back(0x7f);
     m_timestampCt.push_back(evgEndOfSeqBuf);
+    m_timestampCt.reserve(wkCapacity);
+    m_eventCodeCt.reserve(wkCapacity);
+    m_eventMaskCt.reserve(wkCapacity);
 
     scanIoInit(&ioscanpvt);
     scanIoInit(&ioScanPvtErr);
@@ -102,6 +141,7 @@ evgSoftSeq::setTimestamp(epicsUInt64* timestamp, epicsUInt32 size) {
     if(size > 2047)
         throw std::runtime_error("Too many Timestamps. Max: 2047");
 
+    mrf::diffRange(m_timestamp, timestamp, size, m_dirtyLo, m_dirtyHi);
     m_timestamp.clear();
     m_timestamp.assign(timestamp, timestamp + size);
 
@@ -116,6 +156,7 @@ evgSoftSeq::setEventCode(epicsUInt8* eventCode, epicsUInt32 size) {
     if(size > 2047)
         throw std::runtime_error("Too many EventCodes. Max: 2047");
 	
+    mrf::diffRange(m_eventCode, eventCode, size, m_dirtyLo, m_dirtyHi);
     m_eventCode.clear();
     m_eventCode.assign(eventCode, eventCode + size);
 
@@ -125,6 +166,25 @@ evgSoftSeq::setEventCode(epicsUInt8* eventCode, epicsUInt32 size) {
     scanIoRequest(ioscanpvt);
 }
 
+void
+evgSoftSeq::setSequence(const epicsUInt64* timestamp, const epicsUInt8* eventCode,
+                        const epicsUInt8* eventMask, epicsUInt32 size) {
+    if(size > 2047)
+        throw std::runtime_error("Sequence too long. Max: 2047");
+
+    mrf::diffRange(m_timestamp, timestamp, size, m_dirtyLo, m_dirtyHi);
+    mrf::diffRange(m_eventCode, eventCode, size, m_dirtyLo, m_dirtyHi);
+    mrf::diffRange(m_eventMask, eventMask, size, m_dirtyLo, m_dirtyHi);
+    m_timestamp.assign(timestamp, timestamp + size);
+    m_eventCode.assign(eventCode, eventCode + size);
+    m_eventMask.assign(eventMask, eventMask + size);
+
+    m_isCommited = false;
+    if(mrmEVGSeqDebug>1)
+        fprintf(stderr, "SS%u: Update Sequence\n",m_id);
+    scanIoRequest(ioscanpvt);
+}
+
 void
 evgSoftSeq::setTrigSrc(SeqTrigSrc trigSrc) {
     if(trigSrc != m_trigSrc) {
@@ -161,6 +221,7 @@ void evgSoftSeq::setEventMask(epicsUInt8 * eventCode, epicsUInt32 size)
     if(size > 2047)
         throw std::runtime_error("Too many Event Masks. Max: 2047");
 
+    mrf::diffRange(m_eventMask, eventCode, size, m_dirtyLo, m_dirtyHi);
     m_eventMask.clear();
     m_eventMask.assign(eventCode, eventCode + size);
 
@@ -248,8 +309,10 @@ evgSoftSeq::load() {
     }
 
     if(isLoaded()) {
-        // always need sync after loading
+        // always need sync after loading, and SeqRam content is unknown
         m_isSynced = false;
+        m_ramLo = 0;
+        m_ramHi = (size_t)-1;
         if(mrmEVGSeqDebug)
             fprintf(stderr, "SS%u: Load\n",m_id);
         sync(); 
@@ -418,9 +481,17 @@ evgSoftSeq::finishSync()
         fprintf(stderr, "Syncing...\n Src: %d\n Mode: %d\n",
                 (int)getTrigSrcCt(), (int)getRunModeCt());
     }
-    m_seqRam->setEventCode(getEventCodeCt());
-    m_seqRam->setEventMask(getEventMaskCt());
-    m_seqRam->setTimestamp(getTimestampCt());
+    // only write entries changed since the last sync
+    if(m_ramLo < m_ramHi) {
+        m_seqRam->setEventCode(getEventCodeCt(), m_ramLo, m_ramHi);
+        m_seqRam->setEventMask(getEventMaskCt(), m_ramLo, m_ramHi);
+        m_seqRam->setTimestamp(getTimestampCt(), m_ramLo, m_ramHi);
+        if(mrmEVGSeqDebug>1)
+            fprintf(stderr, "SS%u: Write SeqRam [%u, %u)\n", m_id,
+                    (unsigned)m_ramLo,
+                    (unsigned)std::min(m_ramHi, getTimestampCt().size()));
+        m_ramLo = m_ramHi = 0;
+    }
     m_seqRam->setTrigSrc(getTrigSrcCt());
     m_seqRam->setRunMode(getRunModeCt());
     if(m_isEnabled) {
@@ -435,6 +506,16 @@ evgSoftSeq::finishSync()
     scanIoRequest(ioscanpvt);
 }
 
+/*
+ * Compile the scratch copy into the working copy.
+ *
+ * Only scratch entries from the first changed one are re-compiled.
+ * Compilation stops early once past the last changed entry if the
+ * output is back in step with the previous working copy (same index
+ * and same preceding timestamp).  Then the remainder is unchanged.
+ * Only the affected window is re-validated and copied to the commited
+ * copy, and only this window is written to the SeqRam on sync.
+ */
 void
 evgSoftSeq::commitSoftSeq() {
     epicsInt64 tsUInt64;
@@ -443,97 +524,168 @@ evgSoftSeq::commitSoftSeq() {
     epicsUInt64 preTs = 0;
     epicsUInt64 curTs = 0;
 
-    // Erase all element in working copy of the sequence
-    m_timestampWk.erase(m_timestampWk.begin(), m_timestampWk.end());
-    m_eventCodeWk.erase(m_eventCodeWk.begin(), m_eventCodeWk.end());
-    m_eventMaskWk.erase(m_eventMaskWk.begin(), m_eventMaskWk.end());
-
     /*
      * Make EventCode and Timestamp vector of same size
      *(Smaller of the two vectors sizes).
      */
-    std::vector<epicsUInt64>::iterator itTS = m_timestamp.begin();
-    std::vector<epicsUInt8>::iterator itEC = m_eventCode.begin();
-    std::vector<epicsUInt8>::iterator itMSK = m_eventMask.begin();
+    const size_t numIn = std::min(m_timestamp.size(),
+                                  std::min(m_eventCode.size(), m_eventMask.size()));
+
+    size_t inLo = m_dirtyLo, inHi = m_dirtyHi;
+    if(!m_validWk) {
+        inLo = 0;
+        inHi = (size_t)-1;
+    } else if(inLo >= inHi || (m_userEosWk && inLo >= m_consumedWk)) {
+        /* nothing changed, or only entries past the user provided
+         * end of sequence event.
+         */
+        inLo = inHi = m_consumedWk;
+    }
+    inLo = std::min(inLo, m_consumedWk);
+
+    const bool noop = m_validWk && inLo==inHi;
+
+    // invalid until complete
+    m_validWk = false;
+
+    size_t pos = inLo ? m_startWk[inLo] : 0;
+    const size_t wkLo = pos;
+    size_t bodyLen = m_bodyLenWk, len = m_lenWk;
+    size_t consumed = m_consumedWk;
+    bool userEos = m_userEosWk;
+    bool converged = noop;
+
+    if(inLo)
+        preTs = m_timestamp[inLo-1];
+
+    size_t i = inLo;
+    for(; !noop && i < numIn; i++) {
+        if(i > inHi && i < m_consumedWk && pos==m_startWk[i] &&
+                pos && pos<=m_timestampCt.size() &&
+                m_timestampWk[pos-1]==m_timestampCt[pos-1]) {
+            // remainder is unchanged
+            converged = true;
+            break;
+        }
 
-    for(; itTS < m_timestamp.end() && itEC < m_eventCode.end() && itMSK < m_eventMask.end(); itTS++, itEC++, itMSK++) {
-        ecUInt8 = *itEC;
-        mskUInt8 = *itMSK;
+        ecUInt8 = m_eventCode[i];
+        mskUInt8 = m_eventMask[i];
+
+        m_startWk[i] = pos;
 
         //FIXME: Why is ts recalculated from previous value?
-        curTs = *itTS;
+        curTs = m_timestamp[i];
         tsUInt64 = curTs - preTs;
-        if(m_timestampWk.size())
-            tsUInt64 += m_timestampWk.back();
+        if(pos)
+            tsUInt64 += m_timestampWk[pos-1];
 
          /* inject continuation event(s) when output time would overflow */
         for(;tsUInt64 > 0xffffffff; tsUInt64 -= 0xffffffff) {
-            m_timestampWk.push_back(0xffffffff);
-            m_eventCodeWk.push_back(0);
-            m_eventMaskWk.push_back(0);
-
+            if(pos >= 2047)
+                throw std::runtime_error("Sequence too long (>2047)");
+            m_timestampWk[pos] = 0xffffffff;
+            m_eventCodeWk[pos] = 0;
+            m_eventMaskWk[pos] = 0;
+            pos++;
         }
         preTs = curTs;
 
-        m_timestampWk.push_back(tsUInt64);
-        m_eventCodeWk.push_back(ecUInt8);
-        m_eventMaskWk.push_back(mskUInt8);
+        if(pos >= 2047)
+            throw std::runtime_error("Sequence too long (>2047)");
+        m_timestampWk[pos] = tsUInt64;
+        m_eventCodeWk[pos] = ecUInt8;
+        m_eventMaskWk[pos] = mskUInt8;
+        pos++;
 
         if(ecUInt8==0x7f)
             break; /* User provided end of sequence event */
     }
 
+    if(!converged) {
+        userEos = i < numIn;
+        consumed = userEos ? i+1 : i;
+        if(consumed < m_startWk.size())
+            m_startWk[consumed] = pos;
+        bodyLen = pos;
+    }
+
     /*
-     * Check if the timestamps are sorted and unique 
+     * Check if the timestamps are sorted and unique.
+     * Entries outside of the re-compiled window were checked previously.
      */
-    if(m_timestampWk.size() > 1) {
-        for(unsigned int i = 0; i < m_timestampWk.size()-1; i++) {
-            if( m_timestampWk[i] >= m_timestampWk[i+1] ) {
-                if( (m_timestampWk[i] == 0xffffffff) && (m_eventCodeWk[i] == 0))
-                    continue;
-                else
-                    throw std::runtime_error("Sequencer timestamps are not Sorted/Unique");
-            } 
-        }
+    {
+        const size_t chkEnd = converged ? std::min(pos+1, bodyLen) : bodyLen;
+        if(!mrf::seqSorted(m_timestampWk, m_eventCodeWk, wkLo, chkEnd))
+            throw std::runtime_error("Sequencer timestamps are not Sorted/Unique");
     }
 
-    if(m_eventCodeWk.size()==0 && m_timestampWk.size()==0 && m_eventMaskWk.size()==0) {
-        /* empty sequence.  Not very useful, but not an error */
-        m_eventCodeWk.push_back(0x7f);
-        m_eventMaskWk.push_back(0x0);
-        m_timestampWk.push_back(evgEndOfSeqBuf);
-    }
+    if(!converged) {
+        len = bodyLen;
 
-    if(m_timestampWk.size()!=m_eventCodeWk.size() || m_timestampWk.size()!=m_eventMaskWk.size()) {
-        throw std::logic_error("SoftSeq, length of timestamp, eventCode and eventMask don't match");
+        if(len==0) {
+            /* empty sequence.  Not very useful, but not an error */
+            m_eventCodeWk[len] = 0x7f;
+            m_eventMaskWk[len] = 0x0;
+            m_timestampWk[len] = evgEndOfSeqBuf;
+            len++;
 
-    } else if(m_timestampWk.size()>2047) {
-        throw std::runtime_error("Sequence too long (>2047)");
+        } else if(m_eventCodeWk[len-1]!=0x7f) {
+            /*
+             * If not already present append 'End of Sequence' event code(0x7f) and
+             * timestamp.
+             */
+            if(m_timestampWk[len-1]+evgEndOfSeqBuf>=0xffffffff) {
+                m_eventCodeWk[len] = 0;
+                m_timestampWk[len] = 0xffffffff;
+                m_eventMaskWk[len] = 0x0;
+                len++;
+
+                m_eventCodeWk[len] = 0x7f;
+                m_timestampWk[len] = evgEndOfSeqBuf;
+                m_eventMaskWk[len] = 0x0;
+                len++;
+            } else {
+                m_eventCodeWk[len] = 0x7f;
+                m_timestampWk[len] = m_timestampWk[len-1] + evgEndOfSeqBuf;
+                m_eventMaskWk[len] = 0x0;
+                len++;
+            }
+        }
+    }
 
-    } else if(m_eventCodeWk.back()!=0x7f) {
-        /*
-         * If not already present append 'End of Sequence' event code(0x7f) and
-         * timestamp.
-         */
-         if(m_timestampWk.back()+evgEndOfSeqBuf>=0xffffffff) {
-            m_eventCodeWk.push_back(0);
-            m_timestampWk.push_back(0xffffffff);
-            m_eventMaskWk.push_back(0x0);
-
-            m_eventCodeWk.push_back(0x7f);
-            m_timestampWk.push_back(evgEndOfSeqBuf);
-            m_eventMaskWk.push_back(0x0);
+    /*
+     * Find the range of entries which actually differ from the
+     * commited copy, and copy only these.
+     */
+    size_t ctLo = wkLo, ctHi = converged ? pos : len;
+    mrf::trimRange(ctLo, ctHi, m_timestampCt.size(),
+                   sameEntry(m_timestampWk, m_timestampCt, m_eventCodeWk, m_eventCodeCt,
+                             m_eventMaskWk, m_eventMaskCt));
+
+    m_timestampCt.resize(len);
+    m_eventCodeCt.resize(len);
+    m_eventMaskCt.resize(len);
+
+    std::copy(m_timestampWk.begin()+ctLo, m_timestampWk.begin()+ctHi, m_timestampCt.begin()+ctLo);
+    std::copy(m_eventCodeWk.begin()+ctLo, m_eventCodeWk.begin()+ctHi, m_eventCodeCt.begin()+ctLo);
+    std::copy(m_eventMaskWk.begin()+ctLo, m_eventMaskWk.begin()+ctHi, m_eventMaskCt.begin()+ctLo);
+
+    if(ctLo < ctHi) {
+        if(m_ramLo < m_ramHi) {
+            m_ramLo = std::min(m_ramLo, ctLo);
+            m_ramHi = std::max(m_ramHi, ctHi);
         } else {
-            m_eventCodeWk.push_back(0x7f);
-            m_timestampWk.push_back(m_timestampWk.back() + evgEndOfSeqBuf);
-            m_eventMaskWk.push_back(0x0);
+            m_ramLo = ctLo;
+            m_ramHi = ctHi;
         }
     }
 
-
-    m_timestampCt = m_timestampWk;
-    m_eventCodeCt = m_eventCodeWk;
-    m_eventMaskCt = m_eventMaskWk;
+    m_lenWk = len;
+    m_bodyLenWk = bodyLen;
+    m_consumedWk = consumed;
+    m_userEosWk = userEos;
+    m_validWk = true;
+    m_dirtyLo = m_dirtyHi = 0;
 
     m_trigSrcCt = m_trigSrc;
     m_runModeCt = m_runMode;
@@ -542,7 +694,8 @@ evgSoftSeq::commitSoftSeq() {
     m_isSynced = false;
 
     if(mrmEVGSeqDebug>1)
-        fprintf(stderr, "SS%u: Commit complete, need sync\n",m_id);
+        fprintf(stderr, "SS%u: Commit complete, entries [%u, %u) changed, need sync\n",
+                m_id, (unsigned)ctLo, (unsigned)ctHi);
 }
 
 void
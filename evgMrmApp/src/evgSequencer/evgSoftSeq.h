@@ -122,6 +122,15 @@ public:
     void setEventMask(epicsUInt8*, epicsUInt32);
     const std::vector<epicsUInt8>& getEventMaskCt();
 
+    /* Replace timestamps (in ticks), event codes and masks at once.
+     * Each array has 'size' entries.
+     */
+    void setSequence(const epicsUInt64*, const epicsUInt8*, const epicsUInt8*, epicsUInt32);
+    // scratch (uncommited) copy
+    const std::vector<epicsUInt64>& getTimestamp() const{return m_timestamp;}
+    const std::vector<epicsUInt8>& getEventCode() const{return m_eventCode;}
+    const std::vector<epicsUInt8>& getEventMask() const{return m_eventMask;}
+
     void setTrigSrc(SeqTrigSrc);
     SeqTrigSrc getTrigSrcCt();
 
@@ -178,10 +187,23 @@ private:
     SeqTrigSrc                 m_trigSrc;
     SeqRunMode                 m_runMode;   
 
-    // working copy of sequence
+    // range of scratch entries changed since the last commit
+    size_t                     m_dirtyLo, m_dirtyHi;
+
+    // working copy of sequence (preallocated, m_lenWk entries used)
     std::vector<epicsUInt64>   m_timestampWk;
     std::vector<epicsUInt8>    m_eventCodeWk;
     std::vector<epicsUInt8>    m_eventMaskWk;
+    // index of the first working entry produced by each scratch entry
+    std::vector<size_t>        m_startWk;
+    size_t                     m_lenWk;     // including End of Sequence
+    size_t                     m_bodyLenWk; // excluding appended End of Sequence
+    size_t                     m_consumedWk;// number of scratch entries used
+    bool                       m_userEosWk; // stopped at user provided 0x7f
+    bool                       m_validWk;   // working copy matches commited copy
+
+    // range of commited entries not yet written to the SeqRam
+    size_t                     m_ramLo, m_ramHi;
 
     // commited copy
     std::vector<epicsUInt64>   m_timestampCt;
@@ -0,0 +1,304 @@
+#include "evgTimingCfg.h"
+
+#include <stdexcept>
+#include <string.h>
+
+#include <errlog.h>
+#include <epicsInterrupt.h>
+
+#include <mrfCommonIO.h>
+#include <mrfCommon.h>
+
+#include "evgRegMap.h"
+
+evgTimingCfg::evgTimingCfg(const std::string& name, volatile epicsUInt8* const pReg):
+mrf::ObjectInst<evgTimingCfg>(name),
+m_pReg(pReg),
+m_staging(false),
+m_align(alignNone),
+m_applyStart(0.0),
+m_applyTime(0.0),
+m_applyCount(0),
+m_armed(0)
+{
+    memset(&m_applied, 0, sizeof(m_applied));
+    memset(&m_staged, 0, sizeof(m_staged));
+    memset(&m_armedNext, 0, sizeof(m_armedNext));
+    memset(&m_hw, 0, sizeof(m_hw));
+
+    callbackSetCallback(&evgTimingCfg::done_cb, &m_doneCb);
+    callbackSetPriority(priorityHigh, &m_doneCb);
+    callbackSetUser(this, &m_doneCb);
+    scanIoInit(&m_applyScan);
+    scanIoInit(&m_dirtyScan);
+}
+
+evgTimingCfg::~evgTimingCfg() {
+}
+
+void
+evgTimingCfg::readRegs(regSet& regs) const {
+    for(epicsUInt32 i = 0; i < evgNumMxc; i++) {
+        regs.mxc[i].prescaler = READ32(m_pReg, MuxPrescaler(i));
+        regs.mxc[i].polarity = (READ32(m_pReg, MuxControl(i)) & EVG_MUX_POLARITY) != 0;
+        regs.mxc[i].trigMap = READ8(m_pReg, MuxTrigMap(i));
+    }
+    regs.acDivider = READ8(m_pReg, AcTrigDivider);
+    regs.acPhase   = READ8(m_pReg, AcTrigPhase);
+    regs.acControl = READ8(m_pReg, AcTrigControl);
+    regs.acTrigMap = READ8(m_pReg, AcTrigEvtMap);
+}
+
+/* Also called from ISR context.  Only register access here. */
+void
+evgTimingCfg::writeRegs(volatile epicsUInt8* pReg, const regSet& next, const regSet& prev) {
+    for(epicsUInt32 i = 0; i < evgNumMxc; i++) {
+        const mxcRegs& n = next.mxc[i];
+        const mxcRegs& p = prev.mxc[i];
+
+        if(n.prescaler != p.prescaler)
+            WRITE32(pReg, MuxPrescaler(i), n.prescaler);
+        if(n.polarity != p.polarity) {
+            if(n.polarity)
+                BITSET32(pReg, MuxControl(i), EVG_MUX_POLARITY);
+            else
+                BITCLR32(pReg, MuxControl(i), EVG_MUX_POLARITY);
+        }
+        if(n.trigMap != p.trigMap)
+            WRITE8(pReg, MuxTrigMap(i), n.trigMap);
+    }
+
+    if(next.acDivider != prev.acDivider)
+        WRITE8(pReg, AcTrigDivider, next.acDivider);
+    if(next.acPhase != prev.acPhase)
+        WRITE8(pReg, AcTrigPhase, next.acPhase);
+    if(next.acControl != prev.acControl)
+        WRITE8(pReg, AcTrigControl, next.acControl);
+    if(next.acTrigMap != prev.acTrigMap)
+        WRITE8(pReg, AcTrigEvtMap, next.acTrigMap);
+}
+
+/* Also called from ISR context */
+void
+evgTimingCfg::writeHw(const regSet& next) {
+    writeRegs(m_pReg, next, m_hw);
+    m_hw = next;
+}
+
+epicsUInt32
+evgTimingCfg::countDiff(const regSet& next, const regSet& prev) {
+    epicsUInt32 n = 0;
+    for(epicsUInt32 i = 0; i < evgNumMxc; i++) {
+        n += next.mxc[i].prescaler != prev.mxc[i].prescaler;
+        n += next.mxc[i].polarity != prev.mxc[i].polarity;
+        n += next.mxc[i].trigMap != prev.mxc[i].trigMap;
+    }
+    n += next.acDivider != prev.acDivider;
+    n += next.acPhase != prev.acPhase;
+    n += next.acControl != prev.acControl;
+    n += next.acTrigMap != prev.acTrigMap;
+    return n;
+}
+
+void
+evgTimingCfg::setStaging(bool ena) {
+    SCOPED_LOCK(m_lock);
+    if(ena == m_staging)
+        return;
+
+    if(ena) {
+        readRegs(m_applied);
+        m_staged = m_applied;
+        interruptLock I;
+        m_hw = m_applied;
+    } else {
+        interruptLock I;
+        if(m_armed)
+            errlogPrintf("%s: Pending configuration discarded\n", name().c_str());
+        m_armed = 0;
+    }
+    m_staging = ena;
+    scanIoRequest(m_dirtyScan);
+}
+
+bool
+evgTimingCfg::staging() const {
+    SCOPED_LOCK(m_lock);
+    return m_staging;
+}
+
+void
+evgTimingCfg::setAlign(epicsUInt16 align) {
+    if(align > alignSeqRam1)
+        throw std::out_of_range("Invalid timing configuration alignment");
+    SCOPED_LOCK(m_lock);
+    m_align = align;
+}
+
+epicsUInt16
+evgTimingCfg::getAlign() const {
+    SCOPED_LOCK(m_lock);
+    return m_align;
+}
+
+void
+evgTimingCfg::apply(bool) {
+    SCOPED_LOCK(m_lock);
+    if(!m_staging)
+        throw std::runtime_error("Timing configuration staging not enabled");
+
+    m_applyStart = mrfMonotonicSeconds();
+
+    if(m_align == alignNone) {
+        {
+            interruptLock I;
+            m_armed = 0; // replaces any pending apply
+            writeHw(m_staged);
+        }
+        m_applied = m_staged;
+        m_applyTime = mrfMonotonicSeconds() - m_applyStart;
+        m_applyCount++;
+        scanIoRequest(m_applyScan);
+
+    } else {
+        // Replaces any pending apply.  The ISR writes what differs from
+        // the hardware, which is not changed until then.
+        interruptLock I;
+        m_armedNext = m_staged;
+        m_armed = EVG_IRQ_START_RAM(m_align - alignSeqRam0);
+        m_applied = m_staged;
+    }
+    scanIoRequest(m_dirtyScan);
+}
+
+bool
+evgTimingCfg::pending() const {
+    SCOPED_LOCK(m_lock);
+    return m_armed != 0;
+}
+
+epicsUInt32
+evgTimingCfg::dirty() const {
+    SCOPED_LOCK(m_lock);
+    return m_staging ? countDiff(m_staged, m_applied) : 0;
+}
+
+double
+evgTimingCfg::applyTime() const {
+    SCOPED_LOCK(m_lock);
+    return m_applyTime;
+}
+
+epicsUInt32
+evgTimingCfg::applyCount() const {
+    SCOPED_LOCK(m_lock);
+    return m_applyCount;
+}
+
+bool
+evgTimingCfg::stageMxcPolarity(epicsUInt32 id, bool polarity) {
+    SCOPED_LOCK(m_lock);
+    if(!m_staging)
+        return false;
+    m_staged.mxc[id].polarity = polarity;
+    scanIoRequest(m_dirtyScan);
+    return true;
+}
+
+bool
+evgTimingCfg::stageMxcPrescaler(epicsUInt32 id, epicsUInt32 preScaler) {
+    SCOPED_LOCK(m_lock);
+    if(!m_staging)
+        return false;
+    m_staged.mxc[id].prescaler = preScaler;
+    scanIoRequest(m_dirtyScan);
+    return true;
+}
+
+bool
+evgTimingCfg::stageMxcTrigMap(epicsUInt32 id, epicsUInt16 trigEvt, bool ena) {
+    SCOPED_LOCK(m_lock);
+    if(!m_staging)
+        return false;
+    epicsUInt8 mask = 1 << trigEvt;
+    if(ena)
+        m_staged.mxc[id].trigMap |= mask;
+    else
+        m_staged.mxc[id].trigMap &= ~mask;
+    scanIoRequest(m_dirtyScan);
+    return true;
+}
+
+bool
+evgTimingCfg::stageAcDivider(epicsUInt8 divider) {
+    SCOPED_LOCK(m_lock);
+    if(!m_staging)
+        return false;
+    m_staged.acDivider = divider;
+    scanIoRequest(m_dirtyScan);
+    return true;
+}
+
+bool
+evgTimingCfg::stageAcPhase(epicsUInt8 phase) {
+    SCOPED_LOCK(m_lock);
+    if(!m_staging)
+        return false;
+    m_staged.acPhase = phase;
+    scanIoRequest(m_dirtyScan);
+    return true;
+}
+
+bool
+evgTimingCfg::stageAcControl(epicsUInt8 mask, epicsUInt8 val) {
+    SCOPED_LOCK(m_lock);
+    if(!m_staging)
+        return false;
+    m_staged.acControl = (m_staged.acControl & ~mask) | (val & mask);
+    scanIoRequest(m_dirtyScan);
+    return true;
+}
+
+bool
+evgTimingCfg::stageAcTrigMap(epicsUInt16 trigEvt, bool ena) {
+    SCOPED_LOCK(m_lock);
+    if(!m_staging)
+        return false;
+    epicsUInt8 mask = 1 << trigEvt;
+    if(ena)
+        m_staged.acTrigMap |= mask;
+    else
+        m_staged.acTrigMap &= ~mask;
+    scanIoRequest(m_dirtyScan);
+    return true;
+}
+
+void
+evgTimingCfg::isr(epicsUInt32 active) {
+    interruptLock I;
+    if(!(m_armed & active))
+        return;
+
+    writeHw(m_armedNext);
+    m_armed = 0;
+    callbackRequest(&m_doneCb);
+}
+
+void
+evgTimingCfg::done_cb(CALLBACK* pCallback) {
+    void* pVoid;
+    callbackGetUser(pVoid, pCallback);
+    evgTimingCfg* cfg = (evgTimingCfg*)pVoid;
+
+    cfg->done();
+}
+
+void
+evgTimingCfg::done() {
+    {
+        SCOPED_LOCK(m_lock);
+        m_applyTime = mrfMonotonicSeconds() - m_applyStart;
+        m_applyCount++;
+    }
+    scanIoRequest(m_applyScan);
+}
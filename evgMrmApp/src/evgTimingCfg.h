@@ -0,0 +1,121 @@
+#ifndef EVG_TIMING_CFG_H
+#define EVG_TIMING_CFG_H
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <callback.h>
+#include <dbScan.h>
+
+#include "mrf/object.h"
+
+#define evgNumMxc 8
+
+/**
+ * Staged configuration of the multiplexed counters and the AC trigger.
+ *
+ * While staging is enabled, writes through evgMxc and evgAcTrig go to
+ * a copy in memory instead of the hardware.  The copy starts as a
+ * snapshot of the hardware.  apply() then writes the registers which
+ * differ from the snapshot in one locked burst.  The burst is done
+ * immediately, or from the ISR on the next start of a sequence RAM.
+ *
+ * Values are validated by the evgMxc/evgAcTrig setters before being
+ * staged.
+ */
+class evgTimingCfg : public mrf::ObjectInst<evgTimingCfg> {
+public:
+    evgTimingCfg(const std::string&, volatile epicsUInt8* const);
+    ~evgTimingCfg();
+
+    /* locking done internally */
+    virtual void lock() const{};
+    virtual void unlock() const{};
+
+    enum align_t {
+        alignNone=0,     // write immediately
+        alignSeqRam0=1,  // on start of sequence RAM 0
+        alignSeqRam1=2   // on start of sequence RAM 1
+    };
+
+    //! Enable staging.  Disabling discards anything not applied.
+    void setStaging(bool);
+    bool staging() const;
+
+    void setAlign(epicsUInt16);
+    epicsUInt16 getAlign() const;
+
+    //! Write staged changes (or arm for the ISR)
+    void apply(bool);
+    //! An aligned apply is waiting for the ISR
+    bool pending() const;
+    //! Number of staged, not applied, registers
+    epicsUInt32 dirty() const;
+    IOSCANPVT dirtyChanged() const{return m_dirtyScan;}
+
+    //! Time from apply() until the registers were written.  Units of sec.
+    double applyTime() const;
+    epicsUInt32 applyCount() const;
+    IOSCANPVT applyChanged() const{return m_applyScan;}
+
+    /* Called by the sub-unit setters.
+     * @returns false if not staging, and the caller should write the register.
+     */
+    bool stageMxcPolarity(epicsUInt32 id, bool);
+    bool stageMxcPrescaler(epicsUInt32 id, epicsUInt32);
+    bool stageMxcTrigMap(epicsUInt32 id, epicsUInt16 trigEvt, bool);
+    bool stageAcDivider(epicsUInt8);
+    bool stageAcPhase(epicsUInt8);
+    bool stageAcControl(epicsUInt8 mask, epicsUInt8 val);
+    bool stageAcTrigMap(epicsUInt16 trigEvt, bool);
+
+    //! Called from evgMrm::isr() with the active interrupts
+    void isr(epicsUInt32 active);
+
+private:
+    struct mxcRegs {
+        epicsUInt32 prescaler;
+        bool        polarity;
+        epicsUInt8  trigMap;
+    };
+    struct regSet {
+        mxcRegs    mxc[evgNumMxc];
+        epicsUInt8 acDivider;
+        epicsUInt8 acPhase;
+        epicsUInt8 acControl;
+        epicsUInt8 acTrigMap;
+    };
+
+    void readRegs(regSet&) const;
+    //! Write the registers of 'next' which differ from 'prev'
+    static void writeRegs(volatile epicsUInt8*, const regSet& next, const regSet& prev);
+    //! Write 'next' and update m_hw.  Call with interruptLock.
+    void writeHw(const regSet& next);
+    static epicsUInt32 countDiff(const regSet& next, const regSet& prev);
+
+    void done();
+    static void done_cb(CALLBACK*);
+
+    volatile epicsUInt8* const m_pReg;
+
+    mutable epicsMutex m_lock;
+
+    // Guarded by m_lock
+    bool        m_staging;
+    epicsUInt16 m_align;
+    regSet      m_applied; // as of the snapshot or last apply, maybe armed and not written yet
+    regSet      m_staged;
+    double      m_applyStart;
+    double      m_applyTime;
+    epicsUInt32 m_applyCount;
+
+    // Guarded by m_lock and interruptLock.  Used by the ISR.
+    epicsUInt32 m_armed;   // interrupt bit which triggers the write
+    regSet      m_armedNext;
+    regSet      m_hw;      // hardware, as of the snapshot or last write
+
+    CALLBACK    m_doneCb;
+    IOSCANPVT   m_applyScan;
+    IOSCANPVT   m_dirtyScan;
+};
+
+#endif // EVG_TIMING_CFG_H
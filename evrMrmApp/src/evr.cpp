@@ -35,8 +35,10 @@ OBJECT_BEGIN(EVRMRM) {
     OBJECT_PROP1("Receive Error Count", &EVRMRM::linkChanged);
 
     OBJECT_PROP1("FIFO Overflow Count", &EVRMRM::FIFOFullCount);
+    OBJECT_PROP1("FIFO Overflow Count", &EVRMRM::FIFOFullChanged);
 
     OBJECT_PROP1("FIFO Over rate", &EVRMRM::FIFOOverRate);
+    OBJECT_PROP1("FIFO Over rate", &EVRMRM::FIFOOverRateChanged);
     OBJECT_PROP1("FIFO Event Count", &EVRMRM::FIFOEvtCount);
     OBJECT_PROP1("FIFO Loop Count", &EVRMRM::FIFOLoopCount);
 
@@ -65,14 +67,19 @@ OBJECT_BEGIN(EVRMRM) {
     OBJECT_PROP1("Topology ID", &EVRMRM::getTopologyId);
 
     OBJECT_PROP1("CG Lock Status", &EVRMRM::cgLocked);
+    OBJECT_PROP1("CG Lock Status", &EVRMRM::cgLockedChanged);
     OBJECT_PROP1("PLL Lock Status", &EVRMRM::pllLocked);
+    OBJECT_PROP1("PLL Lock Status", &EVRMRM::pllLockedChanged);
     OBJECT_PROP2("PLL Bandwidth", &EVRMRM::pllBandwidthRaw, &EVRMRM::setPllBandwidthRaw);
     OBJECT_PROP2("Event Clock Mode", &EVRMRM::evtClkModeRaw, &EVRMRM::setEvtClkModeRaw);
 
     OBJECT_PROP1("Interrupt Count", &EVRMRM::irqCount);
 
     OBJECT_PROP1("Link Status", &EVRMRM::linkStatus);
-    OBJECT_PROP1("Link Status", &EVRMRM::linkChanged);
+    OBJECT_PROP1("Link Status", &EVRMRM::linkStatusChanged);
+
+    OBJECT_PROP1("Health Reason", &EVRMRM::healthReason);
+    OBJECT_PROP1("Health Reason", &EVRMRM::healthReasonChanged);
 
     OBJECT_PROP1("Timestamp Valid", &EVRMRM::TimeStampValid);
     OBJECT_PROP1("Timestamp Valid", &EVRMRM::TimeStampValidEvent);
@@ -196,6 +203,9 @@ OBJECT_BEGIN(EvrCML) {
     OBJECT_PROP2("Pat Low", &EvrCML::getPattern<EvrCML::patternLow>,
                             &EvrCML::setPattern<EvrCML::patternLow>);
 
+    OBJECT_PROP1("Upload Time", &EvrCML::uploadTime);
+    OBJECT_PROP1("Upload Words", &EvrCML::uploadWords);
+
 } OBJECT_END(EvrCML)
 
 OBJECT_BEGIN(EvrDelayModule) {
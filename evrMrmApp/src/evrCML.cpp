@@ -11,8 +11,11 @@
 #define NOMINMAX
 #include <stdexcept>
 #include <algorithm>
+#include <cstring>
 
 #include <epicsMath.h>
+#include <epicsEndian.h>
+#include <mrfCommon.h>
 
 #define epicsExportSharedSymbols
 #include <mrfCommonIO.h>
@@ -23,6 +26,50 @@
 #include "evrMrm.h"
 #include "evrCML.h"
 
+/* Pack 8 bytes of a bit waveform (one bit per byte, non-zero is set)
+ * into one byte with the first byte as MSB.
+ *
+ * Done with 64-bit arithmetic instead of a loop over the bits.
+ * Each byte is first reduced to 0/1, then a single multiply
+ * gathers the 8 LSBs into the top byte.
+ */
+static inline
+epicsUInt32 packByte(const unsigned char *buf)
+{
+    epicsUInt64 x;
+    memcpy(&x, buf, sizeof(x));
+
+    // non-zero byte -> 1
+    x |= x>>4;
+    x |= x>>2;
+    x |= x>>1;
+    x &= 0x0101010101010101ULL;
+
+#if EPICS_BYTE_ORDER == EPICS_ENDIAN_LITTLE
+    return (epicsUInt32)((x * 0x8040201008040201ULL) >> 56);
+#else
+    return (epicsUInt32)((x * 0x0102040810204080ULL) >> 56);
+#endif
+}
+
+/* Pack 'nbits' (at most 64) bytes of a bit waveform into an integer.
+ * The first byte becomes the most significant bit.
+ */
+static
+epicsUInt64 packBits(const unsigned char *buf, epicsUInt32 nbits)
+{
+    epicsUInt64 val=0;
+    epicsUInt32 i=0;
+
+    for(; i+8<=nbits; i+=8)
+        val = (val<<8) | packByte(buf+i);
+
+    for(; i<nbits; i++)
+        val = (val<<1) | (buf[i] ? 1 : 0);
+
+    return val;
+}
+
 EvrCML::EvrCML(const std::string& n, size_t i, EVRMRM& o, outkind k)
   :mrf::ObjectInst<EvrCML>(n)
   ,base(o.base)
@@ -30,6 +77,8 @@ EvrCML::EvrCML(const std::string& n, size_t i, EVRMRM& o, outkind k)
   ,owner(o)
   ,shadowEnable(0)
   ,shadowWaveformlength(0)
+  ,lastUploadTime(0.0)
+  ,lastUploadWords(0)
   ,kind(k)
   ,deviceInfo(o.getDeviceInfo())
 {
@@ -59,6 +108,10 @@ EvrCML::EvrCML(const std::string& n, size_t i, EVRMRM& o, outkind k)
         std::fill(shadowPattern[i], shadowPattern[i]+L, 0);
     }
 
+    // Content of the pattern RAM is unknown until first written
+    uploadedPattern.resize(wordlen * OutputCMLPatLengthMax, 0);
+    uploadedValid.resize(wordlen * OutputCMLPatLengthMax, false);
+
     shadowEnable=val;
 }
 
@@ -408,26 +461,16 @@ EvrCML::setPattern(pattern p, const unsigned char *buf, epicsUInt32 blen)
         throw std::out_of_range("Pattern is too long");
 
 
-    epicsUInt32 val=0;
-    for(epicsUInt32 i=0; i<blen; i++) {
-        size_t cmlword = (i/mult);
-        size_t cmlbit  = (i%mult);
-        size_t cpuword, cpubit;
+    // Pack one CML word (20 or 40 bits) at a time
+    for(epicsUInt32 cmlword=0; cmlword<blen/mult; cmlword++) {
+        epicsUInt64 val=packBits(buf+cmlword*mult, mult);
+
         if(mult<32) {
-            cpuword = cmlword;
-            cpubit = 19 - cmlbit;
+            shadowPattern[p][cmlword] = (epicsUInt32)val;
         } else {
-            cpuword = 2*cmlword + (cmlbit<8 ? 0 : 1);
-            cpubit  = cmlbit<8 ? 7-cmlbit : 31-(cmlbit-8);
-        }
-
-        val|=(!!buf[i])<<cpubit;
-
-        // cpubit is counting down.
-        // write complete dword after the last bit is set
-        if(cpubit==0) {
-            shadowPattern[p][cpuword] = val;
-            val=0;
+            // first 8 bits in the first dword, remaining 32 in the second
+            shadowPattern[p][2*cmlword]   = (epicsUInt32)(val>>32);
+            shadowPattern[p][2*cmlword+1] = (epicsUInt32)val;
         }
     }
 
@@ -449,6 +492,22 @@ EvrCML::setPattern(pattern p, const unsigned char *buf, epicsUInt32 blen)
         enable(true);
 }
 
+/* Write one word of pattern RAM.
+ * Skipped if the hardware is known to already hold this value.
+ @returns 1 if the word was written, 0 otherwise
+ */
+epicsUInt32
+EvrCML::writePatWord(size_t i, epicsUInt32 val)
+{
+    if(uploadedValid[i] && uploadedPattern[i]==val)
+        return 0;
+
+    WRITE32(base, OutputCMLPat(N, i), val);
+    uploadedPattern[i]=val;
+    uploadedValid[i]=true;
+    return 1;
+}
+
 void
 EvrCML::syncPattern(pattern p)
 {
@@ -473,28 +532,31 @@ EvrCML::syncPattern(pattern p)
     if(curmode==cmlModeFreq)
         return; // Don't know which pattern to sync...
 
+    double start = mrfMonotonicSeconds();
+    epicsUInt32 nwritten=0;
+
     switch(curmode) {
     case cmlModeOrig:
 
         switch(p) {
         case patternLow:
-            WRITE32(base, OutputCMLPat(N, 0), shadowPattern[patternLow][0]);
-            WRITE32(base, OutputCMLPat(N, 1), shadowPattern[patternLow][1]);
+            nwritten += writePatWord(0, shadowPattern[patternLow][0]);
+            nwritten += writePatWord(1, shadowPattern[patternLow][1]);
             break;
 
         case patternRise:
-            WRITE32(base, OutputCMLPat(N, 2), shadowPattern[patternRise][0]);
-            WRITE32(base, OutputCMLPat(N, 3), shadowPattern[patternRise][1]);
+            nwritten += writePatWord(2, shadowPattern[patternRise][0]);
+            nwritten += writePatWord(3, shadowPattern[patternRise][1]);
             break;
 
         case patternFall:
-            WRITE32(base, OutputCMLPat(N, 4), shadowPattern[patternFall][0]);
-            WRITE32(base, OutputCMLPat(N, 5), shadowPattern[patternFall][1]);
+            nwritten += writePatWord(4, shadowPattern[patternFall][0]);
+            nwritten += writePatWord(5, shadowPattern[patternFall][1]);
             break;
 
         case patternHigh:
-            WRITE32(base, OutputCMLPat(N, 6), shadowPattern[patternHigh][0]);
-            WRITE32(base, OutputCMLPat(N, 7), shadowPattern[patternHigh][1]);
+            nwritten += writePatWord(6, shadowPattern[patternHigh][0]);
+            nwritten += writePatWord(7, shadowPattern[patternHigh][1]);
             break;
 
         case patternWaveform:
@@ -506,7 +568,7 @@ EvrCML::syncPattern(pattern p)
         switch(p) {
         case patternWaveform:
             for(size_t i=0; i<shadowWaveformlength*wordlen; i++)
-                WRITE32(base, OutputCMLPat(N, i), shadowPattern[patternWaveform][i]);
+                nwritten += writePatWord(i, shadowPattern[patternWaveform][i]);
             break;
         default:
             break; // not safe to sync
@@ -517,4 +579,7 @@ EvrCML::syncPattern(pattern p)
     default:
         throw std::logic_error("syncPattern: invalid state 40");
     }
+
+    lastUploadTime = mrfMonotonicSeconds() - start;
+    lastUploadWords = nwritten;
 }
@@ -11,6 +11,8 @@
 #ifndef EVRCML_H_INC
 #define EVRCML_H_INC
 
+#include <vector>
+
 #include "mrf/object.h"
 #include <epicsTypes.h>
 
@@ -115,6 +117,11 @@ public:
     void setModRaw(epicsUInt16 r){setMode((cmlMode)r);};
     epicsUInt16 modeRaw() const{return (epicsUInt16)mode();};
 
+    //! Duration of the last pattern upload.  Units of sec
+    double uploadTime() const{return lastUploadTime;}
+    //! Number of pattern RAM words written by the last upload
+    epicsUInt32 uploadWords() const{return lastUploadWords;}
+
 private:
 
     epicsUInt32 mult, wordlen;
@@ -127,7 +134,16 @@ private:
     epicsUInt32 *shadowPattern[5]; // 5 is wavefrom + 4x pattern
     epicsUInt32  shadowWaveformlength;
 
+    // Last value written to each word of the pattern RAM
+    std::vector<epicsUInt32> uploadedPattern;
+    // Is the uploadedPattern entry known to match the hardware
+    std::vector<bool> uploadedValid;
+
+    double lastUploadTime;
+    epicsUInt32 lastUploadWords;
+
     void syncPattern(pattern);
+    epicsUInt32 writePatWord(size_t i, epicsUInt32 val);
 
     outkind kind;
     mrmDeviceInfo* deviceInfo;
@@ -15,6 +15,8 @@
 #include <stdexcept>
 #include <sstream>
 #include <map>
+#include <memory>
+#include <vector>
 
 #include <epicsString.h>
 #include <drvSup.h>
@@ -32,6 +34,7 @@
 #include "mrfcsr.h"
 #include "mrfpci.h"
 #include "mrmDeviceInfo.h"
+#include "mrmDeferredSetup.h"
 
 // for htons() et al.
 #ifdef _WIN32
@@ -327,6 +330,10 @@ mrmEvrSetupPCI(const char* id,      // Card Identifier
     volatile epicsUInt8 *plx = 0, *evr = 0; // base addressed for plx/evr bar
 
     try {
+        // Cards may be set up concurrently, see mrmSetupDeferred.
+        // The ID check and the registration of the object are atomic.
+        SCOPED_LOCK2(mrmDeferredSetup::busLock(), busGuard);
+
         epicsPrintf("Checking if card %s is already in use\n", id);
         if(mrf::Object::getObject(id)){
             errlogPrintf("Object ID %s already in use\n",id);
@@ -510,6 +517,9 @@ mrmEvrSetupPCI(const char* id,      // Card Identifier
 
         // Install ISR
 
+        // before the threads of the card start
+        mrmThreadTopology::setPCIDevice(id, o, b, d, f);
+
         EVRMRM *receiver=new EVRMRM(id,*deviceInfo,evr, NULL);
 
         void *arg=receiver;
@@ -519,6 +529,11 @@ mrmEvrSetupPCI(const char* id,      // Card Identifier
             epicsPrintf("Not connecting interrupts.\n");
         }
         else {
+            // kernel module interface version 2 records IRQFlag and the time of each interrupt
+            receiver->irqStats = mrmIrqStats::create(std::string(id)+":IRQ", o, b, d, f);
+            // interface version 3 can empty the event FIFO in the interrupt handler
+            receiver->fifoRing = mrmEvtFifoRing::create(std::string(id)+":FIFORING", o, b, d, f);
+
             if(devPCIConnectInterrupt(cur, &EVRMRM::isr_pci, arg, 0)){
                 errlogPrintf("Failed to install ISR\n");
                 delete receiver;
@@ -603,6 +618,18 @@ startSFPUpdate(mrf::Object* obj, void*)
     return true;
 }
 
+static bool
+startStatusPoll(mrf::Object* obj, void*)
+{
+    EVRMRM *mrm=dynamic_cast<EVRMRM*>(obj);
+    if(!mrm)
+        return true;
+
+    mrm->startStatusPoll();
+
+    return true;
+}
+
 static
 void inithooks(initHookState state)
 {
@@ -634,6 +661,7 @@ void inithooks(initHookState state)
      */
     case initHookAfterCallbackInit:
         mrf::Object::visitObjects(&startSFPUpdate, 0);
+        mrf::Object::visitObjects(&startStatusPoll, 0);
         break;
 
   default:
@@ -656,16 +684,33 @@ static const iocshArg * const mrmEvrSetupPCIArgs[6] ={&mrmEvrSetupPCIArg0,
                                                       &mrmEvrSetupPCIArg4,
                                                       &mrmEvrSetupPCIArg5};
 static const iocshFuncDef mrmEvrSetupPCIFuncDef = {"mrmEvrSetupPCI", 6, mrmEvrSetupPCIArgs};
+
+namespace {
+struct evrSetupPCIJob : public mrmDeferredSetup::Job {
+    int o, b, d, f;
+    bool ignoreVersion;
+    evrSetupPCIJob(const char *id, int o, int b, int d, int f, bool ignoreVersion)
+        :mrmDeferredSetup::Job(id), o(o), b(b), d(d), f(f), ignoreVersion(ignoreVersion)
+    {}
+    virtual int setup() {
+        return mrmEvrSetupPCI(card.c_str(), o, b, d, f, ignoreVersion);
+    }
+};
+}
+
 static void mrmEvrSetupPCICallFunc(const iocshArgBuf *args)
 {
-    // check the 'ignore' parameter
-    if(args[5].aval.ac > 1 && (strcmp("true", args[5].aval.av[1]) == 0 ||
-                               strtol(args[5].aval.av[1], NULL, 10) != 0)){
-        mrmEvrSetupPCI(args[0].sval,args[1].ival,args[2].ival,args[3].ival,args[4].ival, true);
-    }
-    else {
-        mrmEvrSetupPCI(args[0].sval,args[1].ival,args[2].ival,args[3].ival,args[4].ival, false);
+    if(!args[0].sval) {
+        errlogPrintf("mrmEvrSetupPCI: missing device name\n");
+        return;
     }
+
+    // check the 'ignore' parameter
+    bool ignoreVersion = args[5].aval.ac > 1 && (strcmp("true", args[5].aval.av[1]) == 0 ||
+                                                 strtol(args[5].aval.av[1], NULL, 10) != 0);
+
+    mrmDeferredSetup::submit(new evrSetupPCIJob(args[0].sval,args[1].ival,args[2].ival,args[3].ival,args[4].ival,
+                                                ignoreVersion));
 }
 
 extern "C"
@@ -1196,6 +1241,103 @@ static void mrmEvrEnableSoftEventFunc(const iocshArgBuf *args) {
 }
 
 
+/********** Simulated event FIFO ring  *******/
+
+namespace {
+struct fifoRingSim {
+    EVRMRM *card;
+    mrmEvtFifoRing *ring;
+    std::vector<epicsUInt8> codes;
+    unsigned count;
+    double period;
+};
+
+void fifoRingSimRun(void *raw)
+{
+    fifoRingSim *sim = static_cast<fifoRingSim*>(raw);
+
+    for(unsigned i=0; i<sim->count; i++) {
+        epicsTimeStamp now;
+        epicsTimeGetCurrent(&now);
+
+        sim->ring->produce(sim->codes[i%sim->codes.size()], now.secPastEpoch, i);
+        sim->card->notifyFifoRing();
+
+        if(sim->period>0.0)
+            epicsThreadSleep(sim->period);
+    }
+
+    epicsPrintf("%s: %u simulated events produced\n", sim->ring->name().c_str(), sim->count);
+    delete sim;
+}
+}
+
+/* Attach a ring filled by a thread in the same way as the kernel module does,
+ * to exercise the event FIFO ring consumer without it.
+ */
+extern "C"
+void mrmEvrFifoRingSim(const char* id, const char* codes, int count, double period)
+{
+    try {
+        if(!id || !codes || count<=0)
+            throw std::runtime_error("Usage: mrmEvrFifoRingSim <EVR> \"<code>[,<code>...]\" <count> <period>");
+
+        mrf::Object *obj = mrf::Object::getObject(id);
+        EVRMRM *card = obj ? dynamic_cast<EVRMRM*>(obj) : NULL;
+        if(!card)
+            throw std::runtime_error(std::string("Unknown EVR '")+id+"'");
+
+        std::auto_ptr<fifoRingSim> sim(new fifoRingSim);
+        sim->card = card;
+        sim->count = count;
+        sim->period = period;
+
+        std::istringstream strm(codes);
+        std::string tok;
+        while(std::getline(strm, tok, ',')) {
+            unsigned long code = strtoul(tok.c_str(), NULL, 0);
+            if(code==0 || code>255)
+                throw std::runtime_error("Invalid event code '"+tok+"'");
+            sim->codes.push_back(code);
+        }
+        if(sim->codes.empty())
+            throw std::runtime_error("No event codes");
+
+        if(card->fifoRing)
+            throw std::runtime_error(std::string(id)+" already has an event FIFO ring");
+
+        sim->ring = mrmEvtFifoRing::createSim(std::string(id)+":FIFORING");
+        try {
+            card->attachSimFifoRing(sim->ring);
+        } catch(...) {
+            delete sim->ring;
+            throw;
+        }
+
+        epicsThreadMustCreate("EVRFIFOSIM", epicsThreadPriorityMedium,
+                              epicsThreadGetStackSize(epicsThreadStackSmall),
+                              &fifoRingSimRun, sim.get());
+        sim.release();
+
+    } catch(std::exception& e) {
+        errlogPrintf("Error: %s\n", e.what());
+    }
+}
+
+static const iocshArg mrmEvrFifoRingSimArg0 = { "Device_name", iocshArgString };
+static const iocshArg mrmEvrFifoRingSimArg1 = { "Event_codes", iocshArgString };
+static const iocshArg mrmEvrFifoRingSimArg2 = { "Count", iocshArgInt };
+static const iocshArg mrmEvrFifoRingSimArg3 = { "Period", iocshArgDouble };
+
+static const iocshArg * const mrmEvrFifoRingSimArgs[4] = { &mrmEvrFifoRingSimArg0, &mrmEvrFifoRingSimArg1,
+                                                            &mrmEvrFifoRingSimArg2, &mrmEvrFifoRingSimArg3 };
+static const iocshFuncDef mrmEvrFifoRingSimFuncDef = { "mrmEvrFifoRingSim", 4, mrmEvrFifoRingSimArgs };
+
+static void mrmEvrFifoRingSimFunc(const iocshArgBuf *args) {
+    mrmEvrFifoRingSim(args[0].sval, args[1].sval, args[2].ival, args[3].dval);
+}
+
+
 /********** Create embedded EVR on EVG  *******/
 
 static const iocshArg mrmEvrSetupEmbeddedArg0 = { "Device name", iocshArgString };
@@ -1271,6 +1413,7 @@ void mrmsetupreg()
     iocshRegister(&mrmEvrReadFuncDef, mrmEvrReadFunc);
     iocshRegister(&mrmEvrPrintSoftEventFuncDef, mrmEvrPrintSoftEventFunc);
     iocshRegister(&mrmEvrEnableSoftEventFuncDef, mrmEvrEnableSoftEventFunc);
+    iocshRegister(&mrmEvrFifoRingSimFuncDef, mrmEvrFifoRingSimFunc);
 }
 
 
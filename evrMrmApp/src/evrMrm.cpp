@@ -34,6 +34,8 @@
 
 #include "evrIocsh.h"
 #include "evrMrm.h"
+#include "evrSoftEventLatency.h"
+#include "evrPulseHistory.h"
 #include "mrmShared.h"
 
 #include "support/util.h"
@@ -94,8 +96,21 @@ extern "C" {
     double mrmEvrFIFOPeriod = 1.0/ 1000.0; /* 1/rate in Hz */
 
     epicsExportAddress(double,mrmEvrFIFOPeriod);
+
+    /* Interval between polls of link/PLL status and FIFO
+     * error counters.  Records using these with SCAN="I/O Intr"
+     * are only processed when a value changes.
+     *
+     * Set to 0.0 to disable
+     */
+    double mrmEvrStatusPeriod = 1.0; /* sec */
+
+    epicsExportAddress(double,mrmEvrStatusPeriod);
 }
 
+/* Time an increase of an error counter is reported as health reason */
+#define HEALTH_HOLD 10.0 /* sec */
+
 /* Number of good updates before the time is considered valid */
 #define TSValidThreshold 5
 
@@ -122,6 +137,8 @@ EVRMRM::EVRMRM(const std::string& n,
                volatile epicsUInt8* evgBase)
   :mrf::ObjectInst<EVRMRM>(n)
   ,evrLock()
+  ,irqStats(NULL)
+  ,fifoRing(NULL)
   ,id(n)
   ,base(b)
   ,evgBaseAddress(evgBase)
@@ -138,6 +155,7 @@ EVRMRM::EVRMRM(const std::string& n,
   ,pulsers()
   ,shortcmls()
   ,gpio_(*this)
+  ,isrStats(NULL)
   ,drain_fifo_method(*this)
   ,drain_fifo_task(drain_fifo_method, "EVRFIFO",
                    epicsThreadGetStackSize(epicsThreadStackBig),
@@ -157,6 +175,8 @@ EVRMRM::EVRMRM(const std::string& n,
   ,m_dataBuffer_300(NULL)
   ,m_dataBufferObj_230(NULL)
   ,m_dataBufferObj_300(NULL)
+  ,m_latency(NULL)
+  ,m_history(NULL)
 {
 try{
 
@@ -181,6 +201,7 @@ try{
 
     CBINIT(&drain_log_cb   , priorityMedium, &EVRMRM::drain_log , this);
     CBINIT(&poll_link_cb   , priorityMedium, &EVRMRM::poll_link , this);
+    CBINIT(&poll_status_cb , priorityLow,    &EVRMRM::poll_status , this);
 
     /*
      * Create subunit instances
@@ -456,6 +477,11 @@ EVRMRM::cleanup()
     drain_fifo_wakeup.send(&wakeup, sizeof(wakeup));
     drain_fifo_task.exitWait();
 
+    delete fifoRing;
+    fifoRing = NULL;
+    delete isrStats;
+    isrStats = NULL;
+
     for(outputs_t::iterator it=outputs.begin();
         it!=outputs.end(); ++it)
     {
@@ -469,6 +495,8 @@ EVRMRM::cleanup()
     if(m_remoteFlash != NULL) {
         delete m_remoteFlash;
     }
+    delete irqStats;
+    irqStats = NULL;
     delete m_dataBufferObj_230;
     delete m_dataBufferObj_300;
     delete m_dataBuffer_230;
@@ -736,7 +764,7 @@ EVRMRM::clockSet(double freq)
 
     freq/=1e6;
 
-    epicsUInt32 newfrac=FracSynthControlWord(
+    epicsUInt32 newfrac=FracSynthSolve(
                         freq, fracref, 0, &err);
 
     if(newfrac==0)
@@ -1236,14 +1264,35 @@ void EVRMRM::enableSoftEvent(epicsUInt8 evtCode)
 void
 EVRMRM::isr_pci(void *arg) {
     EVRMRM *evr=static_cast<EVRMRM*>(arg);
+    epicsUInt32 flags;
 
-    // Calling the default platform-independent interrupt routine
-    evr->isr(arg);
+    // The interrupt thread belongs to devLib2, so it is bound on its first call
+    if(!evr->isrStats) {
+        mrmThreadTopology::pin(evr->id, mrmThreadTopology::roleISR);
+        evr->isrStats = new mrmThreadStats(evr->id, mrmThreadTopology::roleISR);
+    } else {
+        evr->isrStats->waitEnd();
+    }
+
+    // The kernel module stored IRQFlag when it disabled the interrupt.
+    // Flags set since then are handled after the interrupt is re-enabled.
+    if(!evr->irqStats || !evr->irqStats->consume(flags)) {
+        SCOPED_LOCK2(evr->irqFlagLock, guard);
+        flags=READ32(evr->base, IRQFlag);
+    }
+
+    // The kernel module may have emptied the FIFO already
+    if(evr->fifoRing && evr->fifoRing->pending())
+        flags |= IRQ_Event;
+
+    isr_flags(evr, flags);
 
     EVR_DEBUG(5,"Re-enabling IRQs");
     if(devPCIEnableInterrupt(evr->pciDevice)) {
         errlogPrintf("Failed to re-enable interrupt.  Stuck...\n");
     }
+
+    evr->isrStats->waitStart();
 }
 
 void
@@ -1265,6 +1314,12 @@ EVRMRM::isr(void *arg)
         flags=READ32(evr->base, IRQFlag);
     }
 
+    isr_flags(evr, flags);
+}
+
+void
+EVRMRM::isr_flags(EVRMRM *evr, epicsUInt32 flags)
+{
     epicsUInt32 active=flags&evr->shadowIRQEna;
 
     EVR_INFO(4,"ISR start, flags 0x%x (active: 0x%x)", flags, active);
@@ -1383,12 +1438,69 @@ eventInvoke(eventCode& event)
     }
 }
 
+void
+EVRMRM::attachSimFifoRing(mrmEvtFifoRing *ring)
+{
+    SCOPED_LOCK(evrLock);
+    if(fifoRing)
+        throw std::runtime_error("EVR already has an event FIFO ring");
+    fifoRing = ring;
+}
+
+void
+EVRMRM::notifyFifoRing()
+{
+    int wakeup=0;
+    drain_fifo_wakeup.trySend(&wakeup, sizeof(wakeup));
+}
+
+void
+EVRMRM::fifo_event(epicsUInt32 evt, epicsUInt32 sec, epicsUInt32 ts)
+{
+    count_fifo_events++;
+
+    events[evt].last_sec=sec;
+    events[evt].last_evt=ts; // timestamp register
+
+    EVR_EVENT_INFO(1,"%u.%u: %s received event: %d\n", events[evt].last_sec, events[evt].last_evt, id.c_str(), evt);
+
+    if(m_history)
+        m_history->fifoEvent(evt, sec, ts);
+
+    if (events[evt].again) {
+        // ignore extra events in buffer.
+    } else if (events[evt].waitingfor>0) {
+        // already queued, but occured again before
+        // callbacks finished so disable event
+        events[evt].again=true;
+        specialSetMap(evt, ActionFIFOSave, false);
+        count_FIFO_sw_overrate++;
+        events[evt].numOfDisables++;
+    } else {
+        // needs to be queued
+        if(m_latency)
+            m_latency->fifoArrival(evt, events[evt].last_evt);
+        eventInvoke(events[evt]);
+        events[evt].numOfEvtsQueued++;
+        events[evt].waitingfor=NUM_CALLBACK_PRIORITIES;
+        for(int p=0; p<NUM_CALLBACK_PRIORITIES; p++) {
+            events[evt].done.priority=p;
+            callbackRequest(&events[evt].done);
+        }
+    }
+}
+
 void
 EVRMRM::drain_fifo()
 {
     size_t i;
+    mrmEvtFifoRing::event_t ringEvts[512];
+    size_t burst=0; // events taken from the ring since the last pause
     EVR_INFO(1,"EVR drain FIFO thread started");
 
+    mrmThreadTopology::pin(id, mrmThreadTopology::roleFIFO);
+    mrmThreadStats stats(id, mrmThreadTopology::roleFIFO);
+
 
     SCOPED_LOCK2(evrLock, guard);
 
@@ -1397,7 +1509,9 @@ EVRMRM::drain_fifo()
 
         guard.unlock();
 
+        stats.waitStart();
         err=drain_fifo_wakeup.receive(&code, sizeof(code));
+        stats.waitEnd();
 
         if (err<0) {
             errlogPrintf("FIFO wakeup error %d\n",err);
@@ -1415,65 +1529,58 @@ EVRMRM::drain_fifo()
 
         count_fifo_loops++;
 
-        epicsUInt32 status;
+        epicsUInt32 status=0;
 
-        EVR_EVENT_INFO(1,"Draining FIFO!\n");
-        // Bound the number of events taken from the FIFO
-        // at one time.
-        for(i=0; i<512; i++) {
-            {
-                SCOPED_LOCK(irqFlagLock);
-                status=READ32(base, IRQFlag);
+        // Events emptied from the FIFO by the kernel module
+        if(fifoRing) {
+            unsigned n=fifoRing->take(ringEvts, NELEMENTS(ringEvts));
+            burst+=n;
+            for(unsigned j=0; j<n; j++) {
+                if(ringEvts[j].code>=NELEMENTS(events)) {
+                    errlogPrintf("Really weird event 0x%08x from ring\n", (unsigned)ringEvts[j].code);
+                    continue;
+                }
+                fifo_event(ringEvts[j].code, ringEvts[j].sec, ringEvts[j].evt);
             }
-            if (!(status&IRQ_Event))
-                break;
-            if (status&IRQ_RXErr)
-                break;
-
-            epicsUInt32 evt=READ32(base, EvtFIFOCode);
-            if (!evt)
-                break;
-
-            if (evt>NELEMENTS(events)) {
-                // BUG: we get occasional corrupt VME reads of this register
-                // Fixed in firmware.  Feb 2011
-                epicsUInt32 evt2=READ32(base, EvtFIFOCode);
-                if (evt2>NELEMENTS(events)) {
-                    errlogPrintf("Really weird event 0x%08x 0x%08x\n", evt, evt2);
+        }
+
+        EVR_EVENT_INFO(1,"Draining FIFO!\n");
+        if(fifoRing && fifoRing->kernelDrains()) {
+            // Only the overflow and link status is needed
+            SCOPED_LOCK(irqFlagLock);
+            status=READ32(base, IRQFlag);
+        } else {
+            // Bound the number of events taken from the FIFO
+            // at one time.
+            for(i=0; i<512; i++) {
+                {
+                    SCOPED_LOCK(irqFlagLock);
+                    status=READ32(base, IRQFlag);
+                }
+                if (!(status&IRQ_Event))
                     break;
-                } else
-                    evt=evt2;
-            }
-            evt &= 0xff; // (in)santity check
-
-            count_fifo_events++;
-
-            events[evt].last_sec=READ32(base, EvtFIFOSec);
-            events[evt].last_evt=READ32(base, EvtFIFOEvt); // timestamp register
-
-            EVR_EVENT_INFO(1,"%u.%u: %s received event: %d\n", events[evt].last_sec, events[evt].last_evt, id.c_str(), evt);
-
-
-            if (events[evt].again) {
-                // ignore extra events in buffer.
-            } else if (events[evt].waitingfor>0) {
-                // already queued, but occured again before
-                // callbacks finished so disable event
-                events[evt].again=true;
-                specialSetMap(evt, ActionFIFOSave, false);
-                count_FIFO_sw_overrate++;
-                events[evt].numOfDisables++;
-            } else {
-                // needs to be queued
-                eventInvoke(events[evt]);
-                events[evt].numOfEvtsQueued++;
-                events[evt].waitingfor=NUM_CALLBACK_PRIORITIES;
-                for(int p=0; p<NUM_CALLBACK_PRIORITIES; p++) {
-                    events[evt].done.priority=p;
-                    callbackRequest(&events[evt].done);
+                if (status&IRQ_RXErr)
+                    break;
+
+                epicsUInt32 evt=READ32(base, EvtFIFOCode);
+                if (!evt)
+                    break;
+
+                if (evt>NELEMENTS(events)) {
+                    // BUG: we get occasional corrupt VME reads of this register
+                    // Fixed in firmware.  Feb 2011
+                    epicsUInt32 evt2=READ32(base, EvtFIFOCode);
+                    if (evt2>NELEMENTS(events)) {
+                        errlogPrintf("Really weird event 0x%08x 0x%08x\n", evt, evt2);
+                        break;
+                    } else
+                        evt=evt2;
                 }
-            }
+                evt &= 0xff; // (in)santity check
 
+                epicsUInt32 sec=READ32(base, EvtFIFOSec);
+                fifo_event(evt, sec, READ32(base, EvtFIFOEvt));
+            }
         }
 
         if (status&IRQ_FIFOFull) {
@@ -1494,6 +1601,20 @@ EVRMRM::drain_fifo()
             (void)READ8(base, IRQEnableBot); // make sure write is complete
         }
 
+        // Events put in the ring while IRQ_Event was disabled
+        // are not seen by the ISR.
+        if(fifoRing && fifoRing->pending())
+            notifyFifoRing();
+
+        // The kernel module drains a small batch per interrupt.  While
+        // the FIFO still holds events, the interrupt re-armed above
+        // brings the next batch at once.  Pause only after as many
+        // events as one pass of the user space drain takes.
+        if(fifoRing && fifoRing->kernelDrains() &&
+                (status&IRQ_Event) && burst<NELEMENTS(ringEvts))
+            continue;
+        burst=0;
+
         // wait a fixed interval before checking again
         // Prevents this thread from starving others
         // if a high frequency event is accidentally
@@ -1567,6 +1688,9 @@ try {
     if (--sent->waitingfor)
         return;
 
+    if (sent->owner->m_latency)
+        sent->owner->m_latency->dispatched(sent->code);
+
     bool run=sent->again;
     sent->again=false;
 
@@ -1637,6 +1761,90 @@ try {
 }
 }
 
+void
+EVRMRM::startStatusPoll()
+{
+    callbackRequest(&poll_status_cb);
+}
+
+void
+EVRMRM::poll_status(CALLBACK* cb)
+{
+try {
+    void *vptr;
+    callbackGetUser(vptr,cb);
+    EVRMRM *evr=static_cast<EVRMRM*>(vptr);
+
+    {
+        SCOPED_LOCK2(evr->evrLock, guard);
+
+        // One pass over the status registers for all watched values
+        epicsUInt32 status=READ32(evr->base, Status);
+        epicsUInt32 clkctrl=READ32(evr->base, ClkCtrl);
+
+        bool link = !(status & Status_legvio),
+             cg = (clkctrl & ClkCtrl_cglock) != 0,
+             pll = (clkctrl & ClkCtrl_plllock) != 0;
+
+        evr->chgLinkStatus.update(link);
+        evr->chgCgLocked.update(cg);
+        evr->chgPllLocked.update(pll);
+        evr->chgFIFOFull.update(evr->count_FIFO_overflow);
+        evr->chgFIFOOverRate.update(evr->count_FIFO_sw_overrate);
+        evr->chgHealth.update(evr->evaluateHealth(link, cg, pll));
+    }
+
+    if(mrmEvrStatusPeriod>0.0)
+        callbackRequestDelayed(&evr->poll_status_cb, mrmEvrStatusPeriod);
+} catch(std::exception& e) {
+    epicsPrintf("exception in poll_status callback: %s\n", e.what());
+}
+}
+
+/* Caller must hold evrLock.
+ * Uses the status read by poll_status(), and values already kept in memory.
+ * Order of precedence as in the former calc based evr-health.template.
+ */
+epicsUInt32
+EVRMRM::evaluateHealth(bool link, bool cg, bool pll)
+{
+    epicsUInt32 polls = 1;
+    if(mrmEvrStatusPeriod>0.0)
+        polls = (epicsUInt32)(HEALTH_HOLD/mrmEvrStatusPeriod + 0.999);
+
+    epicsUInt32 dbufErrors = 0;
+    if(m_dataBufferObj_230)
+        dbufErrors += m_dataBufferObj_230->getChecksumCountSum() + m_dataBufferObj_230->getOverflowCountSum();
+    if(m_dataBufferObj_300)
+        dbufErrors += m_dataBufferObj_300->getChecksumCountSum() + m_dataBufferObj_300->getOverflowCountSum();
+
+    // all watches are updated on each poll
+    bool rxerr = watchRxErr.update(count_recv_error, polls),
+         hb = watchHB.update(count_heartbeat, polls),
+         fifo = watchFIFO.update(count_FIFO_overflow, polls),
+         dbuf = watchDBuf.update(dbufErrors, polls);
+
+    epicsUInt16 sfpSev = NO_ALARM;
+    if(sfp.get())
+        sfpSev = std::max(sfp->severity(), sfp->severityRX());
+
+    if(!link || !cg || !pll)
+        return healthLink;
+    else if(sfpSev>=MAJOR_ALARM)
+        return healthSFPError;
+    else if(rxerr)
+        return healthRxErr;
+    else if(hb)
+        return healthHeartbeat;
+    else if(dbuf)
+        return healthDataBuffer;
+    else if(sfpSev==MINOR_ALARM)
+        return healthSFPWarning;
+    else if(fifo)
+        return healthFIFOOverflow;
+    return healthOK;
+}
+
 void
 EVRMRM::seconds_tick(void *raw, epicsUInt32)
 {
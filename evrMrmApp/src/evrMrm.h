@@ -27,6 +27,8 @@
 
 #include "devLibPCI.h"
 
+#include "mrf/changeScan.h"
+
 #include "evrInput.h"
 #include "evrOutput.h"
 #include "evrPrescaler.h"
@@ -42,6 +44,9 @@
 #include "mrmDeviceInfo.h"
 #include "mrmFlash.h"
 #include "mrmRemoteFlash.h"
+#include "mrmIrqStats.h"
+#include "mrmEvtFifoRing.h"
+#include "mrmThreadTopology.h"
 #include "dataBuffer/mrmDataBuffer_300.h"
 #include "dataBuffer/mrmDataBuffer_230.h"
 #include "dataBuffer/mrmDataBufferObj.h"
@@ -78,6 +83,8 @@ public:
 };
 
 class EVRMRM;
+class evrSoftEventLatency;
+class evrPulseHistory;
 typedef void (*eventCallback)(void* userarg, epicsUInt32 event);
 struct eventCode {
     epicsUInt8 code; // constant
@@ -210,8 +217,37 @@ public:
 
     bool linkStatus() const;
     IOSCANPVT linkChanged() const{return IRQrxError;}
+    IOSCANPVT linkStatusChanged() const{return chgLinkStatus.scan();}
     epicsUInt32 recvErrorCount() const{return count_recv_error;}
 
+    IOSCANPVT cgLockedChanged() const{return chgCgLocked.scan();}
+    IOSCANPVT pllLockedChanged() const{return chgPllLocked.scan();}
+
+    /** Health reason, evaluated by each status poll from the link and
+     *  clock status, the SFP diagnostics, and the error counters.
+     *  Values as used by evr-health.template.
+     */
+    enum healthReason_t {
+        healthOK=0,
+        healthLink=1,           //!< Link, CG or PLL error
+        healthRxErr=2,
+        healthSFPWarning=3,
+        healthSFPError=4,
+        healthDataBuffer=5,
+        healthFIFOOverflow=6,
+        healthHeartbeat=7
+    };
+    epicsUInt32 healthReason() const
+    {SCOPED_LOCK(evrLock);return chgHealth.value();}
+    IOSCANPVT healthReasonChanged() const{return chgHealth.scan();}
+
+    /** Start periodic polling of status registers and counters.
+     *  Values are compared with the previous poll and I/O Intr
+     *  scans are only requested when something changed.
+     *  Called from an init hook after callbacks are initialized.
+     */
+    void startStatusPoll();
+
     //! Approximate divider from event clock period to 1us
     epicsUInt32 uSecDiv() const;
     /*@}*/
@@ -266,6 +302,14 @@ public:
     void eventNotifyAdd(epicsUInt32, eventCallback, void*);
     void eventNotifyDel(epicsUInt32, eventCallback, void*);
 
+    //! Install the soft event latency measurement hooks, or remove with NULL.  Call with evrLock held.
+    void setLatencyProbe(evrSoftEventLatency* probe){m_latency=probe;}
+    //! Install the pulse history, or remove with NULL.  Call with evrLock held.
+    void setPulseHistory(evrPulseHistory* history){m_history=history;}
+
+    //! NULL if the firmware has no sequencer
+    const EvrSequencer* sequencer() const{return m_sequencer;}
+
     bool convertTS(epicsTimeStamp* ts);
 
     epicsUInt16 dbus() const;
@@ -277,8 +321,10 @@ public:
 
     epicsUInt32 FIFOFullCount() const
     {SCOPED_LOCK(evrLock);return count_FIFO_overflow;}
+    IOSCANPVT FIFOFullChanged() const{return chgFIFOFull.scan();}
     epicsUInt32 FIFOOverRate() const
     {SCOPED_LOCK(evrLock);return count_FIFO_sw_overrate;}
+    IOSCANPVT FIFOOverRateChanged() const{return chgFIFOOverRate.scan();}
     epicsUInt32 FIFOEvtCount() const{return count_fifo_events;}
     epicsUInt32 FIFOLoopCount() const{return count_fifo_loops;}
 
@@ -292,6 +338,15 @@ public:
     static void isr_pci(void*);
     static void isr_vme(void*);
     const epicsPCIDevice *pciDevice;
+    //! IRQ statistics of the kernel module (Linux PCI only), may be NULL
+    mrmIrqStats *irqStats;
+    //! Event FIFO drained by the kernel module (Linux PCI only), may be NULL
+    mrmEvtFifoRing *fifoRing;
+
+    //! Use a simulated event FIFO ring in addition to the FIFO
+    void attachSimFifoRing(mrmEvtFifoRing*);
+    //! Wake the FIFO thread after events were added to a simulated ring
+    void notifyFifoRing();
 
     mrmRemoteFlash* getRemoteFlash();
 
@@ -383,8 +438,15 @@ private:
 
     EvrGPIO gpio_;
 
+    // Handle the flags of an interrupt, and acknowledge them
+    static void isr_flags(EVRMRM*, epicsUInt32 flags);
+    // Created by the PCI interrupt thread on its first call
+    mrmThreadStats *isrStats;
+
     // run when FIFO not-full IRQ is received
     void drain_fifo();
+    // Caller must hold evrLock
+    void fifo_event(epicsUInt32 evt, epicsUInt32 sec, epicsUInt32 ts);
     epicsThreadRunableMethod<EVRMRM, &EVRMRM::drain_fifo> drain_fifo_method;
     epicsThread drain_fifo_task;
     epicsMessageQueue drain_fifo_wakeup;
@@ -407,6 +469,39 @@ private:
     CALLBACK poll_link_cb;
     static void poll_link(CALLBACK*);
 
+    // Periodic callback to publish status changes
+    CALLBACK poll_status_cb;
+    static void poll_status(CALLBACK*);
+
+    // Guarded by evrLock, updated by poll_status()
+    mrf::changeScan<bool> chgLinkStatus;
+    mrf::changeScan<bool> chgCgLocked;
+    mrf::changeScan<bool> chgPllLocked;
+    mrf::changeScan<epicsUInt32> chgFIFOFull;
+    mrf::changeScan<epicsUInt32> chgFIFOOverRate;
+    mrf::changeScan<epicsUInt32> chgHealth;
+
+    /* Error counter watched by the health evaluation.
+     * A change keeps the reason active for some polls.
+     */
+    struct countWatch {
+        epicsUInt32 last;
+        epicsUInt32 hold; // polls left
+        countWatch() :last(0), hold(0) {}
+        bool update(epicsUInt32 cnt, epicsUInt32 polls)
+        {
+            if(cnt!=last) {
+                last=cnt;
+                hold=polls;
+            } else if(hold>0) {
+                hold--;
+            }
+            return hold>0;
+        }
+    };
+    countWatch watchRxErr, watchHB, watchFIFO, watchDBuf;
+    epicsUInt32 evaluateHealth(bool link, bool cg, bool pll);
+
     // Set by clockTSSet() with IRQ disabled
     double stampClock;
     TSSource shadowSourceTS;
@@ -436,6 +531,10 @@ private:
     mrmDataBufferObj *m_dataBufferObj_230;
     mrmDataBufferObj *m_dataBufferObj_300;
 
+    // Guarded by evrLock
+    evrSoftEventLatency *m_latency;
+    evrPulseHistory *m_history;
+
 }; // class EVRMRM
 
 #endif // EVRMRM_H_INC
@@ -0,0 +1,380 @@
+/*************************************************************************\
+* mrfioc2 is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
+
+#include <errlog.h>
+#include <iocsh.h>
+
+#include "mrfCommon.h"
+#include "evrMrm.h"
+
+#include <epicsExport.h>
+#include "evrPatternCheck.h"
+
+evrPatternRule::evrPatternRule(const std::string& n, evrPatternCheck& owner, const std::string& spec)
+    :mrf::ObjectInst<evrPatternRule>(n)
+    ,m_owner(owner)
+    ,m_spec(spec)
+    ,m_type(present)
+    ,m_a(0)
+    ,m_b(0)
+    ,m_window(1)
+    ,m_min(0)
+    ,m_max(0)
+    ,m_enable(true)
+    ,m_inWindow(0)
+    ,m_evaluated(0)
+    ,m_lastViolation(0)
+{
+    char type[16];
+    unsigned int a=0, b=0, n1=0, n2=0, n3=0;
+    int nargs = sscanf(spec.c_str(), "%15s %u %u %u %u", type, &a, &n1, &n2, &n3);
+
+    if(nargs<2)
+        throw std::invalid_argument("Rule must be '<type> <code> ...'");
+
+    if(strcmp(type, "present")==0 && nargs==3) {
+        m_type = present;
+        m_window = n1;
+    } else if(strcmp(type, "absent")==0 && nargs==2) {
+        m_type = absent;
+    } else if(strcmp(type, "order")==0 && nargs==3) {
+        m_type = order;
+        b = n1;
+    } else if(strcmp(type, "follows")==0 && nargs==4) {
+        m_type = follows;
+        b = n1;
+        m_window = n2+1; // the pulse of B and N more
+    } else if(strcmp(type, "count")==0 && nargs==5) {
+        m_type = count;
+        m_window = n1;
+        m_min = n2;
+        m_max = n3;
+    } else {
+        throw std::invalid_argument("Unknown rule or wrong number of arguments."
+                                    " Rules are: present A N, absent A, order A B, follows A B N, count A N MIN MAX");
+    }
+
+    if(a==0 || a>255 || b>255 || ((m_type==order || m_type==follows) && b==0))
+        throw std::invalid_argument("Event code out of range");
+    if(m_window==0 || m_window>=evrPatternCheck::depth)
+        throw std::invalid_argument("Number of pulses out of range");
+    if(m_type==count && (m_min>m_max || m_max>m_window))
+        throw std::invalid_argument("Count limits out of range");
+
+    m_a = a;
+    m_b = b;
+}
+
+evrPatternRule::~evrPatternRule() {}
+
+void evrPatternRule::lock() const{m_owner.lock();}
+void evrPatternRule::unlock() const{m_owner.unlock();}
+
+void evrPatternRule::enable(bool e)
+{
+    if(e && !m_enable)
+        reset(true);
+    m_enable = e;
+}
+
+void evrPatternRule::reset(bool)
+{
+    // Recount the window from the history
+    epicsUInt32 n = std::min(m_window, m_owner.pulses());
+    m_inWindow = 0;
+    for(epicsUInt32 age=1; age<=n; age++)
+        m_inWindow += m_owner.seen(m_a, age);
+
+    m_evaluated = 0;
+    m_lastViolation = 0;
+    m_violations.update(0);
+    m_ok.invalidate();
+    m_ok.update(true); // until the window is complete
+}
+
+
+evrPatternCheck::evrPatternCheck(const std::string& n, EVRMRM* evr, epicsUInt8 endCode)
+    :mrf::ObjectInst<evrPatternCheck>(n)
+    ,m_evr(evr)
+    ,m_endCode(endCode)
+    ,m_head(0)
+    ,m_pulses(0)
+    ,m_nseq(0)
+    ,m_evalTime(0.0)
+    ,m_evalTimeMax(0.0)
+    ,m_evalTimeSum(0.0)
+    ,m_evalCount(0)
+{
+    if(endCode==0)
+        throw std::invalid_argument("End of pulse event code out of range");
+
+    memset(m_ring, 0, sizeof(m_ring));
+    memset(m_seq, 0, sizeof(m_seq));
+    memset(m_users, 0, sizeof(m_users));
+
+    watch(endCode);
+}
+
+evrPatternCheck::~evrPatternCheck()
+{
+    for(unsigned code=1; code<256; code++) {
+        if(m_users[code])
+            m_evr->eventNotifyDel(code, &evrPatternCheck::event, (void*)this);
+    }
+    for(size_t i=0; i<m_rules.size(); i++)
+        delete m_rules[i];
+}
+
+void evrPatternCheck::lock() const{m_evr->lock();}
+void evrPatternCheck::unlock() const{m_evr->unlock();}
+
+evrPatternRule* evrPatternCheck::addRule(const std::string& name, const std::string& spec)
+{
+    evrPatternRule *rule = new evrPatternRule(this->name()+":"+name, *this, spec);
+
+    SCOPED_LOCK2(m_evr->evrLock, guard);
+
+    rule->reset(true);
+    m_rules.push_back(rule);
+    watch(rule->codeA());
+    if(rule->codeB())
+        watch(rule->codeB());
+
+    return rule;
+}
+
+// Caller must hold evrLock, or be the constructor
+void evrPatternCheck::watch(epicsUInt8 code)
+{
+    if(m_users[code]++ == 0)
+        m_evr->eventNotifyAdd(code, &evrPatternCheck::event, (void*)this);
+}
+
+double evrPatternCheck::evalTimeMean() const
+{
+    return m_evalCount ? m_evalTimeSum/m_evalCount : 0.0;
+}
+
+void evrPatternCheck::resetStats(bool)
+{
+    m_evalTimeMax = 0.0;
+    m_evalTimeSum = 0.0;
+    m_evalCount = 0;
+}
+
+// Called from the EVR FIFO thread with evrLock held
+void evrPatternCheck::event(void *raw, epicsUInt32 code)
+{
+    evrPatternCheck *self = static_cast<evrPatternCheck*>(raw);
+
+    self->m_ring[self->m_head].bits[code>>5] |= 1u<<(code&31);
+    if(!self->m_seq[code])
+        self->m_seq[code] = ++self->m_nseq;
+
+    if(code==self->m_endCode)
+        self->endOfPulse();
+}
+
+void evrPatternCheck::endOfPulse()
+{
+    double start = mrfMonotonicSeconds();
+
+    for(size_t i=0; i<m_rules.size(); i++) {
+        if(m_rules[i]->m_enable)
+            evaluate(*m_rules[i]);
+    }
+
+    m_pulses++;
+    m_head = (m_head+1)%depth;
+    memset(m_ring[m_head].bits, 0, sizeof(m_ring[m_head].bits));
+    memset(m_seq, 0, sizeof(m_seq));
+    m_nseq = 0;
+
+    m_evalTime = (mrfMonotonicSeconds() - start)*1e6;
+    if(m_evalTime > m_evalTimeMax)
+        m_evalTimeMax = m_evalTime;
+    m_evalTimeSum += m_evalTime;
+    m_evalCount++;
+}
+
+void evrPatternCheck::evaluate(evrPatternRule& rule)
+{
+    // slide the window: add this pulse, drop the one which left
+    rule.m_inWindow += seen(rule.m_a, 0);
+    if(m_pulses >= rule.m_window)
+        rule.m_inWindow -= seen(rule.m_a, rule.m_window);
+
+    // the window is complete
+    const bool full = m_pulses+1 >= rule.m_window;
+    bool bad = false;
+
+    switch(rule.m_type) {
+    case evrPatternRule::present:
+        if(!full) return;
+        bad = rule.m_inWindow==0;
+        break;
+    case evrPatternRule::absent:
+        bad = seen(rule.m_a, 0);
+        break;
+    case evrPatternRule::order:
+        bad = m_seq[rule.m_a] && m_seq[rule.m_b] && m_seq[rule.m_a] > m_seq[rule.m_b];
+        break;
+    case evrPatternRule::follows:
+        if(!full) return;
+        bad = seen(rule.m_b, rule.m_window-1) && rule.m_inWindow==0;
+        break;
+    case evrPatternRule::count:
+        if(!full) return;
+        bad = rule.m_inWindow < rule.m_min || rule.m_inWindow > rule.m_max;
+        break;
+    }
+
+    rule.m_evaluated++;
+    if(bad) {
+        rule.m_lastViolation = m_pulses;
+        rule.m_violations.update(rule.m_violations.value()+1);
+    }
+    rule.m_ok.update(!bad);
+}
+
+void evrPatternCheck::report(int lvl) const
+{
+    SCOPED_LOCK2(m_evr->evrLock, guard);
+
+    printf("%s: end of pulse code %u, %u pulses, evaluation %.1f us (mean %.1f, max %.1f)\n",
+           name().c_str(), m_endCode, m_pulses, m_evalTime, evalTimeMean(), m_evalTimeMax);
+
+    for(size_t i=0; i<m_rules.size(); i++) {
+        const evrPatternRule& rule = *m_rules[i];
+        printf(" %s '%s'%s: %u violations in %u pulses",
+               rule.name().c_str(), rule.m_spec.c_str(), rule.m_enable ? "" : " (disabled)",
+               rule.violations(), rule.m_evaluated);
+        if(rule.violations())
+            printf(", last in pulse %u", rule.m_lastViolation);
+        printf("\n");
+    }
+}
+
+evrPatternCheck* evrPatternCheck::find(const std::string& evr)
+{
+    return dynamic_cast<evrPatternCheck*>(mrf::Object::getObject(evr+":Pattern"));
+}
+
+
+OBJECT_BEGIN(evrPatternRule) {
+    OBJECT_PROP1("Spec", &evrPatternRule::spec);
+    OBJECT_PROP2("Enable", &evrPatternRule::enabled, &evrPatternRule::enable);
+    OBJECT_PROP1("OK", &evrPatternRule::ok);
+    OBJECT_PROP1("OK", &evrPatternRule::okChanged);
+    OBJECT_PROP1("Violations", &evrPatternRule::violations);
+    OBJECT_PROP1("Violations", &evrPatternRule::violationsChanged);
+    OBJECT_PROP1("Evaluated", &evrPatternRule::evaluated);
+    OBJECT_PROP1("Last Violation", &evrPatternRule::lastViolation);
+    OBJECT_PROP2("Reset", &evrPatternRule::dummyReturn, &evrPatternRule::reset);
+} OBJECT_END(evrPatternRule)
+
+OBJECT_BEGIN(evrPatternCheck) {
+    OBJECT_PROP1("End Code", &evrPatternCheck::endCode);
+    OBJECT_PROP1("Pulses", &evrPatternCheck::pulses);
+    OBJECT_PROP1("Rules", &evrPatternCheck::numRules);
+    OBJECT_PROP1("Eval Time", &evrPatternCheck::evalTime);
+    OBJECT_PROP1("Eval Time Mean", &evrPatternCheck::evalTimeMean);
+    OBJECT_PROP1("Eval Time Max", &evrPatternCheck::evalTimeMax);
+    OBJECT_PROP2("Reset Stats", &evrPatternCheck::dummyReturn, &evrPatternCheck::resetStats);
+} OBJECT_END(evrPatternCheck)
+
+
+/********** Create pattern checker  *******/
+static const iocshArg mrmEvrPatternCheckArg0 = { "EVR", iocshArgString };
+static const iocshArg mrmEvrPatternCheckArg1 = { "End of pulse code", iocshArgInt };
+static const iocshArg * const mrmEvrPatternCheckArgs[2] = { &mrmEvrPatternCheckArg0, &mrmEvrPatternCheckArg1 };
+static const iocshFuncDef mrmEvrPatternCheckDef = { "mrmEvrPatternCheck", 2, mrmEvrPatternCheckArgs };
+
+static void mrmEvrPatternCheckFunc(const iocshArgBuf *args)
+{
+    if(!args[0].sval || args[1].ival<=0) {
+        printf("Usage: mrmEvrPatternCheck EVR Code\n\t" \
+               "EVR = name of the event receiver (eg.: EVR0)\n\t" \
+               "Code = event code received last in each pulse\n");
+        return;
+    }
+
+    try {
+        EVRMRM *evr = dynamic_cast<EVRMRM*>(mrf::Object::getObject(args[0].sval));
+        if(!evr)
+            throw std::runtime_error("EVR not found");
+        if(evrPatternCheck::find(args[0].sval))
+            throw std::runtime_error("Pattern checker already exists");
+        if(args[1].ival>255)
+            throw std::invalid_argument("Event code out of range");
+
+        new evrPatternCheck(std::string(args[0].sval)+":Pattern", evr, (epicsUInt8)args[1].ival);
+    } catch(std::exception& e) {
+        errlogPrintf("mrmEvrPatternCheck %s: %s\n", args[0].sval, e.what());
+    }
+}
+
+/********** Add rule  *******/
+static const iocshArg mrmEvrPatternRuleArg0 = { "EVR", iocshArgString };
+static const iocshArg mrmEvrPatternRuleArg1 = { "Name", iocshArgString };
+static const iocshArg mrmEvrPatternRuleArg2 = { "Rule", iocshArgString };
+static const iocshArg * const mrmEvrPatternRuleArgs[3] = { &mrmEvrPatternRuleArg0, &mrmEvrPatternRuleArg1, &mrmEvrPatternRuleArg2 };
+static const iocshFuncDef mrmEvrPatternRuleDef = { "mrmEvrPatternRule", 3, mrmEvrPatternRuleArgs };
+
+static void mrmEvrPatternRuleFunc(const iocshArgBuf *args)
+{
+    if(!args[0].sval || !args[1].sval || !args[2].sval) {
+        printf("Usage: mrmEvrPatternRule EVR Name \"Rule\"\n\t" \
+               "EVR = name of the event receiver (eg.: EVR0)\n\t" \
+               "Name = rule name. Object name is <EVR>:Pattern:<Name>\n\t" \
+               "Rule = one of\n\t" \
+               "  present A N       : A arrives at least once in every N pulses\n\t" \
+               "  absent A          : A does not arrive\n\t" \
+               "  order A B         : if both arrive in a pulse, A arrives first\n\t" \
+               "  follows A B N     : after a pulse with B, A arrives in the same or one of the next N pulses\n\t" \
+               "  count A N MIN MAX : A arrives in MIN to MAX of the last N pulses\n");
+        return;
+    }
+
+    try {
+        evrPatternCheck *check = evrPatternCheck::find(args[0].sval);
+        if(!check)
+            throw std::runtime_error("No pattern checker. Call mrmEvrPatternCheck first");
+
+        check->addRule(args[1].sval, args[2].sval);
+    } catch(std::exception& e) {
+        errlogPrintf("mrmEvrPatternRule %s %s: %s\n", args[0].sval, args[1].sval, e.what());
+    }
+}
+
+/********** Report  *******/
+static const iocshArg mrmEvrPatternReportArg0 = { "EVR", iocshArgString };
+static const iocshArg * const mrmEvrPatternReportArgs[1] = { &mrmEvrPatternReportArg0 };
+static const iocshFuncDef mrmEvrPatternReportDef = { "mrmEvrPatternReport", 1, mrmEvrPatternReportArgs };
+
+static void mrmEvrPatternReportFunc(const iocshArgBuf *args)
+{
+    evrPatternCheck *check = args[0].sval ? evrPatternCheck::find(args[0].sval) : NULL;
+    if(!check) {
+        printf("Usage: mrmEvrPatternReport EVR\n");
+        return;
+    }
+    check->report(1);
+}
+
+extern "C" {
+static void evrPatternCheckRegistrar()
+{
+    iocshRegister(&mrmEvrPatternCheckDef, mrmEvrPatternCheckFunc);
+    iocshRegister(&mrmEvrPatternRuleDef, mrmEvrPatternRuleFunc);
+    iocshRegister(&mrmEvrPatternReportDef, mrmEvrPatternReportFunc);
+}
+epicsExportRegistrar(evrPatternCheckRegistrar);
+}
@@ -0,0 +1,160 @@
+/*************************************************************************\
+* mrfioc2 is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+#ifndef EVRPATTERNCHECK_H
+#define EVRPATTERNCHECK_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <dbScan.h>
+
+#include "mrf/object.h"
+#include "mrf/changeScan.h"
+
+class EVRMRM;
+class evrPatternCheck;
+
+/** @brief One event pattern rule, evaluated at the end of each pulse
+ *
+ * Rule types, with A and B event codes and N a number of pulses
+ *  - present A N       : A arrives at least once in every N pulses
+ *  - absent A          : A does not arrive
+ *  - order A B         : if both arrive in a pulse, A arrives first
+ *  - follows A B N     : after each pulse with B, A arrives in the same or one of the next N pulses
+ *  - count A N MIN MAX : A arrives in MIN to MAX of the last N pulses
+ *
+ * Guarded by the EVR lock.
+ */
+class evrPatternRule : public mrf::ObjectInst<evrPatternRule>
+{
+public:
+    enum type_t {
+        present,
+        absent,
+        order,
+        follows,
+        count
+    };
+
+    //! @param spec Rule definition, eg. "follows 6 14 3"
+    evrPatternRule(const std::string& n, evrPatternCheck& owner, const std::string& spec);
+    virtual ~evrPatternRule();
+
+    virtual void lock() const;
+    virtual void unlock() const;
+
+    type_t type() const{return m_type;}
+    epicsUInt8 codeA() const{return m_a;}
+    epicsUInt8 codeB() const{return m_b;}
+    std::string spec() const{return m_spec;}
+
+    bool enabled() const{return m_enable;}
+    void enable(bool e);
+
+    bool ok() const{return m_ok.value();}
+    IOSCANPVT okChanged() const{return m_ok.scan();}
+    epicsUInt32 violations() const{return m_violations.value();}
+    IOSCANPVT violationsChanged() const{return m_violations.scan();}
+    epicsUInt32 evaluated() const{return m_evaluated;}
+    //! Pulse number (evrPatternCheck::pulses()) of the last violation
+    epicsUInt32 lastViolation() const{return m_lastViolation;}
+
+    void reset(bool);
+    bool dummyReturn() const{return false;}
+
+private:
+    friend class evrPatternCheck;
+
+    evrPatternCheck& m_owner;
+    const std::string m_spec;
+    type_t m_type;
+    epicsUInt8 m_a, m_b;
+    epicsUInt32 m_window, m_min, m_max;
+
+    bool m_enable;
+    epicsUInt32 m_inWindow; // pulses with A in the window
+    epicsUInt32 m_evaluated;
+    epicsUInt32 m_lastViolation;
+    mrf::changeScan<bool> m_ok;
+    mrf::changeScan<epicsUInt32> m_violations;
+};
+
+/** @brief Checks the pattern of received events against a set of rules
+ *
+ * Hooked as event notifiee of an EVR for the codes used by the rules, and
+ * for the end of pulse code.  The codes seen in each pulse are kept as a
+ * bitmap in a ring of the last evrPatternCheck::depth pulses.  When the end
+ * of pulse code arrives all rules are evaluated, before the pulse is
+ * advanced.  The end of pulse code itself belongs to the pulse it ends.
+ *
+ * Runs in the EVR FIFO thread with the EVR lock held.
+ */
+class evrPatternCheck : public mrf::ObjectInst<evrPatternCheck>
+{
+public:
+    enum { depth = 256 };
+
+    evrPatternCheck(const std::string& n, EVRMRM* evr, epicsUInt8 endCode);
+    virtual ~evrPatternCheck();
+
+    virtual void lock() const;
+    virtual void unlock() const;
+
+    EVRMRM* evr() const{return m_evr;}
+
+    //! Create a rule.  Throws std::invalid_argument if spec is not valid.
+    evrPatternRule* addRule(const std::string& name, const std::string& spec);
+
+    epicsUInt32 endCode() const{return m_endCode;}
+    epicsUInt32 pulses() const{return m_pulses;}
+    epicsUInt32 numRules() const{return (epicsUInt32)m_rules.size();}
+    //! Evaluation time of all rules in the last pulse [us]
+    double evalTime() const{return m_evalTime;}
+    double evalTimeMax() const{return m_evalTimeMax;}
+    double evalTimeMean() const;
+    void resetStats(bool);
+    bool dummyReturn() const{return false;}
+
+    //! Seen code in a pulse.  age=0 is the current pulse.
+    bool seen(epicsUInt8 code, epicsUInt32 age) const
+    {
+        const epicsUInt32 *bits = m_ring[(m_head + depth - age) % depth].bits;
+        return bits[code>>5] & (1u<<(code&31));
+    }
+
+    void report(int lvl) const;
+
+    static evrPatternCheck* find(const std::string& evr);
+
+private:
+    EVRMRM * const m_evr;
+    const epicsUInt8 m_endCode;
+
+    struct pulse_t {
+        epicsUInt32 bits[8];
+    };
+    pulse_t m_ring[depth];
+    epicsUInt32 m_head;
+    epicsUInt32 m_pulses;
+
+    // arrival order of the first occurrence of each code in the current pulse, 0 when not seen
+    epicsUInt16 m_seq[256];
+    epicsUInt16 m_nseq;
+
+    std::vector<evrPatternRule*> m_rules;
+    // number of rules using each code
+    epicsUInt16 m_users[256];
+
+    double m_evalTime, m_evalTimeMax, m_evalTimeSum;
+    epicsUInt32 m_evalCount;
+
+    void watch(epicsUInt8 code);
+    static void event(void *raw, epicsUInt32 code);
+    void endOfPulse();
+    void evaluate(evrPatternRule& rule);
+};
+
+#endif // EVRPATTERNCHECK_H
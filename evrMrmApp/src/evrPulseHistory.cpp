@@ -0,0 +1,568 @@
+/*************************************************************************\
+* mrfioc2 is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
+
+#include <errlog.h>
+#include <iocsh.h>
+
+#include "evrMrm.h"
+#include "dataBuffer/mrmDataBufferSchema.h"
+
+#include <epicsExport.h>
+#include "evrPulseHistory.h"
+
+evrPulseHistory::evrPulseHistory(const std::string& n, EVRMRM* evr, epicsUInt32 depth, epicsUInt8 startCode,
+                                 source_t source, epicsUInt32 rate, const std::string& field)
+    :mrf::ObjectInst<evrPulseHistory>(n)
+    ,m_evr(evr)
+    ,m_startCode(startCode)
+    ,m_source(source)
+    ,m_rate(rate)
+    ,m_field(NULL)
+    ,m_sequencer(evr->sequencer())
+    ,m_interest(0)
+    ,m_payloadOffset(0)
+    ,m_payloadLength(0)
+    ,m_current(NULL)
+    ,m_lastId(0)
+    ,m_pulses(0)
+    ,m_gaps(0)
+    ,m_overflows(0)
+    ,m_sos(0)
+    ,m_eos(0)
+    ,m_payloadNext(0)
+    ,m_payloadPending(0)
+    ,m_queryId(0)
+    ,m_queryValid(false)
+{
+    if(startCode==0)
+        throw std::invalid_argument("Start of pulse event code out of range");
+    if(depth==0)
+        throw std::invalid_argument("Depth must be at least 1");
+
+    if(source==sourceTimestamp && rate==0)
+        throw std::invalid_argument("Pulse rate must be given for the timestamp source");
+
+    if(source==sourceDataBuffer) {
+        m_field = dynamic_cast<mrmDataBufferField*>(mrf::Object::getObject(field));
+        if(!m_field)
+            throw std::runtime_error("Data buffer field '"+field+"' not found");
+    }
+
+    pulse_t empty;
+    memset(&empty, 0, sizeof(empty));
+    m_ring.resize(depth, empty);
+    memset(&m_query, 0, sizeof(m_query));
+
+    SCOPED_LOCK2(m_evr->evrLock, guard);
+    m_evr->interestedInEvent(startCode, true);
+    m_evr->setPulseHistory(this);
+}
+
+evrPulseHistory::~evrPulseHistory()
+{
+    {
+        SCOPED_LOCK2(m_evr->evrLock, guard);
+        m_evr->setPulseHistory(NULL);
+        m_evr->interestedInEvent(m_startCode, false);
+        for(size_t i=0; i<m_watched.size(); i++)
+            m_evr->interestedInEvent(m_watched[i], false);
+    }
+    if(m_interest)
+        m_user.removeInterest(m_interest);
+}
+
+void evrPulseHistory::watch(const std::vector<epicsUInt8>& codes)
+{
+    SCOPED_LOCK2(m_evr->evrLock, guard);
+    for(size_t i=0; i<codes.size(); i++) {
+        if(codes[i]==0 || codes[i]==m_startCode)
+            continue;
+        m_evr->interestedInEvent(codes[i], true);
+        m_watched.push_back(codes[i]);
+    }
+}
+
+void evrPulseHistory::captureDataBuffer(mrmDataBufferType::type_t type, size_t offset, size_t length, epicsUInt32 depth)
+{
+    if(m_interest)
+        throw std::runtime_error("Data buffer already captured");
+    if(length==0 || depth==0)
+        throw std::invalid_argument("Length and depth must be at least 1");
+
+    {
+        SCOPED_LOCK(m_lock);
+        m_payloadOffset = offset;
+        m_payloadLength = length;
+        m_payloadData.resize((size_t)depth*length);
+        m_payloadSeq.assign(depth, 0);
+    }
+
+    if(!m_user.init(m_evr->name().c_str(), type))
+        throw std::runtime_error("Can't use the data buffer of "+m_evr->name());
+
+    m_interest = m_user.registerInterest(offset, length, &evrPulseHistory::received, this);
+    if(!m_interest)
+        throw std::runtime_error("Can't receive the data buffer of "+m_evr->name());
+}
+
+void evrPulseHistory::received(size_t, size_t, void *pvt)
+{
+    evrPulseHistory *self = static_cast<evrPulseHistory*>(pvt);
+
+    const epicsUInt8 *buf = self->m_user.requestRxBuffer();
+    {
+        SCOPED_LOCK2(self->m_lock, guard);
+
+        // 0 is reserved for "no payload"
+        if(++self->m_payloadNext==0)
+            self->m_payloadNext = 1;
+        epicsUInt32 seq = self->m_payloadNext;
+        size_t slot = seq % self->m_payloadSeq.size();
+
+        memcpy(&self->m_payloadData[slot*self->m_payloadLength], buf+self->m_payloadOffset, self->m_payloadLength);
+        self->m_payloadSeq[slot] = seq;
+
+        // Sent ahead of the start code, the payload belongs to the next pulse
+        self->m_payloadPending = seq;
+    }
+    self->m_user.releaseRxBuffer();
+}
+
+void evrPulseHistory::startPulse(epicsUInt32 sec, epicsUInt32 ticks)
+{
+    epicsUInt64 id;
+    switch(m_source) {
+    case sourceTimestamp: {
+        double clk = m_evr->clockTS();
+        id = (epicsUInt64)sec*m_rate;
+        if(clk>0.0)
+            id += (epicsUInt64)(ticks/clk*m_rate + 0.5);
+        break;
+    }
+    case sourceDataBuffer: {
+        double value = m_field->value();
+        id = value>0.0 ? (epicsUInt64)value : 0;
+        break;
+    }
+    case sourceCounter:
+    default:
+        id = m_lastId+1;
+        break;
+    }
+
+    if(m_pulses && id!=m_lastId+1)
+        m_gaps++;
+    m_lastId = id;
+    m_pulses++;
+
+    pulse_t& pulse = m_ring[id % m_ring.size()];
+    memset(&pulse, 0, sizeof(pulse));
+    pulse.id = id;
+    pulse.valid = true;
+    pulse.payload = m_payloadPending;
+    m_payloadPending = 0;
+
+    if(m_current && m_sequencer) {
+        // sequencer interrupts counted since the start of the previous pulse
+        epicsUInt32 sos = m_sequencer->sosCount(), eos = m_sequencer->eosCount();
+        m_current->sos = sos - m_sos;
+        m_current->eos = eos - m_eos;
+        m_sos = sos;
+        m_eos = eos;
+    } else if(m_sequencer) {
+        m_sos = m_sequencer->sosCount();
+        m_eos = m_sequencer->eosCount();
+    }
+
+    m_current = &pulse;
+}
+
+void evrPulseHistory::fifoEvent(epicsUInt8 code, epicsUInt32 sec, epicsUInt32 ticks)
+{
+    SCOPED_LOCK(m_lock);
+
+    if(code==m_startCode)
+        startPulse(sec, ticks);
+
+    if(!m_current)
+        return;
+
+    pulse_t& pulse = *m_current;
+    pulse.bits[code>>5] |= 1u<<(code&31);
+    if(pulse.nevents<maxEvents) {
+        arrival_t& arrival = pulse.events[pulse.nevents];
+        arrival.code = code;
+        arrival.sec = sec;
+        arrival.ticks = ticks;
+    } else {
+        m_overflows++;
+    }
+    pulse.nevents++;
+}
+
+bool evrPulseHistory::lookup(epicsUInt64 id, pulse_t& pulse, std::vector<epicsUInt8>* payload) const
+{
+    SCOPED_LOCK(m_lock);
+
+    const pulse_t& slot = m_ring[id % m_ring.size()];
+    if(!slot.valid || slot.id!=id)
+        return false;
+
+    pulse = slot;
+
+    if(payload) {
+        payload->clear();
+        if(pulse.payload && !m_payloadSeq.empty()) {
+            size_t i = pulse.payload % m_payloadSeq.size();
+            if(m_payloadSeq[i]==pulse.payload)
+                payload->assign(m_payloadData.begin()+i*m_payloadLength,
+                                m_payloadData.begin()+(i+1)*m_payloadLength);
+        }
+    }
+    return true;
+}
+
+double evrPulseHistory::pulseId() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_current ? (double)m_current->id : 0.0;
+}
+
+epicsUInt32 evrPulseHistory::pulses() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_pulses;
+}
+
+epicsUInt32 evrPulseHistory::gaps() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_gaps;
+}
+
+epicsUInt32 evrPulseHistory::overflows() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_overflows;
+}
+
+epicsUInt32 evrPulseHistory::payloads() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_payloadNext;
+}
+
+double evrPulseHistory::query() const
+{
+    SCOPED_LOCK(m_lock);
+    return (double)m_queryId;
+}
+
+void evrPulseHistory::setQuery(double id)
+{
+    pulse_t pulse;
+    std::vector<epicsUInt8> payload;
+    bool valid = id>=0.0 && lookup((epicsUInt64)id, pulse, &payload);
+
+    SCOPED_LOCK(m_lock);
+    m_queryId = id>=0.0 ? (epicsUInt64)id : 0;
+    m_queryValid = valid;
+    if(valid) {
+        m_query = pulse;
+        m_queryPayload.swap(payload);
+    } else {
+        memset(&m_query, 0, sizeof(m_query));
+        m_queryPayload.clear();
+    }
+}
+
+bool evrPulseHistory::queryValid() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_queryValid;
+}
+
+epicsUInt32 evrPulseHistory::queryCodes(epicsUInt32 *arr, epicsUInt32 count) const
+{
+    SCOPED_LOCK(m_lock);
+    epicsUInt32 n = std::min(count, std::min(m_query.nevents, (epicsUInt32)maxEvents));
+    for(epicsUInt32 i=0; i<n; i++)
+        arr[i] = m_query.events[i].code;
+    return n;
+}
+
+epicsUInt32 evrPulseHistory::querySec(epicsUInt32 *arr, epicsUInt32 count) const
+{
+    SCOPED_LOCK(m_lock);
+    epicsUInt32 n = std::min(count, std::min(m_query.nevents, (epicsUInt32)maxEvents));
+    for(epicsUInt32 i=0; i<n; i++)
+        arr[i] = m_query.events[i].sec;
+    return n;
+}
+
+epicsUInt32 evrPulseHistory::queryTicks(epicsUInt32 *arr, epicsUInt32 count) const
+{
+    SCOPED_LOCK(m_lock);
+    epicsUInt32 n = std::min(count, std::min(m_query.nevents, (epicsUInt32)maxEvents));
+    for(epicsUInt32 i=0; i<n; i++)
+        arr[i] = m_query.events[i].ticks;
+    return n;
+}
+
+epicsUInt32 evrPulseHistory::queryPayload(epicsUInt8 *arr, epicsUInt32 count) const
+{
+    SCOPED_LOCK(m_lock);
+    epicsUInt32 n = std::min(count, (epicsUInt32)m_queryPayload.size());
+    if(n)
+        memcpy(arr, &m_queryPayload[0], n);
+    return n;
+}
+
+void evrPulseHistory::reset(bool)
+{
+    SCOPED_LOCK(m_lock);
+    m_pulses = m_gaps = m_overflows = 0;
+}
+
+void evrPulseHistory::show(const pulse_t& pulse, const std::vector<epicsUInt8>& payload) const
+{
+    printf("Pulse %llu: %u events", (unsigned long long)pulse.id, pulse.nevents);
+    if(m_sequencer)
+        printf(", %u SOS, %u EOS", pulse.sos, pulse.eos);
+    printf("\n");
+
+    for(epicsUInt32 i=0; i<pulse.nevents && i<maxEvents; i++)
+        printf(" %3u  %u.%09u\n", pulse.events[i].code, pulse.events[i].sec, pulse.events[i].ticks);
+    if(pulse.nevents>maxEvents) {
+        printf(" %u more:", pulse.nevents-maxEvents);
+        for(unsigned code=1; code<256; code++) {
+            if(pulse.bits[code>>5] & (1u<<(code&31)))
+                printf(" %u", code);
+        }
+        printf(" (all codes)\n");
+    }
+
+    if(!payload.empty()) {
+        printf(" Data buffer payload %u, %u bytes:", pulse.payload, (unsigned)payload.size());
+        for(size_t i=0; i<payload.size(); i++)
+            printf("%s%02x", i%16 ? " " : "\n  ", payload[i]);
+        printf("\n");
+    } else if(pulse.payload) {
+        printf(" Data buffer payload %u overwritten\n", pulse.payload);
+    }
+}
+
+void evrPulseHistory::report(int) const
+{
+    static const char *sources[] = {"counter", "timestamp", "dbuf"};
+
+    SCOPED_LOCK(m_lock);
+    printf("%s: start code %u, ID from %s, depth %u\n",
+           name().c_str(), m_startCode, sources[m_source], (unsigned)m_ring.size());
+    printf(" %u pulses, last ID %llu, %u gaps, %u events overflowed\n",
+           m_pulses, (unsigned long long)(m_current ? m_current->id : 0), m_gaps, m_overflows);
+    if(m_interest)
+        printf(" Data buffer %u bytes at %u, %u payloads, depth %u\n",
+               (unsigned)m_payloadLength, (unsigned)m_payloadOffset, m_payloadNext, (unsigned)m_payloadSeq.size());
+}
+
+evrPulseHistory* evrPulseHistory::find(const std::string& evr)
+{
+    return dynamic_cast<evrPulseHistory*>(mrf::Object::getObject(evr+":History"));
+}
+
+
+OBJECT_BEGIN(evrPulseHistory) {
+    OBJECT_PROP1("Depth", &evrPulseHistory::depth);
+    OBJECT_PROP1("Start Code", &evrPulseHistory::startCode);
+    OBJECT_PROP1("Pulse ID", &evrPulseHistory::pulseId);
+    OBJECT_PROP1("Pulses", &evrPulseHistory::pulses);
+    OBJECT_PROP1("Gaps", &evrPulseHistory::gaps);
+    OBJECT_PROP1("Overflows", &evrPulseHistory::overflows);
+    OBJECT_PROP1("Payloads", &evrPulseHistory::payloads);
+    OBJECT_PROP2("Query", &evrPulseHistory::query, &evrPulseHistory::setQuery);
+    OBJECT_PROP1("Query Valid", &evrPulseHistory::queryValid);
+    OBJECT_PROP1("Query Codes", &evrPulseHistory::queryCodes);
+    OBJECT_PROP1("Query Sec", &evrPulseHistory::querySec);
+    OBJECT_PROP1("Query Ticks", &evrPulseHistory::queryTicks);
+    OBJECT_PROP1("Query Payload", &evrPulseHistory::queryPayload);
+    OBJECT_PROP2("Reset", &evrPulseHistory::dummyReturn, &evrPulseHistory::reset);
+} OBJECT_END(evrPulseHistory)
+
+
+/********** Create history  *******/
+static const iocshArg mrmEvrHistoryArg0 = { "EVR", iocshArgString };
+static const iocshArg mrmEvrHistoryArg1 = { "Depth", iocshArgInt };
+static const iocshArg mrmEvrHistoryArg2 = { "Start of pulse code", iocshArgInt };
+static const iocshArg mrmEvrHistoryArg3 = { "Source", iocshArgString };
+static const iocshArg mrmEvrHistoryArg4 = { "Rate or field", iocshArgString };
+static const iocshArg * const mrmEvrHistoryArgs[5] = { &mrmEvrHistoryArg0, &mrmEvrHistoryArg1, &mrmEvrHistoryArg2,
+                                                      &mrmEvrHistoryArg3, &mrmEvrHistoryArg4 };
+static const iocshFuncDef mrmEvrHistoryDef = { "mrmEvrHistory", 5, mrmEvrHistoryArgs };
+
+static void mrmEvrHistoryFunc(const iocshArgBuf *args)
+{
+    if(!args[0].sval || args[1].ival<=0 || args[2].ival<=0) {
+        printf("Usage: mrmEvrHistory EVR Depth Code [Source] [Rate|Field]\n\t" \
+               "EVR = name of the event receiver (eg.: EVR0)\n\t" \
+               "Depth = number of pulses kept\n\t" \
+               "Code = event code received first in each pulse\n\t" \
+               "Source = pulse ID from 'counter' (default), 'timestamp' or 'dbuf'\n\t" \
+               "Rate = pulse rate [Hz] for 'timestamp'\n\t" \
+               "Field = data buffer field for 'dbuf' (eg.: EVR0:Beam:pulseId, see mrmDataBufferSchemaLoad)\n");
+        return;
+    }
+
+    try {
+        EVRMRM *evr = dynamic_cast<EVRMRM*>(mrf::Object::getObject(args[0].sval));
+        if(!evr)
+            throw std::runtime_error("EVR not found");
+        if(evrPulseHistory::find(args[0].sval))
+            throw std::runtime_error("History already exists");
+        if(args[2].ival>255)
+            throw std::invalid_argument("Event code out of range");
+
+        evrPulseHistory::source_t source = evrPulseHistory::sourceCounter;
+        std::string src(args[3].sval ? args[3].sval : "counter");
+        std::string param(args[4].sval ? args[4].sval : "");
+        if(src=="timestamp")
+            source = evrPulseHistory::sourceTimestamp;
+        else if(src=="dbuf")
+            source = evrPulseHistory::sourceDataBuffer;
+        else if(src!="counter")
+            throw std::invalid_argument("Source must be counter, timestamp or dbuf");
+
+        new evrPulseHistory(std::string(args[0].sval)+":History", evr, args[1].ival, (epicsUInt8)args[2].ival,
+                            source, source==evrPulseHistory::sourceTimestamp ? strtoul(param.c_str(), NULL, 0) : 0,
+                            param);
+    } catch(std::exception& e) {
+        errlogPrintf("mrmEvrHistory %s: %s\n", args[0].sval, e.what());
+    }
+}
+
+/********** Watch codes  *******/
+static const iocshArg mrmEvrHistoryWatchArg0 = { "EVR", iocshArgString };
+static const iocshArg mrmEvrHistoryWatchArg1 = { "Codes", iocshArgString };
+static const iocshArg * const mrmEvrHistoryWatchArgs[2] = { &mrmEvrHistoryWatchArg0, &mrmEvrHistoryWatchArg1 };
+static const iocshFuncDef mrmEvrHistoryWatchDef = { "mrmEvrHistoryWatch", 2, mrmEvrHistoryWatchArgs };
+
+static void mrmEvrHistoryWatchFunc(const iocshArgBuf *args)
+{
+    if(!args[0].sval || !args[1].sval) {
+        printf("Usage: mrmEvrHistoryWatch EVR \"Codes\"\n\t" \
+               "EVR = name of the event receiver (eg.: EVR0)\n\t" \
+               "Codes = event codes recorded in the history, eg. \"10 14 125\"\n");
+        return;
+    }
+
+    try {
+        evrPulseHistory *history = evrPulseHistory::find(args[0].sval);
+        if(!history)
+            throw std::runtime_error("No history. Call mrmEvrHistory first");
+
+        std::vector<epicsUInt8> codes;
+        const char *pos = args[1].sval;
+        while(*pos) {
+            char *end;
+            unsigned long code = strtoul(pos, &end, 0);
+            if(end==pos)
+                throw std::invalid_argument("Codes must be numbers");
+            if(code==0 || code>255)
+                throw std::invalid_argument("Event code out of range");
+            codes.push_back((epicsUInt8)code);
+            pos = end;
+            while(*pos==' ' || *pos==',')
+                pos++;
+        }
+        history->watch(codes);
+    } catch(std::exception& e) {
+        errlogPrintf("mrmEvrHistoryWatch %s: %s\n", args[0].sval, e.what());
+    }
+}
+
+/********** Capture data buffer  *******/
+static const iocshArg mrmEvrHistoryDataBufferArg0 = { "EVR", iocshArgString };
+static const iocshArg mrmEvrHistoryDataBufferArg1 = { "Type", iocshArgInt };
+static const iocshArg mrmEvrHistoryDataBufferArg2 = { "Offset", iocshArgInt };
+static const iocshArg mrmEvrHistoryDataBufferArg3 = { "Length", iocshArgInt };
+static const iocshArg mrmEvrHistoryDataBufferArg4 = { "Depth", iocshArgInt };
+static const iocshArg * const mrmEvrHistoryDataBufferArgs[5] = { &mrmEvrHistoryDataBufferArg0, &mrmEvrHistoryDataBufferArg1,
+                                                                &mrmEvrHistoryDataBufferArg2, &mrmEvrHistoryDataBufferArg3,
+                                                                &mrmEvrHistoryDataBufferArg4 };
+static const iocshFuncDef mrmEvrHistoryDataBufferDef = { "mrmEvrHistoryDataBuffer", 5, mrmEvrHistoryDataBufferArgs };
+
+static void mrmEvrHistoryDataBufferFunc(const iocshArgBuf *args)
+{
+    if(!args[0].sval || args[2].ival<0 || args[3].ival<=0) {
+        printf("Usage: mrmEvrHistoryDataBuffer EVR Type Offset Length [Depth]\n\t" \
+               "EVR = name of the event receiver (eg.: EVR0)\n\t" \
+               "Type = 0 for the 230 series, 1 for the 300 series data buffer\n\t" \
+               "Offset, Length = bytes of the data buffer kept for each pulse.  The buffer\n\t" \
+               "                 received before a start code is kept with that pulse\n\t" \
+               "Depth = number of payloads kept (default: depth of the history)\n");
+        return;
+    }
+
+    try {
+        evrPulseHistory *history = evrPulseHistory::find(args[0].sval);
+        if(!history)
+            throw std::runtime_error("No history. Call mrmEvrHistory first");
+        if(args[1].ival!=mrmDataBufferType::type_230 && args[1].ival!=mrmDataBufferType::type_300)
+            throw std::invalid_argument("Unknown data buffer type");
+
+        history->captureDataBuffer((mrmDataBufferType::type_t)args[1].ival, args[2].ival, args[3].ival,
+                                   args[4].ival>0 ? args[4].ival : history->depth());
+    } catch(std::exception& e) {
+        errlogPrintf("mrmEvrHistoryDataBuffer %s: %s\n", args[0].sval, e.what());
+    }
+}
+
+/********** Show pulse  *******/
+static const iocshArg mrmEvrHistoryShowArg0 = { "EVR", iocshArgString };
+static const iocshArg mrmEvrHistoryShowArg1 = { "Pulse ID", iocshArgString };
+static const iocshArg * const mrmEvrHistoryShowArgs[2] = { &mrmEvrHistoryShowArg0, &mrmEvrHistoryShowArg1 };
+static const iocshFuncDef mrmEvrHistoryShowDef = { "mrmEvrHistoryShow", 2, mrmEvrHistoryShowArgs };
+
+static void mrmEvrHistoryShowFunc(const iocshArgBuf *args)
+{
+    evrPulseHistory *history = args[0].sval ? evrPulseHistory::find(args[0].sval) : NULL;
+    if(!history) {
+        printf("Usage: mrmEvrHistoryShow EVR [ID]\n\t" \
+               "EVR = name of the event receiver (eg.: EVR0)\n\t" \
+               "ID = pulse ID. Without, the report of the history\n");
+        return;
+    }
+
+    if(!args[1].sval) {
+        history->report(1);
+        return;
+    }
+
+    epicsUInt64 id = strtoull(args[1].sval, NULL, 0);
+    evrPulseHistory::pulse_t pulse;
+    std::vector<epicsUInt8> payload;
+    if(!history->lookup(id, pulse, &payload)) {
+        printf("Pulse %llu is not in the history\n", (unsigned long long)id);
+        return;
+    }
+    history->show(pulse, payload);
+}
+
+extern "C" {
+static void evrPulseHistoryRegistrar()
+{
+    iocshRegister(&mrmEvrHistoryDef, mrmEvrHistoryFunc);
+    iocshRegister(&mrmEvrHistoryWatchDef, mrmEvrHistoryWatchFunc);
+    iocshRegister(&mrmEvrHistoryDataBufferDef, mrmEvrHistoryDataBufferFunc);
+    iocshRegister(&mrmEvrHistoryShowDef, mrmEvrHistoryShowFunc);
+}
+epicsExportRegistrar(evrPulseHistoryRegistrar);
+}
@@ -0,0 +1,172 @@
+/*************************************************************************\
+* mrfioc2 is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+#ifndef EVRPULSEHISTORY_H
+#define EVRPULSEHISTORY_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+
+#include "mrfCommon.h"
+#include "mrf/object.h"
+#include "dataBuffer/mrmDataBufferUser.h"
+
+class EVRMRM;
+class EvrSequencer;
+class mrmDataBufferField;
+
+/** @brief History of the last pulses received by an EVR, indexed by pulse ID
+ *
+ * A pulse starts with the start of pulse code.  Its ID is taken from one of
+ *  - counter   : the number of start codes received
+ *  - timestamp : the timestamp of the start code, in units of the pulse period:
+ *                seconds * rate + ticks * rate / timestamp clock, rounded
+ *  - dbuf      : a field decoded from the data buffer (mrmDataBufferSchemaLoad),
+ *                which must be sent before the start code
+ *
+ * The pulse of ID N is kept in slot N % depth of a ring, so a lookup is one
+ * index and a compare of the ID.  Each slot holds the codes received in the
+ * pulse (as a bitmap, and the first maxEvents with their timestamps), the
+ * sequencer start/end of sequence interrupts counted during the pulse and,
+ * if captureDataBuffer() was called, the sequence number of the data buffer
+ * payload of the pulse.  The payloads are copied in a ring of their own.
+ *
+ * The data buffer of a pulse is sent ahead of its start code, as the 'dbuf'
+ * source requires anyway.  So a payload received between two start codes
+ * belongs to the pulse started by the second one, not to the one in progress.
+ * If several are received, the last one is kept.
+ *
+ * Only codes which reach the event FIFO are seen.  watch() maps the codes
+ * which are not used by records.
+ *
+ * fifoEvent() runs in the EVR FIFO thread with the EVR lock held.
+ */
+class evrPulseHistory : public mrf::ObjectInst<evrPulseHistory>
+{
+public:
+    enum source_t {
+        sourceCounter,
+        sourceTimestamp,
+        sourceDataBuffer
+    };
+
+    enum { maxEvents = 32 };
+
+    struct arrival_t {
+        epicsUInt8 code;
+        epicsUInt32 sec;
+        epicsUInt32 ticks;
+    };
+
+    struct pulse_t {
+        epicsUInt64 id;
+        bool valid;
+        epicsUInt32 bits[8];
+        epicsUInt32 nevents;        // may be more than maxEvents
+        arrival_t events[maxEvents];
+        epicsUInt32 sos, eos;
+        epicsUInt32 payload;        // sequence number of the data buffer payload, 0 for none
+    };
+
+    /** @param rate pulse rate [Hz] for sourceTimestamp
+     *  @param field name of the mrmDataBufferField object for sourceDataBuffer
+     */
+    evrPulseHistory(const std::string& n, EVRMRM* evr, epicsUInt32 depth, epicsUInt8 startCode,
+                    source_t source, epicsUInt32 rate, const std::string& field);
+    virtual ~evrPulseHistory();
+
+    /* locking done internally */
+    virtual void lock() const{}
+    virtual void unlock() const{}
+
+    //! Map codes to the FIFO for the history
+    void watch(const std::vector<epicsUInt8>& codes);
+
+    /** @brief Copy a range of the received data buffer into the history
+     *
+     * @param depth number of payloads kept
+     * @throws std::runtime_error
+     */
+    void captureDataBuffer(mrmDataBufferType::type_t type, size_t offset, size_t length, epicsUInt32 depth);
+
+    //! Called by the EVR for each event taken from the FIFO
+    void fifoEvent(epicsUInt8 code, epicsUInt32 sec, epicsUInt32 ticks);
+
+    /** @brief Look up a pulse
+     *
+     * @param payload receives the data buffer payload of the pulse, if not NULL
+     * @return false if the pulse is not in the history any more
+     */
+    bool lookup(epicsUInt64 id, pulse_t& pulse, std::vector<epicsUInt8>* payload) const;
+
+    epicsUInt32 depth() const{return (epicsUInt32)m_ring.size();}
+    epicsUInt32 startCode() const{return m_startCode;}
+    double pulseId() const;
+    epicsUInt32 pulses() const;
+    //! Pulses whose ID did not follow the previous one
+    epicsUInt32 gaps() const;
+    //! Events not recorded because a pulse had more than maxEvents
+    epicsUInt32 overflows() const;
+    epicsUInt32 payloads() const;
+
+    /* Query one pulse by ID from records */
+    double query() const;
+    void setQuery(double id);
+    bool queryValid() const;
+    epicsUInt32 queryCodes(epicsUInt32 *arr, epicsUInt32 count) const;
+    epicsUInt32 querySec(epicsUInt32 *arr, epicsUInt32 count) const;
+    epicsUInt32 queryTicks(epicsUInt32 *arr, epicsUInt32 count) const;
+    epicsUInt32 queryPayload(epicsUInt8 *arr, epicsUInt32 count) const;
+
+    bool dummyReturn() const{return false;}
+    void reset(bool);
+
+    void report(int lvl) const;
+    void show(const pulse_t& pulse, const std::vector<epicsUInt8>& payload) const;
+
+    static evrPulseHistory* find(const std::string& evr);
+
+private:
+    static void received(size_t offset, size_t length, void *pvt);
+    void startPulse(epicsUInt32 sec, epicsUInt32 ticks);
+
+    EVRMRM * const m_evr;
+    const epicsUInt8 m_startCode;
+    const source_t m_source;
+    const epicsUInt32 m_rate;
+    const mrmDataBufferField *m_field;
+    const EvrSequencer *m_sequencer;
+
+    std::vector<epicsUInt8> m_watched;
+
+    mrmDataBufferUser m_user;
+    size_t m_interest;
+    size_t m_payloadOffset, m_payloadLength;
+
+    mutable epicsMutex m_lock;
+    // Guarded by m_lock
+    std::vector<pulse_t> m_ring;
+    pulse_t *m_current;
+    epicsUInt64 m_lastId;
+    epicsUInt32 m_pulses, m_gaps, m_overflows;
+    epicsUInt32 m_sos, m_eos;       // sequencer counters at the start of the pulse
+
+    std::vector<epicsUInt8> m_payloadData;  // m_payloadSeq.size() * m_payloadLength
+    std::vector<epicsUInt32> m_payloadSeq;
+    epicsUInt32 m_payloadNext;
+    epicsUInt32 m_payloadPending;   // received since the last start code, for the next pulse
+
+    epicsUInt64 m_queryId;
+    bool m_queryValid;
+    pulse_t m_query;
+    std::vector<epicsUInt8> m_queryPayload;
+
+    evrPulseHistory(const evrPulseHistory&);
+    evrPulseHistory& operator=(const evrPulseHistory&);
+};
+
+#endif // EVRPULSEHISTORY_H
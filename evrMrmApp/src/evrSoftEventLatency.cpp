@@ -0,0 +1,439 @@
+/*************************************************************************\
+* mrfioc2 is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <sstream>
+
+#include <errlog.h>
+#include <iocsh.h>
+
+#include <mrfCommon.h>
+
+#include "evrMrm.h"
+#include "mrmSoftEvent.h"
+
+#include <epicsExport.h>
+#include "evrSoftEventLatency.h"
+
+// Time to wait for an injected event to complete before it is counted lost [s]
+#define LATENCY_TIMEOUT 1.0
+
+
+void evrLatencyHistogram::clear()
+{
+    memset(bins, 0, sizeof(bins));
+    count = 0;
+    max = 0;
+}
+
+unsigned evrLatencyHistogram::bin(epicsUInt32 ns)
+{
+    if(ns < 8)
+        return ns;
+
+    unsigned e = 3;
+    while(e < 31 && (ns >> (e+1)))
+        e++;
+    // 8 bins per power of two, from the 3 bits below the leading one
+    return (e-2)*8 + ((ns >> (e-3)) & 7);
+}
+
+double evrLatencyHistogram::center(unsigned b)
+{
+    if(b < 8)
+        return b;
+
+    unsigned e = b/8 + 2;
+    double width = double(1u << (e-3));
+    return (8 + b%8)*width + width/2;
+}
+
+void evrLatencyHistogram::add(epicsUInt32 ns)
+{
+    bins[bin(ns)]++;
+    count++;
+    if(ns > max)
+        max = ns;
+}
+
+double evrLatencyHistogram::percentile(double pct) const
+{
+    epicsUInt32 n = count;
+    if(n == 0)
+        return 0.0;
+
+    // first bin where the cumulative count reaches pct of all
+    double target = n*pct/100.0;
+    epicsUInt32 sum = 0;
+    for(unsigned b = 0; b < nbins; b++) {
+        sum += bins[b];
+        if(sum >= target && sum > 0) {
+            double c = center(b);
+            return (c < max ? c : max)*1e-3;
+        }
+    }
+    return max*1e-3;
+}
+
+
+const char * const evrSoftEventLatency::stage_names[nstages] = {
+    "hardware",
+    "drain",
+    "dispatch",
+    "total"
+};
+
+evrSoftEventLatency::evrSoftEventLatency(const std::string& n, EVRMRM* evr, mrmSoftEvent* softEvt)
+    :mrf::ObjectInst<evrSoftEventLatency>(n)
+    ,m_evr(evr)
+    ,m_softEvt(softEvt)
+    ,m_thread(*this, "EVRLATENCY", epicsThreadGetStackSize(epicsThreadStackSmall),
+              epicsThreadPriorityMedium)
+    ,m_wakeup()
+    ,m_done()
+    ,m_enable(false)
+    ,m_stop(false)
+    ,m_period(1.0)
+    ,m_codes()
+    ,m_selected(0)
+    ,m_injected(0)
+    ,m_received(0)
+    ,m_lost(0)
+    ,m_state(idle)
+    ,m_code(0)
+    ,m_ticks0(0)
+    ,m_clock(0.0)
+    ,m_t0(0.0)
+    ,m_t1(0.0)
+{
+    memset(m_stats, 0, sizeof(m_stats));
+
+    m_evr->setLatencyProbe(this);
+    m_thread.start();
+}
+
+evrSoftEventLatency::~evrSoftEventLatency()
+{
+    {
+        SCOPED_LOCK2(m_evr->evrLock, guard);
+        m_stop = true;
+        m_evr->setLatencyProbe(NULL);
+        for(size_t i=0; i<m_codes.size(); i++)
+            m_evr->interestedInEvent(m_codes[i], false);
+    }
+    m_wakeup.signal();
+    m_done.signal();
+    m_thread.exitWait();
+
+    for(size_t i=0; i<256; i++)
+        delete m_stats[i];
+}
+
+void evrSoftEventLatency::lock() const{m_evr->lock();}
+void evrSoftEventLatency::unlock() const{m_evr->unlock();}
+
+void evrSoftEventLatency::enable(bool e)
+{
+    {
+        SCOPED_LOCK2(m_evr->evrLock, guard);
+        m_enable = e;
+    }
+    m_wakeup.signal();
+}
+
+void evrSoftEventLatency::setPeriod(double p)
+{
+    if(p < 0.0)
+        throw std::out_of_range("Period must be positive");
+    {
+        SCOPED_LOCK2(m_evr->evrLock, guard);
+        m_period = p;
+    }
+    m_wakeup.signal();
+}
+
+std::string evrSoftEventLatency::codes() const
+{
+    SCOPED_LOCK2(m_evr->evrLock, guard);
+    std::ostringstream strm;
+    for(size_t i=0; i<m_codes.size(); i++)
+        strm<<(i ? " " : "")<<(unsigned)m_codes[i];
+    return strm.str();
+}
+
+void evrSoftEventLatency::setCodes(std::string c)
+{
+    std::vector<epicsUInt8> codes;
+    std::istringstream strm(c);
+    unsigned code;
+    while(strm>>code) {
+        if(code==0 || code>255)
+            throw std::out_of_range("Event code out of range");
+        codes.push_back(code);
+    }
+    if(!strm.eof())
+        throw std::invalid_argument("Codes must be a space separated list of numbers");
+
+    SCOPED_LOCK2(m_evr->evrLock, guard);
+
+    // map the new codes into the FIFO before removing the old ones
+    for(size_t i=0; i<codes.size(); i++) {
+        m_evr->interestedInEvent(codes[i], true);
+        if(!m_stats[codes[i]])
+            m_stats[codes[i]] = new codeStats;
+    }
+    for(size_t i=0; i<m_codes.size(); i++)
+        m_evr->interestedInEvent(m_codes[i], false);
+
+    m_codes.swap(codes);
+    if(m_selected==0 && !m_codes.empty())
+        m_selected = m_codes[0];
+}
+
+void evrSoftEventLatency::select(epicsUInt32 code)
+{
+    if(code>255)
+        throw std::out_of_range("Event code out of range");
+    m_selected = code;
+}
+
+double evrSoftEventLatency::percentile(stage_t stage, epicsUInt8 code, double pct) const
+{
+    const codeStats *stats = m_stats[code];
+    return stats ? stats->hist[stage].percentile(pct) : 0.0;
+}
+
+void evrSoftEventLatency::reset(bool)
+{
+    SCOPED_LOCK2(m_evr->evrLock, guard);
+    for(size_t i=0; i<256; i++) {
+        if(!m_stats[i])
+            continue;
+        for(unsigned s=0; s<nstages; s++)
+            m_stats[i]->hist[s].clear();
+    }
+    m_injected = m_received = m_lost = 0;
+}
+
+void evrSoftEventLatency::record(stage_t stage, double seconds)
+{
+    double ns = seconds*1e9;
+    if(ns < 0.0)
+        ns = 0.0;
+    else if(ns > 4294967295.0)
+        ns = 4294967295.0;
+    m_stats[m_code]->hist[stage].add((epicsUInt32)ns);
+}
+
+void evrSoftEventLatency::fifoArrival(epicsUInt8 code, epicsUInt32 ticks)
+{
+    if(m_state!=sent || code!=m_code)
+        return;
+
+    m_t1 = mrfMonotonicSeconds();
+    double fifo = m_t1 - m_t0;
+
+    // The counter is reset every second.  Only split when it was not reset in between.
+    if(m_clock>0.0 && ticks>=m_ticks0) {
+        double hw = (ticks - m_ticks0)/m_clock;
+        if(hw > fifo)
+            hw = fifo;
+        record(hardware, hw);
+        record(drain, fifo - hw);
+    } else {
+        record(drain, fifo);
+    }
+    m_state = arrived;
+}
+
+void evrSoftEventLatency::dispatched(epicsUInt8 code)
+{
+    if(m_state!=arrived || code!=m_code)
+        return;
+
+    double t2 = mrfMonotonicSeconds();
+    record(dispatch, t2 - m_t1);
+    record(total, t2 - m_t0);
+    m_received++;
+    m_state = idle;
+    m_done.signal();
+}
+
+void evrSoftEventLatency::inject(epicsUInt8 code)
+{
+    (void)m_done.tryWait(); // discard a late completion
+
+    {
+        SCOPED_LOCK2(m_evr->evrLock, guard);
+        m_clock = m_evr->clockTS();
+        m_code = code;
+        m_state = sent;
+        m_injected++;
+        m_evr->getTicks(&m_ticks0);
+        m_t0 = mrfMonotonicSeconds();
+    }
+
+    try {
+        m_softEvt->setEvtCode(code);
+    } catch(std::exception& e) {
+        SCOPED_LOCK2(m_evr->evrLock, guard);
+        m_state = idle;
+        m_lost++;
+        errlogPrintf("%s: %s\n", name().c_str(), e.what());
+        return;
+    }
+
+    if(!m_done.wait(LATENCY_TIMEOUT)) {
+        SCOPED_LOCK2(m_evr->evrLock, guard);
+        if(m_state!=idle) {
+            m_state = idle;
+            m_lost++;
+        }
+    }
+}
+
+void evrSoftEventLatency::run()
+{
+    std::vector<epicsUInt8> codes;
+
+    while(true) {
+        double period;
+        bool enable;
+        {
+            SCOPED_LOCK2(m_evr->evrLock, guard);
+            if(m_stop)
+                break;
+            codes = m_codes;
+            period = m_period;
+            enable = m_enable;
+        }
+
+        if(!enable || codes.empty()) {
+            m_wakeup.wait();
+            continue;
+        }
+
+        double start = mrfMonotonicSeconds();
+
+        for(size_t i=0; i<codes.size(); i++)
+            inject(codes[i]);
+
+        double left = period - (mrfMonotonicSeconds() - start);
+        if(left > 0.0)
+            m_wakeup.wait(left);
+    }
+}
+
+void evrSoftEventLatency::report(int lvl) const
+{
+    printf("%s: codes '%s', period %.3f s%s, %u injected, %u received, %u lost\n",
+           name().c_str(), codes().c_str(), m_period, m_enable ? "" : " (disabled)",
+           m_injected, m_received, m_lost);
+
+    for(unsigned c=1; c<256; c++) {
+        const codeStats *stats = m_stats[c];
+        if(!stats || !stats->hist[total].count)
+            continue;
+        printf(" Code %u [us]\n", c);
+        for(unsigned s=0; s<nstages; s++) {
+            const evrLatencyHistogram& hist = stats->hist[s];
+            printf("  %-9s n=%-8u p50=%-10.2f p90=%-10.2f p99=%-10.2f max=%.2f\n",
+                   stage_names[s], hist.count, hist.percentile(50), hist.percentile(90),
+                   hist.percentile(99), hist.max*1e-3);
+        }
+    }
+}
+
+evrSoftEventLatency* evrSoftEventLatency::find(const std::string& evr)
+{
+    return dynamic_cast<evrSoftEventLatency*>(mrf::Object::getObject(evr+":Latency"));
+}
+
+
+#define LATENCY_STAGE_PROPS(NAME, S) \
+    OBJECT_PROP1(NAME " P50", (&evrSoftEventLatency::percentileProp<evrSoftEventLatency::S, 50>)); \
+    OBJECT_PROP1(NAME " P90", (&evrSoftEventLatency::percentileProp<evrSoftEventLatency::S, 90>)); \
+    OBJECT_PROP1(NAME " P99", (&evrSoftEventLatency::percentileProp<evrSoftEventLatency::S, 99>)); \
+    OBJECT_PROP1(NAME " Max", &evrSoftEventLatency::maxProp<evrSoftEventLatency::S>)
+
+OBJECT_BEGIN(evrSoftEventLatency) {
+    OBJECT_PROP2("Enable", &evrSoftEventLatency::enabled, &evrSoftEventLatency::enable);
+    OBJECT_PROP2("Period", &evrSoftEventLatency::period, &evrSoftEventLatency::setPeriod);
+    OBJECT_PROP2("Codes", &evrSoftEventLatency::codes, &evrSoftEventLatency::setCodes);
+    OBJECT_PROP2("Code", &evrSoftEventLatency::selected, &evrSoftEventLatency::select);
+    OBJECT_PROP1("Injected", &evrSoftEventLatency::injected);
+    OBJECT_PROP1("Received", &evrSoftEventLatency::received);
+    OBJECT_PROP1("Lost", &evrSoftEventLatency::lost);
+    LATENCY_STAGE_PROPS("HW", hardware);
+    LATENCY_STAGE_PROPS("Drain", drain);
+    LATENCY_STAGE_PROPS("Dispatch", dispatch);
+    LATENCY_STAGE_PROPS("Total", total);
+    OBJECT_PROP2("Reset", &evrSoftEventLatency::dummyReturn, &evrSoftEventLatency::reset);
+} OBJECT_END(evrSoftEventLatency)
+
+
+/********** Create latency measurement  *******/
+static const iocshArg mrmEvrLatencyArg0 = { "EVR", iocshArgString };
+static const iocshArg mrmEvrLatencyArg1 = { "Codes", iocshArgString };
+static const iocshArg mrmEvrLatencyArg2 = { "Period", iocshArgDouble };
+static const iocshArg * const mrmEvrLatencyArgs[3] = { &mrmEvrLatencyArg0, &mrmEvrLatencyArg1, &mrmEvrLatencyArg2 };
+static const iocshFuncDef mrmEvrLatencyDef = { "mrmEvrLatency", 3, mrmEvrLatencyArgs };
+
+static void mrmEvrLatencyFunc(const iocshArgBuf *args)
+{
+    if(!args[0].sval) {
+        printf("Usage: mrmEvrLatency EVR \"Codes\" Period\n\t" \
+               "EVR = name of the event receiver (eg.: EVR0)\n\t" \
+               "Codes = soft event codes to inject, eg. \"122 123\". Not used by anything else.\n\t" \
+               "Period = interval between injections [s] (default: 1)\n" \
+               "Injection starts when enabled, see evr-softEvent-latency.template\n");
+        return;
+    }
+
+    try {
+        EVRMRM *evr = dynamic_cast<EVRMRM*>(mrf::Object::getObject(args[0].sval));
+        if(!evr)
+            throw std::runtime_error("EVR not found");
+        mrmSoftEvent *softEvt = dynamic_cast<mrmSoftEvent*>(mrf::Object::getObject(std::string(args[0].sval)+":SoftEvt"));
+        if(!softEvt)
+            throw std::runtime_error("EVR has no soft event register");
+        if(evrSoftEventLatency::find(args[0].sval))
+            throw std::runtime_error("Latency measurement already exists");
+
+        evrSoftEventLatency *lat = new evrSoftEventLatency(std::string(args[0].sval)+":Latency", evr, softEvt);
+        if(args[1].sval)
+            lat->setCodes(args[1].sval);
+        if(args[2].dval > 0.0)
+            lat->setPeriod(args[2].dval);
+    } catch(std::exception& e) {
+        errlogPrintf("mrmEvrLatency %s: %s\n", args[0].sval, e.what());
+    }
+}
+
+/********** Report  *******/
+static const iocshArg mrmEvrLatencyReportArg0 = { "EVR", iocshArgString };
+static const iocshArg * const mrmEvrLatencyReportArgs[1] = { &mrmEvrLatencyReportArg0 };
+static const iocshFuncDef mrmEvrLatencyReportDef = { "mrmEvrLatencyReport", 1, mrmEvrLatencyReportArgs };
+
+static void mrmEvrLatencyReportFunc(const iocshArgBuf *args)
+{
+    evrSoftEventLatency *lat = args[0].sval ? evrSoftEventLatency::find(args[0].sval) : NULL;
+    if(!lat) {
+        printf("Usage: mrmEvrLatencyReport EVR\n");
+        return;
+    }
+    lat->report(1);
+}
+
+extern "C" {
+static void evrSoftEventLatencyRegistrar()
+{
+    iocshRegister(&mrmEvrLatencyDef, mrmEvrLatencyFunc);
+    iocshRegister(&mrmEvrLatencyReportDef, mrmEvrLatencyReportFunc);
+}
+epicsExportRegistrar(evrSoftEventLatencyRegistrar);
+}
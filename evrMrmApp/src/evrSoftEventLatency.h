@@ -0,0 +1,167 @@
+/*************************************************************************\
+* mrfioc2 is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+#ifndef EVRSOFTEVENTLATENCY_H
+#define EVRSOFTEVENTLATENCY_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
+
+#include "mrf/object.h"
+
+class EVRMRM;
+class mrmSoftEvent;
+
+/** @brief Latency histogram
+ *
+ * Log-linear bins of 1 ns below 8 ns, then 8 bins per power of two
+ * (12% resolution) up to 4.3 s.  There is one writer at a time, which is
+ * serialized by the owner.  Readers do not lock, and may see a sample
+ * counted in a bin before it is counted in the total.
+ */
+struct evrLatencyHistogram
+{
+    enum { nbins = 240 };
+
+    epicsUInt32 bins[nbins];
+    epicsUInt32 count;
+    epicsUInt32 max;
+
+    evrLatencyHistogram() {clear();}
+
+    void clear();
+    //! @param ns latency [ns]
+    void add(epicsUInt32 ns);
+    //! @param pct 0 to 100.  Returns [us], 0 when empty.
+    double percentile(double pct) const;
+
+    static unsigned bin(epicsUInt32 ns);
+    //! Middle of a bin [ns]
+    static double center(unsigned bin);
+};
+
+/** @brief Measures the latency of soft events injected into an EVR
+ *
+ * A thread injects each of a set of codes in turn through the soft event
+ * register of the EVR (\<EVR\>:SoftEvt), one at a time, and waits for it
+ * to complete before the next.  Hooks in EVRMRM capture the arrival in
+ * the FIFO thread and the completion of the callbacks of the event.
+ *
+ * The latency is split in stages, each with a histogram per code
+ *  - hardware : injection until the event is stored in the FIFO, from the
+ *               timestamp event counter latched at injection and stored in the FIFO.
+ *  - drain    : FIFO until read by the FIFO thread (IRQ and thread wake up)
+ *  - dispatch : FIFO thread until the callbacks of all priorities completed,
+ *               which includes processing of "I/O Intr" records of the event.
+ *  - total    : injection until dispatch completed
+ *
+ * Times are taken from the monotonic clock (Base >= 3.16.1) or the system clock.
+ * In-flight state is guarded by the EVR lock.
+ */
+class evrSoftEventLatency : public mrf::ObjectInst<evrSoftEventLatency>,
+                            public epicsThreadRunable
+{
+public:
+    enum stage_t {
+        hardware,
+        drain,
+        dispatch,
+        total,
+        nstages
+    };
+    static const char * const stage_names[nstages];
+
+    evrSoftEventLatency(const std::string& n, EVRMRM* evr, mrmSoftEvent* softEvt);
+    virtual ~evrSoftEventLatency();
+
+    virtual void lock() const;
+    virtual void unlock() const;
+
+    bool enabled() const{return m_enable;}
+    void enable(bool e);
+
+    //! Interval between injections of the same code [s]
+    double period() const{return m_period;}
+    void setPeriod(double p);
+
+    //! Space separated list of codes to inject, eg. "122 123"
+    std::string codes() const;
+    void setCodes(std::string c);
+
+    //! Code shown by the percentile properties
+    epicsUInt32 selected() const{return m_selected;}
+    void select(epicsUInt32 code);
+
+    epicsUInt32 injected() const{return m_injected;}
+    epicsUInt32 received() const{return m_received;}
+    epicsUInt32 lost() const{return m_lost;}
+
+    //! [us]
+    double percentile(stage_t stage, epicsUInt8 code, double pct) const;
+    template<int S, int P>
+    double percentileProp() const{return percentile((stage_t)S, m_selected, P);}
+    template<int S>
+    double maxProp() const;
+
+    void reset(bool);
+    bool dummyReturn() const{return false;}
+
+    void report(int lvl) const;
+
+    static evrSoftEventLatency* find(const std::string& evr);
+
+    //! Called by EVRMRM::drain_fifo() for each event, with the EVR lock held
+    void fifoArrival(epicsUInt8 code, epicsUInt32 ticks);
+    //! Called by EVRMRM::sentinel_done() when all callbacks of an event completed, with the EVR lock held
+    void dispatched(epicsUInt8 code);
+
+    virtual void run();
+
+private:
+    EVRMRM * const m_evr;
+    mrmSoftEvent * const m_softEvt;
+
+    epicsThread m_thread;
+    epicsEvent m_wakeup;
+    epicsEvent m_done;
+
+    // Guarded by the EVR lock
+    bool m_enable;
+    bool m_stop;
+    double m_period;
+    std::vector<epicsUInt8> m_codes;
+    epicsUInt32 m_selected;
+    epicsUInt32 m_injected, m_received, m_lost;
+
+    // In-flight event
+    enum { idle, sent, arrived } m_state;
+    epicsUInt8 m_code;
+    epicsUInt32 m_ticks0;
+    double m_clock;     // timestamp counter [Hz] at injection
+    double m_t0, m_t1;  // [s] from mrfMonotonicSeconds()
+
+    // One set of histograms per code, allocated when the code is first used.
+    // Never freed while running, so readers do not lock.
+    struct codeStats {
+        evrLatencyHistogram hist[nstages];
+    };
+    codeStats *m_stats[256];
+
+    void inject(epicsUInt8 code);
+    void record(stage_t stage, double seconds);
+};
+
+template<int S>
+double evrSoftEventLatency::maxProp() const
+{
+    const codeStats *stats = m_stats[m_selected&0xff];
+    return stats ? stats->hist[S].max*1e-3 : 0.0;
+}
+
+#endif // EVRSOFTEVENTLATENCY_H
@@ -0,0 +1,709 @@
+/*************************************************************************\
+* mrfioc2 is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*
+ * Serve up EVR time to chronyd through its SOCK reference clock driver.
+ *
+ * cf. chrony.conf(5), refclock SOCK, and refclock_sock.c of chrony
+ *
+ * Unlike ntpShm.cpp, which is fed once per second, the samples are taken
+ * from any mapped event at up to 'rate' samples per second.
+ *
+ * To use, add to init script.
+ *
+ *   mrmTimeExport("EVR0", "/var/run/chrony.evr0.sock", 14, 50)
+ *
+ * Add to chrony.conf.  Add 'noselect' when testing
+ *
+ *   refclock SOCK /var/run/chrony.evr0.sock refid EVR poll 0 precision 1e-7
+ *
+ * chronyd creates the socket, the IOC connects to it and sends one datagram
+ * per sample.  Until chronyd runs, connecting is retried once per second.
+ *
+ * Each sample, in the EVR FIFO thread when the event arrives:
+ *  1) read the timestamp latched by the event
+ *  2) latch and read the current EVR time, between two monotonic clock reads
+ *  3) read the system clock, followed by a monotonic clock read
+ * The system time is moved back to the middle of the EVR read, by the
+ * monotonic time elapsed between the two, so the offset is not biased by
+ * the time it takes to read the EVR and the system clock.  The delay
+ * between the arrival of the event and the sample is the difference of the
+ * two EVR timestamps.  Samples with a slow EVR read (preempted, bus busy)
+ * are rejected.
+ *
+ * Without hardware, mrmTimeExportSim sends samples of the system clock plus
+ * an offset, and mrmTimeExportListen acts as chronyd to receive them.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <stdexcept>
+#include <vector>
+
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <epicsTime.h>
+#include <epicsVersion.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <errlog.h>
+#include <iocsh.h>
+
+#include "mrfCommon.h"
+#include "mrf/object.h"
+#include "evrMrm.h"
+
+#include <epicsExport.h>
+
+#define RETRY_TIME 1.0
+
+// Samples kept for the offset mean and jitter
+#define WINDOW 64
+
+namespace {
+
+// definition of the sample, as in chrony refclock_sock.c
+#define SOCK_MAGIC 0x534f434b
+
+struct sock_sample {
+    // The system time of the sample
+    struct timeval tv;
+
+    // Offset between the reference and the system clock (reference - system)
+    double offset;
+
+    // Non-zero if only the fraction of the second is valid (PPS)
+    int pulse;
+
+    int leap;
+    int _pad;
+    int magic;
+};
+
+double realtime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// EPICS time stamp as POSIX seconds
+double posix(const epicsTimeStamp& ts)
+{
+    return (double)ts.secPastEpoch + POSIX_TIME_AT_EPICS_EPOCH + ts.nsec*1e-9;
+}
+
+} // namespace
+
+/** @brief Exports the time of an EVR to chronyd
+ *
+ * Object name is <EVR>:TimeExport, or the name given to mrmTimeExportSim.
+ */
+class evrTimeExport : public mrf::ObjectInst<evrTimeExport>,
+                      public epicsThreadRunable
+{
+public:
+    //! @param evr NULL to simulate the reference with the system clock plus simOffset
+    evrTimeExport(const std::string& n, EVRMRM *evr, epicsUInt32 event, double rate,
+                  const std::string& path, double simOffset);
+    virtual ~evrTimeExport();
+
+    /* locking done internally */
+    virtual void lock() const{}
+    virtual void unlock() const{}
+
+    epicsUInt32 code() const{return m_event;}
+    double rate() const;
+    void setRate(double rate);
+    //! [us]
+    double maxReadTime() const;
+    void setMaxReadTime(double us);
+
+    //! Offset of the last sample, reference - system [us]
+    double offset() const;
+    double offsetMean() const;
+    //! Standard deviation of the offset over the last samples [us]
+    double jitter() const;
+    //! Event arrival to sample [us]
+    double delay() const;
+    double delayMax() const;
+    //! Time to read the EVR [us]
+    double readTime() const;
+    double readTimeMax() const;
+    epicsUInt32 samples() const;
+    epicsUInt32 rejected() const;
+    epicsUInt32 failed() const;
+    epicsUInt32 sendErrors() const;
+    bool connected() const;
+
+    bool dummyReturn() const{return false;}
+    void reset(bool);
+
+    void report() const;
+
+    static evrTimeExport* find(const std::string& evr);
+
+    virtual void run();
+
+private:
+    static void event(void *raw, epicsUInt32 code);
+    void sample();
+    void send(double sys, double offset);
+    void stats(double& mean, double& jitter) const;
+
+    EVRMRM * const m_evr;
+    const epicsUInt32 m_event;
+    const std::string m_path;
+    const double m_simOffset;
+
+    mutable epicsMutex m_lock;
+    // Guarded by m_lock
+    double m_rate, m_maxRead;
+    double m_last;              // monotonic time of the last sample
+    int m_sock;
+    double m_retry;             // monotonic time of the next connection attempt
+    double m_offset, m_delay, m_delayMax, m_read, m_readMax;
+    double m_window[WINDOW];
+    epicsUInt32 m_samples, m_rejected, m_failed, m_sendErrors;
+    bool m_stop;
+
+    epicsThread m_thread;       // only runs to simulate
+
+    evrTimeExport(const evrTimeExport&);
+    evrTimeExport& operator=(const evrTimeExport&);
+};
+
+evrTimeExport::evrTimeExport(const std::string& n, EVRMRM *evr, epicsUInt32 event, double rate,
+                             const std::string& path, double simOffset)
+    :mrf::ObjectInst<evrTimeExport>(n)
+    ,m_evr(evr)
+    ,m_event(event)
+    ,m_path(path)
+    ,m_simOffset(simOffset)
+    ,m_rate(rate)
+    ,m_maxRead(20.0)
+    ,m_last(0.0)
+    ,m_sock(-1)
+    ,m_retry(0.0)
+    ,m_offset(0.0)
+    ,m_delay(0.0)
+    ,m_delayMax(0.0)
+    ,m_read(0.0)
+    ,m_readMax(0.0)
+    ,m_samples(0)
+    ,m_rejected(0)
+    ,m_failed(0)
+    ,m_sendErrors(0)
+    ,m_stop(false)
+    ,m_thread(*this, "MRF TIME SIM",
+              epicsThreadGetStackSize(epicsThreadStackSmall),
+              epicsThreadPriorityHigh)
+{
+    struct sockaddr_un addr;
+    if(path.size()>=sizeof(addr.sun_path))
+        throw std::invalid_argument("Socket path too long");
+    if(rate<=0.0)
+        throw std::invalid_argument("Rate must be positive");
+
+    memset(m_window, 0, sizeof(m_window));
+
+    if(m_evr)
+        m_evr->eventNotifyAdd(m_event, &evrTimeExport::event, (void*)this);
+    else
+        m_thread.start();
+}
+
+evrTimeExport::~evrTimeExport()
+{
+    if(m_evr) {
+        m_evr->eventNotifyDel(m_event, &evrTimeExport::event, (void*)this);
+    } else {
+        {
+            SCOPED_LOCK(m_lock);
+            m_stop = true;
+        }
+        m_thread.exitWait();
+    }
+    if(m_sock!=-1)
+        close(m_sock);
+}
+
+void evrTimeExport::event(void *raw, epicsUInt32)
+{
+    evrTimeExport *self = static_cast<evrTimeExport*>(raw);
+    self->sample();
+}
+
+void evrTimeExport::run()
+{
+    while(true) {
+        double period;
+        {
+            SCOPED_LOCK(m_lock);
+            if(m_stop)
+                break;
+            period = 1.0/m_rate;
+        }
+        epicsThreadSleep(period);
+        sample();
+    }
+}
+
+void evrTimeExport::sample()
+{
+    double start = mrfMonotonicSeconds();
+    {
+        SCOPED_LOCK(m_lock);
+        // The event may come faster than the sample rate.  Allow some jitter of the event.
+        if(start - m_last < 0.9/m_rate)
+            return;
+        m_last = start;
+    }
+
+    epicsTimeStamp evt, ref;
+    double tevt=0.0, tref=0.0, m0, m1, sys, m2;
+
+    if(m_evr) {
+        if(!m_evr->getTimeStamp(&evt, m_event)) {
+            SCOPED_LOCK(m_lock);
+            m_failed++;
+            return;
+        }
+        tevt = posix(evt);
+
+        m0 = mrfMonotonicSeconds();
+        bool valid = m_evr->getTimeStamp(&ref, 0);
+        m1 = mrfMonotonicSeconds();
+        sys = realtime();
+        m2 = mrfMonotonicSeconds();
+
+        if(!valid) {
+            SCOPED_LOCK(m_lock);
+            m_failed++;
+            return;
+        }
+        tref = posix(ref);
+    } else {
+        m0 = mrfMonotonicSeconds();
+        tref = realtime() + m_simOffset;
+        m1 = mrfMonotonicSeconds();
+        sys = realtime();
+        m2 = mrfMonotonicSeconds();
+        tevt = tref - (m0 - start);
+    }
+
+    // System time in the middle of the EVR read
+    double sysAtRef = sys - (m2 - m1) - (m1 - m0)/2.0;
+    double offset = tref - sysAtRef;
+    double read = (m1 - m0)*1e6;
+
+    {
+        SCOPED_LOCK(m_lock);
+        m_read = read;
+        if(read>m_readMax)
+            m_readMax = read;
+        if(read>m_maxRead) {
+            m_rejected++;
+            return;
+        }
+
+        m_delay = (tref - tevt)*1e6;
+        if(m_delay>m_delayMax)
+            m_delayMax = m_delay;
+        m_offset = offset*1e6;
+        m_window[m_samples%WINDOW] = m_offset;
+        m_samples++;
+
+        send(sysAtRef, offset);
+    }
+}
+
+// Caller must hold m_lock
+void evrTimeExport::send(double sys, double offset)
+{
+    if(m_sock==-1) {
+        double t = mrfMonotonicSeconds();
+        if(t<m_retry)
+            return;
+        m_retry = t + RETRY_TIME;
+
+        m_sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+        if(m_sock==-1) {
+            m_sendErrors++;
+            return;
+        }
+
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, m_path.c_str());
+
+        if(connect(m_sock, (struct sockaddr*)&addr, sizeof(addr))) {
+            // chronyd not running (yet)
+            close(m_sock);
+            m_sock = -1;
+            m_sendErrors++;
+            return;
+        }
+    }
+
+    sock_sample s;
+    memset(&s, 0, sizeof(s));
+    s.tv.tv_sec = (time_t)floor(sys);
+    s.tv.tv_usec = (suseconds_t)((sys - floor(sys))*1e6);
+    s.offset = offset;
+    s.pulse = 0;
+    s.leap = 0;
+    s.magic = SOCK_MAGIC;
+
+    if(::send(m_sock, &s, sizeof(s), MSG_DONTWAIT)!=(ssize_t)sizeof(s)) {
+        m_sendErrors++;
+        if(errno!=EAGAIN) {
+            // chronyd restarted, connect again
+            close(m_sock);
+            m_sock = -1;
+        }
+    }
+}
+
+double evrTimeExport::rate() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_rate;
+}
+
+void evrTimeExport::setRate(double rate)
+{
+    if(rate<=0.0 || rate>1000.0)
+        throw std::out_of_range("Rate out of range");
+    SCOPED_LOCK(m_lock);
+    m_rate = rate;
+}
+
+double evrTimeExport::maxReadTime() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_maxRead;
+}
+
+void evrTimeExport::setMaxReadTime(double us)
+{
+    SCOPED_LOCK(m_lock);
+    m_maxRead = us;
+}
+
+double evrTimeExport::offset() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_offset;
+}
+
+// Caller must hold m_lock
+void evrTimeExport::stats(double& mean, double& jitter) const
+{
+    size_t n = m_samples<WINDOW ? m_samples : WINDOW;
+    mean = jitter = 0.0;
+    if(!n)
+        return;
+
+    for(size_t i=0; i<n; i++)
+        mean += m_window[i];
+    mean /= n;
+    for(size_t i=0; i<n; i++)
+        jitter += (m_window[i]-mean)*(m_window[i]-mean);
+    jitter = sqrt(jitter/n);
+}
+
+double evrTimeExport::offsetMean() const
+{
+    SCOPED_LOCK(m_lock);
+    double mean, jitter;
+    stats(mean, jitter);
+    return mean;
+}
+
+double evrTimeExport::jitter() const
+{
+    SCOPED_LOCK(m_lock);
+    double mean, jitter;
+    stats(mean, jitter);
+    return jitter;
+}
+
+double evrTimeExport::delay() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_delay;
+}
+
+double evrTimeExport::delayMax() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_delayMax;
+}
+
+double evrTimeExport::readTime() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_read;
+}
+
+double evrTimeExport::readTimeMax() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_readMax;
+}
+
+epicsUInt32 evrTimeExport::samples() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_samples;
+}
+
+epicsUInt32 evrTimeExport::rejected() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_rejected;
+}
+
+epicsUInt32 evrTimeExport::failed() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_failed;
+}
+
+epicsUInt32 evrTimeExport::sendErrors() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_sendErrors;
+}
+
+bool evrTimeExport::connected() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_sock!=-1;
+}
+
+void evrTimeExport::reset(bool)
+{
+    SCOPED_LOCK(m_lock);
+    m_delayMax = m_readMax = 0.0;
+    m_samples = m_rejected = m_failed = m_sendErrors = 0;
+    memset(m_window, 0, sizeof(m_window));
+}
+
+void evrTimeExport::report() const
+{
+    SCOPED_LOCK(m_lock);
+    double mean, jitter;
+    stats(mean, jitter);
+
+    printf("%s: event %u at %.1f Hz to %s (%s)\n", name().c_str(), m_event, m_rate,
+           m_path.c_str(), m_sock!=-1 ? "connected" : "not connected");
+    printf(" %u samples, %u rejected, %u failed, %u send errors\n",
+           m_samples, m_rejected, m_failed, m_sendErrors);
+    printf(" offset %.3f us, mean %.3f us, jitter %.3f us\n", m_offset, mean, jitter);
+    printf(" delay %.1f us (max %.1f), read %.1f us (max %.1f, limit %.1f)\n",
+           m_delay, m_delayMax, m_read, m_readMax, m_maxRead);
+}
+
+evrTimeExport* evrTimeExport::find(const std::string& evr)
+{
+    return dynamic_cast<evrTimeExport*>(mrf::Object::getObject(evr+":TimeExport"));
+}
+
+OBJECT_BEGIN(evrTimeExport) {
+    OBJECT_PROP1("Code", &evrTimeExport::code);
+    OBJECT_PROP2("Rate", &evrTimeExport::rate, &evrTimeExport::setRate);
+    OBJECT_PROP2("Max Read Time", &evrTimeExport::maxReadTime, &evrTimeExport::setMaxReadTime);
+    OBJECT_PROP1("Offset", &evrTimeExport::offset);
+    OBJECT_PROP1("Offset Mean", &evrTimeExport::offsetMean);
+    OBJECT_PROP1("Jitter", &evrTimeExport::jitter);
+    OBJECT_PROP1("Delay", &evrTimeExport::delay);
+    OBJECT_PROP1("Delay Max", &evrTimeExport::delayMax);
+    OBJECT_PROP1("Read Time", &evrTimeExport::readTime);
+    OBJECT_PROP1("Read Time Max", &evrTimeExport::readTimeMax);
+    OBJECT_PROP1("Samples", &evrTimeExport::samples);
+    OBJECT_PROP1("Rejected", &evrTimeExport::rejected);
+    OBJECT_PROP1("Failed", &evrTimeExport::failed);
+    OBJECT_PROP1("Send Errors", &evrTimeExport::sendErrors);
+    OBJECT_PROP1("Connected", &evrTimeExport::connected);
+    OBJECT_PROP2("Reset", &evrTimeExport::dummyReturn, &evrTimeExport::reset);
+} OBJECT_END(evrTimeExport)
+
+
+/********** Export EVR time  *******/
+static const iocshArg mrmTimeExportArg0 = { "EVR", iocshArgString };
+static const iocshArg mrmTimeExportArg1 = { "Socket", iocshArgString };
+static const iocshArg mrmTimeExportArg2 = { "Event code", iocshArgInt };
+static const iocshArg mrmTimeExportArg3 = { "Rate", iocshArgDouble };
+static const iocshArg * const mrmTimeExportArgs[4] = { &mrmTimeExportArg0, &mrmTimeExportArg1,
+                                                       &mrmTimeExportArg2, &mrmTimeExportArg3 };
+static const iocshFuncDef mrmTimeExportDef = { "mrmTimeExport", 4, mrmTimeExportArgs };
+
+static void mrmTimeExportFunc(const iocshArgBuf *args)
+{
+    if(!args[0].sval || !args[1].sval) {
+        printf("Usage: mrmTimeExport EVR Socket [Code] [Rate]\n\t" \
+               "EVR = name of the event receiver (eg.: EVR0)\n\t" \
+               "Socket = path of the chronyd SOCK refclock\n\t" \
+               "Code = event code sampled (default: 125, 1 Hz)\n\t" \
+               "Rate = samples per second, at most (default: 1)\n");
+        return;
+    }
+
+    try {
+        EVRMRM *evr = dynamic_cast<EVRMRM*>(mrf::Object::getObject(args[0].sval));
+        if(!evr)
+            throw std::runtime_error("EVR not found");
+        if(evrTimeExport::find(args[0].sval))
+            throw std::runtime_error("Time export already exists");
+
+        int code = args[2].ival ? args[2].ival : MRF_EVENT_TS_COUNTER_RST;
+        if(code<=0 || code>255)
+            throw std::invalid_argument("Event code out of range");
+
+        new evrTimeExport(std::string(args[0].sval)+":TimeExport", evr, code,
+                          args[3].dval>0.0 ? args[3].dval : 1.0, args[1].sval, 0.0);
+    } catch(std::exception& e) {
+        errlogPrintf("mrmTimeExport %s: %s\n", args[0].sval, e.what());
+    }
+}
+
+/********** Simulate  *******/
+static const iocshArg mrmTimeExportSimArg0 = { "Name", iocshArgString };
+static const iocshArg mrmTimeExportSimArg1 = { "Socket", iocshArgString };
+static const iocshArg mrmTimeExportSimArg2 = { "Rate", iocshArgDouble };
+static const iocshArg mrmTimeExportSimArg3 = { "Offset", iocshArgDouble };
+static const iocshArg * const mrmTimeExportSimArgs[4] = { &mrmTimeExportSimArg0, &mrmTimeExportSimArg1,
+                                                          &mrmTimeExportSimArg2, &mrmTimeExportSimArg3 };
+static const iocshFuncDef mrmTimeExportSimDef = { "mrmTimeExportSim", 4, mrmTimeExportSimArgs };
+
+static void mrmTimeExportSimFunc(const iocshArgBuf *args)
+{
+    if(!args[0].sval || !args[1].sval || args[2].dval<=0.0) {
+        printf("Usage: mrmTimeExportSim Name Socket Rate [Offset]\n\t" \
+               "Name = object name (eg.: SIM0:TimeExport)\n\t" \
+               "Socket = path of the chronyd SOCK refclock\n\t" \
+               "Rate = samples per second\n\t" \
+               "Offset = of the simulated reference from the system clock [us]\n");
+        return;
+    }
+
+    try {
+        new evrTimeExport(args[0].sval, NULL, 0, args[2].dval, args[1].sval, args[3].dval*1e-6);
+    } catch(std::exception& e) {
+        errlogPrintf("mrmTimeExportSim %s: %s\n", args[0].sval, e.what());
+    }
+}
+
+/********** Receive like chronyd  *******/
+static const iocshArg mrmTimeExportListenArg0 = { "Socket", iocshArgString };
+static const iocshArg mrmTimeExportListenArg1 = { "Count", iocshArgInt };
+static const iocshArg * const mrmTimeExportListenArgs[2] = { &mrmTimeExportListenArg0, &mrmTimeExportListenArg1 };
+static const iocshFuncDef mrmTimeExportListenDef = { "mrmTimeExportListen", 2, mrmTimeExportListenArgs };
+
+static void mrmTimeExportListenFunc(const iocshArgBuf *args)
+{
+    if(!args[0].sval || args[1].ival<=0) {
+        printf("Usage: mrmTimeExportListen Socket Count\n\t" \
+               "Socket = path of the socket to create, as chronyd does\n\t" \
+               "Count = number of samples to receive\n");
+        return;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(args[0].sval)>=sizeof(addr.sun_path)) {
+        errlogPrintf("mrmTimeExportListen: socket path too long\n");
+        return;
+    }
+    strcpy(addr.sun_path, args[0].sval);
+
+    int sock = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if(sock==-1) {
+        errlogPrintf("mrmTimeExportListen: socket: %s\n", strerror(errno));
+        return;
+    }
+
+    unlink(addr.sun_path);
+    struct timeval timeout = {5, 0};
+    if(bind(sock, (struct sockaddr*)&addr, sizeof(addr)) ||
+       setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)))
+    {
+        errlogPrintf("mrmTimeExportListen %s: %s\n", args[0].sval, strerror(errno));
+        close(sock);
+        return;
+    }
+
+    int n = 0, bad = 0;
+    double sum = 0.0, sum2 = 0.0, first = 0.0, last = 0.0;
+    while(n<args[1].ival) {
+        sock_sample s;
+        ssize_t len = recv(sock, &s, sizeof(s), 0);
+        if(len<0) {
+            printf("No sample in %d s\n", (int)timeout.tv_sec);
+            break;
+        }
+        if(len!=(ssize_t)sizeof(s) || s.magic!=SOCK_MAGIC) {
+            bad++;
+            continue;
+        }
+
+        double t = s.tv.tv_sec + s.tv.tv_usec*1e-6;
+        if(n==0)
+            first = t;
+        last = t;
+        printf(" %ld.%06ld  offset %+.3f us\n", (long)s.tv.tv_sec, (long)s.tv.tv_usec, s.offset*1e6);
+        sum += s.offset;
+        sum2 += s.offset*s.offset;
+        n++;
+    }
+
+    if(n) {
+        double mean = sum/n;
+        printf("%d samples (%d bad), %.1f Hz, offset %+.3f us, jitter %.3f us\n", n, bad,
+               n>1 ? (n-1)/(last-first) : 0.0, mean*1e6, sqrt(fabs(sum2/n - mean*mean))*1e6);
+    }
+
+    close(sock);
+    unlink(addr.sun_path);
+}
+
+/********** Report  *******/
+static const iocshArg mrmTimeExportReportArg0 = { "Name", iocshArgString };
+static const iocshArg * const mrmTimeExportReportArgs[1] = { &mrmTimeExportReportArg0 };
+static const iocshFuncDef mrmTimeExportReportDef = { "mrmTimeExportReport", 1, mrmTimeExportReportArgs };
+
+static void mrmTimeExportReportFunc(const iocshArgBuf *args)
+{
+    evrTimeExport *texp = NULL;
+    if(args[0].sval) {
+        texp = evrTimeExport::find(args[0].sval);
+        if(!texp)
+            texp = dynamic_cast<evrTimeExport*>(mrf::Object::getObject(args[0].sval));
+    }
+    if(!texp) {
+        printf("Usage: mrmTimeExportReport EVR|Name\n");
+        return;
+    }
+    texp->report();
+}
+
+extern "C" {
+static void evrTimeExportRegistrar()
+{
+    iocshRegister(&mrmTimeExportDef, mrmTimeExportFunc);
+    iocshRegister(&mrmTimeExportSimDef, mrmTimeExportSimFunc);
+    iocshRegister(&mrmTimeExportListenDef, mrmTimeExportListenFunc);
+    iocshRegister(&mrmTimeExportReportDef, mrmTimeExportReportFunc);
+}
+epicsExportRegistrar(evrTimeExportRegistrar);
+}
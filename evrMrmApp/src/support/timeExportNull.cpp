@@ -0,0 +1,14 @@
+/*************************************************************************\
+* mrfioc2 is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+#include <epicsExport.h>
+
+static void evrTimeExportRegistrar()
+{
+    // chronyd SOCK refclock is only supported on Linux
+}
+
+extern "C"{
+ epicsExportRegistrar(evrTimeExportRegistrar);
+}
@@ -0,0 +1,71 @@
+/***************************************************************************************************
+|* FracSynthTable () -- Write a table of SY87739L control words for FracSynthTableLoad()
+|*
+|*--------------------------------------------------------------------------------------------------
+|* MODULE DESCRIPTION:
+|*
+|* Host utility.  Runs the exhaustive control word search for each frequency of a range and
+|* prints the requested frequency and the control word found, in increasing order.
+|*
+|* Usage:
+|*      FracSynthTable <MinFreq> <MaxFreq> <Step> > table.txt
+|*
+|* All frequencies are in MegaHertz.  The reference frequency is MRF_FRAC_SYNTH_REF.
+|*
+\**************************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <epicsTypes.h>
+#ifdef _WIN32
+ #include <mrfFracSynth.h>
+#endif
+#include <debugPrint.h>
+
+#include <mrfCommon.h>
+
+#include <epicsExport.h>
+
+#define HOST_BUILD
+
+#ifndef _WIN32
+# include <mrfFracSynth.h>
+# include <mrfFracSynth.c>
+#endif
+
+int main (int argc, char *argv[]) {
+    epicsFloat64  fmin, fmax, step, f, Error;
+    epicsUInt32   i, n;
+
+    if (argc != 4 ||
+        (fmin = strtod (argv[1], NULL)) <= 0.0 ||
+        (fmax = strtod (argv[2], NULL)) < fmin ||
+        (step = strtod (argv[3], NULL)) <= 0.0)
+    {
+        printf ("Usage:\n");
+        printf ("FracSynthTable <MinFreq> <MaxFreq> <Step>\n");
+        printf ("  Prints the control words for frequencies (in MegaHertz)\n");
+        printf ("  MinFreq, MinFreq+Step, ... MaxFreq.\n");
+        return ERROR;
+    }
+
+    printf ("# SY87739L control words for %f - %f MHz, step %f MHz\n", fmin, fmax, step);
+    printf ("# ref %f\n", MRF_FRAC_SYNTH_REF);
+
+   /*---------------------
+    * Computed from the index so that rounding does not accumulate
+    */
+    n = (epicsUInt32)((fmax - fmin) / step + 0.5);
+    for (i = 0;  i <= n;  i++) {
+        epicsUInt32 word;
+
+        f = fmin + i * step;
+        word = FracSynthControlWord (f, MRF_FRAC_SYNTH_REF, DP_NONE, &Error);
+        if (word)
+            printf ("%.9f 0x%08X\n", f, word);
+    }
+
+    return OK;
+}/*end main()*/
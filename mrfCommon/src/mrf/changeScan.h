@@ -0,0 +1,66 @@
+/*************************************************************************\
+* mrfioc2 is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/**
+ * Change detecting I/O Intr publication of property values.
+ *
+ * A driver keeps one changeScan<T> per value which it wants to publish
+ * on change, and exposes the scan list as an IOSCANPVT property with the
+ * same name as the value property.
+ @code
+   OBJECT_PROP1("Link Status", &mycls::linkStatus);
+   OBJECT_PROP1("Link Status", &mycls::linkStatusChanged);
+ @endcode
+ * devObj (get_ioint_info_property) will then use this scan list for
+ * records with SCAN="I/O Intr".  The driver (ISR, poller, or setter)
+ * calls update() with the freshly read value.  The scan list is only
+ * requested when the value differs from the cached one.
+ *
+ * changeScan does no locking.  Callers must serialize update() with
+ * the owning object's lock.
+ */
+#ifndef MRFCHANGESCAN_H
+#define MRFCHANGESCAN_H
+
+#include <dbScan.h>
+
+namespace mrf {
+
+template<typename T>
+class changeScan
+{
+    IOSCANPVT m_scan;
+    T m_last;
+    bool m_valid;
+public:
+    changeScan() :m_last(), m_valid(false)
+    {
+        scanIoInit(&m_scan);
+    }
+
+    /** @brief Compare with the cached value and publish on change
+     *
+     @returns true if the value changed (or was not yet known)
+     */
+    bool update(const T& v)
+    {
+        if(m_valid && v==m_last)
+            return false;
+        m_last=v;
+        m_valid=true;
+        scanIoRequest(m_scan);
+        return true;
+    }
+
+    //! @brief Force the next update() to publish
+    void invalidate(){m_valid=false;}
+
+    bool valid() const{return m_valid;}
+    const T& value() const{return m_last;}
+    IOSCANPVT scan() const{return m_scan;}
+};
+
+} // namespace mrf
+
+#endif // MRFCHANGESCAN_H
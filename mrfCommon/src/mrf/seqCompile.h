@@ -0,0 +1,87 @@
+/*************************************************************************\
+* mrfioc2 is distributed subject to a Software License Agreement found
+* in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/**
+ * Range helpers of the incremental soft sequence compilation
+ * (evgSoftSeq::commitSoftSeq()).
+ *
+ * A range [lo, hi) is empty when lo>=hi.
+ */
+#ifndef MRFSEQCOMPILE_H
+#define MRFSEQCOMPILE_H
+
+#include <stddef.h>
+#include <vector>
+#include <algorithm>
+
+namespace mrf {
+
+/** @brief Widen [lo, hi) to include all entries where 'cur' differs from
+ * the 'size' entries of 'next'.
+ *
+ * A change of length marks everything past the shorter length.
+ */
+template<typename T>
+void diffRange(const std::vector<T>& cur, const T* next, size_t size, size_t& lo, size_t& hi)
+{
+    size_t common = std::min(cur.size(), size);
+    size_t first = 0;
+    while(first < common && cur[first]==next[first])
+        first++;
+
+    size_t last;
+    if(cur.size()!=size) {
+        last = std::max(cur.size(), size);
+    } else if(first==common) {
+        return; // identical
+    } else {
+        last = common;
+        while(last > first && cur[last-1]==next[last-1])
+            last--;
+    }
+
+    if(lo < hi) {
+        lo = std::min(lo, first);
+        hi = std::max(hi, last);
+    } else {
+        lo = first;
+        hi = last;
+    }
+}
+
+/** @brief Narrow [lo, hi) by the unchanged entries at both ends.
+ *
+ * unchanged(i) compares entry i with the old copy of 'oldLen' entries.
+ * It is only called for i < oldLen.
+ */
+template<class Unchanged>
+void trimRange(size_t& lo, size_t& hi, size_t oldLen, const Unchanged& unchanged)
+{
+    while(lo < hi && lo < oldLen && unchanged(lo))
+        lo++;
+    while(hi > lo && hi <= oldLen && unchanged(hi-1))
+        hi--;
+}
+
+/** @brief Check that the timestamps of the entries [begin, end) increase.
+ *
+ * The check starts with the entry before 'begin', so the boundary with the
+ * entries checked previously is included.  A continuation entry (timestamp
+ * 0xffffffff, code 0) may be followed by any timestamp.
+ @returns false if not sorted, or not unique
+ */
+template<typename TS, typename EC>
+bool seqSorted(const TS& timestamp, const EC& eventCode, size_t begin, size_t end)
+{
+    for(size_t n = begin ? begin-1 : 0; n+1 < end; n++) {
+        if(timestamp[n] >= timestamp[n+1] &&
+                !(timestamp[n]==0xffffffff && eventCode[n]==0))
+            return false;
+    }
+    return true;
+}
+
+} // namespace mrf
+
+#endif // MRFSEQCOMPILE_H
@@ -223,6 +223,26 @@ public:
 #  define isfinite finite
 #endif
 
+/*---------------------
+ * Full memory barrier, for the lock-free rings shared between an ISR (or the
+ * kernel) and a thread.  epicsAtomic.h is new in 3.15.
+ */
+#if EPICS_VERSION_INT >= VERSION_INT(3,15,0,1)
+#  include <epicsAtomic.h>
+#  define MRF_SYNC() do{ epicsAtomicWriteMemoryBarrier(); epicsAtomicReadMemoryBarrier(); }while(0)
+#elif defined(__GNUC__) && ( ( __GNUC__ * 100 + __GNUC_MINOR__ ) >= 401 )
+#  define MRF_SYNC() __sync_synchronize()
+#elif defined(__GNUC__)
+   /* compilers this old only target uniprocessor boards */
+#  define MRF_SYNC() __asm__ __volatile__ ("":::"memory")
+#elif defined(_MSC_VER)
+   /* x86 does not reorder stores with stores, or loads with loads */
+#  include <intrin.h>
+#  define MRF_SYNC() _ReadWriteBarrier()
+#else
+#  error "No memory barrier (MRF_SYNC) for this compiler"
+#endif
+
 #ifdef __cplusplus
 /* Round down and convert float to unsigned int
  * throws std::range_error for NaN and out of range inputs
@@ -230,6 +250,16 @@ public:
 epicsShareFunc epicsUInt32 roundToUInt(double val, epicsUInt32 maxresult=0xffffffff);
 
 epicsShareFunc char *allocSNPrintf(size_t N, const char *fmt, ...) EPICS_PRINTF_STYLE(2,3);
+
+/* CRC-32 (IEEE 802.3, as used by zlib).
+ * Start with crc=0, pass the previous result to continue a running checksum.
+ */
+epicsShareFunc epicsUInt32 mrfCrc32(epicsUInt32 crc, const void *buf, size_t len);
+
+/* Seconds from an arbitrary origin, for intervals.  Not affected by steps of the
+ * system time, except before EPICS 3.16.1 which has no monotonic clock.
+ */
+epicsShareFunc double mrfMonotonicSeconds();
 #endif
 
 /**************************************************************************************************/
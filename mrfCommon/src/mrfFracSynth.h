@@ -67,6 +67,13 @@ epicsShareExtern epicsUInt32   FracSynthControlWord  (epicsFloat64, epicsFloat64
 
 epicsShareExtern epicsFloat64  FracSynthAnalyze      (epicsUInt32, epicsFloat64, epicsInt32);
 
+/* Table and memo assisted version of FracSynthControlWord() (mrfFracSynthTable.c) */
+epicsShareExtern epicsUInt32   FracSynthSolve        (epicsFloat64, epicsFloat64, epicsInt32, epicsFloat64*);
+
+epicsShareExtern epicsStatus   FracSynthTableLoad    (const char*);
+
+epicsShareExtern double        FracSynthTableTolerance;
+
 /**************************************************************************************************/
 /*  Special Macros to Define Commonly Used Symbols                                                */
 /*  (note that these values can be overridden in the invoking module)                             */
@@ -0,0 +1,386 @@
+/***************************************************************************************************
+|* mrfFracSynthTable.c -- Table and memo assisted SY87739L control word solver
+|*
+|*--------------------------------------------------------------------------------------------------
+|* MODULE DESCRIPTION:
+|*
+|* FracSynthControlWord() does an exhaustive search for each request.  FracSynthSolve() returns
+|* the same kind of control word, but first looks in
+|*
+|*   - A small LRU memo of recent requests.
+|*   - A table of precomputed search results, loaded from file with FracSynthTableLoad().
+|*     The table is sorted by requested frequency and searched with a binary search.
+|*     A request found in the table gives the same word as the exhaustive search.  Otherwise
+|*     the words of the neighbouring entries are used if the frequency they produce is within
+|*     FracSynthTableTolerance ppm of the request.
+|*
+|* and only then falls back to the exhaustive search.
+|*
+|* The table file is text.  Lines are "<requested frequency in MHz> <control word>".  An optional
+|* line "# ref <MHz>" gives the reference frequency (default MRF_FRAC_SYNTH_REF).  Lines starting
+|* with '#' are otherwise ignored.  Such a file is written by the FracSynthTable host utility.
+|* The frequency produced by each word is computed with FracSynthAnalyze() when loaded.  Words
+|* which are invalid, or more than 100 ppm from their request, are dropped.
+|*
+\**************************************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <errlog.h>
+#include <iocsh.h>
+
+#include <epicsExport.h>
+#include <mrfFracSynth.h>
+#include <mrfCommon.h>
+
+/**************************************************************************************************/
+/*  Configuration Parameters                                                                      */
+/**************************************************************************************************/
+
+#define MEMO_SIZE  16                     /* Number of recent requests remembered                 */
+
+/* Max. difference (ppm) between a table entry and the request for the entry to be used */
+epicsShareDef double FracSynthTableTolerance = 0.1;
+
+/**************************************************************************************************/
+/*  Structure Definitions                                                                         */
+/**************************************************************************************************/
+
+typedef struct {
+    epicsFloat64    Request;             /* Requested frequency (MHz)                             */
+    epicsFloat64    Freq;                /* Frequency produced by the word (MHz)                  */
+    epicsUInt32     Word;                /* Control word                                          */
+} TableEntry;
+
+typedef struct {
+    epicsFloat64    Desired;             /* Requested frequency (MHz)                             */
+    epicsFloat64    Reference;           /* Reference frequency (MHz)                             */
+    epicsFloat64    Error;               /* Error (ppm) of the result                             */
+    epicsUInt32     Word;                /* Resulting control word                                */
+} MemoEntry;
+
+/**************************************************************************************************/
+/*  Module State (guarded by SolverLock)                                                          */
+/**************************************************************************************************/
+
+static epicsThreadOnceId SolverOnce = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId      SolverLock;
+
+static TableEntry   *Table;
+static size_t        TableSize;
+static epicsFloat64  TableRef;
+
+static MemoEntry     Memo[MEMO_SIZE];     /* Most recent first                                    */
+static size_t        MemoCount;
+
+static epicsUInt32   MemoHits, TableHits, Searches;
+
+static
+void SolverInit (void *unused) {
+    SolverLock = epicsMutexMustCreate();
+}
+
+static
+int TableCompare (const void *a, const void *b) {
+    epicsFloat64 fa = ((const TableEntry*)a)->Request,
+                 fb = ((const TableEntry*)b)->Request;
+    return fa < fb ? -1 : (fa > fb ? 1 : 0);
+}
+
+/*---------------------
+ * Move memo entry 'i' to the front, or insert a new entry at the front (i==MemoCount).
+ * Caller must hold SolverLock.
+ */
+static
+void MemoFront (size_t i, const MemoEntry *entry) {
+    if (i == MemoCount) {
+        if (MemoCount < MEMO_SIZE)
+            MemoCount++;
+        i = MemoCount - 1;
+    }
+    memmove (&Memo[1], &Memo[0], i * sizeof(MemoEntry));
+    Memo[0] = *entry;
+}
+
+/*---------------------
+ * Look up 'Desired' in the table.  Caller must hold SolverLock.
+ * @returns the control word, or 0 if the table has no suitable entry.
+ */
+static
+epicsUInt32 TableLookup (epicsFloat64 Desired, epicsFloat64 Reference, epicsFloat64 *Error) {
+    size_t lo = 0, hi = TableSize, i, best = TableSize;
+    epicsFloat64 err, bestErr = 0.0;
+
+    if (!TableSize || fabs(Reference - TableRef) > 1e-9)
+        return 0;
+
+    /* first entry with Request >= Desired */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (Table[mid].Request < Desired)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    /* A precomputed request (allowing for rounding in the file) */
+    if (lo < TableSize && fabs(Table[lo].Request - Desired) <= 1e-9 * Desired)
+        best = lo;
+    else if (lo > 0 && fabs(Table[lo-1].Request - Desired) <= 1e-9 * Desired)
+        best = lo - 1;
+
+    if (best == TableSize) {
+       /*---------------------
+        * Otherwise the neighbours, if close enough
+        */
+        for (i = (lo > 0 ? lo - 1 : 0);  i <= lo && i < TableSize;  i++) {
+            err = 1.e6 * (Table[i].Freq - Desired) / Desired;
+            if (fabs(err) <= FracSynthTableTolerance &&
+                (best == TableSize || fabs(err) < fabs(bestErr))) {
+                best = i;
+                bestErr = err;
+            }
+        }
+        if (best == TableSize)
+            return 0;
+    }
+
+    *Error = 1.e6 * (Table[best].Freq - Desired) / Desired;
+    return Table[best].Word;
+}
+
+/**************************************************************************************************
+ * FracSynthSolve () -- Control word for a frequency, using the memo and table when possible
+ **************************************************************************************************/
+/**
+ * Same arguments and return value as FracSynthControlWord().
+ */
+epicsShareFunc epicsUInt32 FracSynthSolve (
+    epicsFloat64   DesiredFreq,
+    epicsFloat64   ReferenceFreq,
+    epicsInt32     debugFlag,
+    epicsFloat64  *Error)
+{
+    MemoEntry    entry;
+    size_t       i;
+    int          searched = 0;
+
+    epicsThreadOnce (&SolverOnce, &SolverInit, NULL);
+
+    entry.Desired   = DesiredFreq;
+    entry.Reference = ReferenceFreq;
+    entry.Error     = 0.0;
+    entry.Word      = 0;
+
+    epicsMutexMustLock (SolverLock);
+
+    for (i = 0;  i < MemoCount;  i++) {
+        if (Memo[i].Desired == DesiredFreq && Memo[i].Reference == ReferenceFreq) {
+            entry = Memo[i];
+            MemoFront (i, &entry);
+            MemoHits++;
+            epicsMutexUnlock (SolverLock);
+            *Error = entry.Error;
+            return entry.Word;
+        }
+    }
+
+    entry.Word = TableLookup (DesiredFreq, ReferenceFreq, &entry.Error);
+    if (entry.Word)
+        TableHits++;
+
+    epicsMutexUnlock (SolverLock);
+
+   /*---------------------
+    * Not known.  Search without holding the lock.
+    */
+    if (!entry.Word) {
+        entry.Word = FracSynthControlWord (DesiredFreq, ReferenceFreq, debugFlag, &entry.Error);
+        if (!entry.Word)
+            return 0;
+        searched = 1;
+    }
+
+    epicsMutexMustLock (SolverLock);
+    Searches += searched;
+    MemoFront (MemoCount, &entry);
+    epicsMutexUnlock (SolverLock);
+
+    *Error = entry.Error;
+    return entry.Word;
+}/*end FracSynthSolve()*/
+
+/**************************************************************************************************
+ * FracSynthTableLoad () -- Load the table of reachable frequencies
+ **************************************************************************************************/
+/**
+ * @return OK, or ERROR if the file could not be read.  The previous table is kept on error.
+ */
+epicsShareFunc epicsStatus FracSynthTableLoad (const char *fname) {
+    FILE         *fp;
+    char          line[128];
+    TableEntry   *entries = NULL;
+    size_t        count = 0, alloc = 0, dropped = 0;
+    epicsFloat64  ref = MRF_FRAC_SYNTH_REF;
+
+    epicsThreadOnce (&SolverOnce, &SolverInit, NULL);
+
+    fp = fopen (fname, "r");
+    if (!fp) {
+        errlogPrintf ("FracSynthTableLoad: Can't open %s\n", fname);
+        return ERROR;
+    }
+
+    while (fgets (line, sizeof(line), fp)) {
+        double        request, freq;
+        unsigned int  word;
+
+        if (line[0] == '#') {
+            sscanf (line, "# ref %lf", &ref);
+            continue;
+        }
+        if (sscanf (line, "%lf %x", &request, &word) != 2 || request <= 0.0)
+            continue;
+
+        freq = FracSynthAnalyze (word, ref, 0);
+        if (freq == 0.0 || fabs(1.e6 * (freq - request) / request) >= 100.0) {
+            dropped++;
+            continue;
+        }
+
+        if (count == alloc) {
+            TableEntry *temp;
+            alloc = alloc ? 2*alloc : 1024;
+            temp = realloc (entries, alloc * sizeof(TableEntry));
+            if (!temp) {
+                errlogPrintf ("FracSynthTableLoad: Out of memory\n");
+                free (entries);
+                fclose (fp);
+                return ERROR;
+            }
+            entries = temp;
+        }
+        entries[count].Request = request;
+        entries[count].Freq    = freq;
+        entries[count].Word    = word;
+        count++;
+    }
+    fclose (fp);
+
+    qsort (entries, count, sizeof(TableEntry), &TableCompare);
+
+    epicsMutexMustLock (SolverLock);
+    free (Table);
+    Table     = entries;
+    TableSize = count;
+    TableRef  = ref;
+    MemoCount = 0;
+    epicsMutexUnlock (SolverLock);
+
+    printf ("FracSynthTableLoad: %lu entries for %f MHz reference", (unsigned long)count, ref);
+    if (dropped)
+        printf (", %lu invalid words ignored", (unsigned long)dropped);
+    printf ("\n");
+    return OK;
+}/*end FracSynthTableLoad()*/
+
+/**************************************************************************************************/
+/*                              EPICS IOC Shell Registery                                         */
+/**************************************************************************************************/
+
+static const iocshArg         FracSynthTableLoadArg0    = {"file", iocshArgString};
+static const iocshArg *const  FracSynthTableLoadArgs[1] = {&FracSynthTableLoadArg0};
+static const iocshFuncDef     FracSynthTableLoadDef     = {"FracSynthTableLoad", 1,
+                                                          FracSynthTableLoadArgs};
+
+static
+void FracSynthTableLoadCall (const iocshArgBuf *args) {
+    if (!args[0].sval) {
+        printf ("Usage: FracSynthTableLoad <file>\n");
+        return;
+    }
+    FracSynthTableLoad (args[0].sval);
+}/*end FracSynthTableLoadCall()*/
+
+
+/*---------------------
+ * FracSynthBench() -- Compare FracSynthSolve() with the exhaustive search over a frequency range
+ */
+static const iocshArg         FracSynthBenchArg0    = {"MinFreq", iocshArgDouble};
+static const iocshArg         FracSynthBenchArg1    = {"MaxFreq", iocshArgDouble};
+static const iocshArg         FracSynthBenchArg2    = {"Step",    iocshArgDouble};
+static const iocshArg *const  FracSynthBenchArgs[3] = {&FracSynthBenchArg0, &FracSynthBenchArg1,
+                                                       &FracSynthBenchArg2};
+static const iocshFuncDef     FracSynthBenchDef     = {"FracSynthBench", 3, FracSynthBenchArgs};
+
+static
+void FracSynthBenchCall (const iocshArgBuf *args) {
+    epicsFloat64    fmin = args[0].dval, fmax = args[1].dval, step = args[2].dval, f;
+    epicsTimeStamp  t0, t1;
+    double          tSearch = 0.0, tSolve = 0.0, tMemo = 0.0, maxDiff = 0.0;
+    unsigned long   n = 0, differ = 0;
+
+    if (step <= 0.0 || fmax < fmin) {
+        printf ("Usage: FracSynthBench <MinFreq> <MaxFreq> <Step>  (MHz)\n");
+        return;
+    }
+
+    for (f = fmin;  f <= fmax;  f += step) {
+        epicsFloat64  errSearch = 0.0, errSolve = 0.0;
+        epicsUInt32   wSearch, wSolve;
+
+        epicsTimeGetCurrent (&t0);
+        wSearch = FracSynthControlWord (f, MRF_FRAC_SYNTH_REF, 0, &errSearch);
+        epicsTimeGetCurrent (&t1);
+        tSearch += epicsTimeDiffInSeconds (&t1, &t0);
+
+        epicsTimeGetCurrent (&t0);
+        wSolve = FracSynthSolve (f, MRF_FRAC_SYNTH_REF, 0, &errSolve);
+        epicsTimeGetCurrent (&t1);
+        tSolve += epicsTimeDiffInSeconds (&t1, &t0);
+
+        epicsTimeGetCurrent (&t0);
+        FracSynthSolve (f, MRF_FRAC_SYNTH_REF, 0, &errSolve);
+        epicsTimeGetCurrent (&t1);
+        tMemo += epicsTimeDiffInSeconds (&t1, &t0);
+
+        if (wSearch != wSolve) {
+            differ++;
+            if (fabs(errSolve - errSearch) > maxDiff)
+                maxDiff = fabs(errSolve - errSearch);
+        }
+        n++;
+    }
+
+    if (!n)
+        return;
+
+    printf ("%lu frequencies\n", n);
+    printf (" search : %10.3f us/call\n", 1e6 * tSearch / n);
+    printf (" solve  : %10.3f us/call (first)\n", 1e6 * tSolve / n);
+    printf (" memo   : %10.3f us/call (repeat)\n", 1e6 * tMemo / n);
+    printf (" %lu different words, max. error difference %.4f ppm\n", differ, maxDiff);
+
+    epicsMutexMustLock (SolverLock);
+    printf (" table %lu entries, memo hits %u, table hits %u, searches %u\n",
+            (unsigned long)TableSize, MemoHits, TableHits, Searches);
+    epicsMutexUnlock (SolverLock);
+}/*end FracSynthBenchCall()*/
+
+
+static
+void FracSynthTableRegistrar () {
+    epicsThreadOnce (&SolverOnce, &SolverInit, NULL);
+    iocshRegister (&FracSynthTableLoadDef, FracSynthTableLoadCall);
+    iocshRegister (&FracSynthBenchDef,     FracSynthBenchCall);
+}/*end FracSynthTableRegistrar()*/
+
+epicsExportRegistrar (FracSynthTableRegistrar);
+epicsExportAddress (double, FracSynthTableTolerance);
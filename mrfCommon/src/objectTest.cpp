@@ -7,6 +7,10 @@
 #include "epicsExport.h"
 
 #include "mrf/object.h"
+#include "mrf/changeScan.h"
+#include "mrf/seqCompile.h"
+#include "mrfCommon.h"
+#include "mrfFracSynth.h"
 using namespace mrf;
 
 class mine : public ObjectInst<mine>
@@ -50,6 +54,13 @@ OBJECT_PROP2("val", &mine::val,     &mine::setVal);
 OBJECT_PROP2("darr",&mine::getdarr, &mine::setdarr);
 OBJECT_END(mine)
 
+// entry i of two arrays is the same
+struct same {
+    const int *a, *b;
+    same(const int *x, const int *y) :a(x), b(y) {}
+    bool operator()(size_t i) const { return a[i]==b[i]; }
+};
+
 MAIN(objectTest)
 {
     testPlan(0);
@@ -119,5 +130,92 @@ MAIN(objectTest)
     testOk1(p!=NULL);
     testOk1(p==o);
 
+    changeScan<int> chg;
+    testOk1(!chg.valid());
+    testOk1(chg.scan()!=NULL);
+    testOk1(chg.update(5));   // first value always published
+    testOk1(!chg.update(5));
+    testOk1(chg.update(6));
+    testOk1(chg.value()==6);
+    chg.invalidate();
+    testOk1(chg.update(6));
+
+    // standard check value
+    testOk1(mrfCrc32(0, "123456789", 9)==0xcbf43926);
+    testOk1(mrfCrc32(mrfCrc32(0, "1234", 4), "56789", 5)==0xcbf43926);
+
+    // memoised solver agrees with the full search, also when repeated
+    {
+        epicsFloat64 err1, err2, err3;
+        epicsUInt32 word = FracSynthControlWord(124.9135, MRF_FRAC_SYNTH_REF, 0, &err1);
+        testOk1(word!=0);
+        testOk1(FracSynthSolve(124.9135, MRF_FRAC_SYNTH_REF, 0, &err2)==word);
+        testOk1(FracSynthSolve(124.9135, MRF_FRAC_SYNTH_REF, 0, &err3)==word);
+        testOk1(err1==err2 && err2==err3);
+    }
+
+    // changed range of a sequence update
+    {
+        const epicsUInt32 cur[] = {10, 20, 30, 40, 50};
+        std::vector<epicsUInt32> seq(cur, cur+5);
+        size_t lo = 0, hi = 0;
+
+        diffRange(seq, cur, 5, lo, hi);
+        testOk1(lo>=hi);    // identical
+
+        const epicsUInt32 one[] = {10, 20, 31, 40, 50};
+        diffRange(seq, one, 5, lo, hi);
+        testOk(lo==2 && hi==3, "one entry [%u, %u)", (unsigned)lo, (unsigned)hi);
+
+        const epicsUInt32 two[] = {10, 21, 30, 41, 50};
+        lo = hi = 0;
+        diffRange(seq, two, 5, lo, hi);
+        testOk(lo==1 && hi==4, "two entries [%u, %u)", (unsigned)lo, (unsigned)hi);
+
+        lo = 0; hi = 1;     // widened, not replaced
+        diffRange(seq, one, 5, lo, hi);
+        testOk(lo==0 && hi==3, "widened [%u, %u)", (unsigned)lo, (unsigned)hi);
+
+        lo = hi = 0;
+        diffRange(seq, cur, 3, lo, hi);
+        testOk(lo==3 && hi==5, "shorter [%u, %u)", (unsigned)lo, (unsigned)hi);
+    }
+
+    // commited entries which actually change
+    {
+        const int oldCt[] = {1, 2, 3, 4, 5};
+        const int newCt[] = {1, 2, 9, 4, 5, 6};
+
+        size_t lo = 0, hi = 5;
+        trimRange(lo, hi, 5, same(newCt, oldCt));
+        testOk(lo==2 && hi==3, "trimmed [%u, %u)", (unsigned)lo, (unsigned)hi);
+
+        lo = 0; hi = 6;     // past the old length is kept
+        trimRange(lo, hi, 5, same(newCt, oldCt));
+        testOk(lo==2 && hi==6, "longer [%u, %u)", (unsigned)lo, (unsigned)hi);
+
+        lo = 3; hi = 5;
+        trimRange(lo, hi, 5, same(newCt, oldCt));
+        testOk1(lo>=hi);
+    }
+
+    // re-validation of the re-compiled window
+    {
+        const epicsUInt64 ts[] = {10, 30, 20, 40, 50};
+        const epicsUInt8 ec[] = {1, 2, 3, 4, 5};
+        testOk1(!seqSorted(ts, ec, 0, 5));
+        testOk1(seqSorted(ts, ec, 3, 5));  // before the window, checked previously
+        testOk1(!seqSorted(ts, ec, 2, 5)); // boundary with the previous entry
+
+        const epicsUInt64 cont[] = {10, 0xffffffff, 5, 6};
+        const epicsUInt8 ecCont[] = {1, 0, 2, 3};
+        const epicsUInt8 ecNoCont[] = {1, 4, 2, 3};
+        testOk1(seqSorted(cont, ecCont, 0, 4));
+        testOk1(!seqSorted(cont, ecNoCont, 0, 4));
+
+        const epicsUInt64 dup[] = {10, 20, 20};
+        testOk1(!seqSorted(dup, ec, 0, 3));
+    }
+
     return testDone();
 }
@@ -128,6 +128,91 @@
 #define FPGAVersion 0x02c
 #  define FPGAVer_FF    0xff000000
 
+#define EvtFIFOSec  0x070
+#define EvtFIFOEvt  0x074
+#define EvtFIFOCode 0x078
+
+/************************ IRQ statistics ****************************/
+
+/* One page, mapped read-only by user space as the UIO map named
+ * MRF_IRQSTATS_NAME.  For each handled interrupt the handler stores the
+ * time of entry and IRQFlag in a ring.  The layout is also defined in
+ * mrmShared/src/mrmIrqStats.h.
+ *
+ * An entry is written with seq=0 first and seq=index+1 last, then head
+ * is advanced.  A reader which finds seq!=index+1 lost the entry to an
+ * overrun.
+ */
+#define MRF_IRQSTATS_NAME    "mrf-irqstats"
+#define MRF_IRQSTATS_MAP     3
+#define MRF_IRQSTATS_MAGIC   0x4d524649 /* "MRFI" */
+#define MRF_IRQSTATS_VERSION 1
+#define MRF_IRQSTATS_RING    64
+
+struct mrf_irqstats_entry {
+    u64 time;  /* CLOCK_MONOTONIC [ns] */
+    u32 flags; /* IRQFlag */
+    u32 seq;
+};
+
+struct mrf_irqstats {
+    u32 magic;
+    u32 version;
+    u32 ringsize;
+    u32 head;     /* number of entries written */
+    u32 irqcount; /* handled */
+    u32 spurious; /* not from this device */
+    u32 masked;   /* while the device interrupt was not enabled */
+    u32 reserved;
+    struct mrf_irqstats_entry ring[MRF_IRQSTATS_RING];
+};
+
+/************************ Event FIFO ring ****************************/
+
+/* Optional draining of the event FIFO of an EVR by the interrupt handler.
+ * Enabled by writing MRF_IRQCTL_FIFO_DRAIN_ON to /dev/uioX, which fails
+ * for devices without FIFO.  Events are stored in a ring mapped read-only
+ * by user space as the UIO map named MRF_EVTFIFO_NAME.  The layout is also
+ * defined in mrmShared/src/mrmEvtFifoRing.h.
+ *
+ * Entries are written like those of struct mrf_irqstats.  The consumer
+ * is not known to the kernel, and detects overruns with seq.
+ */
+#define MRF_EVTFIFO_NAME    "mrf-evtfifo"
+#define MRF_EVTFIFO_MAP     4
+#define MRF_EVTFIFO_MAGIC   0x4d524645 /* "MRFE" */
+#define MRF_EVTFIFO_VERSION 1
+#define MRF_EVTFIFO_RING    512
+/* Events drained per interrupt.  Each takes four register reads with
+ * interrupts off, so the handler stays short.  User space re-arms
+ * IRQ_Event at once while the FIFO is not empty, so the next batch
+ * follows without waiting for the FIFO poll period.
+ */
+#define MRF_EVTFIFO_BATCH   16
+
+/* Values written to /dev/uioX in addition to 0 and 1 (interrupt enable) */
+#define MRF_IRQCTL_FIFO_DRAIN_OFF 2
+#define MRF_IRQCTL_FIFO_DRAIN_ON  3
+
+struct mrf_evtfifo_entry {
+    u32 code; /* EvtFIFOCode */
+    u32 sec;  /* EvtFIFOSec */
+    u32 evt;  /* EvtFIFOEvt */
+    u32 seq;
+};
+
+struct mrf_evtfifo {
+    u32 magic;
+    u32 version;
+    u32 ringsize;
+    u32 head;     /* number of entries written */
+    u32 enabled;  /* draining by the handler */
+    u32 drained;  /* events */
+    u32 fifofull; /* FIFO overflows seen */
+    u32 reserved;
+    struct mrf_evtfifo_entry ring[MRF_EVTFIFO_RING];
+};
+
 /* driver private struct */
 
 struct mrf_priv {
@@ -135,6 +220,8 @@ struct mrf_priv {
     struct pci_dev *pdev;
     unsigned int irqmode;
     unsigned int intrcount;
+    struct mrf_irqstats *stats;
+    struct mrf_evtfifo *fifo; /* EVRs only */
 
 #if defined(CONFIG_GENERIC_GPIO) || defined(CONFIG_PARPORT_NOT_PC)
     spinlock_t lock;
@@ -28,8 +28,11 @@ MODULE_AUTHOR("Michael Davidsaver <mdavidsaver@bnl.gov>");
 
 /* something that userspace can test to see if we
  * are the kernel module its looking for.
+ *
+ * 2 - adds the IRQ statistics map (MRF_IRQSTATS_NAME)
+ * 3 - adds the event FIFO ring map (MRF_EVTFIFO_NAME)
  */
-static int modparam_iversion = 1;
+static int modparam_iversion = 3;
 module_param_named(interfaceversion, modparam_iversion, int, 0444);
 MODULE_PARM_DESC(interfaceversion, "User space interface version");
 
@@ -105,6 +108,25 @@ int mrf_mmap_physical(struct uio_info *info, struct vm_area_struct *vma)
         return -EINVAL;
     }
 
+    switch(info->mem[mi].memtype) {
+    case UIO_MEM_PHYS:
+        break;
+    case UIO_MEM_LOGICAL:
+        /* IRQ statistics and event FIFO ring, read only */
+        if (vma->vm_flags & VM_WRITE)
+            return -EPERM;
+        vma->vm_flags &= ~VM_MAYWRITE;
+        vma->vm_flags |= VM_RESERVED;
+
+        return remap_pfn_range(vma,
+                               vma->vm_start,
+                               virt_to_phys((void*)(unsigned long)info->mem[mi].addr) >> PAGE_SHIFT,
+                               vma->vm_end - vma->vm_start,
+                               vma->vm_page_prot);
+    default:
+        return -EINVAL;
+    }
+
     vma->vm_flags |= VM_IO | VM_RESERVED;
     vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
 
@@ -120,12 +142,142 @@ int mrf_mmap_physical(struct uio_info *info, struct vm_area_struct *vma)
 
 /******************** PCI interrupt handler ***********************/
 
+static
+void
+mrf_irqstats_masked(struct uio_info *info)
+{
+    struct mrf_priv *priv = container_of(info, struct mrf_priv, uio);
+
+    if(priv->stats)
+        priv->stats->masked++;
+}
+
+/* Store an interrupt in the statistics page.
+ * Interrupts of one device are not concurrent, so there is one writer.
+ */
+static
+void
+mrf_irqstats_record(struct mrf_priv *priv, irqreturn_t ret, u64 time, u32 flags)
+{
+    struct mrf_irqstats *st = priv->stats;
+    struct mrf_irqstats_entry *ent;
+    u32 n;
+
+    if(!st)
+        return;
+
+    if(ret != IRQ_HANDLED) {
+        st->spurious++;
+        return;
+    }
+
+    n = st->head;
+    ent = &st->ring[n % MRF_IRQSTATS_RING];
+
+    ent->seq = 0;
+    wmb();
+    ent->time = time;
+    ent->flags = flags;
+    wmb();
+    ent->seq = n+1;
+    st->irqcount++;
+    wmb();
+    st->head = n+1;
+}
+
+/* Find the registers of the device, and the byte order user space selected */
+static
+int
+mrf_regs(struct uio_info *info, void __iomem **base, int *end)
+{
+    struct pci_dev *dev = info->priv;
+    void __iomem *plx = info->mem[0].internal_addr;
+    u32 val;
+
+    switch(dev->device) {
+    case PCI_DEVICE_ID_PLX_9030:
+        *base = info->mem[2].internal_addr;
+        *end = ioread32(plx + LAS0BRD) & LAS0BRD_ENDIAN;
+        break;
+    case PCI_DEVICE_ID_PLX_9056:
+        *base = info->mem[2].internal_addr;
+        *end = ioread32(plx + BIGEND9056) & BIGEND9056_BIG;
+        break;
+    case PCI_DEVICE_ID_EC_30:
+    case PCI_DEVICE_ID_XILINX:
+        *base = plx;
+        val = ioread32(plx + FPGAVersion);
+        *end = ((val & FPGAVer_FF) >> 24) != FPGAVER_EVR300;
+        break;
+    default:
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static inline
+u32
+mrf_read32(void __iomem *addr, int end)
+{
+    if (end) {
+        return ioread32be(addr);
+    } else {
+        return ioread32(addr);
+    }
+}
+
+/* Move at most MRF_EVTFIFO_BATCH events from the event FIFO of an EVR into
+ * the ring.  The interrupt of the device is disabled, so there is one writer.
+ * Events left in the FIFO keep IRQ_Event set, so the interrupt is raised
+ * again, and the next batch drained, when user space re-enables it.
+ * The FIFO is reset by user space after an overflow or a receive error.
+ */
+static
+unsigned
+mrf_drain_fifo(struct mrf_priv *priv, void __iomem *base, int end)
+{
+    struct mrf_evtfifo *fifo = priv->fifo;
+    struct mrf_evtfifo_entry *ent;
+    u32 n = fifo->head, status = 0, code;
+    unsigned i;
+
+    for(i=0; i<MRF_EVTFIFO_BATCH; i++) {
+        status = mrf_read32(base + IRQFlag, end);
+        if (!(status & IRQ_Event) || (status & IRQ_RXErr))
+            break;
+
+        code = mrf_read32(base + EvtFIFOCode, end);
+        if (!code)
+            break;
+
+        ent = &fifo->ring[n % MRF_EVTFIFO_RING];
+        ent->seq = 0;
+        wmb();
+        ent->code = code;
+        ent->sec = mrf_read32(base + EvtFIFOSec, end);
+        ent->evt = mrf_read32(base + EvtFIFOEvt, end);
+        wmb();
+        ent->seq = ++n;
+    }
+
+    if (status & IRQ_FIFOFull)
+        fifo->fifofull++;
+
+    if (i) {
+        fifo->drained += i;
+        wmb();
+        fifo->head = n;
+    }
+
+    return i;
+}
+
 /* original ISR behavior which manipulates the EVR's
  * IRQFlag and IRQEnable.
  */
 static
 irqreturn_t
-mrf_handler_evr(int irq, struct uio_info *info)
+mrf_handler_evr(int irq, struct uio_info *info, u32 *flags)
 {
     void __iomem *base = info->mem[2].internal_addr;
     void __iomem *plx = info->mem[0].internal_addr;
@@ -160,8 +312,10 @@ mrf_handler_evr(int irq, struct uio_info *info)
     if (!(status & enable)) {
             return IRQ_NONE;
     }
+    *flags = status;
 
     if(!(enable & IRQ_Enable)) {
+        mrf_irqstats_masked(info);
         dev_info(&dev->dev, "Interrupt when not enabled! 0x%08lx 0x%08lx\n",
                  (unsigned long)enable, (unsigned long)status);
     }
@@ -240,6 +394,7 @@ mrf_handler_plx(int irq, struct uio_info *info)
         }
 
         if(!(val & IRQ_Enable_ALL)) {
+            mrf_irqstats_masked(info);
             dev_info(&dev->dev, "ERROR: Interrupt happening when not enabled!");
             return IRQ_NONE;
         }
@@ -312,16 +467,37 @@ irqreturn_t
 mrf_handler(int irq, struct uio_info *info)
 {
     struct mrf_priv *priv = container_of(info, struct mrf_priv, uio);
+    u64 time = ktime_to_ns(ktime_get());
+    void __iomem *base;
+    u32 flags = 0;
+    int end, drain;
+    irqreturn_t ret;
 
     // Count interrupt handler executions
     priv->intrcount++;
 
     rmb();
+    drain = priv->fifo && priv->fifo->enabled;
+
     if(priv->irqmode) {
-        return mrf_handler_plx(irq, info);
+        ret = mrf_handler_plx(irq, info);
     } else {
-        return mrf_handler_evr(irq, info);
+        ret = mrf_handler_evr(irq, info, &flags);
     }
+
+    if(ret == IRQ_HANDLED && (priv->stats || drain) && !mrf_regs(info, &base, &end)) {
+        // the interrupt is disabled, so the flags are stable until user space acknowledges them
+        if(priv->irqmode)
+            flags = mrf_read32(base + IRQFlag, end);
+
+        // flags keep IRQ_Event so that user space takes the events from the ring
+        if(drain && (flags & (IRQ_Event|IRQ_FIFOFull)))
+            mrf_drain_fifo(priv, base, end);
+    }
+
+    mrf_irqstats_record(priv, ret, time, flags);
+
+    return ret;
 }
 
 static
@@ -332,6 +508,14 @@ int mrf_irqcontrol(struct uio_info *info, s32 onoff)
     void __iomem *plx = info->mem[0].internal_addr;
     u32 val, end;
 
+    if (onoff == MRF_IRQCTL_FIFO_DRAIN_OFF || onoff == MRF_IRQCTL_FIFO_DRAIN_ON) {
+        if (!priv->fifo)
+            return -EINVAL;
+        priv->fifo->enabled = onoff == MRF_IRQCTL_FIFO_DRAIN_ON;
+        wmb();
+        return 0;
+    }
+
     // FIXME: Why not -EINVAL in both cases?
     if (onoff < 0) {
         return -EINVAL;
@@ -501,6 +685,12 @@ mrf_probe(struct pci_dev *dev,
                 goto err_release;
             }
 
+            /* Not used */
+            info->mem[1].memtype = UIO_MEM_NONE;
+            info->mem[1].size = 1; /* Otherwise UIO will stop searching... */
+            info->mem[2].memtype = UIO_MEM_NONE;
+            info->mem[2].size = 1;
+
         }
         /* Other devices also have BAR 1 and 2 present (for PLX bridge).. */
         else{
@@ -532,6 +722,49 @@ mrf_probe(struct pci_dev *dev,
             }
         }
 
+#ifdef USE_CUSTOM_MMAP
+        /* IRQ statistics.  Optional, user space checks for the map by name. */
+        priv->stats = (struct mrf_irqstats *)get_zeroed_page(GFP_KERNEL);
+        if (priv->stats) {
+            priv->stats->magic = MRF_IRQSTATS_MAGIC;
+            priv->stats->version = MRF_IRQSTATS_VERSION;
+            priv->stats->ringsize = MRF_IRQSTATS_RING;
+
+            info->mem[MRF_IRQSTATS_MAP].name = MRF_IRQSTATS_NAME;
+            info->mem[MRF_IRQSTATS_MAP].addr = (unsigned long)priv->stats;
+            info->mem[MRF_IRQSTATS_MAP].size = PAGE_SIZE;
+            info->mem[MRF_IRQSTATS_MAP].memtype = UIO_MEM_LOGICAL;
+        } else {
+            dev_warn(&dev->dev, "No memory for IRQ statistics\n");
+            info->mem[MRF_IRQSTATS_MAP].memtype = UIO_MEM_NONE;
+            info->mem[MRF_IRQSTATS_MAP].size = 1;
+        }
+
+        /* Event FIFO ring, EVRs only */
+        if (dev->subsystem_device != PCI_SUBDEVICE_ID_MRF_PXIEVG_230) {
+            priv->fifo = (struct mrf_evtfifo *)__get_free_pages(GFP_KERNEL|__GFP_ZERO,
+                                                                get_order(sizeof(struct mrf_evtfifo)));
+            if (priv->fifo) {
+                priv->fifo->magic = MRF_EVTFIFO_MAGIC;
+                priv->fifo->version = MRF_EVTFIFO_VERSION;
+                priv->fifo->ringsize = MRF_EVTFIFO_RING;
+
+                info->mem[MRF_EVTFIFO_MAP].name = MRF_EVTFIFO_NAME;
+                info->mem[MRF_EVTFIFO_MAP].addr = (unsigned long)priv->fifo;
+                info->mem[MRF_EVTFIFO_MAP].size = PAGE_SIZE << get_order(sizeof(struct mrf_evtfifo));
+                info->mem[MRF_EVTFIFO_MAP].memtype = UIO_MEM_LOGICAL;
+            } else {
+                dev_warn(&dev->dev, "No memory for event FIFO ring\n");
+            }
+        }
+
+#else
+        /* The default UIO mmap() would let user space write the IRQ statistics
+         * and the event FIFO ring, so they are only exposed with mrf_mmap_physical().
+         * Without them user space drains the event FIFO itself, and has no IRQ statistics.
+         */
+#endif
+
         info->irq = dev->irq;
         info->irq_flags = IRQF_SHARED;
         info->handler = mrf_handler;
@@ -608,6 +841,10 @@ mrf_probe(struct pci_dev *dev,
 //        uio_unregister_device(info);
 //        pci_set_drvdata(dev, NULL);
 err_unmap:
+        if (priv->fifo)
+            free_pages((unsigned long)priv->fifo, get_order(sizeof(struct mrf_evtfifo)));
+        if (priv->stats)
+            free_page((unsigned long)priv->stats);
         iounmap(info->mem[0].internal_addr);
         iounmap(info->mem[2].internal_addr);
 err_release:
@@ -708,6 +945,11 @@ mrf_remove(struct pci_dev *dev)
         pci_release_regions(dev);
         pci_disable_device(dev);
 
+        if (priv->fifo)
+            free_pages((unsigned long)priv->fifo, get_order(sizeof(struct mrf_evtfifo)));
+        if (priv->stats)
+            free_page((unsigned long)priv->stats);
+
         kzfree(priv);
 
         dev_info(&dev->dev, "MRF Cleaned up\n");
@@ -8,6 +8,7 @@
 #include <algorithm>  // for remove()
 
 #include <epicsGuard.h>
+#include <epicsThread.h>
 #include <epicsMMIO.h>
 #include <errlog.h>
 #include <callback.h>
@@ -29,6 +30,14 @@ extern "C" {
 
 
 static std::map<std::string, mrmDataBuffer*> data_buffers[2];
+// cards may be set up concurrently (mrmSetupDeferred)
+static epicsMutex *data_buffers_lock;
+static epicsThreadOnceId data_buffers_once = EPICS_THREAD_ONCE_INIT;
+
+static void data_buffers_init(void*)
+{
+    data_buffers_lock = new epicsMutex;
+}
 
 mrmDataBuffer::mrmDataBuffer(const char * parentName, mrmDataBufferType::type_t type,
                              volatile epicsUInt8 *parentBaseAddress,
@@ -62,6 +71,8 @@ mrmDataBuffer::mrmDataBuffer(const char * parentName, mrmDataBufferType::type_t
     // init interest flags
     setInterest(NULL, NULL);
 
+    epicsThreadOnce(&data_buffers_once, &data_buffers_init, NULL);
+    epicsGuard<epicsMutex> g(*data_buffers_lock);
     data_buffers[m_type][parentName] = this;
 }
 
@@ -261,10 +272,12 @@ void mrmDataBuffer::handleDataBufferRxIRQ(CALLBACK *cb) {
 }
 
 mrmDataBuffer* mrmDataBuffer::getDataBufferFromDevice(const char *device, mrmDataBufferType::type_t type) {
-    // locking not needed because all data buffer instances are created before someone can use them
+    epicsThreadOnce(&data_buffers_once, &data_buffers_init, NULL);
+    epicsGuard<epicsMutex> g(*data_buffers_lock);
 
-    if(data_buffers[type].count(device)){
-        return data_buffers[type][device];
+    std::map<std::string, mrmDataBuffer*>::const_iterator it = data_buffers[type].find(device);
+    if(it != data_buffers[type].end()){
+        return it->second;
     }
 
     return NULL;
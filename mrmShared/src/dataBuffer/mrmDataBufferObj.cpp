@@ -1,6 +1,7 @@
 #include "iocsh.h"
 #include <epicsExport.h>
 #include "mrmDataBufferObj.h"
+#include "mrmDataBufferTxQueue.h"
 
 
 const char *mrmDataBufferObj::OBJECT_NAME = ":DataBuffer"; // appended to device name for use in mrfioc2 object model
@@ -198,6 +199,11 @@ static void mrmDataBufferObjFunc_report(const iocshArgBuf *args) {
         }
 
         dataBuffer->report();
+
+        mrmDataBufferTxQueue *txQueue = mrmDataBufferTxQueue::find(args[0].sval, (mrmDataBufferType::type_t)i);
+        if(txQueue) {
+            txQueue->report();
+        }
     }
 }
 
@@ -0,0 +1,755 @@
+#include <string.h>     // for memcpy
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdexcept>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsTime.h>
+#include <epicsGuard.h>
+#include <epicsEndian.h>
+
+#include "mrmShared.h"
+#include "mrfCommon.h"
+
+#include <epicsExport.h>
+#include "mrmDataBufferSchema.h"
+
+
+namespace {
+
+const char * const typeNames[] = {
+    "int8", "uint8", "int16", "uint16", "int32", "uint32",
+    "int64", "uint64", "float32", "float64"
+};
+const size_t typeSizes[] = {1, 1, 2, 2, 4, 4, 8, 8, 4, 8};
+const size_t ntypes = sizeof(typeSizes)/sizeof(typeSizes[0]);
+
+template<typename U>
+U byteSwap(U v)
+{
+    U r = 0;
+    for(size_t b=0; b<sizeof(U); b++) {
+        r = (U)((r<<8) | (v&0xff));
+        v = (U)(v>>8);
+    }
+    return r;
+}
+
+// T is the field type, U an unsigned integer of the same size
+template<typename T, typename U>
+void convert(const epicsUInt8 *src, double *dst, size_t count, bool swap)
+{
+    for(size_t i=0; i<count; i++, src+=sizeof(U)) {
+        U raw;
+        memcpy(&raw, src, sizeof(U));
+        if(swap)
+            raw = byteSwap(raw);
+        T v;
+        memcpy(&v, &raw, sizeof(T));
+        dst[i] = (double)v;
+    }
+}
+
+void fnv1a(epicsUInt32& hash, const std::string& s)
+{
+    for(size_t i=0; i<s.size(); i++) {
+        hash ^= (epicsUInt8)s[i];
+        hash *= 16777619u;
+    }
+}
+
+void putBE32(epicsUInt8 *p, epicsUInt32 v)
+{
+    p[0] = (epicsUInt8)(v>>24);
+    p[1] = (epicsUInt8)(v>>16);
+    p[2] = (epicsUInt8)(v>>8);
+    p[3] = (epicsUInt8)v;
+}
+
+epicsUInt32 getBE32(const epicsUInt8 *p)
+{
+    return (epicsUInt32(p[0])<<24) | (epicsUInt32(p[1])<<16) | (epicsUInt32(p[2])<<8) | p[3];
+}
+
+size_t parseSize(const std::string& tok, const char *what)
+{
+    char *end;
+    unsigned long v = strtoul(tok.c_str(), &end, 0);
+    if(tok.empty() || *end!='\0')
+        throw std::runtime_error(std::string("Invalid ")+what+" '"+tok+"'");
+    return v;
+}
+
+bool byOffset(const mrmDataBufferSchema::Field& a, const mrmDataBufferSchema::Field& b)
+{
+    return a.offset < b.offset;
+}
+
+} // namespace
+
+size_t mrmDataBufferSchema::Field::size() const
+{
+    return typeSizes[type]*count;
+}
+
+const char* mrmDataBufferSchema::typeName(type_t type)
+{
+    return (size_t)type<ntypes ? typeNames[type] : "?";
+}
+
+mrmDataBufferSchema::mrmDataBufferSchema()
+    :m_version(0)
+    ,m_layout(0)
+    ,m_header(-1)
+    ,m_nvalues(0)
+    ,m_begin(0)
+    ,m_end(0)
+{}
+
+void mrmDataBufferSchema::load(const std::string& fname)
+{
+    std::ifstream strm(fname.c_str());
+    if(!strm.is_open())
+        throw std::runtime_error("Can't open schema "+fname);
+
+    std::string line;
+    unsigned lineno = 0;
+    while(std::getline(strm, line)) {
+        lineno++;
+        try {
+            parse(line);
+        } catch(std::exception& e) {
+            std::ostringstream msg;
+            msg<<fname<<":"<<lineno<<": "<<e.what();
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+    try {
+        compile();
+    } catch(std::exception& e) {
+        throw std::runtime_error(fname+": "+e.what());
+    }
+}
+
+void mrmDataBufferSchema::parse(const std::string& line)
+{
+    std::istringstream strm(line.substr(0, line.find('#')));
+    std::vector<std::string> toks;
+    std::string tok;
+    while(strm>>tok)
+        toks.push_back(tok);
+
+    if(toks.empty())
+        return;
+
+    if(toks[0]=="version" && toks.size()==2) {
+        m_version = (epicsUInt32)parseSize(toks[1], "version");
+
+    } else if(toks[0]=="header" && toks.size()==2) {
+        m_header = (long)parseSize(toks[1], "offset");
+
+    } else if(toks[0]=="field" && toks.size()>=4 && toks.size()<=6) {
+        Field fld;
+        fld.name = toks[1];
+
+        size_t t;
+        for(t=0; t<ntypes; t++) {
+            if(toks[2]==typeNames[t])
+                break;
+        }
+        if(t==ntypes)
+            throw std::runtime_error("Unknown type '"+toks[2]+"'");
+        fld.type = (type_t)t;
+
+        fld.offset = parseSize(toks[3], "offset");
+        fld.count = 1;
+        fld.littleEndian = false;
+        fld.value = 0;
+
+        for(size_t i=4; i<toks.size(); i++) {
+            if(toks[i]=="be")
+                fld.littleEndian = false;
+            else if(toks[i]=="le")
+                fld.littleEndian = true;
+            else if(i==4)
+                fld.count = parseSize(toks[i], "element count");
+            else
+                throw std::runtime_error("Invalid byte order '"+toks[i]+"', expected be or le");
+        }
+        if(fld.count==0)
+            throw std::runtime_error("Field '"+fld.name+"' has no elements");
+
+        for(size_t i=0; i<m_fields.size(); i++) {
+            if(m_fields[i].name==fld.name)
+                throw std::runtime_error("Duplicate field '"+fld.name+"'");
+        }
+        m_fields.push_back(fld);
+
+    } else {
+        throw std::runtime_error("Expected 'version N', 'header OFFSET' or 'field NAME TYPE OFFSET [COUNT] [be|le]'");
+    }
+}
+
+void mrmDataBufferSchema::compile()
+{
+    if(m_fields.empty())
+        throw std::runtime_error("Schema has no fields");
+
+    std::stable_sort(m_fields.begin(), m_fields.end(), byOffset);
+
+    const bool hostLittle = EPICS_BYTE_ORDER == EPICS_ENDIAN_LITTLE;
+
+    m_ops.clear();
+    m_nvalues = 0;
+    m_layout = 2166136261u;
+    m_begin = m_fields.front().offset;
+    m_end = 0;
+
+    if(hasHeader()) {
+        if(headerOffset()+8 > DataBuffer_len_max)
+            throw std::runtime_error("Header is out of the data buffer");
+        m_begin = std::min(m_begin, headerOffset());
+        m_end = headerOffset()+8;
+    }
+
+    for(size_t i=0; i<m_fields.size(); i++) {
+        Field& fld = m_fields[i];
+
+        Op op;
+        op.begin = fld.offset;
+        op.end = fld.offset + fld.size();
+        op.field = i;
+        op.swap = fld.littleEndian != hostLittle && typeSizes[fld.type]>1;
+
+        if(op.end > DataBuffer_len_max)
+            throw std::runtime_error("Field '"+fld.name+"' is out of the data buffer");
+        if(i>0 && op.begin < m_ops.back().end)
+            throw std::runtime_error("Field '"+fld.name+"' overlaps '"+m_fields[i-1].name+"'");
+        if(hasHeader() && op.begin < headerOffset()+8 && op.end > headerOffset())
+            throw std::runtime_error("Field '"+fld.name+"' overlaps the header");
+
+        switch(fld.type) {
+        case typeInt8:    op.convert = &convert<epicsInt8, epicsUInt8>; break;
+        case typeUInt8:   op.convert = &convert<epicsUInt8, epicsUInt8>; break;
+        case typeInt16:   op.convert = &convert<epicsInt16, epicsUInt16>; break;
+        case typeUInt16:  op.convert = &convert<epicsUInt16, epicsUInt16>; break;
+        case typeInt32:   op.convert = &convert<epicsInt32, epicsUInt32>; break;
+        case typeUInt32:  op.convert = &convert<epicsUInt32, epicsUInt32>; break;
+        case typeInt64:   op.convert = &convert<epicsInt64, epicsUInt64>; break;
+        case typeUInt64:  op.convert = &convert<epicsUInt64, epicsUInt64>; break;
+        case typeFloat32: op.convert = &convert<epicsFloat32, epicsUInt32>; break;
+        case typeFloat64: op.convert = &convert<epicsFloat64, epicsUInt64>; break;
+        }
+        m_ops.push_back(op);
+
+        fld.value = m_nvalues;
+        m_nvalues += fld.count;
+        m_end = std::max(m_end, op.end);
+
+        std::ostringstream def;
+        def<<fld.name<<' '<<typeNames[fld.type]<<' '<<fld.offset<<' '<<fld.count<<' '
+           <<(fld.littleEndian ? "le" : "be")<<'\n';
+        fnv1a(m_layout, def.str());
+    }
+}
+
+void mrmDataBufferSchema::writeHeader(epicsUInt8 *buf) const
+{
+    if(!hasHeader())
+        return;
+    putBE32(buf+headerOffset(), m_version);
+    putBE32(buf+headerOffset()+4, m_layout);
+}
+
+void mrmDataBufferSchema::writeHeader(mrmDataBufferUser& user) const
+{
+    if(!hasHeader())
+        return;
+    epicsUInt8 header[8];
+    putBE32(header, m_version);
+    putBE32(header+4, m_layout);
+    user.put(headerOffset(), sizeof(header), header);
+}
+
+bool mrmDataBufferSchema::checkHeader(const epicsUInt8 *buf) const
+{
+    if(!hasHeader())
+        return true;
+    return getBE32(buf+headerOffset())==m_version && getBE32(buf+headerOffset()+4)==m_layout;
+}
+
+void mrmDataBufferSchema::decode(const epicsUInt8 *buf, size_t offset, size_t length,
+                                 double *values, std::vector<size_t>& touched) const
+{
+    const size_t last = offset+length;
+    touched.clear();
+
+    for(size_t i=0; i<m_ops.size(); i++) {
+        const Op& op = m_ops[i];
+        if(op.begin >= last)
+            break;              // ordered by offset
+        if(op.end <= offset)
+            continue;
+
+        const Field& fld = m_fields[op.field];
+        op.convert(buf+op.begin, values+fld.value, fld.count, op.swap);
+        touched.push_back(op.field);
+    }
+}
+
+
+mrmDataBufferDecoder::mrmDataBufferDecoder(const std::string& name, const std::string& device,
+                                           mrmDataBufferType::type_t type, const mrmDataBufferSchema& schema,
+                                           bool onChange)
+    :mrf::ObjectInst<mrmDataBufferDecoder>(name)
+    ,m_schema(schema)
+    ,m_interest(0)
+    ,m_values(schema.valueCount(), 0.0)
+    ,m_compatible(false)
+    ,m_decoded(0)
+    ,m_mismatch(0)
+    ,m_decodeTime(0.0)
+    ,m_decodeTimeMax(0.0)
+{
+    const std::vector<mrmDataBufferSchema::Field>& fields = m_schema.fields();
+    m_touched.reserve(fields.size());
+
+    try {
+        for(size_t i=0; i<fields.size(); i++)
+            m_objects.push_back(new mrmDataBufferField(name+":"+fields[i].name, *this, i));
+
+        if(!m_user.init(device.c_str(), type))
+            throw std::runtime_error("Can't use the data buffer of "+device);
+
+        m_interest = m_user.registerInterest(m_schema.begin(), m_schema.end()-m_schema.begin(),
+                                             &mrmDataBufferDecoder::received, this, 0, onChange);
+        if(!m_interest)
+            throw std::runtime_error("Can't receive the data buffer of "+device);
+    } catch(...) {
+        for(size_t i=0; i<m_objects.size(); i++)
+            delete m_objects[i];
+        throw;
+    }
+}
+
+mrmDataBufferDecoder::~mrmDataBufferDecoder()
+{
+    m_user.removeInterest(m_interest);
+    for(size_t i=0; i<m_objects.size(); i++)
+        delete m_objects[i];
+}
+
+void mrmDataBufferDecoder::received(size_t offset, size_t length, void *pvt)
+{
+    mrmDataBufferDecoder *self = static_cast<mrmDataBufferDecoder*>(pvt);
+    double start = mrfMonotonicSeconds();
+
+    // called by the update thread of the user, which holds the lock of the receive buffer
+    const epicsUInt8 *buf = self->m_user.requestRxBuffer();
+    {
+        SCOPED_LOCK2(self->m_lock, guard);
+
+        self->m_compatible = self->m_schema.checkHeader(buf);
+        if(self->m_compatible) {
+            self->m_schema.decode(buf, offset, length, &self->m_values[0], self->m_touched);
+            self->m_decoded++;
+        } else {
+            self->m_touched.clear();
+            self->m_mismatch++;
+        }
+
+        double us = (mrfMonotonicSeconds()-start)*1e6;
+        self->m_decodeTime = us;
+        if(us > self->m_decodeTimeMax)
+            self->m_decodeTimeMax = us;
+    }
+    self->m_user.releaseRxBuffer();
+
+    for(size_t i=0; i<self->m_touched.size(); i++)
+        self->m_objects[self->m_touched[i]]->publish();
+}
+
+bool mrmDataBufferDecoder::compatible() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_compatible;
+}
+
+epicsUInt32 mrmDataBufferDecoder::decoded() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_decoded;
+}
+
+epicsUInt32 mrmDataBufferDecoder::mismatch() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_mismatch;
+}
+
+double mrmDataBufferDecoder::decodeTime() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_decodeTime;
+}
+
+double mrmDataBufferDecoder::decodeTimeMax() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_decodeTimeMax;
+}
+
+void mrmDataBufferDecoder::reset(bool)
+{
+    SCOPED_LOCK(m_lock);
+    m_decoded = m_mismatch = 0;
+    m_decodeTime = m_decodeTimeMax = 0.0;
+}
+
+double mrmDataBufferDecoder::value(size_t field) const
+{
+    SCOPED_LOCK(m_lock);
+    return m_values[m_schema.fields()[field].value];
+}
+
+epicsUInt32 mrmDataBufferDecoder::values(size_t field, double *arr, epicsUInt32 count) const
+{
+    const mrmDataBufferSchema::Field& fld = m_schema.fields()[field];
+    if(count > fld.count)
+        count = (epicsUInt32)fld.count;
+
+    SCOPED_LOCK(m_lock);
+    std::copy(m_values.begin()+fld.value, m_values.begin()+fld.value+count, arr);
+    return count;
+}
+
+void mrmDataBufferDecoder::report(int level) const
+{
+    // before m_lock, the update thread holds the user lock while decoding
+    epicsUInt32 ndelivered = delivered(), nsuppressed = suppressed();
+
+    SCOPED_LOCK(m_lock);
+
+    printf("%s: schema version %u, layout %08x, %s, %u decoded, %u mismatched, decode %.1f us (max %.1f us)\n",
+           name().c_str(), (unsigned)m_schema.version(), (unsigned)m_schema.layout(),
+           m_compatible ? "compatible" : "not compatible",
+           (unsigned)m_decoded, (unsigned)m_mismatch, m_decodeTime, m_decodeTimeMax);
+    printf(" %u updates delivered, %u unchanged suppressed\n",
+           (unsigned)ndelivered, (unsigned)nsuppressed);
+
+    if(level<=0)
+        return;
+
+    if(m_schema.hasHeader())
+        printf("\t%-20s header  %4u\n", "", (unsigned)m_schema.headerOffset());
+
+    const std::vector<mrmDataBufferSchema::Field>& fields = m_schema.fields();
+    for(size_t i=0; i<fields.size(); i++) {
+        const mrmDataBufferSchema::Field& fld = fields[i];
+        printf("\t%-20s %-7s %4u [%u] %s = %g\n", fld.name.c_str(), mrmDataBufferSchema::typeName(fld.type),
+               (unsigned)fld.offset, (unsigned)fld.count, fld.littleEndian ? "le" : "be", m_values[fld.value]);
+    }
+}
+
+mrmDataBufferField::mrmDataBufferField(const std::string& name, const mrmDataBufferDecoder& decoder, size_t field)
+    :mrf::ObjectInst<mrmDataBufferField>(name)
+    ,m_decoder(decoder)
+    ,m_field(field)
+{
+    scanIoInit(&m_scan);
+}
+
+mrmDataBufferField::~mrmDataBufferField() {}
+
+double mrmDataBufferField::value() const
+{
+    return m_decoder.value(m_field);
+}
+
+epicsUInt32 mrmDataBufferField::values(double *arr, epicsUInt32 count) const
+{
+    return m_decoder.values(m_field, arr, count);
+}
+
+epicsUInt32 mrmDataBufferField::count() const
+{
+    return (epicsUInt32)m_decoder.schema().fields()[m_field].count;
+}
+
+
+/**
+ * Construct mrfioc2 objects for linking to EPICS records
+ **/
+
+OBJECT_BEGIN(mrmDataBufferDecoder) {
+
+    OBJECT_PROP1("Version", &mrmDataBufferDecoder::version);
+    OBJECT_PROP1("Layout", &mrmDataBufferDecoder::layout);
+    OBJECT_PROP1("Compatible", &mrmDataBufferDecoder::compatible);
+    OBJECT_PROP1("Decoded", &mrmDataBufferDecoder::decoded);
+    OBJECT_PROP1("Mismatch", &mrmDataBufferDecoder::mismatch);
+    OBJECT_PROP1("Decode Time", &mrmDataBufferDecoder::decodeTime);
+    OBJECT_PROP1("Decode Time Max", &mrmDataBufferDecoder::decodeTimeMax);
+    OBJECT_PROP1("Delivered", &mrmDataBufferDecoder::delivered);
+    OBJECT_PROP1("Suppressed", &mrmDataBufferDecoder::suppressed);
+    OBJECT_PROP2("Reset", &mrmDataBufferDecoder::dummyReturn, &mrmDataBufferDecoder::reset);
+
+} OBJECT_END(mrmDataBufferDecoder)
+
+OBJECT_BEGIN(mrmDataBufferField) {
+
+    OBJECT_PROP1("Value", &mrmDataBufferField::value);
+    OBJECT_PROP1("Value", &mrmDataBufferField::values);
+    OBJECT_PROP1("Value", &mrmDataBufferField::scan);
+    OBJECT_PROP1("Count", &mrmDataBufferField::count);
+
+} OBJECT_END(mrmDataBufferField)
+
+
+
+/**
+ * IOCSH functions
+ **/
+
+/********** Load  *******/
+static const iocshArg mrmDataBufferSchemaLoadArg0 = { "Name", iocshArgString };
+static const iocshArg mrmDataBufferSchemaLoadArg1 = { "Device", iocshArgString };
+static const iocshArg mrmDataBufferSchemaLoadArg2 = { "Type", iocshArgString };
+static const iocshArg mrmDataBufferSchemaLoadArg3 = { "File", iocshArgString };
+static const iocshArg mrmDataBufferSchemaLoadArg4 = { "OnChange", iocshArgInt };
+
+static const iocshArg * const mrmDataBufferSchemaLoadArgs[5] = { &mrmDataBufferSchemaLoadArg0, &mrmDataBufferSchemaLoadArg1,
+                                                                 &mrmDataBufferSchemaLoadArg2, &mrmDataBufferSchemaLoadArg3,
+                                                                 &mrmDataBufferSchemaLoadArg4 };
+static const iocshFuncDef mrmDataBufferSchemaLoadDef = { "mrmDataBufferSchemaLoad", 5, mrmDataBufferSchemaLoadArgs };
+
+static void mrmDataBufferSchemaLoadFunc(const iocshArgBuf *args) {
+    if(!args[0].sval || !args[1].sval || !args[2].sval || !args[3].sval) {
+        printf("Usage: mrmDataBufferSchemaLoad Name Device Type File OnChange\n\t"   \
+               "Name = name of the decoder, fields are <Name>:<field>\n\t" \
+               "Device = name of the timing card (eg.: EVR0)\n\t" \
+               "Type = data buffer type (230 or 300)\n\t" \
+               "File = schema file\n\t" \
+               "OnChange = 1 to only decode segments whose content changed\n" \
+               "Must be called before iocInit\n");
+        return;
+    }
+
+    size_t i;
+    for(i=mrmDataBufferType::type_first; i<=mrmDataBufferType::type_last; i++) {
+        if(strcmp(args[2].sval, mrmDataBufferType::type_string[i]) == 0) break;
+    }
+    if(i > mrmDataBufferType::type_last) {
+        errlogPrintf("Unknown data buffer type %s\n", args[2].sval);
+        return;
+    }
+
+    try {
+        if(mrf::Object::getObject(args[0].sval))
+            throw std::runtime_error("Object already exists");
+
+        mrmDataBufferSchema schema;
+        schema.load(args[3].sval);
+
+        new mrmDataBufferDecoder(args[0].sval, args[1].sval, (mrmDataBufferType::type_t)i, schema, args[4].ival!=0);
+        printf("%s: %u fields of schema version %u, layout %08x\n", args[0].sval,
+               (unsigned)schema.fields().size(), (unsigned)schema.version(), (unsigned)schema.layout());
+    } catch(std::exception& e) {
+        errlogPrintf("mrmDataBufferSchemaLoad %s: %s\n", args[0].sval, e.what());
+    }
+}
+
+/********** Report  *******/
+static const iocshArg mrmDataBufferSchemaReportArg0 = { "Name", iocshArgString };
+static const iocshArg mrmDataBufferSchemaReportArg1 = { "Level", iocshArgInt };
+
+static const iocshArg * const mrmDataBufferSchemaReportArgs[2] = { &mrmDataBufferSchemaReportArg0, &mrmDataBufferSchemaReportArg1 };
+static const iocshFuncDef mrmDataBufferSchemaReportDef = { "mrmDataBufferSchemaReport", 2, mrmDataBufferSchemaReportArgs };
+
+static void mrmDataBufferSchemaReportFunc(const iocshArgBuf *args) {
+    if(!args[0].sval) {
+        printf("Usage: mrmDataBufferSchemaReport Name Level\n");
+        return;
+    }
+
+    mrmDataBufferDecoder *decoder = dynamic_cast<mrmDataBufferDecoder*>(mrf::Object::getObject(args[0].sval));
+    if(!decoder) {
+        printf("Decoder <%s> does not exist!\n", args[0].sval);
+        return;
+    }
+    decoder->report(args[1].ival);
+}
+
+/********** Send header  *******/
+static const iocshArg mrmDataBufferSchemaSendHeaderArg0 = { "Device", iocshArgString };
+static const iocshArg mrmDataBufferSchemaSendHeaderArg1 = { "Type", iocshArgString };
+static const iocshArg mrmDataBufferSchemaSendHeaderArg2 = { "File", iocshArgString };
+
+static const iocshArg * const mrmDataBufferSchemaSendHeaderArgs[3] = { &mrmDataBufferSchemaSendHeaderArg0, &mrmDataBufferSchemaSendHeaderArg1,
+                                                                       &mrmDataBufferSchemaSendHeaderArg2 };
+static const iocshFuncDef mrmDataBufferSchemaSendHeaderDef = { "mrmDataBufferSchemaSendHeader", 3, mrmDataBufferSchemaSendHeaderArgs };
+
+static void mrmDataBufferSchemaSendHeaderFunc(const iocshArgBuf *args) {
+    if(!args[0].sval || !args[1].sval || !args[2].sval) {
+        printf("Usage: mrmDataBufferSchemaSendHeader Device Type File\n\t"   \
+               "Device = name of the sending timing card (eg.: EVG0)\n\t" \
+               "Type = data buffer type (230 or 300)\n\t" \
+               "File = schema file, with a header\n" \
+               "Sends the version and layout of the schema, for senders which do not write it themselves\n");
+        return;
+    }
+
+    size_t i;
+    for(i=mrmDataBufferType::type_first; i<=mrmDataBufferType::type_last; i++) {
+        if(strcmp(args[1].sval, mrmDataBufferType::type_string[i]) == 0) break;
+    }
+    if(i > mrmDataBufferType::type_last) {
+        errlogPrintf("Unknown data buffer type %s\n", args[1].sval);
+        return;
+    }
+
+    try {
+        mrmDataBufferSchema schema;
+        schema.load(args[2].sval);
+        if(!schema.hasHeader())
+            throw std::runtime_error("Schema has no header");
+
+        mrmDataBufferUser user;
+        if(!user.init(args[0].sval, (mrmDataBufferType::type_t)i))
+            throw std::runtime_error("Can't use the data buffer");
+        if(!user.supportsTx())
+            throw std::runtime_error("Data buffer can't send");
+
+        schema.writeHeader(user);
+        if(!user.send(true))
+            throw std::runtime_error("Send failed");
+
+        printf("%s: sent schema version %u, layout %08x at %u\n", args[0].sval,
+               (unsigned)schema.version(), (unsigned)schema.layout(), (unsigned)schema.headerOffset());
+    } catch(std::exception& e) {
+        errlogPrintf("mrmDataBufferSchemaSendHeader %s: %s\n", args[0].sval, e.what());
+    }
+}
+
+/********** Benchmark  *******/
+// Field by field, element by element, as applications parse the buffer by hand
+static void handParse(const mrmDataBufferSchema& schema, const epicsUInt8 *buf, double *values)
+{
+    const std::vector<mrmDataBufferSchema::Field>& fields = schema.fields();
+
+    for(size_t f=0; f<fields.size(); f++) {
+        const mrmDataBufferSchema::Field& fld = fields[f];
+        size_t size = fld.size()/fld.count;
+
+        for(size_t e=0; e<fld.count; e++) {
+            const epicsUInt8 *p = buf + fld.offset + e*size;
+            epicsUInt64 raw = 0;
+            for(size_t b=0; b<size; b++) {
+                if(fld.littleEndian)
+                    raw |= epicsUInt64(p[b]) << (8*b);
+                else
+                    raw = (raw<<8) | p[b];
+            }
+
+            double v;
+            switch(fld.type) {
+            case mrmDataBufferSchema::typeInt8:   v = (epicsInt8)raw; break;
+            case mrmDataBufferSchema::typeInt16:  v = (epicsInt16)raw; break;
+            case mrmDataBufferSchema::typeInt32:  v = (epicsInt32)raw; break;
+            case mrmDataBufferSchema::typeInt64:  v = (double)(epicsInt64)raw; break;
+            case mrmDataBufferSchema::typeFloat32: {
+                epicsUInt32 r32 = (epicsUInt32)raw;
+                epicsFloat32 f32;
+                memcpy(&f32, &r32, sizeof(f32));
+                v = f32;
+                break;
+            }
+            case mrmDataBufferSchema::typeFloat64: {
+                epicsFloat64 f64;
+                memcpy(&f64, &raw, sizeof(f64));
+                v = f64;
+                break;
+            }
+            default: v = (double)raw; break;
+            }
+            values[fld.value + e] = v;
+        }
+    }
+}
+
+static const iocshArg mrmDataBufferSchemaBenchArg0 = { "File", iocshArgString };
+static const iocshArg mrmDataBufferSchemaBenchArg1 = { "Iterations", iocshArgInt };
+
+static const iocshArg * const mrmDataBufferSchemaBenchArgs[2] = { &mrmDataBufferSchemaBenchArg0, &mrmDataBufferSchemaBenchArg1 };
+static const iocshFuncDef mrmDataBufferSchemaBenchDef = { "mrmDataBufferSchemaBench", 2, mrmDataBufferSchemaBenchArgs };
+
+static void mrmDataBufferSchemaBenchFunc(const iocshArgBuf *args) {
+    if(!args[0].sval) {
+        printf("Usage: mrmDataBufferSchemaBench File Iterations\n\t" \
+               "Decodes a random buffer with the schema and by hand-written style parsing, and compares\n");
+        return;
+    }
+
+    try {
+        mrmDataBufferSchema schema;
+        schema.load(args[0].sval);
+
+        size_t iterations = args[1].ival > 0 ? args[1].ival : 100000;
+
+        std::vector<epicsUInt8> buf(2048);
+        for(size_t i=0; i<buf.size(); i++)
+            buf[i] = (epicsUInt8)rand();
+
+        std::vector<double> decoded(schema.valueCount()), parsed(schema.valueCount());
+        std::vector<size_t> touched;
+        touched.reserve(schema.fields().size());
+
+        double start = mrfMonotonicSeconds();
+        for(size_t n=0; n<iterations; n++)
+            schema.decode(&buf[0], 0, buf.size(), &decoded[0], touched);
+        double tdecode = mrfMonotonicSeconds()-start;
+
+        start = mrfMonotonicSeconds();
+        for(size_t n=0; n<iterations; n++)
+            handParse(schema, &buf[0], &parsed[0]);
+        double tparse = mrfMonotonicSeconds()-start;
+
+        size_t differ = 0;
+        for(size_t i=0; i<decoded.size(); i++) {
+            // compare the bits, NaN != NaN
+            if(memcmp(&decoded[i], &parsed[i], sizeof(double))!=0)
+                differ++;
+        }
+
+        printf("%u fields, %u values, %u iterations\n", (unsigned)schema.fields().size(),
+               (unsigned)schema.valueCount(), (unsigned)iterations);
+        printf("schema decoder: %.3f us per buffer\n", tdecode*1e6/iterations);
+        printf("hand parsing:   %.3f us per buffer\n", tparse*1e6/iterations);
+        if(differ)
+            printf("%u values differ!\n", (unsigned)differ);
+        else
+            printf("Results are identical\n");
+    } catch(std::exception& e) {
+        errlogPrintf("mrmDataBufferSchemaBench: %s\n", e.what());
+    }
+}
+
+
+/******************/
+
+
+extern "C" {
+    static void mrmDataBufferSchemaRegistrar() {
+        iocshRegister(&mrmDataBufferSchemaLoadDef, mrmDataBufferSchemaLoadFunc);
+        iocshRegister(&mrmDataBufferSchemaReportDef, mrmDataBufferSchemaReportFunc);
+        iocshRegister(&mrmDataBufferSchemaSendHeaderDef, mrmDataBufferSchemaSendHeaderFunc);
+        iocshRegister(&mrmDataBufferSchemaBenchDef, mrmDataBufferSchemaBenchFunc);
+    }
+
+    epicsExportRegistrar(mrmDataBufferSchemaRegistrar);
+}
@@ -0,0 +1,226 @@
+#ifndef MRMDATABUFFERSCHEMA_H
+#define MRMDATABUFFERSCHEMA_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <dbScan.h>
+
+#include "mrmDataBufferUser.h"
+#include "mrf/object.h"
+
+#ifdef _WIN32
+#pragma warning( disable: 4251 )
+#endif
+
+/**
+ * @brief The mrmDataBufferSchema class describes the typed fields of a data buffer.
+ *
+ * A schema is a text file:
+ @code
+   # comment
+   version 3
+   header 0                          # optional 8 byte layout header
+   field mode     uint8   8
+   field current  float32 12
+   field bpm      int16   16 32 le   # 32 elements, little endian
+ @endcode
+ * Each field has a name, a type (int8, uint8, int16, uint16, int32, uint32, int64, uint64,
+ * float32, float64), an offset in the data buffer, an optional number of elements and an
+ * optional byte order (be, the default, or le).
+ *
+ * The header holds the version and a hash of the field definitions, both big endian 32 bit words.
+ * The sender writes it with writeHeader() before each send() or sendAsync() of its mrmDataBufferUser,
+ * or once with the mrmDataBufferSchemaSendHeader iocsh function. The receiver only decodes data with
+ * a matching header.
+ *
+ * compile() sorts the fields by offset and selects the conversion of each field once,
+ * so decode() is a single pass over the fields of an updated range.
+ */
+class epicsShareClass mrmDataBufferSchema {
+public:
+    enum type_t {
+        typeInt8, typeUInt8, typeInt16, typeUInt16, typeInt32, typeUInt32,
+        typeInt64, typeUInt64, typeFloat32, typeFloat64
+    };
+
+    struct Field {
+        std::string name;
+        type_t type;
+        size_t offset;
+        size_t count;       // number of elements
+        bool littleEndian;
+        size_t value;       // index of the first element in the decoded values
+        size_t size() const;
+    };
+
+    mrmDataBufferSchema();
+
+    /**
+     * @brief load reads and compiles a schema file
+     * @throws std::runtime_error with the file name and line of the error
+     */
+    void load(const std::string& fname);
+
+    /**
+     * @brief parse reads one line of a schema
+     * @throws std::runtime_error
+     */
+    void parse(const std::string& line);
+
+    /**
+     * @brief compile checks the fields and prepares the decoding. Must be called after the last parse().
+     * @throws std::runtime_error if fields overlap or are out of the data buffer
+     */
+    void compile();
+
+    epicsUInt32 version() const{return m_version;}
+    //! FNV-1a hash of the field definitions
+    epicsUInt32 layout() const{return m_layout;}
+    bool hasHeader() const{return m_header>=0;}
+    size_t headerOffset() const{return (size_t)m_header;}
+
+    //! Fields ordered by offset
+    const std::vector<Field>& fields() const{return m_fields;}
+    //! Number of decoded values (sum of the elements of all fields)
+    size_t valueCount() const{return m_nvalues;}
+    //! Range of the data buffer used by the schema
+    size_t begin() const{return m_begin;}
+    size_t end() const{return m_end;}
+
+    /**
+     * @brief writeHeader puts the version and layout in a transmit buffer
+     * @param buf is the whole data buffer (2048 bytes)
+     */
+    void writeHeader(epicsUInt8 *buf) const;
+
+    /**
+     * @brief writeHeader puts the version and layout in the transmit buffer of a user, to be sent
+     * with the next send() or sendAsync(). The user must be initialized with userOffset 0.
+     */
+    void writeHeader(mrmDataBufferUser& user) const;
+
+    /**
+     * @brief checkHeader compares the header in a received buffer with the schema
+     * @return true if the schema has no header, or it matches
+     */
+    bool checkHeader(const epicsUInt8 *buf) const;
+
+    /**
+     * @brief decode converts the fields which overlap the updated range
+     * @param buf is the whole data buffer (2048 bytes)
+     * @param values receives valueCount() values
+     * @param touched receives the indices of the decoded fields
+     */
+    void decode(const epicsUInt8 *buf, size_t offset, size_t length,
+                double *values, std::vector<size_t>& touched) const;
+
+    static const char* typeName(type_t);
+
+private:
+    typedef void (*convert_t)(const epicsUInt8 *src, double *dst, size_t count, bool swap);
+
+    struct Op {
+        size_t begin, end;  // byte range
+        size_t field;
+        convert_t convert;
+        bool swap;
+    };
+
+    epicsUInt32 m_version;
+    epicsUInt32 m_layout;
+    long m_header;          // -1 without header
+    std::vector<Field> m_fields;
+    std::vector<Op> m_ops;
+    size_t m_nvalues;
+    size_t m_begin, m_end;
+};
+
+class mrmDataBufferField;
+
+/**
+ * @brief The mrmDataBufferDecoder class decodes the received data buffer with a schema.
+ *
+ * Created with the mrmDataBufferSchemaLoad iocsh function. Each field of the schema is an object
+ * named <decoder>:<field> with the property "Value", as scalar (first element), as waveform
+ * and as I/O Intr scan list, which is requested when the field was decoded.
+ */
+class epicsShareClass mrmDataBufferDecoder : public mrf::ObjectInst<mrmDataBufferDecoder>
+{
+public:
+    mrmDataBufferDecoder(const std::string& name, const std::string& device,
+                         mrmDataBufferType::type_t type, const mrmDataBufferSchema& schema,
+                         bool onChange);
+    virtual ~mrmDataBufferDecoder();
+
+    /* locking done internally */
+    virtual void lock() const{}
+    virtual void unlock() const{}
+
+    const mrmDataBufferSchema& schema() const{return m_schema;}
+
+    epicsUInt32 version() const{return m_schema.version();}
+    epicsUInt32 layout() const{return m_schema.layout();}
+    bool compatible() const;
+    epicsUInt32 decoded() const;
+    epicsUInt32 mismatch() const;
+    //! Time of one decode [us]
+    double decodeTime() const;
+    double decodeTimeMax() const;
+    //! Updates passed to, and skipped as unchanged before, the decoder
+    epicsUInt32 delivered() const{return m_user.getDeliveredCount();}
+    epicsUInt32 suppressed() const{return m_user.getSuppressedCount();}
+
+    bool dummyReturn() const{return false;}
+    void reset(bool);
+
+    void report(int level) const;
+
+    double value(size_t field) const;
+    epicsUInt32 values(size_t field, double *arr, epicsUInt32 count) const;
+
+private:
+    static void received(size_t offset, size_t length, void *pvt);
+
+    const mrmDataBufferSchema m_schema;
+    mrmDataBufferUser m_user;
+    size_t m_interest;
+
+    mutable epicsMutex m_lock;
+    // Guarded by m_lock
+    std::vector<double> m_values;
+    bool m_compatible;
+    epicsUInt32 m_decoded, m_mismatch;
+    double m_decodeTime, m_decodeTimeMax;
+
+    std::vector<size_t> m_touched;  // only used by the update thread
+    std::vector<mrmDataBufferField*> m_objects;
+};
+
+//! One field of a mrmDataBufferDecoder
+class epicsShareClass mrmDataBufferField : public mrf::ObjectInst<mrmDataBufferField>
+{
+public:
+    mrmDataBufferField(const std::string& name, const mrmDataBufferDecoder& decoder, size_t field);
+    virtual ~mrmDataBufferField();
+
+    /* locking done internally */
+    virtual void lock() const{}
+    virtual void unlock() const{}
+
+    double value() const;
+    epicsUInt32 values(double *arr, epicsUInt32 count) const;
+    epicsUInt32 count() const;
+    IOSCANPVT scan() const{return m_scan;}
+
+    void publish(){scanIoRequest(m_scan);}
+
+private:
+    const mrmDataBufferDecoder& m_decoder;
+    const size_t m_field;
+    IOSCANPVT m_scan;
+};
+
+#endif // MRMDATABUFFERSCHEMA_H
@@ -0,0 +1,375 @@
+#include <string.h>     // for memcpy
+#include <stdio.h>
+#include <stdexcept>
+
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsTime.h>
+#include <epicsGuard.h>
+
+#include "mrmShared.h"
+#include "mrmThreadTopology.h"
+#include "mrmDataBufferObj.h"
+#include "mrfCommon.h"
+
+#include <epicsExport.h>
+#include "mrmDataBufferTxQueue.h"
+
+
+const char *mrmDataBufferTxQueue::OBJECT_NAME = ":TxQueue"; // appended to the data buffer object name
+
+static std::string queueName(const std::string& device, mrmDataBufferType::type_t type)
+{
+    return device + mrmDataBufferObj::OBJECT_NAME + mrmDataBufferType::type_string[type]
+            + mrmDataBufferTxQueue::OBJECT_NAME;
+}
+
+mrmDataBufferTxQueue::mrmDataBufferTxQueue(const std::string& device, mrmDataBuffer &dataBuffer, size_t depth, unsigned int priority)
+    :mrf::ObjectInst<mrmDataBufferTxQueue>(queueName(device, dataBuffer.getType()))
+    ,m_device(device)
+    ,m_data_buffer(dataBuffer)
+    ,m_wakeup(epicsEventEmpty)
+    ,m_stop(false)
+    ,m_slots(depth ? depth : 1)
+    ,m_head(0)
+    ,m_count(0)
+    ,m_depthMax(0)
+    ,m_sent(0)
+    ,m_dropped(0)
+    ,m_failed(0)
+    ,m_latency(0.0)
+    ,m_latencyMax(0.0)
+    ,m_latencySum(0.0)
+    ,m_thread(*this, "MRF DBUFF TX",
+              epicsThreadGetStackSize(epicsThreadStackMedium),
+              priority)
+{
+    m_thread.start();
+}
+
+mrmDataBufferTxQueue::~mrmDataBufferTxQueue()
+{
+    {
+        SCOPED_LOCK(m_lock);
+        m_stop = true;
+    }
+    m_wakeup.signal();
+    m_thread.exitWait();
+}
+
+mrmDataBufferTxQueue* mrmDataBufferTxQueue::find(const std::string& device, mrmDataBufferType::type_t type)
+{
+    return dynamic_cast<mrmDataBufferTxQueue*>(mrf::Object::getObject(queueName(device, type)));
+}
+
+bool mrmDataBufferTxQueue::queue(const epicsUInt8 *data, const epicsUInt32 *segments, dataBufferTxCallback_t fptr, void *pvt)
+{
+    {
+        SCOPED_LOCK(m_lock);
+
+        if (m_stop || m_count == m_slots.size()) {
+            m_dropped++;
+            return false;
+        }
+
+        slot_t& slot = m_slots[(m_head + m_count) % m_slots.size()];
+        memcpy(slot.data, data, sizeof(slot.data));
+        memcpy(slot.segments, segments, sizeof(slot.segments));
+        slot.fptr = fptr;
+        slot.pvt = pvt;
+        slot.queued = mrfMonotonicSeconds();
+
+        m_count++;
+        if (m_count > m_depthMax) m_depthMax = (epicsUInt32)m_count;
+    }
+    m_wakeup.signal();
+    return true;
+}
+
+// Same splitting into consecutive segments as mrmDataBufferUser::send()
+bool mrmDataBufferTxQueue::transmit(slot_t& slot)
+{
+    epicsUInt32 segments;
+    epicsUInt8 i, bits, startSegment=0;
+    epicsUInt16 length = 0;
+    bool ok = true;
+
+    for(i=0; i<4; i++){
+        segments = slot.segments[i];
+        bits = 32;
+        while(bits){
+            if (segments & 0x80000000) {
+                if (length == 0) startSegment = 32 * i + 32 - bits;
+                length += DataBuffer_segment_length;
+
+            } else {
+                if (length > 0) {
+                    ok &= m_data_buffer.send(startSegment, length, &slot.data[startSegment*DataBuffer_segment_length]);
+                }
+                length = 0;
+            }
+            segments <<= 1;
+            bits--;
+        }
+    }
+
+    if (length > 0) {
+        if (length > DataBuffer_len_max) length = DataBuffer_len_max;
+        ok &= m_data_buffer.send(startSegment, length, &slot.data[startSegment*DataBuffer_segment_length]);
+    }
+
+    return ok;
+}
+
+void mrmDataBufferTxQueue::complete(slot_t& slot, bool ok, double done)
+{
+    double latency = (done - slot.queued) * 1e6;
+    dataBufferTxCallback_t fptr = slot.fptr;
+    void *pvt = slot.pvt;
+
+    {
+        SCOPED_LOCK(m_lock);
+        // the slot is free again
+        m_head = (m_head + 1) % m_slots.size();
+        m_count--;
+
+        if (ok) {
+            m_sent++;
+            m_latency = latency;
+            if (latency > m_latencyMax) m_latencyMax = latency;
+            m_latencySum += latency;
+        } else {
+            m_failed++;
+        }
+    }
+
+    if (fptr) {
+        try {
+            fptr(ok, latency, pvt);
+        } catch(std::exception& e) {
+            errlogPrintf("%s: Tx complete callback error: %s\n", name().c_str(), e.what());
+        }
+    }
+}
+
+void mrmDataBufferTxQueue::run()
+{
+    mrmThreadTopology::pin(m_device, mrmThreadTopology::roleDataBuffer);
+    mrmThreadStats stats(m_device, mrmThreadTopology::roleDataBuffer);
+
+    slot_t *inflight = NULL;    // triggered, not yet completed
+    bool inflightOk = false;
+
+    while (true) {
+        slot_t *next = NULL;
+        bool stop;
+        {
+            SCOPED_LOCK(m_lock);
+            stop = m_stop;
+            size_t busy = inflight ? 1 : 0;
+            if (!stop && m_count > busy)
+                next = &m_slots[(m_head + busy) % m_slots.size()];
+        }
+
+        if (!next) {
+            if (inflight) {
+                bool ok = inflightOk && m_data_buffer.waitForTxComplete();
+                complete(*inflight, ok, mrfMonotonicSeconds());
+                inflight = NULL;
+                continue;
+            }
+            if (stop) {
+                // fail what is still queued, so every caller gets its callback
+                while (true) {
+                    slot_t *slot;
+                    {
+                        SCOPED_LOCK(m_lock);
+                        if (!m_count)
+                            break;
+                        slot = &m_slots[m_head];
+                    }
+                    complete(*slot, false, mrfMonotonicSeconds());
+                }
+                break;
+            }
+            stats.waitStart();
+            m_wakeup.wait();
+            stats.waitEnd();
+            continue;
+        }
+
+        // The previous payload must be off the wire before the next one is written.
+        // Its callback runs while the next one is being sent, its latency ends here.
+        slot_t *prev = inflight;
+        bool prevOk = prev && inflightOk && m_data_buffer.waitForTxComplete();
+        double prevDone = mrfMonotonicSeconds();
+
+        inflightOk = transmit(*next);
+        inflight = next;
+
+        if (prev)
+            complete(*prev, prevOk, prevDone);
+    }
+}
+
+epicsUInt32 mrmDataBufferTxQueue::capacity() const
+{
+    SCOPED_LOCK(m_lock);
+    return (epicsUInt32)m_slots.size();
+}
+
+epicsUInt32 mrmDataBufferTxQueue::depth() const
+{
+    SCOPED_LOCK(m_lock);
+    return (epicsUInt32)m_count;
+}
+
+epicsUInt32 mrmDataBufferTxQueue::depthMax() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_depthMax;
+}
+
+epicsUInt32 mrmDataBufferTxQueue::sent() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_sent;
+}
+
+epicsUInt32 mrmDataBufferTxQueue::dropped() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_dropped;
+}
+
+epicsUInt32 mrmDataBufferTxQueue::failed() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_failed;
+}
+
+double mrmDataBufferTxQueue::latency() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_latency;
+}
+
+double mrmDataBufferTxQueue::latencyMax() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_latencyMax;
+}
+
+double mrmDataBufferTxQueue::latencyMean() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_sent ? m_latencySum/m_sent : 0.0;
+}
+
+void mrmDataBufferTxQueue::reset(bool)
+{
+    SCOPED_LOCK(m_lock);
+    m_depthMax = (epicsUInt32)m_count;
+    m_sent = m_dropped = m_failed = 0;
+    m_latency = m_latencyMax = m_latencySum = 0.0;
+}
+
+void mrmDataBufferTxQueue::report() const
+{
+    SCOPED_LOCK(m_lock);
+    printf("\tTx queue: %u of %u slots used (max %u), %u sent, %u dropped, %u failed\n",
+           (unsigned)m_count, (unsigned)m_slots.size(), (unsigned)m_depthMax,
+           (unsigned)m_sent, (unsigned)m_dropped, (unsigned)m_failed);
+    printf("\tTx latency: last %.1f us, max %.1f us, mean %.1f us\n",
+           m_latency, m_latencyMax, m_sent ? m_latencySum/m_sent : 0.0);
+}
+
+
+/**
+ * Construct mrfioc2 objects for linking to EPICS records
+ **/
+
+OBJECT_BEGIN(mrmDataBufferTxQueue) {
+
+    OBJECT_PROP1("Capacity", &mrmDataBufferTxQueue::capacity);
+    OBJECT_PROP1("Depth", &mrmDataBufferTxQueue::depth);
+    OBJECT_PROP1("Depth Max", &mrmDataBufferTxQueue::depthMax);
+    OBJECT_PROP1("Sent", &mrmDataBufferTxQueue::sent);
+    OBJECT_PROP1("Dropped", &mrmDataBufferTxQueue::dropped);
+    OBJECT_PROP1("Failed", &mrmDataBufferTxQueue::failed);
+    OBJECT_PROP1("Latency", &mrmDataBufferTxQueue::latency);
+    OBJECT_PROP1("Latency Max", &mrmDataBufferTxQueue::latencyMax);
+    OBJECT_PROP1("Latency Mean", &mrmDataBufferTxQueue::latencyMean);
+    OBJECT_PROP2("Reset", &mrmDataBufferTxQueue::dummyReturn, &mrmDataBufferTxQueue::reset);
+
+} OBJECT_END(mrmDataBufferTxQueue)
+
+
+
+/**
+ * IOCSH functions
+ **/
+
+static const iocshArg   mrmDataBufferTxQueueArg0 = { "Device", iocshArgString };
+static const iocshArg   mrmDataBufferTxQueueArg1 = { "Type", iocshArgString };
+static const iocshArg   mrmDataBufferTxQueueArg2 = { "Depth", iocshArgInt };
+static const iocshArg   mrmDataBufferTxQueueArg3 = { "Priority", iocshArgInt };
+
+static const iocshArg * const mrmDataBufferTxQueueArgs[4] = { &mrmDataBufferTxQueueArg0, &mrmDataBufferTxQueueArg1,
+                                                              &mrmDataBufferTxQueueArg2, &mrmDataBufferTxQueueArg3 };
+static const iocshFuncDef mrmDataBufferTxQueueDef = { "mrmDataBufferTxQueue", 4, mrmDataBufferTxQueueArgs };
+
+
+static void mrmDataBufferTxQueueFunc(const iocshArgBuf *args) {
+    if(args[0].sval == NULL || args[1].sval == NULL){
+        printf("Usage: mrmDataBufferTxQueue Device Type Depth Priority\n\t"   \
+               "Device = name of the timing card (eg.: EVR0, EVG0, ...)\n\t" \
+               "Type = data buffer type (230 or 300)\n\t" \
+               "Depth = number of payloads which can be queued. Default: 16\n\t" \
+               "Priority = priority of the sender thread. Default: epicsThreadPriorityHigh\n" \
+               "Must be called before iocInit\n");
+        return;
+    }
+
+    size_t i;
+    for(i=mrmDataBufferType::type_first; i<=mrmDataBufferType::type_last; i++) {
+        if(strcmp(args[1].sval, mrmDataBufferType::type_string[i]) == 0) break;
+    }
+    if(i > mrmDataBufferType::type_last) {
+        errlogPrintf("Unknown data buffer type %s\n", args[1].sval);
+        return;
+    }
+    mrmDataBufferType::type_t type = (mrmDataBufferType::type_t)i;
+
+    mrmDataBuffer *dataBuffer = mrmDataBuffer::getDataBufferFromDevice(args[0].sval, type);
+    if(!dataBuffer || !dataBuffer->supportsTx()) {
+        errlogPrintf("Device <%s> has no %s series data buffer which can send\n", args[0].sval, args[1].sval);
+        return;
+    }
+
+    if(mrmDataBufferTxQueue::find(args[0].sval, type)) {
+        errlogPrintf("Device <%s> already has a %s series data buffer Tx queue\n", args[0].sval, args[1].sval);
+        return;
+    }
+
+    int depth = args[2].ival > 0 ? args[2].ival : 16;
+    int priority = args[3].ival > 0 ? args[3].ival : epicsThreadPriorityHigh;
+
+    try {
+        new mrmDataBufferTxQueue(args[0].sval, *dataBuffer, depth, priority);
+    } catch(std::exception& e) {
+        errlogPrintf("Can't create data buffer Tx queue for %s: %s\n", args[0].sval, e.what());
+    }
+}
+
+
+/******************/
+
+
+extern "C" {
+    static void mrmDataBufferTxQueueRegistrar() {
+        iocshRegister(&mrmDataBufferTxQueueDef, mrmDataBufferTxQueueFunc);
+    }
+
+    epicsExportRegistrar(mrmDataBufferTxQueueRegistrar);
+}
@@ -0,0 +1,113 @@
+#ifndef MRMDATABUFFERTXQUEUE_H
+#define MRMDATABUFFERTXQUEUE_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+
+#include "mrmDataBuffer.h"
+#include "mrmDataBufferUser.h"
+#include "mrf/object.h"
+
+/**
+ * @brief The mrmDataBufferTxQueue class sends data buffer payloads from a thread of its own.
+ *
+ * A payload is the copy of a whole transmit buffer and the mask of the segments to send.
+ * It is copied into a preallocated slot, so queue() never allocates and never waits for the hardware.
+ * When the queue is full the payload is dropped.
+ *
+ * The hardware has no interrupt for the end of a transmission, so the sender thread polls for it.
+ * It has a single transmit buffer, so a payload is written only once the previous one is off the wire.
+ * What overlaps is the completion callback of a payload, which runs while the next one is sent.
+ *
+ * When the queue is destroyed, the payload being sent is completed, and the callback
+ * of each payload still queued is called with ok=false.
+ *
+ * One queue can be created per data buffer with the mrmDataBufferTxQueue iocsh function.
+ * Its object name is <device>:DataBuffer<type>:TxQueue.
+ */
+class epicsShareClass mrmDataBufferTxQueue : public mrf::ObjectInst<mrmDataBufferTxQueue>,
+                                             public epicsThreadRunable
+{
+public:
+    mrmDataBufferTxQueue(const std::string& device, mrmDataBuffer &dataBuffer, size_t depth, unsigned int priority);
+    virtual ~mrmDataBufferTxQueue();
+
+    static const char *OBJECT_NAME;
+
+    /**
+     * @brief find the queue of a data buffer
+     * @return the queue, or NULL if none was created
+     */
+    static mrmDataBufferTxQueue* find(const std::string& device, mrmDataBufferType::type_t type);
+
+    /* locking done internally */
+    virtual void lock() const{}
+    virtual void unlock() const{}
+
+    /**
+     * @brief queue copies a payload into a free slot
+     * @param data is the whole transmit buffer (2048 bytes)
+     * @param segments is the mask of the segments to send (4 words, MSB first)
+     * @param fptr is called by the sender thread when the payload was sent or failed, or NULL
+     * @param pvt is passed to fptr
+     * @return false if the queue is full or stopping, and the payload was dropped
+     */
+    bool queue(const epicsUInt8 *data, const epicsUInt32 *segments, dataBufferTxCallback_t fptr, void *pvt);
+
+    epicsUInt32 capacity() const;
+    epicsUInt32 depth() const;
+    epicsUInt32 depthMax() const;
+    epicsUInt32 sent() const;
+    epicsUInt32 dropped() const;
+    epicsUInt32 failed() const;
+    //! From queue() to the end of the transmission [us]
+    double latency() const;
+    double latencyMax() const;
+    double latencyMean() const;
+
+    bool dummyReturn() const{return false;}
+    void reset(bool);
+
+    void report() const;
+
+    virtual void run();
+
+private:
+    struct slot_t {
+        epicsUInt8 data[2048];
+        epicsUInt32 segments[4];
+        dataBufferTxCallback_t fptr;
+        void *pvt;
+        double queued;
+    };
+
+    bool transmit(slot_t&);
+    //! @param done end of the transmission, from mrfMonotonicSeconds()
+    void complete(slot_t&, bool ok, double done);
+
+    const std::string m_device;
+    mrmDataBuffer &m_data_buffer;
+
+    mutable epicsMutex m_lock;
+    epicsEvent m_wakeup;
+    bool m_stop;
+
+    // Guarded by m_lock
+    std::vector<slot_t> m_slots;    // preallocated ring
+    size_t m_head;                  // next slot to send
+    size_t m_count;                 // slots queued, including the one being sent
+    epicsUInt32 m_depthMax, m_sent, m_dropped, m_failed;
+    double m_latency, m_latencyMax, m_latencySum;
+
+    epicsThread m_thread;
+
+    mrmDataBufferTxQueue(const mrmDataBufferTxQueue&);
+    mrmDataBufferTxQueue& operator=(const mrmDataBufferTxQueue&);
+};
+
+#endif // MRMDATABUFFERTXQUEUE_H
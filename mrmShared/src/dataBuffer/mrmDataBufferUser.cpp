@@ -3,12 +3,15 @@
 
 #include <errlog.h>
 #include <epicsGuard.h>
+#include "mrfCommon.h"
 
 #include "mrmShared.h"
 #include "mrmDataBuffer.h"
+#include "mrmThreadTopology.h"
 
 #include <epicsExport.h>
 #include "mrmDataBufferUser.h"
+#include "mrmDataBufferTxQueue.h"
 
 
 mrmDataBufferUser::mrmDataBufferUser() {
@@ -17,6 +20,8 @@ mrmDataBufferUser::mrmDataBufferUser() {
     for (i=0; i<4; i++){
         m_rx_segments[i] = 0;
         m_tx_segments[i] = 0;
+        m_rx_changed[i] = 0;
+        m_rx_valid[i] = 0;
         m_segments_interested[i] = 0;
     }
 
@@ -24,8 +29,11 @@ mrmDataBufferUser::mrmDataBufferUser() {
     memset(m_tx_buff, 0, 2048);
 
     m_data_buffer = NULL;
+    m_tx_queue = NULL;
     m_user_offset = 0;
     m_strict_mode = false;
+    m_delivered = 0;
+    m_suppressed = 0;
 }
 
 bool mrmDataBufferUser::init(const char* deviceName, mrmDataBufferType::type_t type, size_t userOffset, bool strictMode, unsigned int userUpdateThreadPriority) {
@@ -52,6 +60,8 @@ bool mrmDataBufferUser::init(const char* deviceName, mrmDataBufferType::type_t t
 
     m_user_offset = userOffset;
     m_strict_mode = strictMode;
+    m_device_name = deviceName;
+    m_tx_queue = mrmDataBufferTxQueue::find(deviceName, type);
 
     if (m_data_buffer->supportsRx()) {
         m_thread_sync = epicsEventCreate(epicsEventEmpty);
@@ -101,7 +111,7 @@ mrmDataBufferUser::~mrmDataBufferUser()
     }
 }
 
-size_t mrmDataBufferUser::registerInterest(size_t offset, size_t length, dataBufferRxCallback_t fptr, void *pvt, size_t interestId) {
+size_t mrmDataBufferUser::registerInterest(size_t offset, size_t length, dataBufferRxCallback_t fptr, void *pvt, size_t interestId, bool onChange) {
     RxCallback *cb = NULL;
     epicsUInt16 segment, segmentOffset, noOfSegmentsUpdated;
     size_t i;
@@ -154,9 +164,11 @@ size_t mrmDataBufferUser::registerInterest(size_t offset, size_t length, dataBuf
         cb->fptr = fptr;
         cb->pvt = pvt;
         cb->id = id;
+        cb->onChange = onChange;
 
         for (i=0; i<4; i++) {
             cb->segments[i] = 0;
+            cb->delivered[i] = 0;
         }
     }
     else {  // select existing ID
@@ -359,6 +371,28 @@ bool mrmDataBufferUser::send(bool wait)
     return true;
 }
 
+bool mrmDataBufferUser::sendAsync(dataBufferTxCallback_t fptr, void *pvt)
+{
+    if (m_data_buffer == NULL) {
+        errlogPrintf("Cannot send since data buffer is not available!\n");
+        return false;
+    }
+
+    if (m_tx_queue == NULL) {
+        double start = mrfMonotonicSeconds();
+
+        bool ok = send(true);
+
+        if (fptr) {
+            fptr(ok, (mrfMonotonicSeconds() - start) * 1e6, pvt);
+        }
+        return ok;
+    }
+
+    epicsGuard<epicsMutex> g(m_tx_lock);
+    return m_tx_queue->queue(m_tx_buff, m_tx_segments, fptr, pvt);
+}
+
 void mrmDataBufferUser::updateSegment(epicsUInt16 segment, epicsUInt8 *data, epicsUInt16 length) {
     epicsUInt32 segmentMask, segmentsReceived[4]={0, 0, 0, 0};
     epicsUInt32 i;
@@ -386,6 +420,22 @@ void mrmDataBufferUser::updateSegment(epicsUInt16 segment, epicsUInt8 *data, epi
         m_rx_segments[i] |= segmentsReceived[i] & m_segments_interested[i];   // Set segment received flags. We only care for segments someone is interested in.
     }
 
+    // Compare with the previous content before it is overwritten. Segments received for the first time count as changed.
+    for(i=segment; i<(epicsUInt32)(segment+noOfSegmentsUpdated); i++){
+        segmentMask = (0x80000000 >> (i % 32));
+        if (!(m_segments_interested[i / 32] & segmentMask)) continue;
+
+        size_t segmentLength = DataBuffer_segment_length;
+        if ((i - segment + 1) * DataBuffer_segment_length > length) {
+            segmentLength = length - (i - segment) * DataBuffer_segment_length;   // last segment is shorter
+        }
+        if (!(m_rx_valid[i / 32] & segmentMask) ||
+                memcmp(&m_rx_buff[i*DataBuffer_segment_length], &data[i*DataBuffer_segment_length], segmentLength) != 0) {
+            m_rx_changed[i / 32] |= segmentMask;
+        }
+        m_rx_valid[i / 32] |= segmentMask;
+    }
+
     // Copy received segment(s) to local buffer. If the the tryLock fails, the buffer is out of sync...
     memcpy(&m_rx_buff[segment*DataBuffer_segment_length], &data[segment*DataBuffer_segment_length], length);
 
@@ -404,8 +454,15 @@ void mrmDataBufferUser::userUpdateThread(void* args) {
     mrmDataBufferUser* parent = static_cast<mrmDataBufferUser*>(args);
     RxCallback *userCallback;
     epicsUInt16 startOffset=0, length=0;
+    epicsUInt32 dispatch[4];
+    bool received, changed;
 
+    mrmThreadTopology::pin(parent->m_device_name, mrmThreadTopology::roleDataBuffer);
+    mrmThreadStats stats(parent->m_device_name, mrmThreadTopology::roleDataBuffer);
+
+    stats.waitStart();
     epicsEventWait(parent->m_thread_sync);
+    stats.waitEnd();
     while (!parent->m_thread_stop) {
 
         parent->m_rx_lock.lock();
@@ -413,9 +470,25 @@ void mrmDataBufferUser::userUpdateThread(void* args) {
         for (i=0; i<parent->m_rx_callbacks.size(); i++) {
             userCallback = parent->m_rx_callbacks[i];
 
+            // check if there is any data this user is interested in, and if it changed
+            received = changed = false;
+            for (j=0; j<4; j++) {
+                dispatch[j] = parent->m_rx_segments[j] & userCallback->segments[j];
+                received |= dispatch[j] != 0;
+                if (userCallback->onChange) {
+                    // segments not passed to this interest yet are passed even if unchanged
+                    dispatch[j] &= parent->m_rx_changed[j] | ~userCallback->delivered[j];
+                }
+                changed |= dispatch[j] != 0;
+                userCallback->delivered[j] |= dispatch[j];
+            }
+            if (received && !changed) {
+                parent->m_suppressed++;
+                continue;
+            }
+
             for (j=0; j<4; j++) {
-                // check if there is any data this user is interested in
-                segments = parent->m_rx_segments[j] & userCallback->segments[j];
+                segments = dispatch[j];
                 bits = 32;
 
                 while (bits) {
@@ -425,6 +498,7 @@ void mrmDataBufferUser::userUpdateThread(void* args) {
                     }
                     else if (length > 0) {
                         userCallback->fptr(startOffset-parent->m_user_offset, length, userCallback->pvt); // call the function that the user registered
+                        parent->m_delivered++;
                         length = 0;
                     }
                     segments <<= 1;
@@ -438,6 +512,7 @@ void mrmDataBufferUser::userUpdateThread(void* args) {
                     length = (length - 1) & DataBuffer_len_max; // Length of the entire buffer is greater than max length that can be send (because of the 4 byte increment). This means that the last segment is actually smaller than 16 bytes. Trim the length...
                 }
                 userCallback->fptr(startOffset-parent->m_user_offset, length, userCallback->pvt); // call the function that the user registered
+                parent->m_delivered++;
             }
 
             length = 0;
@@ -447,10 +522,13 @@ void mrmDataBufferUser::userUpdateThread(void* args) {
         // note that only when all users handle all the data, the overflow flags are cleared. Since we are holding a lock here, new reception can't start anyway...
         for(j=0; j<4; j++) {
             parent->m_rx_segments[j] = 0;  // mark the segments as handled
+            parent->m_rx_changed[j] = 0;
         }
 
         parent->m_rx_lock.unlock();
+        stats.waitStart();
         epicsEventWait(parent->m_thread_sync);
+        stats.waitEnd();
     }
     epicsEventSignal(parent->m_thread_stopped);
 }
@@ -469,3 +547,15 @@ size_t mrmDataBufferUser::getMaxLength()
 {
     return DataBuffer_len_max - m_user_offset;
 }
+
+epicsUInt32 mrmDataBufferUser::getDeliveredCount() const
+{
+    epicsGuard<epicsMutex> g(m_rx_lock);
+    return m_delivered;
+}
+
+epicsUInt32 mrmDataBufferUser::getSuppressedCount() const
+{
+    epicsGuard<epicsMutex> g(m_rx_lock);
+    return m_suppressed;
+}
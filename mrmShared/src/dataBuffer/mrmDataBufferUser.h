@@ -1,6 +1,7 @@
 #ifndef MRMDATABUFFERUSER_H
 #define MRMDATABUFFERUSER_H
 
+#include <string>
 #include <vector>
 #include <epicsTypes.h>
 #include <epicsMutex.h>
@@ -20,9 +21,11 @@
 
 
 class mrmDataBuffer;    // forward decleration in order to avoid dependancy on mrmDataBuffer.h file when using this class
+class mrmDataBufferTxQueue;
 
 
 typedef void(*dataBufferRxCallback_t)(size_t updated_offset, size_t length, void* pvt);
+typedef void(*dataBufferTxCallback_t)(bool ok, double latency_us, void* pvt);
 
 
 /**
@@ -59,9 +62,10 @@ public:
      * @param fptr is the callback function to invoke when data buffer on registered addresses is updated
      * @param pvt is pointer to the callback function private structure
      * @param the ID of the iterest we want to update, or 0 for new registation
+     * @param onChange when true, the callback is only invoked for segments whose content differs from the previous reception, and for the first reception after the segments were registered. Used for new registrations only.
      * @return the ID of the registered interest or 0 on error
      */
-    size_t registerInterest(size_t offset, size_t length, dataBufferRxCallback_t fptr, void* pvt, size_t interestId=0);
+    size_t registerInterest(size_t offset, size_t length, dataBufferRxCallback_t fptr, void* pvt, size_t interestId=0, bool onChange=false);
 
     /**
      * @brief removeInterest Remove previously registred interest
@@ -95,6 +99,16 @@ public:
      */
     bool send(bool wait);
 
+    /**
+     * @brief sendAsync queues the updated segments of data buffer that were set via put() and returns without waiting for MRF HW.
+     * The segments are sent by the sender thread of the Tx queue created with the mrmDataBufferTxQueue iocsh function.
+     * Without a Tx queue the segments are sent like send(true), and fptr is called before returning.
+     * @param fptr is called when the segments were sent, with the time since sendAsync in us. May be NULL.
+     * @param pvt is pointer to the callback function private structure
+     * @return false if the queue is full and the segments were dropped, or if sending failed
+     */
+    bool sendAsync(dataBufferTxCallback_t fptr, void* pvt);
+
     /**
      * @brief updateSegment is called from the underlying data buffer class when data is received.
      * @param segment is the first segment that was updated
@@ -121,6 +135,16 @@ public:
      */
     size_t getMaxLength();
 
+    /**
+     * @brief getDeliveredCount Returns the number of callback invocations of registered interests.
+     */
+    epicsUInt32 getDeliveredCount() const;
+
+    /**
+     * @brief getSuppressedCount Returns the number of updates not passed to registered interests with onChange set, because the content of their segments did not change.
+     */
+    epicsUInt32 getSuppressedCount() const;
+
     /**
      * @brief requestTxBuffer opens direct access to the user transmit buffer. Great care must be taken when using this function, since it locks the buffer transmission until releaseTxBuffer() is called. User must also make sure that the offset and length to be written to are inside the allowed buffer length (can be checked using getMaxLength()).
      * @return a pointer to the start + user offset of the underlying transmit buffer.
@@ -150,11 +174,15 @@ private:
 
     epicsUInt32 m_tx_segments[4];  // Segment mask for updated segments,  e.g. segments that are updated in a local buffer but were not sent out yet
     epicsUInt32 m_rx_segments[4];  // Segment mask for updates that were received but not yet dispatched
+    epicsUInt32 m_rx_changed[4];   // Segment mask for received updates whose content differs from the previous one
+    epicsUInt32 m_rx_valid[4];     // Segment mask for segments that were received at least once
     epicsMutex m_tx_lock;          // Protects race condition betwen put and send
-    epicsMutex m_rx_lock;          // Protects race condition between level 1 callback and consumer + protects access to rx buffer, rx segments and rx callbacks.
+    mutable epicsMutex m_rx_lock;  // Protects race condition between level 1 callback and consumer + protects access to rx buffer, rx segments and rx callbacks.
 
     mrmDataBuffer *m_data_buffer;  // Reference to the underlying data buffer
+    mrmDataBufferTxQueue *m_tx_queue; // Tx queue of the data buffer, or NULL
 
+    std::string m_device_name;      // the card, for the CPU placement of the update thread
     epicsThreadId m_thread_id;      // the ID of the user update thread
     bool m_thread_stop;             // used to signal the user update thread that it should exit
     epicsEventId m_thread_stopped;  // used to signal when the user update thread exited
@@ -167,11 +195,15 @@ private:
         epicsUInt32 segments[4];                // segment mask in which the user is interested
         dataBufferRxCallback_t fptr;            // callback function pointer
         void* pvt;                              // callback private
+        bool onChange;                          // only invoke the callback for changed segments
+        epicsUInt32 delivered[4];               // segments passed to the callback at least once. The first reception is always passed.
     };
     std::vector<RxCallback*> m_rx_callbacks;    // a list of registered users and their segments of interest (offset + length)
     epicsUInt32 m_segments_interested[4];       // global segment mask in which users are interested in
 
     size_t m_user_offset;                       // user offset + offset of the calling function determine the actuall data buffer offset.
+    epicsUInt32 m_delivered;                    // callback invocations
+    epicsUInt32 m_suppressed;                   // updates of onChange interests without changed segments
     bool m_strict_mode;                         // When in strict mode, updateSegment function uses 'lock' instead of 'tryLock'. When using strict mode, sser must ensure that the buffer operations are fast and non-blocking, sice they affect all users.
 
 
@@ -0,0 +1,322 @@
+
+#include <stdio.h>
+#include <stdexcept>
+#include <deque>
+#include <vector>
+
+#include <errlog.h>
+#include <iocsh.h>
+#include <initHooks.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsGuard.h>
+
+#include "mrfCommon.h"
+
+#include <epicsExport.h>
+#include "mrmDeferredSetup.h"
+
+namespace {
+
+struct queued_t {
+    mrmDeferredSetup::Job *job;
+    double queuedAt;
+};
+typedef std::deque<queued_t> queue_t;
+
+struct state_t {
+    epicsMutex lock;
+    epicsMutex bus;
+    unsigned workers;               // 0 when not deferring
+    queue_t queue;
+    std::vector<std::string> cards; // in order of submission
+    state_t() :workers(0) {}
+};
+
+state_t *state;
+epicsThreadOnceId stateOnce = EPICS_THREAD_ONCE_INIT;
+
+void stateInit(void*)
+{
+    state = new state_t;
+}
+
+state_t& getState()
+{
+    epicsThreadOnce(&stateOnce, &stateInit, NULL);
+    return *state;
+}
+
+// Run and record one setup, deletes the job
+int execute(mrmDeferredSetup::Job *job, double queuedAt)
+{
+    std::string card(job->card), error;
+    int status;
+    double start = mrfMonotonicSeconds();
+
+    try {
+        status = job->setup();
+        if(status)
+            error = "setup failed, see messages above";
+    } catch(std::exception& e) {
+        status = -1;
+        error = e.what();
+    }
+    double end = mrfMonotonicSeconds();
+    delete job;
+
+    try {
+        std::string name(card+":Setup");
+        mrmSetupResult *result = dynamic_cast<mrmSetupResult*>(mrf::Object::getObject(name));
+        if(!result)
+            result = new mrmSetupResult(name);
+        result->set(status, start-queuedAt, end-start, error);
+    } catch(std::exception& e) {
+        errlogPrintf("%s: Can't record setup result: %s\n", card.c_str(), e.what());
+    }
+
+    return status;
+}
+
+class SetupWorker : public epicsThreadRunable {
+public:
+    SetupWorker(epicsMutex& lock, queue_t& queue)
+        :m_lock(lock)
+        ,m_queue(queue)
+        ,m_failed(0)
+        ,m_thread(*this, "MRMSETUP",
+                  epicsThreadGetStackSize(epicsThreadStackBig),
+                  epicsThreadPriorityMedium)
+    {}
+
+    void start() {m_thread.start();}
+    unsigned wait() {m_thread.exitWait(); return m_failed;}
+
+    virtual void run()
+    {
+        while(true) {
+            queued_t next;
+            {
+                SCOPED_LOCK(m_lock);
+                if(m_queue.empty())
+                    break;
+                next = m_queue.front();
+                m_queue.pop_front();
+            }
+            if(execute(next.job, next.queuedAt))
+                m_failed++;
+        }
+    }
+
+private:
+    epicsMutex& m_lock;
+    queue_t& m_queue;
+    unsigned m_failed;
+    epicsThread m_thread;
+};
+
+} // namespace
+
+void
+mrmDeferredSetup::submit(Job *job)
+{
+    state_t& st = getState();
+    {
+        SCOPED_LOCK2(st.lock, guard);
+        st.cards.push_back(job->card);
+        if(st.workers) {
+            queued_t q = {job, mrfMonotonicSeconds()};
+            st.queue.push_back(q);
+            printf("%s: setup queued\n", job->card.c_str());
+            return;
+        }
+    }
+    execute(job, mrfMonotonicSeconds());
+}
+
+void
+mrmDeferredSetup::defer(unsigned workers)
+{
+    state_t& st = getState();
+    SCOPED_LOCK2(st.lock, guard);
+    st.workers = workers ? workers : 1;
+}
+
+bool
+mrmDeferredSetup::deferring()
+{
+    state_t& st = getState();
+    SCOPED_LOCK2(st.lock, guard);
+    return st.workers!=0;
+}
+
+int
+mrmDeferredSetup::run()
+{
+    state_t& st = getState();
+    queue_t queue;
+    unsigned nworkers;
+    {
+        SCOPED_LOCK2(st.lock, guard);
+        queue.swap(st.queue);
+        nworkers = st.workers;
+        st.workers = 0; // following setups run immediately
+    }
+
+    if(queue.empty())
+        return 0;
+
+    size_t njobs = queue.size();
+    if(nworkers>njobs)
+        nworkers = njobs;
+
+    printf("Setting up %u cards with %u threads\n", (unsigned)njobs, nworkers);
+
+    double start = mrfMonotonicSeconds();
+    epicsMutex lock;
+    std::vector<SetupWorker*> workers;
+    for(unsigned i=0; i<nworkers; i++) {
+        workers.push_back(new SetupWorker(lock, queue));
+        workers.back()->start();
+    }
+
+    unsigned failed = 0;
+    for(size_t i=0; i<workers.size(); i++) {
+        failed += workers[i]->wait();
+        delete workers[i];
+    }
+
+    printf("Set up %u cards in %.3f s\n", (unsigned)njobs, mrfMonotonicSeconds()-start);
+    if(failed) {
+        errlogPrintf("Setup of %u of %u cards failed:\n", failed, (unsigned)njobs);
+        report();
+    }
+    return failed ? -1 : 0;
+}
+
+epicsMutex&
+mrmDeferredSetup::busLock()
+{
+    return getState().bus;
+}
+
+void
+mrmDeferredSetup::report()
+{
+    std::vector<std::string> cards;
+    {
+        state_t& st = getState();
+        SCOPED_LOCK2(st.lock, guard);
+        cards = st.cards;
+    }
+
+    for(size_t i=0; i<cards.size(); i++) {
+        mrmSetupResult *result = dynamic_cast<mrmSetupResult*>(mrf::Object::getObject(cards[i]+":Setup"));
+        if(!result) {
+            printf("%-12s queued\n", cards[i].c_str());
+            continue;
+        }
+        epicsInt32 status = result->status();
+        printf("%-12s %s  %8.3f s  (queued %.3f s)%s%s\n", cards[i].c_str(),
+               status ? "FAILED" : "OK    ", result->duration(), result->queued(),
+               status ? "  " : "", status ? result->error().c_str() : "");
+    }
+}
+
+mrmSetupResult::mrmSetupResult(const std::string& name)
+    :mrf::ObjectInst<mrmSetupResult>(name)
+    ,m_status(0)
+    ,m_queued(0.0)
+    ,m_duration(0.0)
+{}
+
+void
+mrmSetupResult::set(epicsInt32 status, double queued, double duration, const std::string& error)
+{
+    SCOPED_LOCK(m_lock);
+    m_status = status;
+    m_queued = queued;
+    m_duration = duration;
+    m_error = error;
+}
+
+epicsInt32
+mrmSetupResult::status() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_status;
+}
+
+double
+mrmSetupResult::queued() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_queued;
+}
+
+double
+mrmSetupResult::duration() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_duration;
+}
+
+std::string
+mrmSetupResult::error() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_error;
+}
+
+OBJECT_BEGIN(mrmSetupResult) {
+    OBJECT_PROP1("Failed", &mrmSetupResult::failed);
+    OBJECT_PROP1("Queued", &mrmSetupResult::queued);
+    OBJECT_PROP1("Duration", &mrmSetupResult::duration);
+    OBJECT_PROP1("Error", &mrmSetupResult::error);
+} OBJECT_END(mrmSetupResult)
+
+/********** iocsh  *******/
+
+static const iocshArg mrmSetupDeferredArg0 = { "Threads", iocshArgInt };
+static const iocshArg * const mrmSetupDeferredArgs[1] = { &mrmSetupDeferredArg0 };
+static const iocshFuncDef mrmSetupDeferredDef = { "mrmSetupDeferred", 1, mrmSetupDeferredArgs };
+
+static void mrmSetupDeferredFunc(const iocshArgBuf *args)
+{
+    int n = args[0].ival;
+    if(n<=0)
+        n = 4;
+    mrmDeferredSetup::defer(n);
+    printf("Following card setups are run by %d threads when iocInit starts, or by mrmSetupRun\n", n);
+}
+
+static const iocshFuncDef mrmSetupRunDef = { "mrmSetupRun", 0, NULL };
+
+static void mrmSetupRunFunc(const iocshArgBuf *)
+{
+    mrmDeferredSetup::run();
+}
+
+static const iocshFuncDef mrmSetupReportDef = { "mrmSetupReport", 0, NULL };
+
+static void mrmSetupReportFunc(const iocshArgBuf *)
+{
+    mrmDeferredSetup::report();
+}
+
+static void mrmDeferredSetupHook(initHookState state)
+{
+    if(state==initHookAtBeginning)
+        mrmDeferredSetup::run();
+}
+
+extern "C" {
+static void mrmDeferredSetupRegistrar()
+{
+    initHookRegister(&mrmDeferredSetupHook);
+    iocshRegister(&mrmSetupDeferredDef, mrmSetupDeferredFunc);
+    iocshRegister(&mrmSetupRunDef, mrmSetupRunFunc);
+    iocshRegister(&mrmSetupReportDef, mrmSetupReportFunc);
+}
+epicsExportRegistrar(mrmDeferredSetupRegistrar);
+}
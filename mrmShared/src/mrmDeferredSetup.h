@@ -0,0 +1,81 @@
+#ifndef MRMDEFERREDSETUP_H
+#define MRMDEFERREDSETUP_H
+
+#include <string>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <shareLib.h>
+
+#include "mrf/object.h"
+
+/* Setup of cards by several threads.
+ *
+ * After mrmSetupDeferred, the mrmEvrSetupPCI and mrmEvgSetupPCI commands
+ * only queue the setup of a card.  The queue is run by a pool of worker
+ * threads when iocInit starts, or earlier with mrmSetupRun for commands
+ * which need the cards.  Bus access, and the construction and registration
+ * of the card objects, are serialized with busLock().  Constructors call
+ * scanIoInit, callbackSetup and create threads, which are not thread safe
+ * on EPICS 3.14, and the check that an ID is free must be atomic with its
+ * registration.  Only waits which touch no shared state may be done without
+ * busLock().
+ *
+ * The result and duration of each setup, deferred or not, is kept in an
+ * object named "<card>:Setup" and listed by mrmSetupReport.
+ */
+class epicsShareClass mrmDeferredSetup {
+public:
+    //! Setup of one card
+    struct Job {
+        explicit Job(const std::string& card) :card(card) {}
+        virtual ~Job() {}
+        //! @returns 0 on success
+        virtual int setup() =0;
+        const std::string card;
+    };
+
+    //! Run a setup now, or queue it in deferred mode.  Takes ownership.
+    static void submit(Job*);
+
+    //! Queue following setups for n worker threads
+    static void defer(unsigned workers);
+    static bool deferring();
+
+    //! Run the queued setups and wait for them
+    static int run();
+
+    //! Held during bus access, construction and registration by the setup of a card
+    static epicsMutex& busLock();
+
+    static void report();
+};
+
+//! Result of the setup of a card
+class epicsShareClass mrmSetupResult : public mrf::ObjectInst<mrmSetupResult>
+{
+public:
+    explicit mrmSetupResult(const std::string& name);
+
+    /* locking done internally */
+    virtual void lock() const{};
+    virtual void unlock() const{};
+
+    void set(epicsInt32 status, double queued, double duration, const std::string& error);
+
+    epicsInt32 status() const;
+    bool failed() const{return status()!=0;}
+    //! Time between the queueing and the start of the setup [s]
+    double queued() const;
+    //! Duration of the setup [s]
+    double duration() const;
+    std::string error() const;
+
+private:
+    mutable epicsMutex m_lock;
+    epicsInt32 m_status;
+    double m_queued, m_duration;
+    std::string m_error;
+};
+
+#endif // MRMDEFERREDSETUP_H
@@ -0,0 +1,247 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+
+#ifdef __linux__
+#  include <unistd.h>
+#  include <sys/mman.h>
+#endif
+
+#include <errlog.h>
+#include <epicsStdio.h>
+#include <epicsExport.h>
+
+#include "mrf/object.h"
+#include "mrmEvtFifoRing.h"
+#include "mrmUIO.h"
+
+#include "mrfCommon.h"
+
+/* Must match struct mrf_evtfifo in mrmShared/linux/mrf.h */
+#define EVTFIFO_NAME    "mrf-evtfifo"
+#define EVTFIFO_MAGIC   0x4d524645
+#define EVTFIFO_VERSION 1
+#define EVTFIFO_RING    512
+
+/* Must match MRF_IRQCTL_FIFO_DRAIN_* */
+#define EVTFIFO_DRAIN_OFF 2
+#define EVTFIFO_DRAIN_ON  3
+
+struct mrmEvtFifoRing::page_t {
+    epicsUInt32 magic;
+    epicsUInt32 version;
+    epicsUInt32 ringsize;
+    epicsUInt32 head;
+    epicsUInt32 enabled;
+    epicsUInt32 drained;
+    epicsUInt32 fifofull;
+    epicsUInt32 reserved;
+    struct ring_t {
+        epicsUInt32 code;
+        epicsUInt32 sec;
+        epicsUInt32 evt;
+        epicsUInt32 seq;
+    } ring[EVTFIFO_RING];
+};
+
+#ifdef __linux__
+
+namespace {
+bool drainControl(int fd, epicsInt32 val)
+{
+    return write(fd, &val, sizeof(val))==sizeof(val);
+}
+}
+
+mrmEvtFifoRing*
+mrmEvtFifoRing::create(const std::string& name,
+                       unsigned domain, unsigned bus,
+                       unsigned device, unsigned function)
+{
+    std::string uio(mrmUIO::findDevice(domain, bus, device, function));
+
+    int map = uio.empty() ? -1 : mrmUIO::findMap(uio, EVTFIFO_NAME);
+    if(map<0) {
+        epicsPrintf("%s: kernel module does not provide the event FIFO ring\n", name.c_str());
+        return NULL;
+    }
+
+    int fd;
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    size_t len = ((sizeof(page_t)+pagesize-1)/pagesize)*pagesize;
+    void *mem = mrmUIO::mapPage(name, uio, map, len, true, fd);
+    if(!mem)
+        return NULL;
+
+    volatile page_t *page = (volatile page_t*)mem;
+    if(page->magic!=EVTFIFO_MAGIC || page->version!=EVTFIFO_VERSION || page->ringsize!=EVTFIFO_RING) {
+        errlogPrintf("%s: event FIFO ring of %s has unknown layout %08x %u %u\n", name.c_str(), uio.c_str(),
+                     (unsigned)page->magic, (unsigned)page->version, (unsigned)page->ringsize);
+        munmap(mem, len);
+        close(fd);
+        return NULL;
+    }
+
+    if(!drainControl(fd, EVTFIFO_DRAIN_ON) || !page->enabled) {
+        errlogPrintf("%s: Can't enable draining of the event FIFO of %s\n", name.c_str(), uio.c_str());
+        munmap(mem, len);
+        close(fd);
+        return NULL;
+    }
+
+    return new mrmEvtFifoRing(name, fd, page, len);
+}
+
+mrmEvtFifoRing::~mrmEvtFifoRing()
+{
+    if(m_fd>=0) {
+        // the FIFO is left to user space again
+        if(!drainControl(m_fd, EVTFIFO_DRAIN_OFF))
+            errlogPrintf("%s: Can't disable draining of the event FIFO\n", name().c_str());
+        munmap((void*)m_page, m_len);
+        close(m_fd);
+    } else {
+        delete (page_t*)m_page;
+    }
+}
+
+#else /* __linux__ */
+
+mrmEvtFifoRing*
+mrmEvtFifoRing::create(const std::string&, unsigned, unsigned, unsigned, unsigned)
+{
+    return NULL;
+}
+
+mrmEvtFifoRing::~mrmEvtFifoRing()
+{
+    delete (page_t*)m_page;
+}
+
+#endif /* __linux__ */
+
+mrmEvtFifoRing*
+mrmEvtFifoRing::createSim(const std::string& name)
+{
+    page_t *page = new page_t;
+    memset(page, 0, sizeof(*page));
+    page->magic = EVTFIFO_MAGIC;
+    page->version = EVTFIFO_VERSION;
+    page->ringsize = EVTFIFO_RING;
+    page->enabled = 1;
+
+    return new mrmEvtFifoRing(name, -1, page, sizeof(*page));
+}
+
+mrmEvtFifoRing::mrmEvtFifoRing(const std::string& name, int fd, volatile page_t *page, size_t len)
+    :mrf::ObjectInst<mrmEvtFifoRing>(name)
+    ,m_fd(fd)
+    ,m_page(page)
+    ,m_len(len)
+    ,m_next(page->head) // older events are not ours
+    ,m_lost(0)
+    ,m_taken(0)
+{}
+
+bool
+mrmEvtFifoRing::pending() const
+{
+    return m_page->head!=m_next;
+}
+
+unsigned
+mrmEvtFifoRing::take(event_t *ev, unsigned max)
+{
+    epicsUInt32 head = m_page->head;
+    MRF_SYNC();
+
+    if(head==m_next)
+        return 0;
+
+    unsigned n = 0;
+    epicsUInt32 lost = 0;
+
+    if(head-m_next > EVTFIFO_RING) {
+        lost += head-m_next-EVTFIFO_RING;
+        m_next = head-EVTFIFO_RING;
+    }
+
+    for(; m_next!=head && n<max; m_next++) {
+        const volatile page_t::ring_t& ent = m_page->ring[m_next%EVTFIFO_RING];
+
+        epicsUInt32 seq = ent.seq;
+        MRF_SYNC();
+        ev[n].code = ent.code;
+        ev[n].sec = ent.sec;
+        ev[n].evt = ent.evt;
+        MRF_SYNC();
+
+        if(seq!=m_next+1 || ent.seq!=seq) {
+            lost++; // overwritten while we read
+            continue;
+        }
+        n++;
+    }
+
+    SCOPED_LOCK(m_lock);
+    m_lost += lost;
+    m_taken += n;
+
+    return n;
+}
+
+void
+mrmEvtFifoRing::produce(epicsUInt32 code, epicsUInt32 sec, epicsUInt32 evt)
+{
+    if(m_fd>=0)
+        throw std::logic_error("Only a simulated event FIFO ring can be filled");
+
+    volatile page_t *page = m_page;
+    epicsUInt32 n = page->head;
+    volatile page_t::ring_t& ent = page->ring[n%EVTFIFO_RING];
+
+    ent.seq = 0;
+    MRF_SYNC();
+    ent.code = code;
+    ent.sec = sec;
+    ent.evt = evt;
+    MRF_SYNC();
+    ent.seq = n+1;
+
+    page->drained++;
+    MRF_SYNC();
+    page->head = n+1;
+}
+
+epicsUInt32 mrmEvtFifoRing::drained() const {return m_page->drained;}
+epicsUInt32 mrmEvtFifoRing::fifoFull() const {return m_page->fifofull;}
+
+epicsUInt32
+mrmEvtFifoRing::lost() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_lost;
+}
+
+epicsUInt32
+mrmEvtFifoRing::taken() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_taken;
+}
+
+void
+mrmEvtFifoRing::reset(bool)
+{
+    SCOPED_LOCK(m_lock);
+    m_lost = m_taken = 0;
+}
+
+OBJECT_BEGIN(mrmEvtFifoRing) {
+    OBJECT_PROP1("Drained", &mrmEvtFifoRing::drained);
+    OBJECT_PROP1("FIFO Full", &mrmEvtFifoRing::fifoFull);
+    OBJECT_PROP1("Lost", &mrmEvtFifoRing::lost);
+    OBJECT_PROP1("Taken", &mrmEvtFifoRing::taken);
+    OBJECT_PROP2("Reset", &mrmEvtFifoRing::dummyReturn, &mrmEvtFifoRing::reset);
+} OBJECT_END(mrmEvtFifoRing)
@@ -0,0 +1,89 @@
+#ifndef MRMEVTFIFORING_H
+#define MRMEVTFIFORING_H
+
+#include <string>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <shareLib.h>
+
+#include "mrf/object.h"
+
+/** @brief Event FIFO of an EVR drained by the uio_mrf kernel module (Linux)
+ *
+ * With kernel module interface version 3 the interrupt handler empties the
+ * event FIFO into a ring which is mapped read-only (see
+ * mrmShared/linux/mrf.h).  The drain thread of the EVR then takes the
+ * events with take() instead of reading EvtFIFOCode, EvtFIFOSec and
+ * EvtFIFOEvt for each event.
+ *
+ * createSim() makes a ring in process memory which is filled by produce()
+ * in the same way as the kernel does, to test the consumer without the
+ * kernel module.
+ */
+class epicsShareClass mrmEvtFifoRing : public mrf::ObjectInst<mrmEvtFifoRing>
+{
+public:
+    struct event_t {
+        epicsUInt32 code, sec, evt;
+    };
+
+    /** @brief Map the ring of a PCI device and enable draining by the kernel
+     @returns NULL if the kernel module does not provide it
+     */
+    static mrmEvtFifoRing* create(const std::string& name,
+                                  unsigned domain, unsigned bus,
+                                  unsigned device, unsigned function);
+    //! A ring filled by produce()
+    static mrmEvtFifoRing* createSim(const std::string& name);
+    virtual ~mrmEvtFifoRing();
+
+    /* locking done internally */
+    virtual void lock() const{};
+    virtual void unlock() const{};
+
+    //! True if the kernel empties the FIFO, false for a simulated ring
+    bool kernelDrains() const{return m_fd>=0;}
+
+    //! Events not taken yet
+    bool pending() const;
+
+    /** @brief Take events in order of arrival
+     *
+     * Called from one thread only.
+     @returns number of events stored in ev
+     */
+    unsigned take(event_t *ev, unsigned max);
+
+    //! Add an event to a simulated ring.  Called from one thread only.
+    void produce(epicsUInt32 code, epicsUInt32 sec, epicsUInt32 evt);
+
+    // Kernel counters
+    epicsUInt32 drained() const;
+    epicsUInt32 fifoFull() const;
+
+    //! Events overwritten before they were taken
+    epicsUInt32 lost() const;
+    epicsUInt32 taken() const;
+
+    void reset(bool);
+    bool dummyReturn() const{return false;}
+
+    struct page_t;
+
+private:
+    mrmEvtFifoRing(const std::string& name, int fd, volatile page_t *page, size_t len);
+
+    const int m_fd;
+    volatile page_t * const m_page;
+    const size_t m_len;
+
+    mutable epicsMutex m_lock;
+
+    epicsUInt32 m_next; // drain thread only
+
+    // Guarded by m_lock
+    epicsUInt32 m_lost, m_taken;
+};
+
+#endif // MRMEVTFIFORING_H
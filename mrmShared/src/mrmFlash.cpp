@@ -9,7 +9,10 @@
 #include "stdexcept"
 #include <stdlib.h>
 #include "stdio.h"
+#include <vector>
+#include <algorithm>
 
+#include <mrfCommon.h>
 #include "mrmShared.h"
 
 #include <epicsExport.h>
@@ -19,6 +22,7 @@
 // Misc
 #define RETRY_COUNT             100000        // Amount of retries until we fail when waiting for SPI receiver / transmitter to be ready
 #define STOP_COMPARE_ERRORS     100           // Write this many errors when doing check that written firmware is ok in the flash chip, then stop.
+#define STATUS_SPIN_POLLS       256           // Status polls (one SPI byte each) before falling back to sleeping between polls
 
 // Flash chip commands
 #define CMD_READ_FAST              0x0B
@@ -73,7 +77,13 @@ mrmFlash::mrmFlash(volatile epicsUInt8 *parentBaseAddress)
     :m_base(parentBaseAddress)
     ,m_size_sector(0)
     ,m_size_memory(0)
+    ,m_start(0.0)
+    ,m_cancel(false)
+    ,m_checkpointCrc(0)
+    ,m_checkpointOffset(0)
+    ,m_wip(false)
 {
+    memset(&m_progress, 0, sizeof(m_progress));
 }
 
 void mrmFlash::init(bool autodetect) {
@@ -156,10 +166,9 @@ void mrmFlash::init(bool autodetect) {
 }
 
 
-void mrmFlash::flash(const char *bitfile, size_t offset) {
-    epicsUInt8 buf[SIZE_PAGE], *readBuffer = NULL;
+void mrmFlash::flash(const char *bitfile, size_t offset, bool resume) {
     FILE *fd = NULL;
-    size_t size, readSize, fileSize;
+    size_t fileSize;
 
 
     if(m_size_memory <= 0 || m_size_sector <= 0) {
@@ -185,102 +194,201 @@ void mrmFlash::flash(const char *bitfile, size_t offset) {
     }
     fseek(fd, 0L, SEEK_SET);
 
-    infoPrintf(1,"Starting flash procedure\n");
-    try{
-        epicsGuard<epicsMutex> g(m_lock);
+    if(fileSize == 0) {
+        fclose(fd);
+        throw std::invalid_argument("File is empty.");
+    }
+
+    // The whole image is kept in memory, so that each sector can be compared before and after writing
+    std::vector<epicsUInt8> image(fileSize);
+    if(fread(&image[0], 1, fileSize, fd) != fileSize) {
+        fclose(fd);
+        throw std::runtime_error("Could not read file.");
+    }
+    fclose(fd);
+
+    const epicsUInt32 crc = mrfCrc32(0, &image[0], fileSize);
+    const size_t end = offset + fileSize;
+    std::vector<epicsUInt8> current(m_size_sector);
 
-        infoPrintf(1, "Erasing flash...\n");
-        if(offset <= 0) {    // if offset is 0, erase entire memory
-            bulkErase();
+    infoPrintf(1,"Starting flash procedure. Image CRC32 0x%08x\n", crc);
+    epicsGuard<epicsMutex> g(m_lock);
+
+    size_t start = offset;
+    {
+        epicsGuard<epicsMutex> p(m_progressLock);
+        // Continue an interrupted flash of the same image
+        if(resume && m_checkpointCrc == crc && m_checkpointOffset == offset
+                && m_progress.checkpoint > offset && m_progress.checkpoint < end) {
+            start = m_progress.checkpoint;
         }
-        else {  // start erasing sector at 'offset' address, and continue until the end of memory
-            for (size_t addr = offset; addr < m_size_memory; addr += m_size_sector) {
-                sectorErase(addr);
+    }
+
+    // read back + write, then verify
+    progressStart(2*fileSize);
+    {
+        epicsGuard<epicsMutex> p(m_progressLock);
+        m_progress.crc = crc;
+        m_progress.done = start - offset;
+        m_progress.checkpoint = start;
+        m_checkpointCrc = crc;
+        m_checkpointOffset = offset;
+    }
+    if(start != offset) {
+        infoPrintf(0, "Resuming flash at 0x%08" FORMAT_SIZET_X "\n", start);
+    }
+
+    try{
+        // Sectors are walked on sector boundaries. The first and last one may be partially covered by the image.
+        for(size_t sector = start - (start % m_size_sector); sector < end; sector += m_size_sector) {
+            const size_t first = std::max(sector, offset),
+                         last  = std::min(sector + m_size_sector, end),
+                         len   = last - first;
+            const epicsUInt8 *want = &image[first - offset];
+            size_t readLen = len;
+
+            checkCancel();
+
+            read(&current[0], first, &readLen);
+            if(readLen != len) {
+                throw std::runtime_error("Short read from flash chip.");
+            }
+
+            if(memcmp(&current[0], want, len) == 0) {
+                infoPrintf(2, "\tSector at 0x%08" FORMAT_SIZET_X " unchanged\n", sector);
+                epicsGuard<epicsMutex> p(m_progressLock);
+                m_progress.sectorsSkipped++;
+                m_progress.done += len;
+                m_progress.checkpoint = last;
+                continue;
+            }
+
+            // Programming can only clear bits. Erase if any bit must be set.
+            bool erase = false;
+            for(size_t i = 0; i < len && !erase; i++) {
+                erase = (current[i] & want[i]) != want[i];
+            }
+
+            if(erase) {
+                infoPrintf(1, "\tErasing sector at 0x%08" FORMAT_SIZET_X "\n", sector);
+                sectorErase(first);
+                memset(&current[0], 0xff, len);
+                epicsGuard<epicsMutex> p(m_progressLock);
+                m_progress.sectorsErased++;
             }
-        }
 
-        // start the programming of the flash memory at the 'offset' address
-        infoPrintf(1, "Writing to flash....\n");
-        size_t address = offset;
-        readSize = SIZE_PAGE - (address % SIZE_PAGE);    // address might not be page-alligned. First write is until the end of page. All the rest are page-alligned.
-        size = fread(buf, 1, readSize, fd); // max one page can be written at once
-        readSize = SIZE_PAGE;             // consecutive reads are page-alligned
-        while (size > 0) {    // write data page by page
-            pageProgram(buf, address, size);     // use page program to write data to the flash memory
-            if((address & 0x0000ffff) == 0) {    // Do not print in each iteration so the output is not flooded
-                infoPrintf(1, "\tWriting to address: 0x%08" FORMAT_SIZET_X "\n", address);
+            infoPrintf(1, "\tWriting sector at 0x%08" FORMAT_SIZET_X "\n", sector);
+            epicsUInt32 programmed = 0, skipped = 0;
+            for(size_t addr = first; addr < last; ) {
+                // address might not be page-alligned. First write is until the end of page. All the rest are page-alligned.
+                const size_t pageLen = std::min((size_t)SIZE_PAGE - (addr % SIZE_PAGE), last - addr),
+                             i = addr - first;
+
+                if(memcmp(&current[i], want + i, pageLen) != 0) {
+                    pageProgram(want + i, addr, pageLen);
+                    programmed++;
+                }
+                else {
+                    skipped++;
+                }
+                addr += pageLen;
             }
-            address += size;
-            size = fread(buf, 1, readSize, fd); // max one page can be written at once
+            waitReady(); // the sector is only complete once its last page is
+
+            epicsGuard<epicsMutex> p(m_progressLock);
+            m_progress.checkpoint = last;
+            m_progress.pagesProgrammed += programmed;
+            m_progress.pagesSkipped += skipped;
+            m_progress.done += len;
         }
+        waitReady();
 
         infoPrintf(1, "Flash written.\n");
-        infoPrintf(1, "Reading back from flash chip...\n");
-        readBuffer = (epicsUInt8 *) malloc (fileSize * sizeof(epicsUInt8));
-        read(readBuffer, offset, &fileSize);
-
-        infoPrintf(1, "Comparing flash chip content with given firmware file...\n");
-        fseek(fd, 0L, SEEK_SET);
+        infoPrintf(1, "Verifying flash chip content with given firmware file...\n");
 
+        epicsUInt32 readCrc = 0;
         size_t stopWithErrors = 0;
-        for (size_t i = 0; i < fileSize; i++) {
-            buf[0] = fgetc(fd);
-            if(readBuffer[i] != buf[0]) {
-                infoPrintf(0, "ERROR! Source firmware file and actual content in device flash memory are different. Try to flash again!\n\tOffset: %" FORMAT_SIZET_U "\tFile content: 0x%x\t Memory content: 0x%x\n", i, buf[0], readBuffer[i]);
-                stopWithErrors++;
-                if(stopWithErrors > STOP_COMPARE_ERRORS) {
-                    infoPrintf(0, "More than %u bytes do not match between firmware file and device flash memory. Stopping with the check.\n", STOP_COMPARE_ERRORS);
-                    break;
-                }
+        for(size_t addr = offset; addr < end; ) {
+            const size_t len = std::min(m_size_sector - (addr % m_size_sector), end - addr);
+            const epicsUInt8 *want = &image[addr - offset];
+            size_t readLen = len;
+
+            checkCancel();
+
+            read(&current[0], addr, &readLen);
+            if(readLen != len) {
+                throw std::runtime_error("Short read from flash chip.");
             }
+
+            readCrc = mrfCrc32(readCrc, &current[0], len);
+            if(mrfCrc32(0, &current[0], len) != mrfCrc32(0, want, len) && stopWithErrors++ < STOP_COMPARE_ERRORS) {
+                infoPrintf(0, "ERROR! Source firmware file and actual content in device flash memory are different. Try to flash again!\n\tSector at offset: %" FORMAT_SIZET_U "\n", addr);
+            }
+            progressAdd(len);
+            addr += len;
         }
-        if (stopWithErrors > 0) {
-            infoPrintf(0, "ERROR! Comparing flash chip content with given firmware file completed with some errors. Try to flash again!\n");
+
+        if (stopWithErrors > 0 || readCrc != crc) {
+            infoPrintf(0, "ERROR! Flash chip content CRC32 0x%08x, firmware file CRC32 0x%08x. Try to flash again!\n", readCrc, crc);
             throw std::runtime_error("Flash chip content verification failed. If you reboot the timing card in this state it will not boot-up again!");
         }
         else {
-            infoPrintf(1, "Comparing flash chip content with given firmware file completed successfully! Contents are the same.\n");
+            infoPrintf(1, "Comparing flash chip content with given firmware file completed successfully! CRC32 0x%08x\n", readCrc);
         }
-        free(readBuffer);
-        // TODO we could (try to) dump readBuffer into a file in /tmp/bitfile.readback if the comparison fails
     }
     catch(std::exception&) {
-        fclose(fd);
-        free(readBuffer);
+        m_wip = false;
+        progressEnd();
         throw;
     }
 
-    fclose(fd);
-
+    progressEnd();
 }
 
 void mrmFlash::readToFile(const char *bitfile, size_t offset) {
     FILE *fd;
-    size_t length = 0;
-    epicsUInt8 *readBuffer;
 
+    if(m_size_memory <= 0 || m_size_sector <= 0 || offset >= m_size_memory) {
+        throw std::invalid_argument("Address for reading out of bounds!");
+    }
 
     fd = fopen(bitfile, "wb");
     if (fd == NULL) {
         throw std::runtime_error("Could not open file for writing the flash content to!");
     }
 
+    epicsGuard<epicsMutex> g(m_lock);
+    progressStart(m_size_memory - offset);
+
     try{
-        readBuffer = (epicsUInt8 *) malloc (m_size_memory * sizeof(epicsUInt8));
-        read(readBuffer, offset, &length);
+        std::vector<epicsUInt8> readBuffer(m_size_sector);
 
-        if(fwrite(&readBuffer, 1, length, fd) != length){
-            throw std::runtime_error("Could not write to file! Check if there is enough disk space left on device.");
+        // one sector at a time, so that the read can be cancelled
+        for(size_t addr = offset; addr < m_size_memory; ) {
+            size_t length = std::min(m_size_sector - (addr % m_size_sector), m_size_memory - addr);
+
+            checkCancel();
+
+            read(&readBuffer[0], addr, &length);
+            if(length == 0) {
+                throw std::runtime_error("Short read from flash chip.");
+            }
+
+            if(fwrite(&readBuffer[0], 1, length, fd) != length){
+                throw std::runtime_error("Could not write to file! Check if there is enough disk space left on device.");
+            }
+            progressAdd(length);
+            addr += length;
         }
 
         fclose(fd);
-        free(readBuffer);
     }
     catch(std::exception&) {
         fclose(fd);
-        free(readBuffer);
+        progressEnd();
         throw;
     }
+    progressEnd();
 }
 
 void mrmFlash::read(void *buffer, size_t offset, size_t *length) {
@@ -306,6 +414,8 @@ void mrmFlash::read(void *buffer, size_t offset, size_t *length) {
         infoPrintf(1,"Starting to read flash memory at offset %" FORMAT_SIZET_U "\n", offset);
         epicsGuard<epicsMutex> g(m_lock);
 
+        waitReady();
+
         // Dummy write with SS not active
         slaveSelect(false);
         write(0);
@@ -370,6 +480,22 @@ bool mrmFlash::flashBusy()
     }
 }
 
+void mrmFlash::cancel()
+{
+    epicsGuard<epicsMutex> g(m_progressLock);
+    if(m_progress.running)
+        m_cancel = true;
+}
+
+mrmFlash::Progress mrmFlash::getProgress() const
+{
+    epicsGuard<epicsMutex> g(m_progressLock);
+    Progress ret(m_progress);
+    if(ret.running)
+        ret.elapsed = mrfMonotonicSeconds() - m_start;
+    return ret;
+}
+
 void mrmFlash::report()
 {
     printf("\tMemory size: %" FORMAT_SIZET_U " bytes = %" FORMAT_SIZET_U " kB = %" FORMAT_SIZET_U " MB\n", m_size_memory, m_size_memory / 1024, m_size_memory / 1024 / 1024);
@@ -379,7 +505,41 @@ void mrmFlash::report()
 
 //// Private functions start here ////
 
-void mrmFlash::pageProgram(epicsUInt8 *data, size_t addr, size_t size) {
+void mrmFlash::progressStart(size_t total)
+{
+    epicsGuard<epicsMutex> g(m_progressLock);
+    size_t checkpoint = m_progress.checkpoint; // kept for resuming a flash after a read
+    memset(&m_progress, 0, sizeof(m_progress));
+    m_progress.checkpoint = checkpoint;
+    m_cancel = false;
+    m_progress.total = total;
+    m_progress.running = true;
+    m_start = mrfMonotonicSeconds();
+}
+
+void mrmFlash::progressAdd(size_t bytes)
+{
+    epicsGuard<epicsMutex> g(m_progressLock);
+    m_progress.done += bytes;
+}
+
+void mrmFlash::progressEnd()
+{
+    epicsGuard<epicsMutex> g(m_progressLock);
+    m_progress.elapsed = mrfMonotonicSeconds() - m_start;
+    m_progress.running = false;
+    m_cancel = false;
+}
+
+void mrmFlash::checkCancel()
+{
+    epicsGuard<epicsMutex> g(m_progressLock);
+    if(m_cancel) {
+        throw std::runtime_error("Cancelled.");
+    }
+}
+
+void mrmFlash::pageProgram(const epicsUInt8 *data, size_t addr, size_t size) {
     size_t i;
 
     /* Check that size and address are valid */
@@ -391,6 +551,8 @@ void mrmFlash::pageProgram(epicsUInt8 *data, size_t addr, size_t size) {
     }
 
     try{
+        waitReady(); // previous page
+
         infoPrintf(3,"Starting page program on address 0x%" FORMAT_SIZET_X " with size %" FORMAT_SIZET_U "\n", addr, size);
 
         // Dummy write with SS not active
@@ -417,8 +579,8 @@ void mrmFlash::pageProgram(epicsUInt8 *data, size_t addr, size_t size) {
 
         slaveSelect(false);
 
-        waitForCompletition(10, 1, 4); // Command duration info: Typical: 0.8 ms, Max 5ms
-        infoPrintf(3,"Page programmed.\n\n");
+        m_wip = true;   // completition is checked by waitReady()
+        infoPrintf(3,"Page program issued.\n\n");
     }
     catch(std::exception&) {
         slaveSelect(false);
@@ -428,6 +590,8 @@ void mrmFlash::pageProgram(epicsUInt8 *data, size_t addr, size_t size) {
 
 void mrmFlash::bulkErase() {
     try {
+        waitReady();
+
         infoPrintf(2,"Starting bulk erase...\n");
 
         // Dummy write with SS not active
@@ -459,6 +623,8 @@ void mrmFlash::sectorErase(size_t addr) {
     }
 
     try{
+        waitReady();
+
         infoPrintf(2,"Starting sector erase on address: 0x%" FORMAT_SIZET_X "\n", addr);
 
         // Dummy write with SS not active
@@ -552,11 +718,48 @@ void mrmFlash::write(epicsUInt8 data) {
     WRITE32(m_base, SpiData, data);
 }
 
+void mrmFlash::waitReady()
+{
+    if(!m_wip)
+        return;
+    m_wip = false;
+    waitForCompletition(10, 1, 4); // Page program duration info: Typical: 0.8 ms, Max 5ms
+}
+
 void mrmFlash::waitForCompletition(size_t retryCount, size_t msSleep, int verbosity)
 {
     size_t i = 0;
+    epicsUInt8 status;
 
     infoPrintf(verbosity,"\tWaiting for command completition...\n");
+
+    // The chip keeps shifting out the status register while slave select is held,
+    // so polling costs one SPI byte instead of a full read status command.
+    try {
+        slaveSelect(false);
+        write(0);
+
+        slaveSelect(true);
+        write(CMD_READ_STATUS);
+        write(0);
+
+        status = read();
+        for(i = 0; (status & STATUS_WIP) && i < STATUS_SPIN_POLLS; i++) {
+            write(0);
+            status = read();
+        }
+        slaveSelect(false);
+    }
+    catch(std::exception&) {
+        slaveSelect(false);
+        throw;
+    }
+
+    if(!(status & STATUS_WIP)) {
+        return;
+    }
+
+    i = 0;
     while((readStatus() & STATUS_WIP) && (i < retryCount)) {
         infoPrintf(verbosity,"\t\tWaiting for %" FORMAT_SIZET_U " ms\n", i * msSleep);
         i++;
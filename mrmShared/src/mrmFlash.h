@@ -28,6 +28,7 @@ public:
      * @param parentBaseAddress is the base memory-map address of the device (EVG or EVR) that created this class
      */
     mrmFlash(volatile epicsUInt8 *parentBaseAddress);
+    virtual ~mrmFlash() {}
 
     /**
      * @brief init initializes the flash chip memory and sector sizes.
@@ -35,13 +36,33 @@ public:
      */
     void init(bool autodetect);
 
+    /**
+     * @brief Progress of the current (or last) flash or read operation
+     */
+    struct Progress {
+        size_t total;           // bytes to process, counting the read back and the verification [bytes]
+        size_t done;            // bytes processed so far [bytes]
+        double elapsed;         // time since the operation started [s]
+        bool running;
+        epicsUInt32 sectorsSkipped;     // sectors whose content already matched
+        epicsUInt32 sectorsErased;
+        epicsUInt32 pagesProgrammed;
+        epicsUInt32 pagesSkipped;       // pages of rewritten sectors which already matched
+        epicsUInt32 crc;                // CRC32 of the image
+        size_t checkpoint;              // flash memory address up to which the image is known to be written [bytes]
+    };
+
     /**
      * @brief flash writes the entire bit file to an offset on the flash chip
+     * Each sector is read back first. Sectors which already hold the image are skipped.
+     * Sectors are only erased if some bit has to go from 0 to 1, and only the pages which differ are programmed.
+     * The result is verified by comparing the CRC32 of each sector with the file.
      * Throws exceptions (std::invalid_argument or std::runtime_error).
      * @param bitfile is the bit file to write
      * @param offset is the offset from the beginning of the flash chip memory to write to
+     * @param resume if true, and the last flash of the same image to the same offset did not complete, continue after its last completed sector
      */
-    void flash(const char *bitfile, size_t offset);
+    void flash(const char *bitfile, size_t offset, bool resume = false);
 
     /**
      * @brief readToFile will read the flash chip memory from a specified offset to the end of the flash chip memory into a file
@@ -75,11 +96,42 @@ public:
      */
     bool flashBusy();
 
+    /**
+     * @brief cancel requests the flash or read operation in progress to stop at the next sector boundary. The operation throws std::runtime_error.
+     */
+    void cancel();
+
+    /**
+     * @brief getProgress returns a snapshot of the progress counters. Can be called while flashing is in progress.
+     */
+    Progress getProgress() const;
+
     /**
      * @brief report prints basic flash chip information to iocsh
      */
     void report();
 
+protected:
+    // SPI access. Overridden by the simulated flash device (mrmFlashSim)
+
+    /**
+     * @brief slaveSelect a slave select used in the SPI protocol
+     * @param select if true, raises the slave select signal. If false, slave is deselected.
+     */
+    virtual void slaveSelect(bool select);
+
+    /**
+     * @brief write will write one byte to the SPI data register
+     * @param data to be written to the SPI data register
+     */
+    virtual void write(epicsUInt8 data);
+
+    /**
+     * @brief read will read one byte from the SPI data register
+     * @return data from the SPI data register
+     */
+    virtual epicsUInt8 read();
+
 private:
     volatile epicsUInt8 * const m_base; // Base address of the EVR/EVG card
     size_t m_size_sector;               // size of one sector on the flash chip [bytes]
@@ -87,13 +139,37 @@ private:
 
     epicsMutex m_lock;                  // This lock is held while flashing or reading is in progress
 
+    mutable epicsMutex m_progressLock;  // guards m_progress, m_start and m_cancel
+    Progress m_progress;
+    double m_start;
+    bool m_cancel;
+
+    // Image and offset of the last flash, which m_progress.checkpoint refers to
+    epicsUInt32 m_checkpointCrc;
+    size_t m_checkpointOffset;
+
+    // A page program was issued and not yet waited for
+    bool m_wip;
+
+    void progressStart(size_t total);
+    void progressAdd(size_t bytes);
+    void progressEnd();
+    // throws if cancel() was called
+    void checkCancel();
+
     /**
      * @brief pageProgram issues a page program on the flash chip. It is used to write data one page at a time.
+     * Does not wait for the program to complete. The next command will wait (see waitReady()), so the caller can prepare the next page meanwhile.
      * @param data is the data to be written to the flash chip
      * @param addr is the address of the flash chip memory where the writing should start
      * @param size is the size of the data we want to write. Note, that data cannot be written over the page boundary.
      */
-    void pageProgram(epicsUInt8 *data, size_t addr, size_t size);
+    void pageProgram(const epicsUInt8 *data, size_t addr, size_t size);
+
+    /**
+     * @brief waitReady waits for completition of a pending page program, if any.
+     */
+    void waitReady();
 
     /**
      * @brief bulkErase erases entire content of the flash memory
@@ -114,18 +190,6 @@ private:
      */
     void readIdentification(epicsUInt8 *manufacturerID, epicsUInt8 *memoryType, epicsUInt8 *memoryCapacity);
 
-    /**
-     * @brief slaveSelect a slave select used in the SPI protocol
-     * @param select if true, raises the slave select signal. If false, slave is deselected.
-     */
-    void slaveSelect(bool select);
-
-    /**
-     * @brief write will write one byte to the SPI data register
-     * @param data to be written to the SPI data register
-     */
-    void write(epicsUInt8 data);
-
     /**
      * @brief read will read the content of the flash chip to a user supplied buffer, starting at flash chip memory offset and reading length bytes.
      * @param buffer is a user supplied buffer to read flash chip content into
@@ -155,14 +219,9 @@ private:
      */
     epicsUInt8 readStatus();
 
-    /**
-     * @brief read will read one byte from the SPI data register
-     * @return data from the SPI data register
-     */
-    epicsUInt8 read();
-
     /**
      * @brief waitForCompletition will wait until previously issued command to the flash chip is completed. It throws an exception if the command time-outs (std::runtime_error).
+     * The status register is first polled continuously (without sleeping and without re-sending the read status command), then every msSleep.
      * @param retryCount is the number of times to check for the command completition before an exception is raised.
      * @param usSleep is the amount of time to sleep between each check for the command completition. [ms]
      * @param verbosity is an optional argument that determines the verbosity level of debug statements in the function. Defaults to no output.
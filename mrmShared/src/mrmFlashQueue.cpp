@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <string>
+#include <stdexcept>
+
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsGuard.h>
+#include <epicsThread.h>
+#include <epicsStdio.h>
+
+#include "mrmShared.h"
+#include "mrmRemoteFlash.h"
+
+#include <epicsExport.h>
+#include "mrmFlashQueue.h"
+
+#define DEFAULT_LIMIT   4
+
+const char * const mrmFlashQueue::state_string[] = {"queued", "running", "done", "failed", "cancelled"};
+
+mrmFlashQueue::mrmFlashQueue()
+    :mrf::ObjectInst<mrmFlashQueue>("FlashQueue")
+    ,m_wakeup(epicsEventEmpty)
+    ,m_limit(DEFAULT_LIMIT)
+    ,m_workers(0)
+{
+}
+
+mrmFlashQueue& mrmFlashQueue::instance()
+{
+    static mrmFlashQueue *queue = new mrmFlashQueue;
+    return *queue;
+}
+
+void mrmFlashQueue::add(const std::string &device, const std::string &filename, bool read)
+{
+    mrmRemoteFlash* flash = dynamic_cast<mrmRemoteFlash*>(mrf::Object::getObject(device + mrmRemoteFlash::OBJECT_NAME));
+    if(!flash) {
+        throw std::runtime_error("Device with flash support does not exist");
+    }
+    if(!flash->isOffsetValid()) {
+        throw std::runtime_error("This device does not support flash access");
+    }
+
+    Job job;
+    job.device = device;
+    job.filename = filename;
+    job.flash = flash;
+    job.read = read;
+    job.resume = false;
+    job.cancelRequested = false;
+    job.state = state_queued;
+    job.elapsed = 0.0;
+    job.bytes = 0;
+
+    {
+        epicsGuard<epicsMutex> g(m_lock);
+        m_jobs.push_back(job);
+        startWorkers();
+    }
+    m_wakeup.signal();
+}
+
+size_t mrmFlashQueue::cancel(const std::string &device)
+{
+    epicsGuard<epicsMutex> g(m_lock);
+    size_t n = 0;
+
+    for(std::list<Job>::iterator it = m_jobs.begin(); it != m_jobs.end(); ++it) {
+        if(!device.empty() && it->device != device)
+            continue;
+
+        if(it->state == state_queued) {
+            it->state = state_cancelled;
+            n++;
+        }
+        else if(it->state == state_running && !it->cancelRequested) {
+            // the worker sets the final state
+            it->cancelRequested = true;
+            it->flash->cancel();
+            n++;
+        }
+    }
+    return n;
+}
+
+void mrmFlashQueue::cancelAll(bool)
+{
+    cancel(std::string());
+}
+
+bool mrmFlashQueue::resume(const std::string &device)
+{
+    {
+        epicsGuard<epicsMutex> g(m_lock);
+        std::list<Job>::reverse_iterator it;
+
+        for(it = m_jobs.rbegin(); it != m_jobs.rend(); ++it) {
+            if(it->device == device && !it->read)
+                break;
+        }
+        if(it == m_jobs.rend() || (it->state != state_failed && it->state != state_cancelled)) {
+            return false;
+        }
+
+        Job job(*it);
+        job.resume = true;
+        job.cancelRequested = false;
+        job.state = state_queued;
+        job.elapsed = 0.0;
+        job.bytes = 0;
+        m_jobs.push_back(job);
+        startWorkers();
+    }
+    m_wakeup.signal();
+    return true;
+}
+
+void mrmFlashQueue::clear(bool)
+{
+    epicsGuard<epicsMutex> g(m_lock);
+
+    for(std::list<Job>::iterator it = m_jobs.begin(); it != m_jobs.end(); ) {
+        if(it->state == state_queued || it->state == state_running)
+            ++it;
+        else
+            it = m_jobs.erase(it);
+    }
+}
+
+epicsUInt32 mrmFlashQueue::limit() const
+{
+    epicsGuard<epicsMutex> g(m_lock);
+    return m_limit;
+}
+
+void mrmFlashQueue::setLimit(epicsUInt32 limit)
+{
+    if(limit < 1) {
+        throw std::invalid_argument("At least one job must be able to run");
+    }
+    {
+        epicsGuard<epicsMutex> g(m_lock);
+        m_limit = limit;
+        if(!m_jobs.empty())
+            startWorkers();
+    }
+    m_wakeup.signal();
+}
+
+epicsUInt32 mrmFlashQueue::count(state_t state) const
+{
+    epicsGuard<epicsMutex> g(m_lock);
+    epicsUInt32 n = 0;
+
+    for(std::list<Job>::const_iterator it = m_jobs.begin(); it != m_jobs.end(); ++it) {
+        if(it->state == state)
+            n++;
+    }
+    return n;
+}
+
+double mrmFlashQueue::progress() const
+{
+    epicsGuard<epicsMutex> g(m_lock);
+    double sum = 0.0;
+
+    if(m_jobs.empty())
+        return 0.0;
+
+    for(std::list<Job>::const_iterator it = m_jobs.begin(); it != m_jobs.end(); ++it) {
+        if(it->state == state_running) {
+            mrmFlash::Progress p(it->flash->getProgress());
+            if(p.total > 0)
+                sum += double(p.done) / p.total;
+        }
+        else if(it->state != state_queued) {
+            sum += 1.0;
+        }
+    }
+    return 100.0 * sum / m_jobs.size();
+}
+
+double mrmFlashQueue::throughput() const
+{
+    epicsGuard<epicsMutex> g(m_lock);
+    double sum = 0.0;
+
+    for(std::list<Job>::const_iterator it = m_jobs.begin(); it != m_jobs.end(); ++it) {
+        if(it->state == state_running) {
+            sum += it->flash->throughput();
+        }
+    }
+    return sum;
+}
+
+void mrmFlashQueue::report(int level) const
+{
+    epicsGuard<epicsMutex> g(m_lock);
+
+    printf("Flash queue: %u jobs, limit %u. Queued %u, running %u, done %u, failed %u\n",
+           (unsigned)m_jobs.size(), m_limit, queued(), running(), done(), failed());
+    printf("\tProgress %.1f %%, throughput %.1f kB/s\n", progress(), throughput());
+
+    for(std::list<Job>::const_iterator it = m_jobs.begin(); it != m_jobs.end(); ++it) {
+        if(level < 1 && it->state != state_queued && it->state != state_running)
+            continue;
+
+        printf("\t%-10s %-5s %-9s %s%s", it->device.c_str(), it->read ? "read" : "flash",
+               state_string[it->state], it->filename.c_str(), it->resume ? " (resumed)" : "");
+        if(it->state == state_running) {
+            printf(" %.1f %%, %.1f kB/s, ETA %.0f s", it->flash->progress(), it->flash->throughput(), it->flash->eta());
+        }
+        else if(it->state != state_queued) {
+            printf(" %" FORMAT_SIZET_U " bytes in %.1f s", it->bytes, it->elapsed);
+        }
+        printf("\n");
+    }
+}
+
+//// Private functions start here ////
+
+// Call with m_lock held
+void mrmFlashQueue::startWorkers()
+{
+    while(m_workers < m_limit) {
+        char name[20];
+        epicsSnprintf(name, sizeof(name), "MRF FLASH Q%u", m_workers);
+
+        if(!epicsThreadCreate(name, epicsThreadPriorityLow, epicsThreadGetStackSize(epicsThreadStackMedium), &mrmFlashQueue::worker_thread, this)) {
+            errlogPrintf("Flash queue: unable to create worker thread\n");
+            break;
+        }
+        m_workers++;
+    }
+}
+
+// Call with m_lock held
+mrmFlashQueue::Job* mrmFlashQueue::next()
+{
+    if(running() >= m_limit)
+        return NULL;
+
+    for(std::list<Job>::iterator it = m_jobs.begin(); it != m_jobs.end(); ++it) {
+        if(it->state != state_queued)
+            continue;
+
+        // one job per device at a time
+        bool busy = false;
+        for(std::list<Job>::const_iterator other = m_jobs.begin(); other != m_jobs.end() && !busy; ++other) {
+            busy = other->state == state_running && other->flash == it->flash;
+        }
+        if(busy)
+            continue;
+
+        it->state = state_running;
+        return &*it;
+    }
+    return NULL;
+}
+
+void mrmFlashQueue::worker_thread(void *args)
+{
+    static_cast<mrmFlashQueue*>(args)->work();
+}
+
+void mrmFlashQueue::work()
+{
+    while(true) {
+        Job *job;
+        {
+            epicsGuard<epicsMutex> g(m_lock);
+            job = next();
+        }
+        if(!job) {
+            m_wakeup.wait(1.0);
+            continue;
+        }
+
+        // A running job is not removed from the list, and only 'state' changes while it runs.
+        bool ok = false;
+        try {
+            infoPrintf(0, "Flash queue: %s %s %s\n", job->read ? "reading" : "flashing", job->device.c_str(), job->filename.c_str());
+            if(job->read)
+                ok = job->flash->readNow(job->filename);
+            else
+                ok = job->flash->flashNow(job->filename, job->resume);
+        }
+        catch(std::exception& ex) {
+            errlogPrintf("Flash queue: %s: %s\n", job->device.c_str(), ex.what());
+        }
+
+        mrmFlash::Progress p(job->flash->getProgress());
+        {
+            epicsGuard<epicsMutex> g(m_lock);
+            job->state = ok ? state_done : job->cancelRequested ? state_cancelled : state_failed;
+            job->elapsed = p.elapsed;
+            job->bytes = p.done;
+            // may be removed by clear() once the lock is released
+            infoPrintf(0, "Flash queue: %s %s\n", job->device.c_str(), state_string[job->state]);
+        }
+
+        // a job of the same device may be waiting
+        m_wakeup.signal();
+    }
+}
+
+
+/**
+ * Construct mrfioc2 objects for linking to EPICS records
+ **/
+
+OBJECT_BEGIN(mrmFlashQueue) {
+
+    OBJECT_PROP2("Limit", &mrmFlashQueue::limit, &mrmFlashQueue::setLimit);
+    OBJECT_PROP1("Queued", &mrmFlashQueue::queued);
+    OBJECT_PROP1("Running", &mrmFlashQueue::running);
+    OBJECT_PROP1("Done", &mrmFlashQueue::done);
+    OBJECT_PROP1("Failed", &mrmFlashQueue::failed);
+    OBJECT_PROP1("Progress", &mrmFlashQueue::progress);
+    OBJECT_PROP1("Throughput", &mrmFlashQueue::throughput);
+    OBJECT_PROP2("Cancel", &mrmFlashQueue::dummyReturn, &mrmFlashQueue::cancelAll);
+    OBJECT_PROP2("Clear", &mrmFlashQueue::dummyReturn, &mrmFlashQueue::clear);
+
+} OBJECT_END(mrmFlashQueue)
+
+
+
+/**
+ * IOCSH functions
+ **/
+
+/********** Queue a job  *******/
+static const iocshArg mrmFlashQueueArg0_add = { "Device", iocshArgString };
+static const iocshArg mrmFlashQueueArg1_add = { "File", iocshArgString };
+static const iocshArg mrmFlashQueueArg2_add = { "Read", iocshArgInt };
+
+static const iocshArg * const mrmFlashQueueArgs_add[3] = { &mrmFlashQueueArg0_add, &mrmFlashQueueArg1_add, &mrmFlashQueueArg2_add };
+static const iocshFuncDef mrmFlashQueueDef_add = { "mrmFlashQueueAdd", 3, mrmFlashQueueArgs_add };
+
+
+static void mrmFlashQueueFunc_add(const iocshArgBuf *args) {
+    if(args[0].sval == NULL || args[1].sval == NULL){
+        printf("Usage: mrmFlashQueueAdd Device File Read\n\t" \
+               "Device = name of the timing card (eg.: EVR0, EVG0, ...)\n\t"    \
+               "File = bit-file to write to flash memory\n\t" \
+               "Read = if 1, read flash memory into File instead (default: 0)\n");
+        return;
+    }
+
+    try{
+        mrmFlashQueue::instance().add(args[0].sval, args[1].sval, args[2].ival != 0);
+    }
+    catch(std::exception& ex) {
+        errlogPrintf("An error occured while queueing %s: %s\n", args[0].sval, ex.what());
+    }
+}
+
+/********** Cancel jobs  *******/
+static const iocshArg mrmFlashQueueArg0_cancel = { "Device", iocshArgString };
+
+static const iocshArg * const mrmFlashQueueArgs_cancel[1] = { &mrmFlashQueueArg0_cancel };
+static const iocshFuncDef mrmFlashQueueDef_cancel = { "mrmFlashQueueCancel", 1, mrmFlashQueueArgs_cancel };
+
+
+static void mrmFlashQueueFunc_cancel(const iocshArgBuf *args) {
+    std::string device(args[0].sval ? args[0].sval : "");
+
+    printf("Cancelled %u jobs\n", (unsigned)mrmFlashQueue::instance().cancel(device));
+}
+
+/********** Resume a job  *******/
+static const iocshArg mrmFlashQueueArg0_resume = { "Device", iocshArgString };
+
+static const iocshArg * const mrmFlashQueueArgs_resume[1] = { &mrmFlashQueueArg0_resume };
+static const iocshFuncDef mrmFlashQueueDef_resume = { "mrmFlashQueueResume", 1, mrmFlashQueueArgs_resume };
+
+
+static void mrmFlashQueueFunc_resume(const iocshArgBuf *args) {
+    if(args[0].sval == NULL){
+        printf("Usage: mrmFlashQueueResume Device\n\t" \
+               "Device = name of the timing card (eg.: EVR0, EVG0, ...)\n");
+        return;
+    }
+
+    if(!mrmFlashQueue::instance().resume(args[0].sval)) {
+        printf("No cancelled or failed flash job for %s\n", args[0].sval);
+    }
+}
+
+/********** Concurrency limit  *******/
+static const iocshArg mrmFlashQueueArg0_limit = { "Limit", iocshArgInt };
+
+static const iocshArg * const mrmFlashQueueArgs_limit[1] = { &mrmFlashQueueArg0_limit };
+static const iocshFuncDef mrmFlashQueueDef_limit = { "mrmFlashQueueLimit", 1, mrmFlashQueueArgs_limit };
+
+
+static void mrmFlashQueueFunc_limit(const iocshArgBuf *args) {
+    try{
+        mrmFlashQueue::instance().setLimit((epicsUInt32)args[0].ival);
+    }
+    catch(std::exception& ex) {
+        errlogPrintf("An error occured while setting limit: %s\n", ex.what());
+    }
+}
+
+/********** Status  *******/
+static const iocshArg mrmFlashQueueArg0_status = { "Level", iocshArgInt };
+
+static const iocshArg * const mrmFlashQueueArgs_status[1] = { &mrmFlashQueueArg0_status };
+static const iocshFuncDef mrmFlashQueueDef_status = { "mrmFlashQueueStatus", 1, mrmFlashQueueArgs_status };
+
+
+static void mrmFlashQueueFunc_status(const iocshArgBuf *args) {
+    mrmFlashQueue::instance().report(args[0].ival);
+}
+
+
+extern "C" {
+    static void mrmFlashQueueRegistrar() {
+        // Object must exist before records are initialized
+        mrmFlashQueue::instance();
+
+        iocshRegister(&mrmFlashQueueDef_add, mrmFlashQueueFunc_add);
+        iocshRegister(&mrmFlashQueueDef_cancel, mrmFlashQueueFunc_cancel);
+        iocshRegister(&mrmFlashQueueDef_resume, mrmFlashQueueFunc_resume);
+        iocshRegister(&mrmFlashQueueDef_limit, mrmFlashQueueFunc_limit);
+        iocshRegister(&mrmFlashQueueDef_status, mrmFlashQueueFunc_status);
+    }
+
+    epicsExportRegistrar(mrmFlashQueueRegistrar);
+}
@@ -0,0 +1,110 @@
+#ifndef MRMFLASHQUEUE_H
+#define MRMFLASHQUEUE_H
+
+#include <string>
+#include <list>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+
+#include "mrf/object.h"
+
+class mrmRemoteFlash;
+
+/**
+ * @brief mrmFlashQueue runs flash / read jobs for many devices, at most 'Limit' of them at the same time.
+ *
+ * Jobs are run in order, except that a job waits while another job of the same device is running.
+ * A running job can be cancelled at a sector boundary. A cancelled or failed flash job can be resumed,
+ * it then continues after the last sector completed (see mrmFlash::flash()).
+ *
+ * There is a single instance, object name "FlashQueue".
+ */
+class epicsShareClass mrmFlashQueue : public mrf::ObjectInst<mrmFlashQueue>
+{
+public:
+    enum state_t {
+        state_queued,
+        state_running,
+        state_done,
+        state_failed,
+        state_cancelled
+    };
+    static const char * const state_string[];
+
+    struct Job {
+        std::string device;
+        std::string filename;
+        mrmRemoteFlash *flash;
+        bool read;              // read flash content into 'filename' instead of flashing it
+        bool resume;
+        bool cancelRequested;   // cancel() was called while running
+        state_t state;
+        double elapsed;         // [s]
+        size_t bytes;           // bytes processed
+    };
+
+    static mrmFlashQueue& instance();
+
+    virtual void lock() const{m_lock.lock();}
+    virtual void unlock() const{m_lock.unlock();}
+
+    /**
+     * @brief add queues a job. Throws std::runtime_error if the device does not exist or does not support flash access.
+     * @param device name of the timing card (eg.: EVR0)
+     */
+    void add(const std::string& device, const std::string& filename, bool read);
+
+    /**
+     * @brief cancel removes queued jobs, and cancels running jobs, of one device or of all devices.
+     * @param device name of the timing card, or empty for all
+     * @return number of jobs cancelled
+     */
+    size_t cancel(const std::string& device);
+    void cancelAll(bool);
+
+    /**
+     * @brief resume queues the last cancelled or failed flash job of a device again. It continues after the last completed sector.
+     * @return false if there is no such job
+     */
+    bool resume(const std::string& device);
+
+    //! Remove finished jobs from the list
+    void clear(bool);
+    bool dummyReturn() const{return false;}
+
+    epicsUInt32 limit() const;
+    void setLimit(epicsUInt32 limit);
+
+    epicsUInt32 queued() const{return count(state_queued);}
+    epicsUInt32 running() const{return count(state_running);}
+    epicsUInt32 done() const{return count(state_done);}
+    epicsUInt32 failed() const{return count(state_failed) + count(state_cancelled);}
+
+    //! Finished and partial jobs over all jobs in the list [%]
+    double progress() const;
+    //! Sum over the running jobs [kB/s]
+    double throughput() const;
+
+    void report(int level) const;
+
+private:
+    mrmFlashQueue();
+
+    mutable epicsMutex m_lock;
+    epicsEvent m_wakeup;
+
+    std::list<Job> m_jobs;
+    epicsUInt32 m_limit;
+    epicsUInt32 m_workers;  // number of worker threads started
+
+    epicsUInt32 count(state_t state) const;
+    void startWorkers();
+    Job* next();
+
+    static void worker_thread(void* args);
+    void work();
+};
+
+#endif // MRMFLASHQUEUE_H
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+
+#include <errlog.h>
+#include <iocsh.h>
+
+#include "mrmShared.h"
+#include "mrmRemoteFlash.h"
+
+#include <epicsExport.h>
+#include "mrmFlashSim.h"
+
+// Commands and status bits understood by the simulation (see mrmFlash.cpp)
+#define CMD_READ_FAST              0x0B
+#define CMD_READ_IDENTIFICATION    0x9F
+#define CMD_WRITE_ENABLE           0x06
+#define CMD_WRITE_DISABLE          0x04
+#define CMD_READ_STATUS            0x05
+#define CMD_SECTOR_ERASE           0xD8
+#define CMD_BULK_ERASE             0xC7
+#define CMD_PAGE_PROGRAM           0x02
+
+#define STATUS_WIP                 0x01
+#define STATUS_WRITE_ENABLE_LATCH  0x02
+
+#define SIZE_PAGE           256
+#define SIZE_SECTOR         0x00010000
+#define SIZE_SECTOR_128     0x00040000
+
+// Number of status reads a command keeps the chip busy for
+#define BUSY_PROGRAM        2
+#define BUSY_ERASE          20
+
+mrmFlashSim::mrmFlashSim(const std::string &filename, size_t sizeMbit)
+    :mrmFlash(NULL)
+    ,m_fd(NULL)
+    ,m_capacity(0x12)
+    ,m_selected(false)
+    ,m_count(0)
+    ,m_rx(0)
+    ,m_busy(0)
+    ,m_wel(false)
+{
+    size_t code = 2;
+    while(code < sizeMbit && m_capacity < 0x18) {
+        code *= 2;
+        m_capacity++;
+    }
+    if(code != sizeMbit) {
+        throw std::invalid_argument("Simulated flash size must be 2, 4, 8, 16, 32, 64 or 128 Mbit");
+    }
+    memset(m_cmd, 0, sizeof(m_cmd));
+
+    m_mem.resize(sizeMbit * 1024 * 1024 / 8, 0xff);
+
+    m_fd = fopen(filename.c_str(), "r+b");
+    if(!m_fd) {
+        m_fd = fopen(filename.c_str(), "w+b");
+    }
+    if(!m_fd) {
+        throw std::runtime_error("Could not open simulated flash file");
+    }
+
+    size_t len = fread(&m_mem[0], 1, m_mem.size(), m_fd);
+    if(len < m_mem.size()) {
+        store(len, m_mem.size() - len);
+    }
+}
+
+mrmFlashSim::~mrmFlashSim()
+{
+    fclose(m_fd);
+}
+
+void mrmFlashSim::slaveSelect(bool select)
+{
+    if(m_selected && !select) {
+        execute();
+    }
+    if(select && !m_selected) {
+        m_count = 0;
+        m_page.clear();
+    }
+    m_selected = select;
+}
+
+void mrmFlashSim::write(epicsUInt8 data)
+{
+    if(!m_selected) {
+        return;
+    }
+
+    if(m_count < sizeof(m_cmd)) {
+        m_cmd[m_count] = data;
+    }
+    m_count++;
+
+    switch(m_cmd[0]) {
+    case CMD_READ_STATUS:
+        m_rx = (m_busy ? STATUS_WIP : 0) | (m_wel ? STATUS_WRITE_ENABLE_LATCH : 0);
+        if(m_count > 1 && m_busy) {
+            m_busy--;
+        }
+        break;
+
+    case CMD_READ_IDENTIFICATION:
+        switch(m_count) {
+        case 2: m_rx = 0x20; break;    // Micron
+        case 3: m_rx = 0x20; break;    // M25P
+        case 4: m_rx = m_capacity; break;
+        default: m_rx = 0;
+        }
+        break;
+
+    case CMD_READ_FAST:
+        // command, 3 address bytes and one dummy byte
+        if(m_count >= 6 && !m_busy) {
+            size_t addr = address() + m_count - 6;
+            m_rx = addr < m_mem.size() ? m_mem[addr] : 0xff;
+        }
+        break;
+
+    case CMD_PAGE_PROGRAM:
+        if(m_count > 4 && m_page.size() < SIZE_PAGE) {
+            m_page.push_back(data);
+        }
+        break;
+
+    default:
+        m_rx = 0;
+    }
+}
+
+epicsUInt8 mrmFlashSim::read()
+{
+    return m_rx;
+}
+
+size_t mrmFlashSim::address() const
+{
+    return (size_t(m_cmd[1]) << 16) | (size_t(m_cmd[2]) << 8) | m_cmd[3];
+}
+
+void mrmFlashSim::execute()
+{
+    if(m_count == 0 || m_busy) {
+        return; // the chip ignores commands while busy
+    }
+
+    switch(m_cmd[0]) {
+    case CMD_WRITE_ENABLE:
+        m_wel = true;
+        break;
+
+    case CMD_WRITE_DISABLE:
+        m_wel = false;
+        break;
+
+    case CMD_PAGE_PROGRAM:
+        if(m_wel && m_count >= 4 && address() < m_mem.size()) {
+            size_t addr = address(), page = addr - (addr % SIZE_PAGE);
+            for(size_t i = 0; i < m_page.size(); i++) {
+                // programming wraps around within the page, and can only clear bits
+                m_mem[page + (addr + i) % SIZE_PAGE] &= m_page[i];
+            }
+            store(page, SIZE_PAGE);
+            m_busy = BUSY_PROGRAM;
+        }
+        m_wel = false;
+        break;
+
+    case CMD_SECTOR_ERASE:
+        if(m_wel && m_count >= 4 && address() < m_mem.size()) {
+            size_t sector = m_capacity == 0x18 ? SIZE_SECTOR_128 : SIZE_SECTOR,
+                   addr = address() - (address() % sector);
+            memset(&m_mem[addr], 0xff, sector);
+            store(addr, sector);
+            m_busy = BUSY_ERASE;
+        }
+        m_wel = false;
+        break;
+
+    case CMD_BULK_ERASE:
+        if(m_wel) {
+            memset(&m_mem[0], 0xff, m_mem.size());
+            store(0, m_mem.size());
+            m_busy = BUSY_ERASE;
+        }
+        m_wel = false;
+        break;
+    }
+}
+
+void mrmFlashSim::store(size_t addr, size_t len)
+{
+    if(fseek(m_fd, (long)addr, SEEK_SET) != 0 ||
+            fwrite(&m_mem[addr], 1, len, m_fd) != len ||
+            fflush(m_fd) != 0) {
+        errlogPrintf("Simulated flash: could not write to backing file\n");
+    }
+}
+
+
+/********** Create simulated device  *******/
+static const iocshArg mrmFlashSimArg0 = { "Device", iocshArgString };
+static const iocshArg mrmFlashSimArg1 = { "File", iocshArgString };
+static const iocshArg mrmFlashSimArg2 = { "Size [Mbit]", iocshArgInt };
+
+static const iocshArg * const mrmFlashSimArgs[3] = { &mrmFlashSimArg0, &mrmFlashSimArg1, &mrmFlashSimArg2 };
+static const iocshFuncDef mrmFlashSimDef = { "mrmFlashSimCreate", 3, mrmFlashSimArgs };
+
+
+static void mrmFlashSimFunc(const iocshArgBuf *args) {
+    if(args[0].sval == NULL || args[1].sval == NULL){
+        printf("Usage: mrmFlashSimCreate Device File Size\n\t" \
+               "Device = name of the simulated device (eg.: SIM0)\n\t"    \
+               "File = file holding the simulated flash memory content\n\t" \
+               "Size = flash memory size in Mbit (default: 32)\n");
+        return;
+    }
+
+    std::string device = args[0].sval;
+    int size = args[2].ival > 0 ? args[2].ival : 32;
+
+    if(mrf::Object::getObject(device + mrmRemoteFlash::OBJECT_NAME)) {
+        printf("Device <%s> already exists!\n", device.c_str());
+        return;
+    }
+
+    try{
+        mrmFlashSim *flash = new mrmFlashSim(args[1].sval, (size_t)size);
+        new mrmRemoteFlash(device, *flash, 0);
+    }
+    catch(std::exception& ex) {
+        errlogPrintf("An error occured while creating simulated flash: %s\n", ex.what());
+    }
+}
+
+
+extern "C" {
+    static void mrmFlashSimRegistrar() {
+        iocshRegister(&mrmFlashSimDef, mrmFlashSimFunc);
+    }
+
+    epicsExportRegistrar(mrmFlashSimRegistrar);
+}
@@ -0,0 +1,48 @@
+#ifndef MRMFLASHSIM_H
+#define MRMFLASHSIM_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "mrmFlash.h"
+
+/**
+ * @brief mrmFlashSim is a file backed simulation of the M25P SPI flash chip.
+ * It implements the SPI access of mrmFlash, so the flashing, reading and queueing code can be exercised without hardware.
+ * Every page program and sector erase is written through to the backing file, so the content survives an IOC restart.
+ */
+class epicsShareClass mrmFlashSim : public mrmFlash
+{
+public:
+    /**
+     * @param filename backing file. Created, or extended with erased (0xFF) bytes, if shorter than the flash memory.
+     * @param sizeMbit flash memory size in [Mbit]. One of 2, 4, 8, 16, 32, 64 or 128.
+     */
+    mrmFlashSim(const std::string& filename, size_t sizeMbit);
+    virtual ~mrmFlashSim();
+
+protected:
+    virtual void slaveSelect(bool select);
+    virtual void write(epicsUInt8 data);
+    virtual epicsUInt8 read();
+
+private:
+    FILE *m_fd;
+    std::vector<epicsUInt8> m_mem;
+    epicsUInt8 m_capacity;          // memory capacity code returned by read identification
+
+    bool m_selected;
+    size_t m_count;                 // bytes received since slave select
+    epicsUInt8 m_cmd[4];            // command and address bytes
+    std::vector<epicsUInt8> m_page; // page program data
+    epicsUInt8 m_rx;                // byte shifted out while the last byte was written
+    unsigned m_busy;                // status reads until the last program / erase completes
+    bool m_wel;                     // write enable latch
+
+    size_t address() const;
+    void execute();
+    void store(size_t addr, size_t len);
+};
+
+#endif // MRMFLASHSIM_H
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsTime.h>
+#include <epicsGuard.h>
+
+#include "mrmThreadTopology.h"
+#include "mrfCommon.h"
+
+#include <epicsExport.h>
+#include "mrmIrqQueue.h"
+
+namespace {
+
+// monotonic time [ns], or 0 if the latency can not be measured
+epicsUInt64 now()
+{
+#if EPICS_VERSION_INT >= VERSION_INT(3,16,1,0)
+    return epicsMonotonicGet();
+#else
+    return 0;
+#endif
+}
+
+epicsUInt32 ringSize(unsigned depth)
+{
+    epicsUInt32 size = 2;
+    while(size < depth && size < 0x10000)
+        size <<= 1;
+    return size;
+}
+
+void nothing(void*, epicsUInt32) {}
+
+} // namespace
+
+mrmIrqQueue::mrmIrqQueue(const std::string& name, const std::string& card, handler_t fn, void *pvt,
+                         unsigned depth, unsigned int priority)
+    :mrf::ObjectInst<mrmIrqQueue>(name)
+    ,m_card(card)
+    ,m_fn(fn)
+    ,m_pvt(pvt)
+    ,m_ring(ringSize(depth))
+    ,m_mask(ringSize(depth)-1)
+    ,m_head(0)
+    ,m_tail(0)
+    ,m_overruns(0)
+    ,m_nsources(0)
+    ,m_stop(false)
+    ,m_pendingMax(0)
+    ,m_processed(0)
+    ,m_thread(*this, "MRF IRQ",
+              epicsThreadGetStackSize(epicsThreadStackMedium),
+              priority)
+{
+    memset(m_sources, 0, sizeof(m_sources));
+}
+
+mrmIrqQueue::~mrmIrqQueue()
+{
+    m_stop = true;
+    m_wakeup.signal();
+    m_thread.exitWait();
+
+    for(unsigned i=0; i<m_nsources; i++)
+        delete m_sources[i].obj;
+}
+
+void mrmIrqQueue::addSource(const std::string& name, epicsUInt32 mask)
+{
+    if(m_nsources==maxSources)
+        throw std::runtime_error("Too many interrupt sources");
+
+    source_t& src = m_sources[m_nsources];
+    src.mask = mask;
+    src.obj = new mrmIrqQueueSource(this->name()+":"+name, *this, m_nsources);
+    m_nsources++;
+}
+
+void mrmIrqQueue::start()
+{
+    m_thread.start();
+}
+
+bool mrmIrqQueue::push(epicsUInt32 flags)
+{
+    epicsUInt32 head = m_head;
+
+    if(head - m_tail > m_mask) {
+        m_overruns++;
+        for(unsigned i=0; i<m_nsources; i++) {
+            if(flags & m_sources[i].mask)
+                m_sources[i].overruns++;
+        }
+        m_wakeup.signal();
+        return false;
+    }
+
+    record_t& rec = m_ring[head & m_mask];
+    rec.flags = flags;
+    rec.time = now();
+    MRF_SYNC();
+    m_head = head+1;
+
+    m_wakeup.signal();
+    return true;
+}
+
+void mrmIrqQueue::run()
+{
+    mrmThreadTopology::pin(m_card, mrmThreadTopology::roleISR);
+    mrmThreadStats stats(m_card, mrmThreadTopology::roleISR);
+
+    while(true) {
+        stats.waitStart();
+        m_wakeup.wait();
+        stats.waitEnd();
+
+        if(m_stop)
+            break;
+
+        epicsUInt32 tail = m_tail;
+        while(tail != m_head) {
+            MRF_SYNC();
+            record_t rec = m_ring[tail & m_mask];
+            epicsUInt32 pending = m_head - tail;
+            MRF_SYNC();
+            m_tail = ++tail; // the ISR may reuse the slot now
+
+            epicsUInt64 start = now();
+            (*m_fn)(m_pvt, rec.flags);
+
+            account(rec, start, pending);
+        }
+    }
+}
+
+void mrmIrqQueue::account(const record_t& rec, epicsUInt64 start, epicsUInt32 pending)
+{
+    double latency = rec.time ? (start - rec.time)*1e-3 : 0.0;
+
+    SCOPED_LOCK(m_lock);
+    m_processed++;
+    if(pending > m_pendingMax)
+        m_pendingMax = pending;
+
+    for(unsigned i=0; i<m_nsources; i++) {
+        source_t& src = m_sources[i];
+        if(!(rec.flags & src.mask))
+            continue;
+        src.count++;
+        src.latency = latency;
+        src.latencySum += latency;
+        if(latency > src.latencyMax)
+            src.latencyMax = latency;
+    }
+}
+
+epicsUInt32 mrmIrqQueue::pending() const
+{
+    return m_head - m_tail;
+}
+
+epicsUInt32 mrmIrqQueue::pendingMax() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_pendingMax;
+}
+
+epicsUInt32 mrmIrqQueue::processed() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_processed;
+}
+
+epicsUInt32 mrmIrqQueue::overruns() const
+{
+    return m_overruns;
+}
+
+void mrmIrqQueue::reset(bool)
+{
+    SCOPED_LOCK(m_lock);
+    m_pendingMax = m_processed = 0;
+    m_overruns = 0;
+}
+
+void mrmIrqQueue::report(int lvl) const
+{
+    printf("%s: %u of %u queued (max %u), %u processed, %u overruns\n",
+           name().c_str(), pending(), capacity(), pendingMax(), processed(), overruns());
+    if(lvl<1)
+        return;
+    for(unsigned i=0; i<m_nsources; i++) {
+        const mrmIrqQueueSource& src = *m_sources[i].obj;
+        printf(" %-24s %08x %10u %6u overruns  latency %.1f us (max %.1f, mean %.1f)\n",
+               src.name().c_str(), src.mask(), src.count(), src.overruns(),
+               src.latency(), src.latencyMax(), src.latencyMean());
+    }
+}
+
+mrmIrqQueueSource::mrmIrqQueueSource(const std::string& name, mrmIrqQueue& queue, unsigned idx)
+    :mrf::ObjectInst<mrmIrqQueueSource>(name)
+    ,m_queue(queue)
+    ,m_idx(idx)
+{}
+
+epicsUInt32 mrmIrqQueueSource::count() const
+{
+    SCOPED_LOCK2(m_queue.m_lock, guard);
+    return m_queue.m_sources[m_idx].count;
+}
+
+epicsUInt32 mrmIrqQueueSource::overruns() const
+{
+    return m_queue.m_sources[m_idx].overruns;
+}
+
+double mrmIrqQueueSource::latency() const
+{
+    SCOPED_LOCK2(m_queue.m_lock, guard);
+    return m_queue.m_sources[m_idx].latency;
+}
+
+double mrmIrqQueueSource::latencyMax() const
+{
+    SCOPED_LOCK2(m_queue.m_lock, guard);
+    return m_queue.m_sources[m_idx].latencyMax;
+}
+
+double mrmIrqQueueSource::latencyMean() const
+{
+    SCOPED_LOCK2(m_queue.m_lock, guard);
+    const mrmIrqQueue::source_t& src = m_queue.m_sources[m_idx];
+    return src.count ? src.latencySum/src.count : 0.0;
+}
+
+void mrmIrqQueueSource::reset(bool)
+{
+    SCOPED_LOCK2(m_queue.m_lock, guard);
+    mrmIrqQueue::source_t& src = m_queue.m_sources[m_idx];
+    src.count = 0;
+    src.overruns = 0;
+    src.latency = src.latencyMax = src.latencySum = 0.0;
+}
+
+OBJECT_BEGIN(mrmIrqQueue) {
+    OBJECT_PROP1("Capacity", &mrmIrqQueue::capacity);
+    OBJECT_PROP1("Pending", &mrmIrqQueue::pending);
+    OBJECT_PROP1("Pending Max", &mrmIrqQueue::pendingMax);
+    OBJECT_PROP1("Processed", &mrmIrqQueue::processed);
+    OBJECT_PROP1("Overruns", &mrmIrqQueue::overruns);
+    OBJECT_PROP2("Reset", &mrmIrqQueue::dummyReturn, &mrmIrqQueue::reset);
+} OBJECT_END(mrmIrqQueue)
+
+OBJECT_BEGIN(mrmIrqQueueSource) {
+    OBJECT_PROP1("Mask", &mrmIrqQueueSource::mask);
+    OBJECT_PROP1("Count", &mrmIrqQueueSource::count);
+    OBJECT_PROP1("Overruns", &mrmIrqQueueSource::overruns);
+    OBJECT_PROP1("Latency", &mrmIrqQueueSource::latency);
+    OBJECT_PROP1("Latency Max", &mrmIrqQueueSource::latencyMax);
+    OBJECT_PROP1("Latency Mean", &mrmIrqQueueSource::latencyMean);
+    OBJECT_PROP2("Reset", &mrmIrqQueueSource::dummyReturn, &mrmIrqQueueSource::reset);
+} OBJECT_END(mrmIrqQueueSource)
+
+
+/********** Report  *******/
+static const iocshArg mrmIrqQueueReportArg0 = { "Name", iocshArgString };
+static const iocshArg * const mrmIrqQueueReportArgs[1] = { &mrmIrqQueueReportArg0 };
+static const iocshFuncDef mrmIrqQueueReportDef = { "mrmIrqQueueReport", 1, mrmIrqQueueReportArgs };
+
+static void mrmIrqQueueReportFunc(const iocshArgBuf *args)
+{
+    mrmIrqQueue *queue = args[0].sval ? dynamic_cast<mrmIrqQueue*>(mrf::Object::getObject(args[0].sval)) : NULL;
+    if(!queue) {
+        printf("Usage: mrmIrqQueueReport Name\n\t" \
+               "Name = object name of the queue (eg.: EVG1:IrqQueue)\n");
+        return;
+    }
+    queue->report(1);
+}
+
+/********** Simulated interrupts  *******/
+static const iocshArg mrmIrqQueueSimArg0 = { "Name", iocshArgString };
+static const iocshArg mrmIrqQueueSimArg1 = { "Flags", iocshArgInt };
+static const iocshArg mrmIrqQueueSimArg2 = { "Count", iocshArgInt };
+static const iocshArg mrmIrqQueueSimArg3 = { "Period", iocshArgDouble };
+static const iocshArg * const mrmIrqQueueSimArgs[4] = { &mrmIrqQueueSimArg0, &mrmIrqQueueSimArg1,
+                                                        &mrmIrqQueueSimArg2, &mrmIrqQueueSimArg3 };
+static const iocshFuncDef mrmIrqQueueSimDef = { "mrmIrqQueueSim", 4, mrmIrqQueueSimArgs };
+
+static void mrmIrqQueueSimFunc(const iocshArgBuf *args)
+{
+    if(!args[0].sval || args[2].ival<=0) {
+        printf("Usage: mrmIrqQueueSim Name Flags Count [Period]\n\t" \
+               "Name = name of a simulated queue, created with one source 'All'\n\t" \
+               "       and no handler.  Queues of a card can not be used\n\t" \
+               "Flags = IRQFlag bits of each simulated interrupt\n\t" \
+               "Count = number of interrupts\n\t" \
+               "Period = time between interrupts [s], 0 for a burst\n");
+        return;
+    }
+
+    try {
+        mrmIrqQueue *queue = dynamic_cast<mrmIrqQueue*>(mrf::Object::getObject(args[0].sval));
+        if(!queue) {
+            queue = new mrmIrqQueue(args[0].sval, args[0].sval, &nothing, NULL, 64, epicsThreadPriorityHigh);
+            queue->addSource("All", 0xffffffff);
+            queue->start();
+        } else if(queue->handler()!=&nothing) {
+            // the ISR of the card pushes to this queue, and there is one producer
+            throw std::runtime_error("Queue of a card, not simulated");
+        }
+
+        unsigned dropped = 0;
+        for(int i=0; i<args[2].ival; i++) {
+            if(!queue->push((epicsUInt32)args[1].ival))
+                dropped++;
+            if(args[3].dval>0.0)
+                epicsThreadSleep(args[3].dval);
+        }
+        epicsThreadSleep(0.1);
+
+        printf("%d interrupts, %u dropped\n", args[2].ival, dropped);
+        queue->report(1);
+    } catch(std::exception& e) {
+        errlogPrintf("mrmIrqQueueSim %s: %s\n", args[0].sval, e.what());
+    }
+}
+
+extern "C" {
+static void mrmIrqQueueRegistrar()
+{
+    iocshRegister(&mrmIrqQueueReportDef, mrmIrqQueueReportFunc);
+    iocshRegister(&mrmIrqQueueSimDef, mrmIrqQueueSimFunc);
+}
+epicsExportRegistrar(mrmIrqQueueRegistrar);
+}
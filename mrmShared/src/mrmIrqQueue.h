@@ -0,0 +1,148 @@
+#ifndef MRMIRQQUEUE_H
+#define MRMIRQQUEUE_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <shareLib.h>
+
+#include "mrf/object.h"
+
+class mrmIrqQueueSource;
+
+/** @brief Moves the work of an interrupt from the ISR to a worker thread
+ *
+ * The ISR acknowledges the interrupt and calls push() with the active
+ * flags.  push() stores the flags and the monotonic time in a ring and
+ * wakes the worker, which calls the handler with the flags of each
+ * interrupt in order.  push() does not lock, allocate or wait, so it can
+ * be called from interrupt context.  There is one producer (the ISR) and
+ * one consumer (the worker).
+ *
+ * When the ring is full the interrupt is dropped and counted as overrun
+ * of each of its sources.  The sources are the IRQFlag bits with a name,
+ * each with a count, overruns and the latency from push() to the handler
+ * as object <queue>:<source>.  The latency needs the monotonic clock of
+ * EPICS 3.16.1 or later.
+ */
+class epicsShareClass mrmIrqQueue : public mrf::ObjectInst<mrmIrqQueue>,
+                                    public epicsThreadRunable
+{
+public:
+    //! Called by the worker with the flags of one interrupt
+    typedef void (*handler_t)(void *pvt, epicsUInt32 flags);
+
+    enum { maxSources = 32 };
+
+    /**
+     * @param card name of the card, for the thread placement (roleISR)
+     * @param depth number of interrupts queued, rounded up to a power of 2
+     */
+    mrmIrqQueue(const std::string& name, const std::string& card, handler_t fn, void *pvt,
+                unsigned depth, unsigned int priority);
+    virtual ~mrmIrqQueue();
+
+    /* locking done internally */
+    virtual void lock() const{}
+    virtual void unlock() const{}
+
+    //! Name a source.  Must be called before start().
+    void addSource(const std::string& name, epicsUInt32 mask);
+    void start();
+
+    /** @brief Queue an interrupt.  From the ISR only, there must be one producer.
+     * @return false if the ring was full and the interrupt is dropped
+     */
+    bool push(epicsUInt32 flags);
+
+    handler_t handler() const{return m_fn;}
+
+    epicsUInt32 capacity() const{return m_mask+1;}
+    epicsUInt32 pending() const;
+    epicsUInt32 pendingMax() const;
+    epicsUInt32 processed() const;
+    epicsUInt32 overruns() const;
+
+    bool dummyReturn() const{return false;}
+    void reset(bool);
+
+    void report(int lvl) const;
+
+    virtual void run();
+
+private:
+    friend class mrmIrqQueueSource;
+
+    struct record_t {
+        epicsUInt32 flags;
+        epicsUInt64 time;   // monotonic [ns], 0 if not available
+    };
+
+    struct source_t {
+        epicsUInt32 mask;
+        mrmIrqQueueSource *obj;
+        volatile epicsUInt32 overruns;  // ISR only
+        // Guarded by m_lock
+        epicsUInt32 count;
+        double latency, latencyMax, latencySum;
+    };
+
+    const std::string m_card;
+    const handler_t m_fn;
+    void * const m_pvt;
+
+    std::vector<record_t> m_ring;
+    const epicsUInt32 m_mask;
+    volatile epicsUInt32 m_head;    // written by the ISR
+    volatile epicsUInt32 m_tail;    // written by the worker
+    volatile epicsUInt32 m_overruns;
+
+    source_t m_sources[maxSources];
+    unsigned m_nsources;
+
+    epicsEvent m_wakeup;
+    bool m_stop;
+
+    mutable epicsMutex m_lock;
+    // Guarded by m_lock
+    epicsUInt32 m_pendingMax, m_processed;
+
+    epicsThread m_thread;
+
+    void account(const record_t& rec, epicsUInt64 now, epicsUInt32 pending);
+
+    mrmIrqQueue(const mrmIrqQueue&);
+    mrmIrqQueue& operator=(const mrmIrqQueue&);
+};
+
+//! Statistics of one source of a mrmIrqQueue
+class epicsShareClass mrmIrqQueueSource : public mrf::ObjectInst<mrmIrqQueueSource>
+{
+public:
+    mrmIrqQueueSource(const std::string& name, mrmIrqQueue& queue, unsigned idx);
+
+    /* locking done internally */
+    virtual void lock() const{}
+    virtual void unlock() const{}
+
+    epicsUInt32 mask() const{return m_queue.m_sources[m_idx].mask;}
+    epicsUInt32 count() const;
+    epicsUInt32 overruns() const;
+    //! From push() to the handler [us]
+    double latency() const;
+    double latencyMax() const;
+    double latencyMean() const;
+
+    bool dummyReturn() const{return false;}
+    void reset(bool);
+
+private:
+    mrmIrqQueue& m_queue;
+    const unsigned m_idx;
+};
+
+#endif // MRMIRQQUEUE_H
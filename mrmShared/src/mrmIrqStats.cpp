@@ -0,0 +1,218 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+
+#ifdef __linux__
+#  include <stdint.h>
+#  include <time.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#endif
+
+#include <errlog.h>
+#include <epicsStdio.h>
+#include <epicsExport.h>
+
+#include "mrf/object.h"
+#include "mrmIrqStats.h"
+#include "mrmUIO.h"
+
+#include "mrfCommon.h"
+
+/* Must match struct mrf_irqstats in mrmShared/linux/mrf.h */
+#define IRQSTATS_NAME    "mrf-irqstats"
+#define IRQSTATS_MAGIC   0x4d524649
+#define IRQSTATS_VERSION 1
+#define IRQSTATS_RING    64
+
+#ifdef __linux__
+
+struct mrmIrqStats::page_t {
+    epicsUInt32 magic;
+    epicsUInt32 version;
+    epicsUInt32 ringsize;
+    epicsUInt32 head;
+    epicsUInt32 irqcount;
+    epicsUInt32 spurious;
+    epicsUInt32 masked;
+    epicsUInt32 reserved;
+    struct ring_t {
+        uint64_t time;
+        epicsUInt32 flags;
+        epicsUInt32 seq;
+    } ring[IRQSTATS_RING];
+};
+
+mrmIrqStats*
+mrmIrqStats::create(const std::string& name,
+                    unsigned domain, unsigned bus,
+                    unsigned device, unsigned function)
+{
+    std::string uio(mrmUIO::findDevice(domain, bus, device, function));
+
+    int map = uio.empty() ? -1 : mrmUIO::findMap(uio, IRQSTATS_NAME);
+    if(map<0) {
+        epicsPrintf("%s: kernel module does not provide IRQ statistics\n", name.c_str());
+        return NULL;
+    }
+
+    int fd;
+    size_t len = sysconf(_SC_PAGESIZE);
+    void *mem = mrmUIO::mapPage(name, uio, map, len, false, fd);
+    if(!mem)
+        return NULL;
+
+    const volatile page_t *page = (const volatile page_t*)mem;
+    if(page->magic!=IRQSTATS_MAGIC || page->version!=IRQSTATS_VERSION || page->ringsize!=IRQSTATS_RING) {
+        errlogPrintf("%s: IRQ statistics of %s have unknown layout %08x %u %u\n", name.c_str(), uio.c_str(),
+                     (unsigned)page->magic, (unsigned)page->version, (unsigned)page->ringsize);
+        munmap(mem, len);
+        close(fd);
+        return NULL;
+    }
+
+    return new mrmIrqStats(name, fd, page, len);
+}
+
+mrmIrqStats::mrmIrqStats(const std::string& name, int fd, const volatile page_t *page, size_t len)
+    :mrf::ObjectInst<mrmIrqStats>(name)
+    ,m_fd(fd)
+    ,m_page(page)
+    ,m_len(len)
+    ,m_next(page->head) // older interrupts are not ours
+    ,m_lost(0)
+    ,m_wakeup(0.0)
+    ,m_wakeupMax(0.0)
+    ,m_wakeupSum(0.0)
+    ,m_wakeupCount(0)
+{}
+
+mrmIrqStats::~mrmIrqStats()
+{
+    munmap((void*)m_page, m_len);
+    close(m_fd);
+}
+
+epicsUInt32
+mrmIrqStats::consume(epicsUInt32& flags)
+{
+    epicsUInt32 head = m_page->head;
+    __sync_synchronize();
+
+    if(head==m_next)
+        return 0;
+
+    // same clock as ktime_get()
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = uint64_t(ts.tv_sec)*1000000000u + ts.tv_nsec;
+
+    epicsUInt32 n = 0;
+    flags = 0;
+
+    SCOPED_LOCK(m_lock);
+
+    if(head-m_next > IRQSTATS_RING) {
+        m_lost += head-m_next-IRQSTATS_RING;
+        m_next = head-IRQSTATS_RING;
+    }
+
+    for(; m_next!=head; m_next++) {
+        const volatile page_t::ring_t& ent = m_page->ring[m_next%IRQSTATS_RING];
+
+        epicsUInt32 seq = ent.seq;
+        __sync_synchronize();
+        uint64_t time = ent.time;
+        epicsUInt32 f = ent.flags;
+        __sync_synchronize();
+
+        if(seq!=m_next+1 || ent.seq!=seq) {
+            m_lost++; // overwritten while we read
+            continue;
+        }
+
+        flags |= f;
+        n++;
+
+        double us = now>time ? (now-time)*1e-3 : 0.0;
+        m_wakeup = us;
+        if(us>m_wakeupMax)
+            m_wakeupMax = us;
+        m_wakeupSum += us;
+        m_wakeupCount++;
+    }
+
+    return n;
+}
+
+epicsUInt32 mrmIrqStats::irqCount() const {return m_page->irqcount;}
+epicsUInt32 mrmIrqStats::spurious() const {return m_page->spurious;}
+epicsUInt32 mrmIrqStats::masked() const {return m_page->masked;}
+
+#else /* __linux__ */
+
+struct mrmIrqStats::page_t {};
+
+mrmIrqStats*
+mrmIrqStats::create(const std::string&, unsigned, unsigned, unsigned, unsigned)
+{
+    return NULL;
+}
+
+mrmIrqStats::~mrmIrqStats() {}
+
+epicsUInt32 mrmIrqStats::consume(epicsUInt32&) {return 0;}
+epicsUInt32 mrmIrqStats::irqCount() const {return 0;}
+epicsUInt32 mrmIrqStats::spurious() const {return 0;}
+epicsUInt32 mrmIrqStats::masked() const {return 0;}
+
+#endif /* __linux__ */
+
+epicsUInt32
+mrmIrqStats::lost() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_lost;
+}
+
+double
+mrmIrqStats::wakeup() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_wakeup;
+}
+
+double
+mrmIrqStats::wakeupMax() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_wakeupMax;
+}
+
+double
+mrmIrqStats::wakeupMean() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_wakeupCount ? m_wakeupSum/m_wakeupCount : 0.0;
+}
+
+void
+mrmIrqStats::reset(bool)
+{
+    SCOPED_LOCK(m_lock);
+    m_lost = 0;
+    m_wakeup = m_wakeupMax = m_wakeupSum = 0.0;
+    m_wakeupCount = 0;
+}
+
+OBJECT_BEGIN(mrmIrqStats) {
+    OBJECT_PROP1("IRQ Count", &mrmIrqStats::irqCount);
+    OBJECT_PROP1("Spurious", &mrmIrqStats::spurious);
+    OBJECT_PROP1("Masked", &mrmIrqStats::masked);
+    OBJECT_PROP1("Lost", &mrmIrqStats::lost);
+    OBJECT_PROP1("Wakeup", &mrmIrqStats::wakeup);
+    OBJECT_PROP1("Wakeup Max", &mrmIrqStats::wakeupMax);
+    OBJECT_PROP1("Wakeup Mean", &mrmIrqStats::wakeupMean);
+    OBJECT_PROP2("Reset", &mrmIrqStats::dummyReturn, &mrmIrqStats::reset);
+} OBJECT_END(mrmIrqStats)
@@ -0,0 +1,82 @@
+#ifndef MRMIRQSTATS_H
+#define MRMIRQSTATS_H
+
+#include <string>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <shareLib.h>
+
+#include "mrf/object.h"
+
+/** @brief IRQ statistics recorded by the uio_mrf kernel module (Linux)
+ *
+ * The kernel module (interface version 2) stores the time of entry and
+ * IRQFlag of each interrupt in a ring, and counts handled, spurious and
+ * masked interrupts, in a page which is mapped read-only (see
+ * mrmShared/linux/mrf.h).
+ *
+ * consume() is called by the ISR of the card with the interrupts recorded
+ * since the last call.  Their flags replace a read of IRQFlag, and the
+ * time from the kernel handler to consume() is the wakeup latency of the
+ * ISR thread.
+ */
+class epicsShareClass mrmIrqStats : public mrf::ObjectInst<mrmIrqStats>
+{
+public:
+    /** @brief Map the statistics page of a PCI device
+     @returns NULL if the kernel module does not provide it
+     */
+    static mrmIrqStats* create(const std::string& name,
+                               unsigned domain, unsigned bus,
+                               unsigned device, unsigned function);
+    virtual ~mrmIrqStats();
+
+    /* locking done internally */
+    virtual void lock() const{};
+    virtual void unlock() const{};
+
+    /** @brief Take the interrupts recorded since the last call
+     *
+     * Called from one thread only.
+     @param flags OR of the IRQFlag of the interrupts
+     @returns number of interrupts, 0 if none was recorded
+     */
+    epicsUInt32 consume(epicsUInt32& flags);
+
+    // Kernel counters
+    epicsUInt32 irqCount() const;
+    epicsUInt32 spurious() const;
+    epicsUInt32 masked() const;
+
+    //! Entries overwritten before they were consumed
+    epicsUInt32 lost() const;
+
+    //! Wakeup latency [us]
+    double wakeup() const;
+    double wakeupMax() const;
+    double wakeupMean() const;
+
+    void reset(bool);
+    bool dummyReturn() const{return false;}
+
+    struct page_t;
+
+private:
+    mrmIrqStats(const std::string& name, int fd, const volatile page_t *page, size_t len);
+
+    const int m_fd;
+    const volatile page_t * const m_page;
+    const size_t m_len;
+
+    mutable epicsMutex m_lock;
+
+    epicsUInt32 m_next; // ISR thread only
+
+    // Guarded by m_lock
+    epicsUInt32 m_lost;
+    double m_wakeup, m_wakeupMax, m_wakeupSum;
+    epicsUInt32 m_wakeupCount;
+};
+
+#endif // MRMIRQSTATS_H
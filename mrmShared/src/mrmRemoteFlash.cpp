@@ -53,6 +53,24 @@ mrmRemoteFlash::mrmRemoteFlash(const std::string &parentName, volatile epicsUInt
     }
 }
 
+mrmRemoteFlash::mrmRemoteFlash(const std::string &parentName, mrmFlash &flash, size_t offset):
+    mrf::ObjectInst<mrmRemoteFlash>(parentName+OBJECT_NAME),
+    m_base(NULL),
+    m_flash_success(false),
+    m_read_success(false),
+    m_offset(0),
+    m_offsetValid(false),
+    m_flash(flash)
+{
+    try{
+        m_flash.init(true);
+        setOffset(offset);
+    }
+    catch(std::exception& ex) {
+        errlogPrintf("Flash access: %s\n", ex.what());
+    }
+}
+
 void mrmRemoteFlash::setOffset(size_t offset)
 {
     if(offset >= m_flash.getMemorySize()) {
@@ -127,11 +145,25 @@ void mrmRemoteFlash::flash_thread(void* args){
     delete threadArgs;
 }
 
-void mrmRemoteFlash::flash(const char *bitfile)
+bool mrmRemoteFlash::flashNow(const std::string& filename, bool resume)
+{
+    if(!m_offsetValid) {
+        throw std::runtime_error("This device does not support flash access");
+    }
+
+    if(flashInProgress()) {
+        throw std::runtime_error("Flash chip is already in use. Aborting.");
+    }
+
+    flash(filename.c_str(), resume);
+    return m_flash_success;
+}
+
+void mrmRemoteFlash::flash(const char *bitfile, bool resume)
 {
     try{
         infoPrintf(1, "Starting flash of %s to device. Using offset %" FORMAT_SIZET_U " [bytes]\n", bitfile, m_offset);
-        m_flash.flash(bitfile, m_offset);
+        m_flash.flash(bitfile, m_offset, resume);
         infoPrintf(0, "Flashing procedure done.\n");
         m_flash_success = true;
     }
@@ -185,6 +217,25 @@ void mrmRemoteFlash::read_thread(void* args){
     delete threadArgs;
 }
 
+bool mrmRemoteFlash::readNow(const std::string& filename)
+{
+    if(!m_offsetValid) {
+        throw std::runtime_error("This device does not support flash access");
+    }
+
+    if(flashInProgress()) {
+        throw std::runtime_error("Flash chip is already in use. Aborting.");
+    }
+
+    read(filename.c_str());
+    return m_read_success;
+}
+
+void mrmRemoteFlash::cancel(bool)
+{
+    m_flash.cancel();
+}
+
 void mrmRemoteFlash::read(const char *bitfile)
 {
     try{
@@ -224,8 +275,54 @@ bool mrmRemoteFlash::isOffsetValid() const
     return m_offsetValid;
 }
 
+mrmFlash::Progress mrmRemoteFlash::getProgress() const
+{
+    return m_flash.getProgress();
+}
+
+double mrmRemoteFlash::progress() const
+{
+    mrmFlash::Progress p(m_flash.getProgress());
+    if(p.total == 0)
+        return 0.0;
+    return 100.0 * p.done / p.total;
+}
+
+double mrmRemoteFlash::throughput() const
+{
+    mrmFlash::Progress p(m_flash.getProgress());
+    if(p.elapsed <= 0.0)
+        return 0.0;
+    return p.done / p.elapsed / 1024.0;
+}
+
+double mrmRemoteFlash::eta() const
+{
+    mrmFlash::Progress p(m_flash.getProgress());
+    if(!p.running || p.done == 0)
+        return 0.0;
+    return p.elapsed * (p.total - p.done) / p.done;
+}
+
+epicsUInt32 mrmRemoteFlash::sectorsSkipped() const
+{
+    return m_flash.getProgress().sectorsSkipped;
+}
+
+epicsUInt32 mrmRemoteFlash::pagesProgrammed() const
+{
+    return m_flash.getProgress().pagesProgrammed;
+}
+
+epicsUInt32 mrmRemoteFlash::imageCRC() const
+{
+    return m_flash.getProgress().crc;
+}
+
 void mrmRemoteFlash::report() const
 {
+    mrmFlash::Progress p(m_flash.getProgress());
+
     m_flash.report();
 
     if(!isOffsetValid()) {
@@ -237,6 +334,10 @@ void mrmRemoteFlash::report() const
         printf("not ");
     }
     printf("being accessed.\n");
+    printf("\tLast operation: %" FORMAT_SIZET_U " / %" FORMAT_SIZET_U " bytes in %.1f s (%.1f kB/s)\n",
+           p.done, p.total, p.elapsed, throughput());
+    printf("\tSectors skipped: %u, erased: %u. Pages programmed: %u, skipped: %u. Image CRC32: 0x%08x\n",
+           p.sectorsSkipped, p.sectorsErased, p.pagesProgrammed, p.pagesSkipped, p.crc);
 
     printf("\tLast completed flash operation was ");
     if(!flashSuccess()) {
@@ -263,7 +364,14 @@ OBJECT_BEGIN(mrmRemoteFlash) {
     OBJECT_PROP1("IsOffsetValid",&mrmRemoteFlash::isOffsetValid);
     OBJECT_PROP2("Flash", &mrmRemoteFlash::flashSuccess, &mrmRemoteFlash::startFlash);
     OBJECT_PROP2("Read", &mrmRemoteFlash::readSuccess, &mrmRemoteFlash::startRead);
+    OBJECT_PROP2("Cancel", &mrmRemoteFlash::dummyReturn, &mrmRemoteFlash::cancel);
     OBJECT_PROP2("Filename", &mrmRemoteFlash::getFlashFilenameWF, &mrmRemoteFlash::setFlashFilenameWF);
+    OBJECT_PROP1("Progress", &mrmRemoteFlash::progress);
+    OBJECT_PROP1("Throughput", &mrmRemoteFlash::throughput);
+    OBJECT_PROP1("ETA", &mrmRemoteFlash::eta);
+    OBJECT_PROP1("Sectors Skipped", &mrmRemoteFlash::sectorsSkipped);
+    OBJECT_PROP1("Pages Programmed", &mrmRemoteFlash::pagesProgrammed);
+    OBJECT_PROP1("CRC", &mrmRemoteFlash::imageCRC);
 
 } OBJECT_END(mrmRemoteFlash)
 
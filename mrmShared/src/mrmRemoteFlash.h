@@ -15,6 +15,10 @@ class epicsShareClass mrmRemoteFlash : public mrf::ObjectInst<mrmRemoteFlash>
 {
 public:
     mrmRemoteFlash(const std::string& parentName, volatile epicsUInt8* parentBaseAddress, mrmDeviceInfo &deviceInfo, mrmFlash &flash);
+    /**
+     * @brief mrmRemoteFlash constructor for a device with a known offset, eg. a simulated flash chip (mrmFlashSim).
+     */
+    mrmRemoteFlash(const std::string& parentName, mrmFlash &flash, size_t offset);
     static const char *OBJECT_NAME;
 
     /* locking done internally */
@@ -74,6 +78,37 @@ public:
      */
     void startRead(std::string filename);
 
+    /**
+     * @brief flashNow flashes the file in the calling thread. Used by mrmFlashQueue. Throws the same exceptions as startFlash().
+     * @param filename is the name of the file to read from.
+     * @param resume continue the last interrupted flash of the same file, after its last completed sector.
+     * @return true if flashing completed successfully.
+     */
+    bool flashNow(const std::string& filename, bool resume);
+
+    /**
+     * @brief readNow reads the flash chip into a file in the calling thread. Used by mrmFlashQueue. Throws the same exceptions as startRead().
+     * @return true if reading completed successfully.
+     */
+    bool readNow(const std::string& filename);
+
+    /**
+     * @brief cancel stops the flash or read operation in progress at the next sector boundary. The operation then fails.
+     * A cancelled flash can be continued with flashNow(filename, true) or the iocsh function mrmFlashQueueResume.
+     * @param cancel dummy parameter to satisfy mrfioc2 object model.
+     */
+    void cancel(bool cancel = true);
+
+    /**
+     * @brief dummyReturn is the getter of the Cancel command
+     */
+    bool dummyReturn() const{return false;}
+
+    /**
+     * @brief getProgress returns the progress counters of the current (or last) flash / read operation.
+     */
+    mrmFlash::Progress getProgress() const;
+
     /**
      * @brief flashInProgress indicates if the flash chip is currently being accessed.
      * @return true if the flash is currently being accessed, false otherwise.
@@ -98,6 +133,39 @@ public:
      */
     bool isOffsetValid() const;
 
+    /**
+     * @brief progress of the current (or last) flash / read operation.
+     * @return percentage of the work done [%]
+     */
+    double progress() const;
+
+    /**
+     * @brief throughput of the current (or last) flash / read operation, counting skipped sectors.
+     * @return bytes processed per second [kB/s]
+     */
+    double throughput() const;
+
+    /**
+     * @brief eta estimates the remaining time of the current operation from the throughput so far.
+     * @return remaining time, or 0 if no operation is in progress [s]
+     */
+    double eta() const;
+
+    /**
+     * @brief sectorsSkipped returns the number of sectors which already held the image during the last flashing.
+     */
+    epicsUInt32 sectorsSkipped() const;
+
+    /**
+     * @brief pagesProgrammed returns the number of pages written during the last flashing.
+     */
+    epicsUInt32 pagesProgrammed() const;
+
+    /**
+     * @brief imageCRC returns the CRC32 of the last flashed file.
+     */
+    epicsUInt32 imageCRC() const;
+
     /**
      * @brief report prints basic flash chip information to iocsh
      */
@@ -138,8 +206,9 @@ private:
     /**
      * @brief flash is the worker called by the 'flash_thread' that does the flashing.
      * @param bitfile is the file name to be written to the flash chip
+     * @param resume continue the last interrupted flash of the same file
      */
-    void flash(const char *bitfile);
+    void flash(const char *bitfile, bool resume = false);
 
     /**
      * @brief read is the worker called by the 'read_thread' that does the reading of the flash chip.
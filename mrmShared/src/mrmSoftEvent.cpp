@@ -1,21 +1,45 @@
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
 #include <stdexcept>
 
+#include <errlog.h>
+#include <iocsh.h>
+
 #include <mrfCommonIO.h>
+#include <mrfCommon.h>
 #include "mrmShared.h"
 
 #include <epicsExport.h>
 #include "mrmSoftEvent.h"
 
+// Number of bursts which may be queued
+#define SOFTEVT_QUEUE_DEPTH 64
+
 mrmSoftEvent::mrmSoftEvent(const std::string &name, volatile epicsUInt8 * const base):
      mrf::ObjectInst<mrmSoftEvent>(name)
     ,m_base(base)
     ,m_lock()
+    ,m_queue(SOFTEVT_QUEUE_DEPTH, maxBurst)
+    ,m_thread(*this, name.c_str(), epicsThreadGetStackSize(epicsThreadStackSmall),
+              epicsThreadPriorityHigh)
+    ,m_sent(0)
+    ,m_dropped(0)
+    ,m_status(statusOK)
 {
+    m_thread.start();
+}
 
+mrmSoftEvent::~mrmSoftEvent()
+{
+    // empty message to stop
+    m_queue.send(0, 0);
+    m_thread.exitWait();
 }
 
 void mrmSoftEvent::enable(bool ena)
 {
+    SCOPED_LOCK(m_lock);
     if(ena)
          BITSET8(m_base, SwEventControl, SW_EVT_ENABLE);
     else
@@ -33,21 +57,55 @@ bool  mrmSoftEvent::pend() const
     return (READ8(m_base, SwEventControl) & SW_EVT_PEND) != 0;
 }
 
+/* Caller must hold m_lock.
+ * Each write must wait for the previous code to be sent.  The control
+ * register is read once per code, which gives both enable and pend.
+ * Stops at the first code which can not be written.
+ */
+mrmSoftEvent::status_t mrmSoftEvent::writeCodes(const epicsUInt8 *codes, size_t n)
+{
+    for(size_t i = 0; i < n; i++) {
+        int count = 0;
+        epicsUInt8 ctrl;
+        while((ctrl = READ8(m_base, SwEventControl)) & SW_EVT_PEND) {
+            count++;
+            if(count == 50)
+                return statusDiscarded;
+        }
+        if(!(ctrl & SW_EVT_ENABLE))
+            return statusDisabled;
+
+        WRITE8(m_base, SwEventCode, codes[i]);
+    }
+    return statusOK;
+}
+
+void mrmSoftEvent::check(status_t status)
+{
+    switch(status) {
+    case statusOK:
+        break;
+    case statusDiscarded:
+        throw std::runtime_error("Software Event Discarded.");
+    case statusDisabled:
+        throw std::runtime_error("Software Event Disabled");
+    }
+}
+
 void mrmSoftEvent::setEvtCode(epicsUInt32 evtCode)
 {
     if(evtCode > 255)
         throw std::runtime_error("Event Code out of range. Valid range: 0 - 255.");
 
-    if(!enabled())
-        throw std::runtime_error("Software Event Disabled");
+    epicsUInt8 code = evtCode;
+    SCOPED_LOCK(m_lock);
+    check(writeCodes(&code, 1));
+}
 
-    int count = 0;
-    while(pend() == 1) {
-        count++;
-        if(count == 50)
-            throw std::runtime_error("Software Event Discarded.");
-    }
-    WRITE8(m_base, SwEventCode, evtCode);
+void mrmSoftEvent::setEvtCodes(const epicsUInt8 *codes, size_t n)
+{
+    SCOPED_LOCK(m_lock);
+    check(writeCodes(codes, n));
 }
 
 epicsUInt32 mrmSoftEvent::getEvtCode() const
@@ -55,6 +113,88 @@ epicsUInt32 mrmSoftEvent::getEvtCode() const
     return READ8(m_base, SwEventCode);
 }
 
+bool mrmSoftEvent::queueEvtCodes(const epicsUInt8 *codes, size_t n)
+{
+    if(n == 0)
+        return true;
+    else if(n > maxBurst)
+        throw std::out_of_range("Too many soft event codes");
+
+    if(m_queue.trySend((void*)codes, n) != 0) {
+        SCOPED_LOCK(m_lock);
+        m_dropped += n;
+        return false;
+    }
+    return true;
+}
+
+void mrmSoftEvent::queueEvtCode(epicsUInt32 evtCode)
+{
+    if(evtCode > 255)
+        throw std::runtime_error("Event Code out of range. Valid range: 0 - 255.");
+    else if(!enabled())
+        throw std::runtime_error("Software Event Disabled");
+
+    epicsUInt8 code = evtCode;
+    if(!queueEvtCodes(&code, 1))
+        throw std::runtime_error("Software Event queue full");
+}
+
+epicsUInt32 mrmSoftEvent::queueSent() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_sent;
+}
+
+epicsUInt32 mrmSoftEvent::queueDropped() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_dropped;
+}
+
+epicsUInt32 mrmSoftEvent::queueDepth() const
+{
+    return m_queue.pending();
+}
+
+epicsUInt32 mrmSoftEvent::queueStatus() const
+{
+    SCOPED_LOCK(m_lock);
+    return m_status;
+}
+
+void mrmSoftEvent::run()
+{
+    epicsUInt8 codes[maxBurst];
+
+    while(1) {
+        int n = m_queue.receive(codes, sizeof(codes));
+        if(n <= 0)
+            break;
+
+        /* Send everything already queued while holding the lock once.
+         * Bursts stay in queue order.
+         */
+        SCOPED_LOCK(m_lock);
+        do {
+            status_t status = writeCodes(codes, n);
+            if(status == statusOK) {
+                m_sent += n;
+            } else {
+                m_dropped += n;
+                if(status != m_status) // once, the Status property has the rest
+                    errlogPrintf("%s: Software Event %s\n", name().c_str(),
+                                 status == statusDisabled ? "Disabled" : "Discarded");
+            }
+            m_status = status;
+            n = m_queue.tryReceive(codes, sizeof(codes));
+        } while(n > 0);
+
+        if(n == 0)
+            break; // stop requested
+    }
+}
+
 
 /**
  * Construct mrfioc2 objects for linking to EPICS records
@@ -62,5 +202,74 @@ epicsUInt32 mrmSoftEvent::getEvtCode() const
 
 OBJECT_BEGIN(mrmSoftEvent) {
     OBJECT_PROP2("Enable",  &mrmSoftEvent::enabled,    &mrmSoftEvent::enable);
-    OBJECT_PROP2("EvtCode", &mrmSoftEvent::getEvtCode, &mrmSoftEvent::setEvtCode);
+    OBJECT_PROP2("EvtCode", &mrmSoftEvent::getEvtCode, &mrmSoftEvent::queueEvtCode);
+    OBJECT_PROP1("Sent",    &mrmSoftEvent::queueSent);
+    OBJECT_PROP1("Dropped", &mrmSoftEvent::queueDropped);
+    OBJECT_PROP1("Depth",   &mrmSoftEvent::queueDepth);
+    OBJECT_PROP1("Status",  &mrmSoftEvent::queueStatus);
 } OBJECT_END(mrmSoftEvent)
+
+
+/********** Benchmark  *******/
+static const iocshArg mrmSoftEventBenchArg0 = { "Count", iocshArgInt };
+static const iocshArg mrmSoftEventBenchArg1 = { "Burst", iocshArgInt };
+static const iocshArg * const mrmSoftEventBenchArgs[2] = { &mrmSoftEventBenchArg0, &mrmSoftEventBenchArg1 };
+static const iocshFuncDef mrmSoftEventBenchDef = { "mrmSoftEventBench", 2, mrmSoftEventBenchArgs };
+
+static void mrmSoftEventBenchFunc(const iocshArgBuf *args)
+{
+    if(args[0].ival <= 0) {
+        printf("Usage: mrmSoftEventBench Count [Burst]\n\t" \
+               "Count = number of bursts sent directly, then queued\n\t" \
+               "Burst = codes per burst (default 1, max 64)\n" \
+               "The registers are simulated in memory, never pending, so the\n" \
+               "software cost of both paths is measured without the hardware\n");
+        return;
+    }
+
+    const int count = args[0].ival;
+    const size_t burst = args[1].ival > 0 ? std::min((size_t)args[1].ival, (size_t)mrmSoftEvent::maxBurst) : 1;
+    const double total = (double)count*burst;
+
+    try {
+        if(mrf::Object::getObject("SoftEvtBench"))
+            throw std::runtime_error("Benchmark already running");
+
+        std::vector<epicsUInt8> regs(U8_SwEventCode+1, 0);
+        mrmSoftEvent evt("SoftEvtBench", &regs[0]);
+        evt.enable(true);
+
+        std::vector<epicsUInt8> codes(burst, 1);
+
+        double start = mrfMonotonicSeconds();
+        for(int i = 0; i < count; i++)
+            evt.setEvtCodes(&codes[0], burst);
+        double direct = mrfMonotonicSeconds() - start;
+
+        start = mrfMonotonicSeconds();
+        for(int i = 0; i < count; i++) {
+            while(!evt.queueEvtCodes(&codes[0], burst))
+                epicsThreadSleep(0.0);  // full, let the sender drain
+        }
+        double enqueue = mrfMonotonicSeconds() - start;
+
+        while(evt.queueSent() < total && mrfMonotonicSeconds() - start < 10.0)
+            epicsThreadSleep(0.001);
+        double queued = mrfMonotonicSeconds() - start;
+
+        printf("%d bursts of %u codes\n", count, (unsigned)burst);
+        printf(" direct: %.3f us per burst, %.0f codes/s\n", direct/count*1e6, total/direct);
+        printf(" queued: %.3f us per call, %.0f codes/s, queue full %u times\n",
+               enqueue/count*1e6, evt.queueSent()/queued, (unsigned)(evt.queueDropped()/burst));
+    } catch(std::exception& e) {
+        errlogPrintf("mrmSoftEventBench: %s\n", e.what());
+    }
+}
+
+extern "C" {
+static void mrmSoftEventRegistrar()
+{
+    iocshRegister(&mrmSoftEventBenchDef, mrmSoftEventBenchFunc);
+}
+epicsExportRegistrar(mrmSoftEventRegistrar);
+}
@@ -3,14 +3,38 @@
 
 #include <epicsTypes.h>
 #include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsMessageQueue.h>
 #include <shareLib.h>
 
 #include "mrf/object.h"
 
-class epicsShareClass mrmSoftEvent : public mrf::ObjectInst<mrmSoftEvent>
+/* Software event register.
+ *
+ * Codes can be written directly (setEvtCode(), setEvtCodes()) or queued
+ * (queueEvtCodes()) for a dedicated thread which sends them.  Queueing
+ * does not wait for the hardware.  Codes queued by one call are sent back
+ * to back and in order.  Calls from one thread are sent in call order.
+ * Errors of the sending thread are counted as dropped and reported by
+ * queueStatus().
+ *
+ * mrmSoftEventBench measures both paths against registers in memory.
+ */
+class epicsShareClass mrmSoftEvent : public mrf::ObjectInst<mrmSoftEvent>,
+                                     public epicsThreadRunable
 {
 public:
+    //! Max. number of codes queued by one call
+    enum {maxBurst=64};
+
+    enum status_t {
+        statusOK,
+        statusDiscarded,    // the previous code stayed pending
+        statusDisabled
+    };
+
     mrmSoftEvent(const std::string&, volatile epicsUInt8* const);
+    virtual ~mrmSoftEvent();
 
     /* locking done internally */
     virtual void lock() const{};
@@ -24,9 +48,38 @@ public:
     void setEvtCode(epicsUInt32);
     epicsUInt32 getEvtCode() const;
 
+    //! Write several codes in order, under one lock.  Pend and enable are read before each code.
+    void setEvtCodes(const epicsUInt8 *codes, size_t n);
+
+    /** @brief Queue codes for sending
+     @returns false if the queue is full, and the codes are dropped.
+     */
+    bool queueEvtCodes(const epicsUInt8 *codes, size_t n);
+    //! Queue one code.  Throws if disabled or the queue is full.
+    void queueEvtCode(epicsUInt32);
+
+    epicsUInt32 queueSent() const;
+    epicsUInt32 queueDropped() const;
+    epicsUInt32 queueDepth() const;
+    //! status_t of the last burst sent from the queue
+    epicsUInt32 queueStatus() const;
+
+    virtual void run();
+
 private:
+    status_t writeCodes(const epicsUInt8 *codes, size_t n);
+    static void check(status_t);
+
     volatile epicsUInt8* const m_base;
-    epicsMutex                 m_lock;
+    mutable epicsMutex         m_lock;
+
+    epicsMessageQueue          m_queue;
+    epicsThread                m_thread;
+
+    // Guarded by m_lock
+    epicsUInt32                m_sent;
+    epicsUInt32                m_dropped;
+    status_t                   m_status;
 };
 
 #endif // MRMSOFTEVENT_H
@@ -0,0 +1,379 @@
+
+#ifdef __linux__
+#  ifndef _GNU_SOURCE
+#    define _GNU_SOURCE
+#  endif
+#  include <sched.h>
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+#include <sstream>
+#include <map>
+#include <set>
+
+#include <errlog.h>
+#include <iocsh.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsGuard.h>
+#include <epicsStdio.h>
+
+#include "mrfCommon.h"
+
+#include <epicsExport.h>
+#include "mrmThreadTopology.h"
+
+namespace {
+
+const char * const roleNames[] = {"isr", "fifo", "dbuff"};
+
+struct topology_t {
+    epicsMutex lock;
+    typedef std::map<std::pair<std::string, int>, std::vector<unsigned> > cpus_t;
+    cpus_t cpus;
+    std::map<std::string, int> nodes;
+    std::set<mrmThreadStats*> threads;
+};
+
+topology_t *topology;
+epicsThreadOnceId topologyOnce = EPICS_THREAD_ONCE_INIT;
+
+void topologyInit(void*)
+{
+    topology = new topology_t;
+}
+
+topology_t& getTopology()
+{
+    epicsThreadOnce(&topologyOnce, &topologyInit, NULL);
+    return *topology;
+}
+
+int currentCPU()
+{
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+// NUMA node of a CPU, or -1
+int cpuNode(unsigned cpu)
+{
+#ifdef __linux__
+    for(int node=0; node<64; node++) {
+        char path[96];
+        epicsSnprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/node%d", cpu, node);
+        if(access(path, F_OK)==0)
+            return node;
+    }
+#endif
+    return -1;
+}
+
+std::string cpuList(const std::vector<unsigned>& cpus)
+{
+    std::ostringstream strm;
+    for(size_t i=0; i<cpus.size(); i++)
+        strm<<(i ? "," : "")<<cpus[i];
+    return strm.str();
+}
+
+} // namespace
+
+const char*
+mrmThreadTopology::roleName(role_t role)
+{
+    return role<=roleLast ? roleNames[role] : "?";
+}
+
+mrmThreadTopology::role_t
+mrmThreadTopology::roleByName(const std::string& name)
+{
+    for(int i=0; i<=roleLast; i++) {
+        if(name==roleNames[i])
+            return (role_t)i;
+    }
+    throw std::runtime_error("Unknown thread role '"+name+"', expected isr, fifo or dbuff");
+}
+
+void
+mrmThreadTopology::parseCPUs(const std::string& str, std::vector<unsigned>& cpus)
+{
+    cpus.clear();
+
+    std::istringstream strm(str);
+    std::string tok;
+    while(std::getline(strm, tok, ',')) {
+        if(tok.empty())
+            continue;
+
+        char *end;
+        unsigned long first = strtoul(tok.c_str(), &end, 10), last = first;
+        if(end==tok.c_str())
+            throw std::runtime_error("Invalid CPU list '"+str+"'");
+        if(*end=='-') {
+            const char *start = end+1;
+            last = strtoul(start, &end, 10);
+            if(end==start)
+                throw std::runtime_error("Invalid CPU list '"+str+"'");
+        }
+        if(*end!='\0' || last<first || last>=1024)
+            throw std::runtime_error("Invalid CPU list '"+str+"'");
+
+        for(unsigned long cpu=first; cpu<=last; cpu++)
+            cpus.push_back(cpu);
+    }
+}
+
+void
+mrmThreadTopology::setCPUs(const std::string& card, role_t role, const std::string& str)
+{
+    std::vector<unsigned> cpus;
+    parseCPUs(str, cpus);
+
+    topology_t& topo = getTopology();
+    epicsGuard<epicsMutex> g(topo.lock);
+    if(cpus.empty())
+        topo.cpus.erase(std::make_pair(card, int(role)));
+    else
+        topo.cpus[std::make_pair(card, int(role))] = cpus;
+}
+
+void
+mrmThreadTopology::getCPUs(const std::string& card, role_t role, std::vector<unsigned>& cpus)
+{
+    topology_t& topo = getTopology();
+    epicsGuard<epicsMutex> g(topo.lock);
+    topology_t::cpus_t::const_iterator it = topo.cpus.find(std::make_pair(card, int(role)));
+    if(it==topo.cpus.end())
+        cpus.clear();
+    else
+        cpus = it->second;
+}
+
+void
+mrmThreadTopology::setPCIDevice(const std::string& card,
+                                unsigned domain, unsigned bus,
+                                unsigned device, unsigned function)
+{
+#ifdef __linux__
+    char path[96];
+    epicsSnprintf(path, sizeof(path), "/sys/bus/pci/devices/%04x:%02x:%02x.%x/numa_node",
+                  domain, bus, device, function);
+
+    int node = -1;
+    FILE *fp = fopen(path, "r");
+    if(fp) {
+        if(fscanf(fp, "%d", &node)!=1)
+            node = -1;
+        fclose(fp);
+    }
+
+    topology_t& topo = getTopology();
+    epicsGuard<epicsMutex> g(topo.lock);
+    topo.nodes[card] = node;
+#endif
+}
+
+void
+mrmThreadTopology::pin(const std::string& card, role_t role)
+{
+    std::vector<unsigned> cpus;
+    getCPUs(card, role, cpus);
+    if(cpus.empty())
+        return;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for(size_t i=0; i<cpus.size(); i++) {
+        if(cpus[i]<CPU_SETSIZE)
+            CPU_SET(cpus[i], &set);
+    }
+
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if(err) {
+        errlogPrintf("%s: Can't bind %s thread to CPUs %s: %s\n", card.c_str(), roleName(role),
+                     cpuList(cpus).c_str(), strerror(err));
+        return;
+    }
+
+    int node = -1;
+    {
+        topology_t& topo = getTopology();
+        epicsGuard<epicsMutex> g(topo.lock);
+        std::map<std::string, int>::const_iterator it = topo.nodes.find(card);
+        if(it!=topo.nodes.end())
+            node = it->second;
+    }
+    if(node>=0) {
+        for(size_t i=0; i<cpus.size(); i++) {
+            int cnode = cpuNode(cpus[i]);
+            if(cnode>=0 && cnode!=node) {
+                errlogPrintf("%s: %s thread on CPU %u of node %d, the card is on node %d\n",
+                             card.c_str(), roleName(role), cpus[i], cnode, node);
+                break;
+            }
+        }
+    }
+#else
+    errlogPrintf("%s: CPU affinity of the %s thread is not supported on this OS\n",
+                 card.c_str(), roleName(role));
+#endif
+}
+
+void
+mrmThreadTopology::report(const char *card, int level)
+{
+    topology_t& topo = getTopology();
+    epicsGuard<epicsMutex> g(topo.lock);
+
+    if(level>0) {
+        for(topology_t::cpus_t::const_iterator it=topo.cpus.begin(); it!=topo.cpus.end(); ++it) {
+            if(card && it->first.first!=card)
+                continue;
+            printf("%s %s: CPUs %s\n", it->first.first.c_str(), roleName((role_t)it->first.second),
+                   cpuList(it->second).c_str());
+        }
+        for(std::map<std::string, int>::const_iterator it=topo.nodes.begin(); it!=topo.nodes.end(); ++it) {
+            if(card && it->first!=card)
+                continue;
+            printf("%s: PCI device on NUMA node %d\n", it->first.c_str(), it->second);
+        }
+    }
+
+    for(std::set<mrmThreadStats*>::const_iterator it=topo.threads.begin(); it!=topo.threads.end(); ++it) {
+        if(card && (*it)->card!=card)
+            continue;
+        (*it)->report(level);
+    }
+}
+
+mrmThreadStats::mrmThreadStats(const std::string& card, mrmThreadTopology::role_t role)
+    :card(card)
+    ,role(role)
+    ,m_thread(epicsThreadGetNameSelf())
+    ,m_last(mrfMonotonicSeconds())
+    ,m_waiting(false)
+    ,m_run(0.0)
+    ,m_wait(0.0)
+    ,m_runMax(0.0)
+    ,m_wakeups(0)
+    ,m_migrations(0)
+    ,m_cpu(currentCPU())
+{
+    topology_t& topo = getTopology();
+    epicsGuard<epicsMutex> g(topo.lock);
+    topo.threads.insert(this);
+}
+
+mrmThreadStats::~mrmThreadStats()
+{
+    topology_t& topo = getTopology();
+    epicsGuard<epicsMutex> g(topo.lock);
+    topo.threads.erase(this);
+}
+
+void
+mrmThreadStats::waitStart()
+{
+    double t = mrfMonotonicSeconds();
+
+    SCOPED_LOCK(m_lock);
+    double run = t-m_last;
+    m_run += run;
+    if(run>m_runMax)
+        m_runMax = run;
+    m_last = t;
+    m_waiting = true;
+}
+
+void
+mrmThreadStats::waitEnd()
+{
+    double t = mrfMonotonicSeconds();
+    int cpu = currentCPU();
+
+    SCOPED_LOCK(m_lock);
+    m_wait += t-m_last;
+    m_last = t;
+    m_waiting = false;
+    m_wakeups++;
+    if(cpu!=m_cpu) {
+        m_migrations++;
+        m_cpu = cpu;
+    }
+}
+
+void
+mrmThreadStats::report(int level) const
+{
+    SCOPED_LOCK(m_lock);
+
+    double total = m_run+m_wait;
+    printf("%s %-5s %-16s %s CPU %d, %u wakeups, %u migrations, busy %.2f %%\n",
+           card.c_str(), mrmThreadTopology::roleName(role), m_thread.c_str(),
+           m_waiting ? "waiting" : "running", m_cpu,
+           (unsigned)m_wakeups, (unsigned)m_migrations,
+           total>0.0 ? 100.0*m_run/total : 0.0);
+    if(level>0) {
+        printf("    run %.6f s, wait %.6f s, longest run %.1f us, mean run %.1f us\n",
+               m_run, m_wait, m_runMax*1e6, m_wakeups ? m_run*1e6/m_wakeups : 0.0);
+    }
+}
+
+/********** iocsh  *******/
+
+static const iocshArg mrmThreadAffinityArg0 = { "Card", iocshArgString };
+static const iocshArg mrmThreadAffinityArg1 = { "Role", iocshArgString };
+static const iocshArg mrmThreadAffinityArg2 = { "CPUs", iocshArgString };
+static const iocshArg * const mrmThreadAffinityArgs[3] = { &mrmThreadAffinityArg0, &mrmThreadAffinityArg1, &mrmThreadAffinityArg2 };
+static const iocshFuncDef mrmThreadAffinityDef = { "mrmThreadAffinity", 3, mrmThreadAffinityArgs };
+
+static void mrmThreadAffinityFunc(const iocshArgBuf *args)
+{
+    if(!args[0].sval || !args[1].sval) {
+        printf("Usage: mrmThreadAffinity Card Role CPUs\n\t" \
+               "Card = name of the card (eg.: EVR0)\n\t" \
+               "Role = isr, fifo (event FIFO) or dbuff (data buffer users)\n\t" \
+               "CPUs = eg. \"2\" or \"2-3,6\", empty to not bind\n" \
+               "Must be set before the card is set up\n");
+        return;
+    }
+
+    try {
+        mrmThreadTopology::setCPUs(args[0].sval, mrmThreadTopology::roleByName(args[1].sval),
+                                   args[2].sval ? args[2].sval : "");
+    } catch(std::exception& e) {
+        errlogPrintf("mrmThreadAffinity %s: %s\n", args[0].sval, e.what());
+    }
+}
+
+static const iocshArg mrmThreadReportArg0 = { "Card", iocshArgString };
+static const iocshArg mrmThreadReportArg1 = { "Level", iocshArgInt };
+static const iocshArg * const mrmThreadReportArgs[2] = { &mrmThreadReportArg0, &mrmThreadReportArg1 };
+static const iocshFuncDef mrmThreadReportDef = { "mrmThreadReport", 2, mrmThreadReportArgs };
+
+static void mrmThreadReportFunc(const iocshArgBuf *args)
+{
+    const char *card = args[0].sval;
+    if(card && (card[0]=='\0' || strcmp(card, "*")==0))
+        card = NULL;
+    mrmThreadTopology::report(card, args[1].ival);
+}
+
+extern "C" {
+static void mrmThreadTopologyRegistrar()
+{
+    iocshRegister(&mrmThreadAffinityDef, mrmThreadAffinityFunc);
+    iocshRegister(&mrmThreadReportDef, mrmThreadReportFunc);
+}
+epicsExportRegistrar(mrmThreadTopologyRegistrar);
+}
@@ -0,0 +1,88 @@
+#ifndef MRMTHREADTOPOLOGY_H
+#define MRMTHREADTOPOLOGY_H
+
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <shareLib.h>
+
+/* CPU placement of the worker threads of each card.
+ *
+ * The CPUs of a role of a card are set with mrmThreadAffinity before the
+ * card is set up.  Each thread calls pin() itself when it starts, so this
+ * also works for threads created by other modules (eg. the PCI interrupt
+ * thread of devLib2).  Roles without CPUs keep the affinity they inherit.
+ *
+ * On Linux the NUMA node of the PCI device is compared with the nodes of
+ * the CPUs, and a mismatch is reported.  Memory follows the first-touch
+ * policy of the kernel, so start the IOC with eg. "numactl --cpunodebind"
+ * to allocate the card structures on the same node.
+ */
+class epicsShareClass mrmThreadTopology {
+public:
+    enum role_t {
+        roleISR=0,
+        roleFIFO,
+        roleDataBuffer,
+        roleLast=roleDataBuffer
+    };
+
+    static const char* roleName(role_t);
+    //! @throws std::runtime_error for an unknown name
+    static role_t roleByName(const std::string&);
+
+    /** @brief Parse a CPU list like "1", "2-3" or "0,4-5"
+     @throws std::runtime_error
+     */
+    static void parseCPUs(const std::string&, std::vector<unsigned>&);
+
+    //! Set the CPUs of a role of a card.  An empty list removes them.
+    static void setCPUs(const std::string& card, role_t, const std::string& cpus);
+    static void getCPUs(const std::string& card, role_t, std::vector<unsigned>&);
+
+    //! Remember the NUMA node of the PCI device of a card (Linux only)
+    static void setPCIDevice(const std::string& card,
+                             unsigned domain, unsigned bus,
+                             unsigned device, unsigned function);
+
+    //! Bind the calling thread to the CPUs of the role, if any
+    static void pin(const std::string& card, role_t);
+
+    static void report(const char *card, int level);
+};
+
+/* Run and wait time of a worker thread, created on the stack of the thread.
+ * The thread calls waitStart() before blocking for work, and waitEnd()
+ * when it is woken.  Listed by mrmThreadReport while the thread runs.
+ */
+class epicsShareClass mrmThreadStats {
+public:
+    mrmThreadStats(const std::string& card, mrmThreadTopology::role_t);
+    ~mrmThreadStats();
+
+    void waitStart();
+    void waitEnd();
+
+    void report(int level) const;
+
+    const std::string card;
+    const mrmThreadTopology::role_t role;
+
+private:
+    mutable epicsMutex m_lock;
+
+    std::string m_thread;
+    double m_last;      // time of the last waitStart() or waitEnd()
+    bool   m_waiting;
+    double m_run, m_wait, m_runMax;
+    epicsUInt32 m_wakeups;
+    epicsUInt32 m_migrations;
+    int    m_cpu;       // -1 if not known
+
+    mrmThreadStats(const mrmThreadStats&);
+    mrmThreadStats& operator=(const mrmThreadStats&);
+};
+
+#endif // MRMTHREADTOPOLOGY_H
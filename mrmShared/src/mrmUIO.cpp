@@ -0,0 +1,91 @@
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <dirent.h>
+#  include <sys/mman.h>
+#endif
+
+#include <errlog.h>
+#include <epicsStdio.h>
+
+#include "mrmUIO.h"
+
+/* Must match MAX_UIO_MAPS of the kernel */
+#define UIO_MAXMAPS 5
+
+namespace mrmUIO {
+
+#ifdef __linux__
+
+std::string findDevice(unsigned domain, unsigned bus,
+                       unsigned device, unsigned function)
+{
+    char path[128];
+    epicsSnprintf(path, sizeof(path), "/sys/bus/pci/devices/%04x:%02x:%02x.%x/uio",
+                  domain, bus, device, function);
+
+    std::string uio;
+    DIR *dir = opendir(path);
+    if(!dir)
+        return uio;
+    while(struct dirent *ent = readdir(dir)) {
+        if(strncmp(ent->d_name, "uio", 3)==0) {
+            uio = ent->d_name;
+            break;
+        }
+    }
+    closedir(dir);
+    return uio;
+}
+
+int findMap(const std::string& uio, const char *name)
+{
+    for(int i=0; i<UIO_MAXMAPS; i++) {
+        char path[128], buf[64];
+        epicsSnprintf(path, sizeof(path), "/sys/class/uio/%s/maps/map%d/name", uio.c_str(), i);
+
+        FILE *fp = fopen(path, "r");
+        if(!fp)
+            break;
+        bool found = fgets(buf, sizeof(buf), fp) && strncmp(buf, name, strlen(name))==0;
+        fclose(fp);
+        if(found)
+            return i;
+    }
+    return -1;
+}
+
+void* mapPage(const std::string& name, const std::string& uio, int map,
+              size_t len, bool writefd, int& fd)
+{
+    std::string dev("/dev/"+uio);
+    fd = open(dev.c_str(), (writefd ? O_RDWR : O_RDONLY)|O_CLOEXEC);
+    if(fd<0) {
+        errlogPrintf("%s: Can't open %s\n", name.c_str(), dev.c_str());
+        return NULL;
+    }
+
+    // UIO selects the map with the offset
+    void *mem = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, map*sysconf(_SC_PAGESIZE));
+    if(mem==MAP_FAILED) {
+        errlogPrintf("%s: Can't map %d of %s\n", name.c_str(), map, dev.c_str());
+        close(fd);
+        fd = -1;
+        return NULL;
+    }
+    return mem;
+}
+
+#else /* __linux__ */
+
+std::string findDevice(unsigned, unsigned, unsigned, unsigned) {return std::string();}
+int findMap(const std::string&, const char *) {return -1;}
+void* mapPage(const std::string&, const std::string&, int, size_t, bool, int& fd) {fd = -1; return NULL;}
+
+#endif /* __linux__ */
+
+} // namespace mrmUIO
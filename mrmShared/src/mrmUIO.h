@@ -0,0 +1,28 @@
+#ifndef MRMUIO_H
+#define MRMUIO_H
+
+#include <string>
+
+/* Lookup of the pages exported by the uio_mrf kernel module (Linux).
+ * Not installed, only for use inside mrmShared.
+ */
+namespace mrmUIO {
+
+//! The uioN device of a PCI device, or an empty string
+std::string findDevice(unsigned domain, unsigned bus,
+                       unsigned device, unsigned function);
+
+//! Index of the UIO map with the given name, or -1
+int findMap(const std::string& uio, const char *name);
+
+/** @brief Map a page exported by the kernel module read-only
+ *
+ @param fd The open file descriptor of /dev/uioN is stored here
+ @returns NULL if the map does not exist or can not be mapped
+ */
+void* mapPage(const std::string& name, const std::string& uio, int map,
+              size_t len, bool writefd, int& fd);
+
+} // namespace mrmUIO
+
+#endif // MRMUIO_H
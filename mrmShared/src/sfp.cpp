@@ -1,230 +1,410 @@
 
 #include <stdio.h>
+#include <string.h>
+#include <set>
 
+#include <epicsThread.h>
+#include <epicsEvent.h>
 #include <epicsExport.h>
 
 #include "mrf/object.h"
 #include "sfp.h"
 
+#include "mrfCommon.h"
 #include "mrfCommonIO.h"
 
 #include "sfpinfo.h"
-#undef CALLBACK
 
-#define SFP_UPDATE_DELAY 10
+extern "C" {
+/* Interval between reads of the SFP diagnostics (temperature,
+ * power and VCC) by the shared poller thread.
+ *
+ * Set to 0.0 to disable
+ */
+double mrmSFPPollPeriod = 10.0; /* sec */
+
+epicsExportAddress(double,mrmSFPPollPeriod);
+}
 
 static const char nomod[] = "Could not read SFP data";
 
-epicsInt16 SFP::read16(unsigned int offset) const
+/* Only the first part of the identification block is decoded */
+#define SFP_ident_size 128
+
+/* First 4 byte word holding the diagnostics (temperature...status) */
+#define SFP_ddm_start  SFP_temp
+#define SFP_ddm_size   16
+
+namespace {
+
+/* All SFP modules are polled by a single low priority thread
+ * instead of one callback per module.
+ */
+struct SFPPoller : public epicsThreadRunable
+{
+    epicsMutex lock;
+    epicsEvent wakeup;
+    typedef std::set<SFP*> sfps_t;
+    sfps_t sfps;
+    epicsThread worker;
+
+    SFPPoller()
+        :worker(*this, "SFPPoll",
+                epicsThreadGetStackSize(epicsThreadStackSmall),
+                epicsThreadPriorityLow)
+    {
+        worker.start();
+    }
+    virtual ~SFPPoller() {}
+
+    void add(SFP* sfp)
+    {
+        SCOPED_LOCK(lock);
+        sfps.insert(sfp);
+    }
+    void remove(SFP* sfp)
+    {
+        SCOPED_LOCK(lock);
+        sfps.erase(sfp);
+    }
+
+    virtual void run()
+    {
+        while(true) {
+            double period=mrmSFPPollPeriod;
+            if(period>0.0) {
+                wakeup.wait(period);
+                SCOPED_LOCK(lock);
+                for(sfps_t::const_iterator it=sfps.begin(); it!=sfps.end(); ++it)
+                    (*it)->updateNow(false);
+            } else {
+                // disabled, check again later
+                wakeup.wait(1.0);
+            }
+        }
+    }
+
+    static SFPPoller* instance;
+    static epicsThreadOnceId once;
+    static void create(void*) { instance=new SFPPoller; }
+    static SFPPoller& get()
+    {
+        epicsThreadOnce(&once, &create, 0);
+        return *instance;
+    }
+};
+
+SFPPoller* SFPPoller::instance;
+epicsThreadOnceId SFPPoller::once = EPICS_THREAD_ONCE_INIT;
+
+// read I/O 4 bytes at a time to preserve endianness
+// for both PCI and VME.  'buf' need not be aligned.
+void readBlock(volatile unsigned char* base, unsigned int offset,
+               epicsUInt8* buf, unsigned int len)
+{
+    for(unsigned int i=0; i<len/4; i++) {
+        epicsUInt32 word = be_ioread32(base + offset + i*4);
+        memcpy(buf + i*4, &word, 4);
+    }
+}
+
+epicsUInt16 get16(const epicsUInt8* buf)
+{
+    return (epicsUInt16(buf[0])<<8) | buf[1];
+}
+
+/* Limits used when the module does not provide thresholds.
+ * Same as the alarm limits of sfp.template, in raw units
+ * (1/256 C and 0.1 uW).  High alarm, low alarm, high warning, low warning.
+ */
+const epicsInt32 defTempLimits[4] = {85*256, -32768, 80*256, -32768};
+const epicsInt32 defTxLimits[4]   = {65535, 1800, 10000, 1800};
+const epicsInt32 defRxLimits[4]   = {65535, 1000, 6000, 1000};
+
+epicsUInt16 grade(epicsInt32 val, const epicsInt32 *lim)
 {
-    epicsUInt16 val = buffer[offset];
-    val<<=8;
-    val |= buffer[offset+1];
-    return val;
+    if(val>=lim[0] || val<=lim[1])
+        return MAJOR_ALARM;
+    else if(val>=lim[2] || val<=lim[3])
+        return MINOR_ALARM;
+    return NO_ALARM;
 }
 
+} // namespace
+
 SFP::SFP(const std::string &n, volatile unsigned char *reg)
     :mrf::ObjectInst<SFP>(n)
     ,base(reg)
-    ,buffer(SFPMEM_SIZE)
-    ,temp_buffer(SFPMEM_SIZE)
     ,readout_valid(false)
+    ,m_linkSpeed(-1)
+    ,m_bitRateUpper(0xFFFF)
+    ,m_bitRateLower(0xFFFF)
+    ,m_linkLength_9um(0xFFFFFFFF)
+    ,m_linkLength_50um(0xFFFF)
+    ,m_linkLength_62um(0xFFFF)
+    ,m_linkLength_copper(0xFFFF)
+    ,m_ddmLimits(false)
 {
-    updateNow();
+    memcpy(m_tempLimits, defTempLimits, sizeof(m_tempLimits));
+    memcpy(m_txLimits, defTxLimits, sizeof(m_txLimits));
+    memcpy(m_rxLimits, defRxLimits, sizeof(m_rxLimits));
 
-    updateCallback.timer = 0;
-    callbackSetCallback(&SFP::updateTask, &updateCallback);
-    callbackSetPriority(priorityLow, &updateCallback);
-    callbackSetUser(this, &updateCallback);
+    updateNow();
 
     /* Check if type of serial transceiver is SFP */
     if(readout_valid){
         printf("Found %s SFP transceiver\n", n.c_str());
     }else{
+        epicsUInt8 id[4];
+        readBlock(base, 0, id, sizeof(id));
         fprintf(stderr, "Could not read SFP transceiver type. %s readouts INVALID!\n\tFirst 4 bytes of SFP EEPROM: %02x %02x %02x %02x\n",
-                n.c_str(), buffer[0],buffer[1],buffer[2],buffer[3]);
+                n.c_str(), id[0],id[1],id[2],id[3]);
     }
 }
 
-SFP::~SFP() {}
+SFP::~SFP()
+{
+    SFPPoller::get().remove(this);
+}
 
-void
-SFP::updateTask(CALLBACK *pCallback) {
-    void* pVoid;
-    callbackGetUser(pVoid, pCallback);
-    SFP* sfp = (SFP*)pVoid;
+void SFP::startUpdate(){
+    SFPPoller::get().add(this);
+}
 
-    sfp->updateNow();
-    callbackRequestDelayed(&sfp->updateCallback, SFP_UPDATE_DELAY);
+// Caller must hold guard
+void SFP::readIdent()
+{
+    epicsUInt8 buf[SFP_ident_size];
+    readBlock(base, 0, buf, sizeof(buf));
+
+    readout_valid = buf[SFP_type_offset]==SFP_type;  // we consider readout as valid if type 'SFP transceiver' can be read from the SFP EEPROM
+
+    if(readout_valid) {
+        const char *cbuf=(const char*)buf;
+        m_vendorName.assign(cbuf+SFP_vendor_name, 16);
+        m_vendorPart.assign(cbuf+SFP_part_num, 16);
+        m_vendorRev.assign(cbuf+SFP_part_rev, 4);
+        m_serial.assign(cbuf+SFP_serial, 16);
+
+        m_manuDate="20XX/XX";
+        m_manuDate[2]=buf[SFP_man_date];
+        m_manuDate[3]=buf[SFP_man_date+1];
+        m_manuDate[5]=buf[SFP_man_date+2];
+        m_manuDate[6]=buf[SFP_man_date+3];
+
+        m_linkSpeed = buf[SFP_linkrate] * 100.0; // Gives MBits/s
+        m_bitRateUpper = buf[SFP_bitRateMargin_upper];    // in %
+        m_bitRateLower = buf[SFP_bitRateMargin_lower];    // in %
+        m_linkLength_9um = (epicsUInt32)buf[SFP_linkLength_9uminkm] * 1000    // km
+                         + (epicsUInt32)buf[SFP_linkLength_9umin100m] * 100;  // m
+        m_linkLength_50um = (epicsUInt16)buf[SFP_linkLength_50umin10m] * 10;  // in m
+        m_linkLength_62um = (epicsUInt16)buf[SFP_linkLength_62umin10m] * 10;  // in m
+        m_linkLength_copper = buf[SFP_linkLength_copper];    // in m
+
+        // Use the thresholds of the module, unless it has none
+        m_ddmLimits = false;
+        if(buf[SFP_diagType] & SFP_diagType_DDM) {
+            epicsUInt8 thr[SFP_thresholds_size];
+            readBlock(base, SFP_thresholds, thr, sizeof(thr));
+            for(unsigned int i=0; i<sizeof(thr) && !m_ddmLimits; i++)
+                m_ddmLimits = thr[i]!=0;
+
+            for(unsigned int i=0; i<4 && m_ddmLimits; i++) {
+                m_tempLimits[i] = (epicsInt16)get16(&thr[SFP_temp_thresholds-SFP_thresholds+2*i]);
+                m_txLimits[i] = get16(&thr[SFP_tx_pwr_thresholds-SFP_thresholds+2*i]);
+                m_rxLimits[i] = get16(&thr[SFP_rx_pwr_thresholds-SFP_thresholds+2*i]);
+            }
+        }
+        if(!m_ddmLimits) {
+            memcpy(m_tempLimits, defTempLimits, sizeof(m_tempLimits));
+            memcpy(m_txLimits, defTxLimits, sizeof(m_txLimits));
+            memcpy(m_rxLimits, defRxLimits, sizeof(m_rxLimits));
+        }
+    } else {
+        m_vendorName=m_vendorPart=m_vendorRev=m_serial=m_manuDate=nomod;
+        m_linkSpeed = -1;
+        m_bitRateUpper = m_bitRateLower = 0xFFFF;
+        m_linkLength_9um = 0xFFFFFFFF;
+        m_linkLength_50um = m_linkLength_62um = m_linkLength_copper = 0xFFFF;
+    }
+
+    m_ident.update(m_ident.value()+1);
 }
 
-void SFP::startUpdate(){
-    callbackRequest(&updateCallback);
+void SFP::updateNow(bool full)
+{
+    SCOPED_LOCK(guard);
+
+    if(!full) {
+        // Re-read the identification block only if the module was
+        // (un)plugged.  Detected by change of the type byte.
+        epicsUInt8 id[4];
+        readBlock(base, 0, id, sizeof(id));
+        bool present = id[SFP_type_offset]==SFP_type;
+        full = present!=readout_valid;
+    }
+    if(full)
+        readIdent();
+
+    epicsUInt8 ddm[SFP_ddm_size];
+    readBlock(base, SFP_ddm_start, ddm, sizeof(ddm));
+
+    m_temp.update((epicsInt16)get16(&ddm[SFP_temp-SFP_ddm_start]));
+    m_vcc.update(get16(&ddm[SFP_vccPower-SFP_ddm_start]));
+    m_txPower.update((epicsInt16)get16(&ddm[SFP_tx_pwr-SFP_ddm_start]));
+    m_rxPower.update((epicsInt16)get16(&ddm[SFP_rx_pwr-SFP_ddm_start]));
+    m_status.update(ddm[SFP_status-SFP_ddm_start]);
+
+    evaluate();
 }
 
-void SFP::updateNow(bool)
+// Caller must hold guard
+void SFP::evaluate()
 {
-    /* read I/O 4 bytes at a time to preserve endianness
-     * for both PCI and VME
-     */
-    epicsUInt32* p32=(epicsUInt32*)&temp_buffer[0];
-
-    for(unsigned int i=0; i<SFPMEM_SIZE/4; i++)
-        p32[i] = be_ioread32(base+ i*4);
-
-    guard.lock();
-    buffer.swap(temp_buffer);
-    readout_valid = buffer[SFP_type_offset]==SFP_type;  // we consider readout as valid if type 'SFP transceiver' can be read from the SFP EEPROM
-    guard.unlock();
+    if(!readout_valid) {
+        m_severity.update(INVALID_ALARM);
+        m_severityRX.update(INVALID_ALARM);
+        return;
+    }
+
+    // power is unsigned, temperature signed
+    epicsUInt16 sevT = grade(m_temp.value(), m_tempLimits);
+    epicsUInt16 sevTX = grade((epicsUInt16)m_txPower.value(), m_txLimits);
+
+    m_severity.update(sevT > sevTX ? sevT : sevTX);
+    m_severityRX.update(grade((epicsUInt16)m_rxPower.value(), m_rxLimits));
+}
+
+epicsUInt16 SFP::severity() const
+{
+    SCOPED_LOCK(guard);
+    return m_severity.value();
+}
+
+epicsUInt16 SFP::severityRX() const
+{
+    SCOPED_LOCK(guard);
+    return m_severityRX.value();
 }
 
 double SFP::linkSpeed() const
 {
-    if(!readout_valid){
-        return -1;
-    }
-    return buffer[SFP_linkrate] * 100.0; // Gives MBits/s
+    SCOPED_LOCK(guard);
+    return m_linkSpeed;
 }
 
 double SFP::temperature() const
 {
+    SCOPED_LOCK(guard);
     if(!readout_valid){
         return -40;
     }
-    return read16(SFP_temp) / 256.0; // Gives degrees C
+    return m_temp.value() / 256.0; // Gives degrees C
 }
 
 double SFP::powerTX() const
 {
+    SCOPED_LOCK(guard);
     if(!readout_valid){
         return -1e-6;
     }
-    return read16(SFP_tx_pwr) * 0.1e-6; // Gives Watts
+    return m_txPower.value() * 0.1e-6; // Gives Watts
 }
 
 double SFP::powerRX() const
 {
+    SCOPED_LOCK(guard);
     if(!readout_valid){
         return -1e-6;
     }
-    return read16(SFP_rx_pwr) * 0.1e-6; // Gives Watts
+    return m_rxPower.value() * 0.1e-6; // Gives Watts
 }
 
 std::string SFP::vendorName() const
 {
-    if(!readout_valid) {
-        return std::string(nomod);
-    }
-    buffer_t::const_iterator it=buffer.begin()+SFP_vendor_name;
-    return std::string(it, it+16);
+    SCOPED_LOCK(guard);
+    return m_vendorName;
 }
 
 std::string SFP::vendorPart() const
 {
-    if(!readout_valid) {
-        return std::string(nomod);
-    }
-    buffer_t::const_iterator it=buffer.begin()+SFP_part_num;
-    return std::string(it, it+16);
+    SCOPED_LOCK(guard);
+    return m_vendorPart;
 }
 
 std::string SFP::vendorRev() const
 {
-    if(!readout_valid) {
-        return std::string(nomod);
-    }
-    buffer_t::const_iterator it=buffer.begin()+SFP_part_rev;
-    return std::string(it, it+4);
+    SCOPED_LOCK(guard);
+    return m_vendorRev;
 }
 
 std::string SFP::serial() const
 {
-    if(!readout_valid) {
-        return std::string(nomod);
-    }
-    buffer_t::const_iterator it=buffer.begin()+SFP_serial;
-    return std::string(it, it+16);
+    SCOPED_LOCK(guard);
+    return m_serial;
 }
 
 std::string SFP::manuDate() const
 {
-    if(!readout_valid) {
-        return std::string(nomod);
-    }
-    std::string ret("20XX/XX");
-    ret[2]=buffer[SFP_man_date];
-    ret[3]=buffer[SFP_man_date+1];
-    ret[5]=buffer[SFP_man_date+2];
-    ret[6]=buffer[SFP_man_date+3];
-    return ret;
+    SCOPED_LOCK(guard);
+    return m_manuDate;
 }
 
 epicsUInt16 SFP::getStatus() const{
+    SCOPED_LOCK(guard);
     if(!readout_valid){
         return 0xFFFF;
     }
-    return (epicsUInt16)buffer[SFP_status];
+    return m_status.value();
 }
 
 double SFP::getVCCPower() const{
+    SCOPED_LOCK(guard);
     if(!readout_valid){
         return -1e-6;
     }
-    return (epicsUInt16)read16(SFP_vccPower) * 100e-6; // Gives Volts
+    return m_vcc.value() * 100e-6; // Gives Volts
 }
 
 epicsUInt16 SFP::getBitRateUpper() const{
-    if(!readout_valid){
-        return 0xFFFF;
-    }
-    return (epicsUInt16)buffer[SFP_bitRateMargin_upper];    // in %
+    SCOPED_LOCK(guard);
+    return m_bitRateUpper;
 }
 
 epicsUInt16 SFP::getBitRateLower() const{
-    if(!readout_valid){
-        return 0xFFFF;
-    }
-    return (epicsUInt16)buffer[SFP_bitRateMargin_lower];    // in %
+    SCOPED_LOCK(guard);
+    return m_bitRateLower;
 }
 
 epicsUInt32 SFP::getLinkLength_9um() const{
-    epicsUInt32 length;
-
-    if(!readout_valid){
-        return 0xFFFFFFFF;
-    }
-
-    length = (epicsUInt32)buffer[SFP_linkLength_9uminkm] * 1000;    // km
-    length += (epicsUInt32)buffer[SFP_linkLength_9umin100m] * 100;  // m
-
-    return length; // in meters
+    SCOPED_LOCK(guard);
+    return m_linkLength_9um; // in meters
 }
 
 epicsUInt16 SFP::getLinkLength_50um() const{
-    if(!readout_valid){
-        return 0xFFFF;
-    }
-    return (epicsUInt16)buffer[SFP_linkLength_50umin10m] * 10;    // in m
+    SCOPED_LOCK(guard);
+    return m_linkLength_50um;
 }
 
 epicsUInt16 SFP::getLinkLength_62um() const{
-    if(!readout_valid){
-        return 0xFFFF;
-    }
-    return (epicsUInt16)buffer[SFP_linkLength_62umin10m] * 10;    // in m
+    SCOPED_LOCK(guard);
+    return m_linkLength_62um;
 }
 
 epicsUInt16 SFP::getLinkLength_copper() const{
-    if(!readout_valid){
-        return 0xFFFF;
-    }
-    return (epicsUInt16)buffer[SFP_linkLength_copper];    // in m
+    SCOPED_LOCK(guard);
+    return m_linkLength_copper;
 }
 
 void SFP::report() const
 {
+    bool valid;
+    {
+        SCOPED_LOCK(guard);
+        valid=readout_valid;
+    }
     printf("SFP tranceiver information is ");
-    if(readout_valid) printf("valid\n");
+    if(valid) printf("valid\n");
     else printf("invalid\n");
     printf( "\tTemp: %.1f C\n"
             "\tLink: %.1f MBits/s\n"
@@ -265,23 +445,44 @@ void SFP::reportMore() const{
 OBJECT_BEGIN(SFP) {
 
     OBJECT_PROP1("Vendor", &SFP::vendorName);
+    OBJECT_PROP1("Vendor", &SFP::identChanged);
     OBJECT_PROP1("Part", &SFP::vendorPart);
+    OBJECT_PROP1("Part", &SFP::identChanged);
     OBJECT_PROP1("Rev", &SFP::vendorRev);
+    OBJECT_PROP1("Rev", &SFP::identChanged);
     OBJECT_PROP1("Serial", &SFP::serial);
+    OBJECT_PROP1("Serial", &SFP::identChanged);
     OBJECT_PROP1("Date", &SFP::manuDate);
+    OBJECT_PROP1("Date", &SFP::identChanged);
 
     OBJECT_PROP1("Temperature", &SFP::temperature);
+    OBJECT_PROP1("Temperature", &SFP::temperatureChanged);
     OBJECT_PROP1("Link Speed", &SFP::linkSpeed);
+    OBJECT_PROP1("Link Speed", &SFP::identChanged);
     OBJECT_PROP1("Power TX", &SFP::powerTX);
+    OBJECT_PROP1("Power TX", &SFP::powerTXChanged);
     OBJECT_PROP1("Power RX", &SFP::powerRX);
+    OBJECT_PROP1("Power RX", &SFP::powerRXChanged);
 
     OBJECT_PROP1("Status", &SFP::getStatus);
+    OBJECT_PROP1("Status", &SFP::statusChanged);
+    OBJECT_PROP1("Severity", &SFP::severity);
+    OBJECT_PROP1("Severity", &SFP::severityChanged);
+    OBJECT_PROP1("Severity RX", &SFP::severityRX);
+    OBJECT_PROP1("Severity RX", &SFP::severityRXChanged);
     OBJECT_PROP1("Power VCC", &SFP::getVCCPower);
+    OBJECT_PROP1("Power VCC", &SFP::VCCPowerChanged);
     OBJECT_PROP1("BitRate Upper", &SFP::getBitRateUpper);
+    OBJECT_PROP1("BitRate Upper", &SFP::identChanged);
     OBJECT_PROP1("BitRate Lower", &SFP::getBitRateLower);
+    OBJECT_PROP1("BitRate Lower", &SFP::identChanged);
     OBJECT_PROP1("LinkLength 9um", &SFP::getLinkLength_9um);
+    OBJECT_PROP1("LinkLength 9um", &SFP::identChanged);
     OBJECT_PROP1("LinkLength 50um", &SFP::getLinkLength_50um);
+    OBJECT_PROP1("LinkLength 50um", &SFP::identChanged);
     OBJECT_PROP1("LinkLength 62um", &SFP::getLinkLength_62um);
+    OBJECT_PROP1("LinkLength 62um", &SFP::identChanged);
     OBJECT_PROP1("LinkLength copper", &SFP::getLinkLength_copper);
+    OBJECT_PROP1("LinkLength copper", &SFP::identChanged);
 
 } OBJECT_END(SFP)
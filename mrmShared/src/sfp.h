@@ -6,19 +6,54 @@
 
 #include <epicsMutex.h>
 #include <epicsTypes.h>
+#include <dbScan.h>
 #include <shareLib.h>
-#include "callback.h"
 
 #include "mrf/object.h"
-#undef CALLBACK
+#include "mrf/changeScan.h"
 
+/** @brief SFP transceiver EEPROM and digital diagnostics (DDM)
+ *
+ * The identification block is static and is read once when the module
+ * is found.  The DDM words are refreshed by a poller thread shared by
+ * all SFP instances (see mrmSFPPollPeriod).  Values are decoded when read
+ * and cached as typed fields.  I/O Intr scans are only requested when a
+ * value changed.
+ */
 class epicsShareClass SFP : public mrf::ObjectInst<SFP> {
     volatile unsigned char* base;
-    typedef std::vector<epicsUInt8> buffer_t;
-    buffer_t buffer;
-    buffer_t temp_buffer;
     mutable epicsMutex guard;
-    epicsInt16 read16(unsigned int) const;
+
+    // Guarded by guard
+
+    bool readout_valid;
+
+    // Identification block, decoded once
+    std::string m_vendorName, m_vendorPart, m_vendorRev, m_serial, m_manuDate;
+    double m_linkSpeed;
+    epicsUInt16 m_bitRateUpper, m_bitRateLower;
+    epicsUInt32 m_linkLength_9um;
+    epicsUInt16 m_linkLength_50um, m_linkLength_62um, m_linkLength_copper;
+
+    // Diagnostics, raw words as read from the EEPROM
+    mrf::changeScan<epicsInt16> m_temp;
+    mrf::changeScan<epicsInt16> m_txPower;
+    mrf::changeScan<epicsInt16> m_rxPower;
+    mrf::changeScan<epicsUInt16> m_vcc;
+    mrf::changeScan<epicsUInt8> m_status;
+    // incremented each time the identification block is (re)read
+    mrf::changeScan<epicsUInt32> m_ident;
+
+    // Alarm limits: high alarm, low alarm, high warning, low warning.
+    // From the module when it implements DDM, defaults otherwise.
+    epicsInt32 m_tempLimits[4], m_txLimits[4], m_rxLimits[4];
+    bool m_ddmLimits;
+    // Severity (NO_ALARM ... INVALID_ALARM) of temperature and TX power, and of RX power
+    mrf::changeScan<epicsUInt16> m_severity;
+    mrf::changeScan<epicsUInt16> m_severityRX;
+
+    void readIdent();
+    void evaluate();
 public:
     SFP(const std::string& n, volatile unsigned char* reg);
     virtual ~SFP();
@@ -26,7 +61,10 @@ public:
     virtual void lock() const{guard.lock();};
     virtual void unlock() const{guard.unlock();};
 
-    void updateNow(bool=true);
+    /** @brief Read diagnostics now
+     @param full Also re-read the identification block
+     */
+    void updateNow(bool full=true);
 
     double linkSpeed() const;
     double temperature() const;
@@ -51,19 +89,27 @@ public:
     epicsUInt16 getLinkLength_62um() const;
     epicsUInt16 getLinkLength_copper() const;
 
-    /**
-     * @brief updateTask updates a buffer which other functions read from.
+    /** @brief Severity of the last diagnostics, compared with the alarm and warning
+     * thresholds of the module.  INVALID_ALARM if no module is present.
+     * severity() covers temperature and TX power, severityRX() the RX power.
      */
-    static void updateTask(CALLBACK *pCallback);
-    CALLBACK updateCallback;
+    epicsUInt16 severity() const;
+    epicsUInt16 severityRX() const;
+
+    IOSCANPVT identChanged() const{return m_ident.scan();}
+    IOSCANPVT temperatureChanged() const{return m_temp.scan();}
+    IOSCANPVT powerTXChanged() const{return m_txPower.scan();}
+    IOSCANPVT powerRXChanged() const{return m_rxPower.scan();}
+    IOSCANPVT VCCPowerChanged() const{return m_vcc.scan();}
+    IOSCANPVT statusChanged() const{return m_status.scan();}
+    IOSCANPVT severityChanged() const{return m_severity.scan();}
+    IOSCANPVT severityRXChanged() const{return m_severityRX.scan();}
 
     /**
      * @brief startUpdate is called from the init hook (evgInit.cpp / evrIocsh.cpp) after the callback stack has been initialized.
+     * Adds this SFP to the shared poller.
      */
     void startUpdate();
-
-private:
-    bool readout_valid;
 };
 
 #endif // SFP_H
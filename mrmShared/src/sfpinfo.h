@@ -43,6 +43,21 @@ Value      Description of Physical Device
 #define SFP_bitRateMargin_upper     66  // Upper bit rate margin, units of %
 #define SFP_bitRateMargin_lower     67  // Lower bit rate margin, units of %
 
+/* Diagnostic monitoring type
+ * bit 6:   Digital diagnostic monitoring implemented
+ */
+#define SFP_diagType                92
+#define SFP_diagType_DDM            0x40
+
+/* Alarm and warning thresholds, 2 bytes each, in the units of the diagnostics.
+ * Each set is high alarm, low alarm, high warning, low warning.
+ */
+#define SFP_thresholds              256
+#define SFP_thresholds_size         40
+#define SFP_temp_thresholds         256
+#define SFP_tx_pwr_thresholds       280
+#define SFP_rx_pwr_thresholds       288
+
 
 /* Status/control register
  * bit 7:   TX_DISABLE State